@@ -0,0 +1,122 @@
+// This file is part of SymCC.
+//
+// SymCC is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// SymCC is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+// A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// SymCC. If not, see <https://www.gnu.org/licenses/>.
+
+#include "ConcretenessAnalysis.h"
+
+#include <algorithm>
+
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/IR/InstIterator.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/IntrinsicInst.h>
+
+using namespace llvm;
+
+namespace {
+
+/// Check whether all uses of the local variable are loads from it or stores to
+/// it. If so, no other code can access its memory, and loading from it yields
+/// concrete data as long as we only store concrete data.
+bool isPrivateVariable(const AllocaInst &alloca) {
+  return std::all_of(
+      alloca.user_begin(), alloca.user_end(), [&](const User *user) {
+        if (isa<LoadInst>(user))
+          return true;
+        if (auto *store = dyn_cast<StoreInst>(user))
+          return store->getPointerOperand() == &alloca;
+        if (auto *intrinsic = dyn_cast<IntrinsicInst>(user))
+          return intrinsic->isLifetimeStartOrEnd();
+        return false;
+      });
+}
+
+/// Check whether the instruction computes its result from its operands only,
+/// so that the result is concrete if all operands are. These are the
+/// instructions that the symbolizer handles by combining the expressions of
+/// the operands.
+bool propagatesConcreteness(const Instruction &I) {
+  return isa<BinaryOperator>(I) || isa<UnaryOperator>(I) || isa<CmpInst>(I) ||
+         isa<CastInst>(I) || isa<SelectInst>(I) || isa<PHINode>(I) ||
+         isa<GetElementPtrInst>(I) || isa<ExtractElementInst>(I) ||
+         isa<InsertElementInst>(I) || isa<ShuffleVectorInst>(I);
+}
+
+} // namespace
+
+ConcretenessAnalysis::ConcretenessAnalysis(Function &F) {
+  // Loads from private variables, grouped by variable.
+  DenseMap<const AllocaInst *, SmallVector<const LoadInst *, 4>> privateLoads;
+  for (auto &I : instructions(F)) {
+    if (auto *alloca = dyn_cast<AllocaInst>(&I);
+        alloca != nullptr && isPrivateVariable(*alloca)) {
+      auto &loads = privateLoads[alloca];
+      for (auto *user : alloca->users()) {
+        if (auto *load = dyn_cast<LoadInst>(user))
+          loads.push_back(load);
+      }
+    }
+  }
+
+  // Start from the optimistic assumption that all values are concrete, except
+  // for those that come from sources of symbolic data.
+  SmallPtrSet<const Value *, 32> symbolicValues;
+  SmallVector<const Value *, 32> worklist;
+  auto markSymbolic = [&](const Value *V) {
+    if (symbolicValues.insert(V).second)
+      worklist.push_back(V);
+  };
+
+  // The main function doesn't receive symbolic arguments (see
+  // Symbolizer::symbolizeFunctionArguments).
+  if (F.getName() != "main") {
+    for (auto &arg : F.args())
+      markSymbolic(&arg);
+  }
+
+  for (auto &I : instructions(F)) {
+    if (auto *load = dyn_cast<LoadInst>(&I)) {
+      auto *alloca = dyn_cast<AllocaInst>(load->getPointerOperand());
+      if (alloca == nullptr || privateLoads.count(alloca) == 0)
+        markSymbolic(load);
+    } else if (!isa<AllocaInst>(I) && !propagatesConcreteness(I)) {
+      markSymbolic(&I);
+    }
+  }
+
+  // Propagate symbolic data to all values that are computed from it.
+  while (!worklist.empty()) {
+    auto *V = worklist.pop_back_val();
+    for (auto *user : V->users()) {
+      if (auto *store = dyn_cast<StoreInst>(user)) {
+        // Storing a symbolic value makes all loads from the variable symbolic.
+        auto *alloca = dyn_cast<AllocaInst>(store->getPointerOperand());
+        if (store->getValueOperand() != V || alloca == nullptr)
+          continue;
+        if (auto it = privateLoads.find(alloca); it != privateLoads.end()) {
+          for (auto *load : it->second)
+            markSymbolic(load);
+        }
+      } else if (auto *I = dyn_cast<Instruction>(user);
+                 I != nullptr && propagatesConcreteness(*I)) {
+        markSymbolic(I);
+      }
+    }
+  }
+
+  for (auto &I : instructions(F)) {
+    if (symbolicValues.count(&I) == 0)
+      concreteValues.insert(&I);
+  }
+}
@@ -0,0 +1,49 @@
+// This file is part of SymCC.
+//
+// SymCC is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// SymCC is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+// A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// SymCC. If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef CONCRETENESSANALYSIS_H
+#define CONCRETENESSANALYSIS_H
+
+#include <llvm/ADT/SmallPtrSet.h>
+#include <llvm/IR/Function.h>
+
+/// The values of a function that are concrete in every execution.
+///
+/// Compile-time constants are the obvious case (see docs/Concreteness.txt), but
+/// many other values can only ever be computed from concrete data: loop
+/// counters, addresses of local variables, or values loaded from local
+/// variables that only ever receive concrete data. We find them with an
+/// optimistic data-flow analysis: we start by assuming that every value is
+/// concrete unless it's obtained from a source of symbolic data (memory,
+/// function calls, or parameters), and then propagate symbolic data along the
+/// def-use chains until we reach a fixpoint. Loops of concrete computations
+/// thus stay concrete.
+///
+/// The symbolizer doesn't generate any code for the computation of concrete
+/// values, so neither the expression nor the run-time check for concreteness
+/// exists in the instrumented program.
+class ConcretenessAnalysis {
+public:
+  explicit ConcretenessAnalysis(llvm::Function &F);
+
+  /// Check whether the value is known to be concrete at run time.
+  bool isConcrete(const llvm::Value *V) const {
+    return llvm::isa<llvm::Constant>(V) || concreteValues.count(V) > 0;
+  }
+
+private:
+  llvm::SmallPtrSet<const llvm::Value *, 32> concreteValues;
+};
+
+#endif
@@ -15,11 +15,17 @@
 #include <llvm/IR/LegacyPassManager.h>
 #include <llvm/Transforms/IPO/PassManagerBuilder.h>
 #include <llvm/Transforms/Scalar.h>
-#include <llvm/Transforms/Scalar/Scalarizer.h>
+#include <llvm/Transforms/Scalar/ADCE.h>
+#include <llvm/Transforms/Scalar/EarlyCSE.h>
+#include <llvm/Transforms/Scalar/GVN.h>
+#include <llvm/Transforms/Scalar/LICM.h>
+#include <llvm/Transforms/Scalar/SCCP.h>
+#include <llvm/Transforms/Scalar/SimplifyCFG.h>
 
 #if LLVM_VERSION_MAJOR >= 13
 #include <llvm/Passes/PassBuilder.h>
 #include <llvm/Passes/PassPlugin.h>
+#include <llvm/Transforms/Scalar/LoopPassManager.h>
 
 #if LLVM_VERSION_MAJOR >= 14
 #include <llvm/Passes/OptimizationLevel.h>
@@ -39,22 +45,46 @@ using OptimizationLevel = llvm::PassBuilder::OptimizationLevel;
 using namespace llvm;
 
 //
-// Legacy pass registration (up to LLVM 13)
+// Cleanup after instrumentation
+//
+// The instrumentation runs at the end of the pipeline, so the optimizer
+// (including the vectorizers) has already run when we insert our code. At
+// optimization levels above zero, we therefore run a few passes over the
+// instrumented code, similar to what sanitizers do. Most importantly, sparse
+// conditional constant propagation proves that the expressions of loop-carried
+// values are null when the values are computed from concrete data only (the
+// symbolic computations guarded by Symbolizer::shortCircuitExpressionUses are
+// then unreachable), and the remaining passes clean up redundant null checks
+// and unused PHI nodes.
+//
+// We don't hoist or merge calls to the run-time library, not even those that
+// merely build constants: the runtime may free expressions that instrumented
+// code doesn't hold in memory (e.g., on symcc_restore), so an expression must
+// not be reused across such points.
 //
 
 #if LLVM_VERSION_MAJOR <= 15
 
-void addSymbolizeLegacyPass(const PassManagerBuilder & /* unused */,
+void addSymbolizeLegacyPass(const PassManagerBuilder &builder,
                             legacy::PassManagerBase &PM) {
-  PM.add(createScalarizerPass());
   PM.add(createLowerAtomicPass());
   PM.add(new SymbolizeLegacyPass());
+
+  if (builder.OptLevel > 0) {
+    PM.add(createSCCPPass());
+    PM.add(createCFGSimplificationPass());
+    PM.add(createEarlyCSEPass(/* UseMemorySSA */ true));
+    PM.add(createLICMPass());
+    PM.add(createGVNPass());
+    PM.add(createAggressiveDCEPass());
+    PM.add(createCFGSimplificationPass());
+  }
 }
 
 // Make the pass known to opt.
 static RegisterPass<SymbolizeLegacyPass> X("symbolize", "Symbolization Pass");
 // Tell frontends to run the pass automatically.
-static struct RegisterStandardPasses Y(PassManagerBuilder::EP_VectorizerStart,
+static struct RegisterStandardPasses Y(PassManagerBuilder::EP_OptimizerLast,
                                        addSymbolizeLegacyPass);
 static struct RegisterStandardPasses
     Z(PassManagerBuilder::EP_EnabledOnOptLevel0, addSymbolizeLegacyPass);
@@ -72,18 +102,39 @@ PassPluginLibraryInfo getSymbolizePluginInfo() {
           [](PassBuilder &PB) {
             // We need to act on the entire module as well as on each function.
             // Those actions are independent from each other, so we register a
-            // module pass at the start of the pipeline and a function pass just
-            // before the vectorizer. (There doesn't seem to be a way to run
-            // module passes at the start of the vectorizer, hence the split.)
+            // module pass at the start of the pipeline and the function pass at
+            // the very end, after the vectorizers and the final cleanup.
             PB.registerPipelineStartEPCallback(
                 [](ModulePassManager &PM, OptimizationLevel) {
                   PM.addPass(SymbolizePass());
                 });
-            PB.registerVectorizerStartEPCallback(
-                [](FunctionPassManager &PM, OptimizationLevel) {
-                  PM.addPass(ScalarizerPass());
+            PB.registerOptimizerLastEPCallback(
+                [](ModulePassManager &MPM, OptimizationLevel level) {
+                  FunctionPassManager PM;
                   PM.addPass(LowerAtomicPass());
                   PM.addPass(SymbolizePass());
+
+                  if (level != OptimizationLevel::O0) {
+                    PM.addPass(SCCPPass());
+                    PM.addPass(SimplifyCFGPass());
+                    PM.addPass(EarlyCSEPass(/* UseMemorySSA */ true));
+#if LLVM_VERSION_MAJOR >= 15
+                    PM.addPass(createFunctionToLoopPassAdaptor(
+                        LICMPass(LICMOptions()), /* UseMemorySSA */ true));
+#else
+                    PM.addPass(createFunctionToLoopPassAdaptor(
+                        LICMPass(), /* UseMemorySSA */ true));
+#endif
+#if LLVM_VERSION_MAJOR >= 14
+                    PM.addPass(GVNPass());
+#else
+                    PM.addPass(GVN());
+#endif
+                    PM.addPass(ADCEPass());
+                    PM.addPass(SimplifyCFGPass());
+                  }
+
+                  MPM.addPass(createModuleToFunctionPassAdaptor(std::move(PM)));
                 });
           }};
 }
@@ -18,9 +18,13 @@
 #include <llvm/CodeGen/IntrinsicLowering.h>
 #include <llvm/CodeGen/TargetLowering.h>
 #include <llvm/CodeGen/TargetSubtargetInfo.h>
+#include <llvm/Demangle/Demangle.h>
 #include <llvm/IR/InstIterator.h>
 #include <llvm/IR/Module.h>
 #include <llvm/IR/Verifier.h>
+#include <llvm/Support/ErrorHandling.h>
+#include <llvm/Support/GlobPattern.h>
+#include <llvm/Support/MemoryBuffer.h>
 #include <llvm/Target/TargetMachine.h>
 #include <llvm/Target/TargetOptions.h>
 #include <llvm/Transforms/Utils/ModuleUtils.h>
@@ -31,6 +35,12 @@
 #include <llvm/MC/TargetRegistry.h>
 #endif
 
+#include <cstdlib>
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include "ConcretenessAnalysis.h"
 #include "Runtime.h"
 #include "Symbolizer.h"
 
@@ -51,6 +61,123 @@ namespace {
 
 static constexpr char kSymCtorName[] = "__sym_ctor";
 
+/// The functions to instrument, as given in the file named by the environment
+/// variable SYMCC_INSTRUMENT_LIST.
+struct FunctionList {
+  /// The contents of the file; the patterns refer to it.
+  std::unique_ptr<MemoryBuffer> text;
+  std::vector<GlobPattern> included;
+  std::vector<GlobPattern> excluded;
+};
+
+/// Read the function list, or return nothing if there is none.
+///
+/// The file contains one glob pattern per line, matched against mangled and
+/// demangled function names; a leading "!" excludes the matching functions,
+/// and lines starting with "#" are comments.
+std::optional<FunctionList> readFunctionList() {
+  const char *path = getenv("SYMCC_INSTRUMENT_LIST");
+  if (path == nullptr)
+    return std::nullopt;
+
+  auto buffer = MemoryBuffer::getFile(path);
+  if (!buffer)
+    report_fatal_error(Twine("Failed to read the function list ") + path +
+                           ": " + buffer.getError().message(),
+                       /*gen_crash_diag=*/false);
+
+  FunctionList list;
+  list.text = std::move(*buffer);
+  SmallVector<StringRef, 0> lines;
+  list.text->getBuffer().split(lines, '\n');
+  for (auto line : lines) {
+    line = line.trim();
+    if (line.empty() || line.startswith("#"))
+      continue;
+
+    bool exclude = line.consume_front("!");
+    auto pattern = GlobPattern::create(line);
+    if (!pattern)
+      report_fatal_error(Twine("Invalid pattern \"") + line + "\" in " + path +
+                             ": " + toString(pattern.takeError()),
+                         /*gen_crash_diag=*/false);
+
+    (exclude ? list.excluded : list.included).push_back(std::move(*pattern));
+  }
+
+  return list;
+}
+
+/// Decide whether the user wants the function to be instrumented.
+bool shouldInstrument(const Function &F) {
+  static const std::optional<FunctionList> list = readFunctionList();
+  if (!list)
+    return true;
+
+  std::string name = F.getName().str();
+  std::string demangled = name;
+  int status;
+  if (char *buf = itaniumDemangle(name.c_str(), nullptr, nullptr, &status)) {
+    demangled = buf;
+    std::free(buf);
+  }
+
+  auto matches = [&](const std::vector<GlobPattern> &patterns) {
+    for (auto &pattern : patterns) {
+      if (pattern.match(name) || pattern.match(demangled))
+        return true;
+    }
+    return false;
+  };
+
+  if (matches(list->excluded))
+    return false;
+  return list->included.empty() || matches(list->included);
+}
+
+/// Decide whether we can redirect calls of the function to a copy of it.
+bool canCloneForConcreteExecution(const Function &F) {
+  if (F.isDeclaration() || F.hasAvailableExternallyLinkage() ||
+      F.getName() == kSymCtorName || !shouldInstrument(F))
+    return false;
+
+  // Block addresses in the copy would refer to the original's blocks.
+  for (auto &B : F) {
+    if (B.hasAddressTaken())
+      return false;
+  }
+
+  // Only direct calls in this module can use the copy.
+  for (auto *user : F.users()) {
+    if (auto *call = dyn_cast<CallBase>(user);
+        call != nullptr && call->getCalledOperand() == &F)
+      return true;
+  }
+
+  return false;
+}
+
+/// Create an uninstrumented copy of every function that can have one.
+///
+/// Direct calls go to the copies as long as the program hasn't seen any
+/// symbolic data (see Symbolizer::dispatchToConcreteClone), so initialization
+/// code runs at native speed. We copy the functions before the optimizer runs,
+/// so nothing calls the copies yet, and we have to keep them alive until the
+/// instrumentation.
+void cloneForConcreteExecution(Module &M) {
+  SmallVector<Function *, 0> functions;
+  for (auto &F : M.functions()) {
+    if (canCloneForConcreteExecution(F))
+      functions.push_back(&F);
+  }
+
+  SmallVector<GlobalValue *, 0> clones;
+  for (auto *F : functions)
+    clones.push_back(createConcreteClone(*F));
+
+  appendToCompilerUsed(M, clones);
+}
+
 bool instrumentModule(Module &M) {
   DEBUG(errs() << "Symbolizer module instrumentation\n");
 
@@ -68,6 +195,9 @@ bool instrumentModule(Module &M) {
       M, kSymCtorName, "_sym_initialize", {}, {});
   appendToGlobalCtors(M, ctor, 0);
 
+  if (concreteClones())
+    cloneForConcreteExecution(M);
+
   return true;
 }
 
@@ -164,6 +294,14 @@ bool instrumentFunction(Function &F) {
   if (functionName == kSymCtorName)
     return false;
 
+  // Functions that we don't instrument still need to cooperate with
+  // instrumented code around calls.
+  if (isConcreteClone(F) || !shouldInstrument(F)) {
+    ConcretenessAnalysis concreteness(F);
+    Symbolizer(*F.getParent(), concreteness).prepareConcreteFunction(F);
+    return true;
+  }
+
   DEBUG(errs() << "Symbolizing function ");
   DEBUG(errs().write_escaped(functionName) << '\n');
 
@@ -187,11 +325,14 @@ bool instrumentFunction(Function &F) {
   for (auto &I : instructions(F))
     allInstructions.push_back(&I);
 
-  Symbolizer symbolizer(*F.getParent());
+  ConcretenessAnalysis concreteness(F);
+  Symbolizer symbolizer(*F.getParent(), concreteness);
   symbolizer.symbolizeFunctionArguments(F);
 
-  for (auto &basicBlock : F)
-    symbolizer.insertBasicBlockNotification(basicBlock);
+  if (callTracing() == CallTracing::Full) {
+    for (auto &basicBlock : F)
+      symbolizer.insertBasicBlockNotification(basicBlock);
+  }
 
   for (auto *instPtr : allInstructions)
     symbolizer.visit(instPtr);
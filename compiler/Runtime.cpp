@@ -17,11 +17,19 @@
 #include <llvm/ADT/StringSet.h>
 #include <llvm/Config/llvm-config.h>
 #include <llvm/IR/IRBuilder.h>
+#include <llvm/Support/ErrorHandling.h>
+#include <llvm/Transforms/Utils/Cloning.h>
+
+#include <cstdlib>
 
 using namespace llvm;
 
 namespace {
 
+/// The suffix of concrete clones, and the attribute that marks them.
+constexpr char kConcreteCloneSuffix[] = ".symcc_concrete";
+constexpr char kConcreteCloneAttribute[] = "symcc-concrete-clone";
+
 template <typename... ArgsTy>
 SymFnT import(llvm::Module &M, llvm::StringRef name, llvm::Type *ret,
               ArgsTy... args) {
@@ -72,6 +80,9 @@ Runtime::Runtime(Module &M) {
   buildConcat =
       import(M, "_sym_concat_helper", ptrT, ptrT,
              ptrT); // doesn't follow naming convention for historic reasons
+  buildExtractBits = import(M, "_sym_extract_helper", ptrT, ptrT, intPtrType,
+                            intPtrType); // same as above
+  buildIte = import(M, "_sym_build_ite", ptrT, ptrT, ptrT, ptrT);
   pushPathConstraint =
       import(M, "_sym_push_path_constraint", voidT, ptrT, int1T, intPtrType);
 
@@ -96,12 +107,17 @@ Runtime::Runtime(Module &M) {
       import(M, "_sym_build_funnel_shift_right", ptrT, ptrT, ptrT, ptrT);
   buildAbs = import(M, "_sym_build_abs", ptrT, ptrT);
 
-  setParameterExpression =
-      import(M, "_sym_set_parameter_expression", voidT, int8T, ptrT);
-  getParameterExpression =
-      import(M, "_sym_get_parameter_expression", ptrT, int8T);
-  setReturnExpression = import(M, "_sym_set_return_expression", voidT, ptrT);
-  getReturnExpression = import(M, "_sym_get_return_expression", ptrT);
+  // The slots are indexed with 8-bit integers (see RuntimeCommon.h). Like the
+  // calling context below, they're thread-local in static TLS.
+  parameterSlotsType = ArrayType::get(ptrT, 256);
+  auto *parameterSlotsVar = cast<GlobalVariable>(
+      M.getOrInsertGlobal("_sym_parameter_slots", parameterSlotsType));
+  parameterSlotsVar->setThreadLocalMode(GlobalValue::InitialExecTLSModel);
+  parameterSlots = parameterSlotsVar;
+  auto *returnSlotVar =
+      cast<GlobalVariable>(M.getOrInsertGlobal("_sym_return_slot", ptrT));
+  returnSlotVar->setThreadLocalMode(GlobalValue::InitialExecTLSModel);
+  returnSlot = returnSlotVar;
 
 #define LOAD_BINARY_OPERATOR_HANDLER(constant, name)                           \
   binaryOperatorHandlers[Instruction::constant] =                              \
@@ -187,6 +203,15 @@ Runtime::Runtime(Module &M) {
   notifyCall = import(M, "_sym_notify_call", voidT, intPtrType);
   notifyRet = import(M, "_sym_notify_ret", voidT, intPtrType);
   notifyBasicBlock = import(M, "_sym_notify_basic_block", voidT, intPtrType);
+
+  // The runtime is loaded at startup, so the variable is in static TLS and we
+  // can access it without calling __tls_get_addr.
+  callContext = cast<GlobalVariable>(
+      M.getOrInsertGlobal("_sym_call_context", intPtrType));
+  callContext->setThreadLocalMode(GlobalValue::InitialExecTLSModel);
+
+  symbolicDataSeen = cast<GlobalVariable>(
+      M.getOrInsertGlobal("_sym_symbolic_data_seen", int8T));
 }
 
 /// Decide whether a function is called symbolically.
@@ -196,7 +221,61 @@ bool isInterceptedFunction(const Function &f) {
       "lseek",  "lseek64", "fopen",    "fopen64", "fread",   "fseek",
       "fseeko", "rewind",  "fseeko64", "getc",    "ungetc",  "memcpy",
       "memset", "strncpy", "strchr",   "memcmp",  "memmove", "ntohl",
-      "fgets",  "fgetc",   "getchar",  "bcopy",   "bcmp",    "bzero"};
+      "fgets",  "fgetc",   "getchar",  "bcopy",   "bcmp",    "bzero",
+      "strlen", "strcmp",  "strncmp",  "memchr",  "strstr"};
 
   return (kInterceptedFunctions.count(f.getName()) > 0);
 }
+
+CallTracing callTracing() {
+  static const CallTracing mode = [] {
+    const char *value = getenv("SYMCC_CALL_TRACING");
+    if (value == nullptr) {
+#ifdef SYMCC_QSYM_BACKEND
+      return CallTracing::Full;
+#else
+      return CallTracing::Context;
+#endif
+    }
+
+    StringRef name(value);
+    if (name == "none")
+      return CallTracing::None;
+    if (name == "context")
+      return CallTracing::Context;
+    if (name == "full")
+      return CallTracing::Full;
+    report_fatal_error("SYMCC_CALL_TRACING must be one of none, context and "
+                       "full",
+                       /*gen_crash_diag=*/false);
+  }();
+
+  return mode;
+}
+
+bool concreteClones() {
+  static const bool enabled = [] {
+    const char *value = getenv("SYMCC_CONCRETE_CLONES");
+    return value != nullptr && StringRef(value) == "1";
+  }();
+
+  return enabled;
+}
+
+Function *concreteCloneOf(const Function &F) {
+  return F.getParent()->getFunction((F.getName() + kConcreteCloneSuffix).str());
+}
+
+bool isConcreteClone(const Function &F) {
+  return F.hasFnAttribute(kConcreteCloneAttribute);
+}
+
+Function *createConcreteClone(Function &F) {
+  ValueToValueMapTy VMap;
+  auto *clone = CloneFunction(&F, VMap);
+  clone->setName(F.getName() + kConcreteCloneSuffix);
+  clone->setLinkage(GlobalValue::InternalLinkage);
+  clone->setComdat(nullptr);
+  clone->addFnAttr(kConcreteCloneAttribute);
+  return clone;
+}
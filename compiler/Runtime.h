@@ -64,11 +64,9 @@ struct Runtime {
   SymFnT buildFshr{};
   SymFnT buildAbs{};
   SymFnT buildConcat{};
+  SymFnT buildExtractBits{};
+  SymFnT buildIte{};
   SymFnT pushPathConstraint{};
-  SymFnT getParameterExpression{};
-  SymFnT setParameterExpression{};
-  SymFnT setReturnExpression{};
-  SymFnT getReturnExpression{};
   SymFnT memcpy{};
   SymFnT memset{};
   SymFnT memmove{};
@@ -81,6 +79,21 @@ struct Runtime {
   SymFnT notifyRet{};
   SymFnT notifyBasicBlock{};
 
+  /// The run-time library's hash of the calling context, which instrumented
+  /// code updates inline around each call (see CallTracing).
+  llvm::GlobalVariable *callContext{};
+
+  /// The run-time library's flag that tells whether the program has seen any
+  /// symbolic data yet; until then, nothing needs to be instrumented.
+  llvm::GlobalVariable *symbolicDataSeen{};
+
+  /// The run-time library's storage for the expressions of function parameters
+  /// and return values. Instrumented code accesses it with plain loads and
+  /// stores instead of calling into the library.
+  llvm::ArrayType *parameterSlotsType{};
+  llvm::Constant *parameterSlots{};
+  llvm::Constant *returnSlot{};
+
   /// Mapping from icmp predicates to the functions that build the corresponding
   /// symbolic expressions.
   std::array<SymFnT, llvm::CmpInst::BAD_ICMP_PREDICATE> comparisonHandlers{};
@@ -96,4 +109,37 @@ struct Runtime {
 
 bool isInterceptedFunction(const llvm::Function &f);
 
+/// How instrumented code keeps the run-time library informed about the
+/// control flow.
+enum class CallTracing {
+  /// Don't track calls at all.
+  None,
+  /// Keep a hash of the calling context up to date inline, without calling
+  /// into the run-time library. This is all that the simple backend needs.
+  Context,
+  /// Additionally call _sym_notify_call, _sym_notify_ret and
+  /// _sym_notify_basic_block, which the QSYM backend uses for basic-block
+  /// pruning.
+  Full
+};
+
+/// The call-tracing mode for this compilation, taken from the environment
+/// variable SYMCC_CALL_TRACING; the default depends on the backend that SymCC
+/// was built with.
+CallTracing callTracing();
+
+/// Whether to give each function an uninstrumented clone that callers use until
+/// the program has seen symbolic data; set with the environment variable
+/// SYMCC_CONCRETE_CLONES.
+bool concreteClones();
+
+/// Return the concrete clone of a function, or null if it doesn't have one.
+llvm::Function *concreteCloneOf(const llvm::Function &F);
+
+/// Decide whether a function is the concrete clone of another.
+bool isConcreteClone(const llvm::Function &F);
+
+/// Create the concrete clone of a function.
+llvm::Function *createConcreteClone(llvm::Function &F);
+
 #endif
@@ -15,9 +15,11 @@
 #include "Symbolizer.h"
 
 #include <cstdint>
+#include <numeric>
 #include <llvm/ADT/SmallPtrSet.h>
 #include <llvm/IR/Constants.h>
 #include <llvm/IR/GetElementPtrTypeIterator.h>
+#include <llvm/IR/InstIterator.h>
 #include <llvm/IR/Intrinsics.h>
 #include <llvm/Transforms/Utils/BasicBlockUtils.h>
 
@@ -34,8 +36,36 @@ void Symbolizer::symbolizeFunctionArguments(Function &F) {
 
   for (auto &arg : F.args()) {
     if (!arg.user_empty())
-      symbolicExpressions[&arg] = IRB.CreateCall(runtime.getParameterExpression,
-                                                 IRB.getInt8(arg.getArgNo()));
+      symbolicExpressions[&arg] =
+          loadParameterExpression(IRB, arg.getArgNo());
+  }
+}
+
+void Symbolizer::updateCallContext(CallBase &I, Instruction *returnPoint) {
+  if (entryCallContext == nullptr) {
+    IRBuilder<> IRB(&*I.getFunction()->getEntryBlock().getFirstInsertionPt());
+    entryCallContext = IRB.CreateLoad(intPtrType, runtime.callContext);
+  }
+
+  // Mix the call site into the caller's context; the multiplication makes the
+  // hash depend on the order of the calls on the stack.
+  IRBuilder<> IRB(&I);
+  auto *multiplier = ConstantInt::get(
+      intPtrType, (ptrBits == 64) ? 0x9e3779b97f4a7c15ULL : 0x9e3779b9ULL);
+  IRB.CreateStore(
+      IRB.CreateMul(IRB.CreateXor(entryCallContext, getTargetPreferredInt(&I)),
+                    multiplier),
+      runtime.callContext);
+
+  IRB.SetInsertPoint(returnPoint);
+  IRB.CreateStore(entryCallContext, runtime.callContext);
+
+  if (auto *invoke = dyn_cast<InvokeInst>(&I)) {
+    auto *landingPad = invoke->getUnwindDest();
+    if (restoredLandingPads.insert(landingPad).second) {
+      IRB.SetInsertPoint(&*landingPad->getFirstInsertionPt());
+      IRB.CreateStore(entryCallContext, runtime.callContext);
+    }
   }
 }
 
@@ -176,6 +206,62 @@ void Symbolizer::shortCircuitExpressionUses() {
   }
 }
 
+void Symbolizer::prepareConcreteFunction(Function &F) {
+  SmallVector<CallBase *, 16> calls;
+  SmallVector<ReturnInst *, 4> returns;
+  for (auto &I : instructions(F)) {
+    if (auto *ret = dyn_cast<ReturnInst>(&I)) {
+      returns.push_back(ret);
+      continue;
+    }
+
+    auto *call = dyn_cast<CallBase>(&I);
+    if (call == nullptr || call->isInlineAsm())
+      continue;
+    if (auto *callee = call->getCalledFunction();
+        callee != nullptr && callee->isIntrinsic())
+      continue;
+    calls.push_back(call);
+  }
+
+  // An instrumented callee may have left its return expression behind, and
+  // our instrumented caller mustn't mistake it for ours.
+  if (!calls.empty() && !F.getReturnType()->isVoidTy()) {
+    for (auto *ret : returns) {
+      IRBuilder<> IRB(ret);
+      storeReturnExpression(IRB, ConstantPointerNull::get(IRB.getInt8PtrTy()));
+    }
+  }
+
+  for (auto *call : calls) {
+    // Once the program has seen symbolic data, the callee may be instrumented
+    // code that reads its parameter expressions; the slots may still hold
+    // expressions from an earlier call, so we pass null for each argument.
+    IRBuilder<> IRB(call);
+    for (unsigned i = 0; i < call->arg_size(); i++)
+      storeParameterExpression(IRB, i,
+                               ConstantPointerNull::get(IRB.getInt8PtrTy()));
+    dispatchToConcreteClone(IRB, *call);
+  }
+}
+
+void Symbolizer::dispatchToConcreteClone(IRBuilder<> &IRB, CallBase &I) {
+  auto *callee = I.getCalledFunction();
+  if (callee == nullptr)
+    return;
+  auto *clone = concreteCloneOf(*callee);
+  if (clone == nullptr)
+    return;
+
+  // As long as there is no symbolic data, all parameter expressions are null,
+  // so the clone computes the same as the instrumented function. Its return
+  // value is concrete, which the caller assumes anyway when nobody sets the
+  // return expression.
+  auto *seen = IRB.CreateLoad(IRB.getInt8Ty(), runtime.symbolicDataSeen);
+  I.setCalledOperand(IRB.CreateSelect(IRB.CreateICmpNE(seen, IRB.getInt8(0)),
+                                      callee, clone));
+}
+
 void Symbolizer::handleIntrinsicCall(CallBase &I) {
   auto *callee = I.getCalledFunction();
 
@@ -247,9 +333,8 @@ void Symbolizer::handleIntrinsicCall(CallBase &I) {
     // Floating-point absolute value; use the runtime to build the
     // corresponding symbolic expression.
 
-    IRBuilder<> IRB(&I);
-    auto abs = buildRuntimeCall(IRB, runtime.buildFloatAbs, I.getOperand(0));
-    registerSymbolicComputation(abs, &I);
+    symbolizeWithRuntimeCall(I, runtime.buildFloatAbs,
+                             {{I.getOperand(0), true}});
     break;
   }
   case Intrinsic::returnaddress:
@@ -264,9 +349,7 @@ void Symbolizer::handleIntrinsicCall(CallBase &I) {
   case Intrinsic::bswap: {
     // Bswap changes the endian-ness of integer values.
 
-    IRBuilder<> IRB(&I);
-    auto swapped = buildRuntimeCall(IRB, runtime.buildBswap, I.getOperand(0));
-    registerSymbolicComputation(swapped, &I);
+    symbolizeWithRuntimeCall(I, runtime.buildBswap, {{I.getOperand(0), true}});
     break;
   }
 
@@ -274,6 +357,12 @@ void Symbolizer::handleIntrinsicCall(CallBase &I) {
 #define DEF_OVF_ARITH_BUILDER(intrinsic_op, runtime_name)                      \
   case Intrinsic::s##intrinsic_op##_with_overflow:                             \
   case Intrinsic::u##intrinsic_op##_with_overflow: {                           \
+    if (I.getOperand(0)->getType()->isVectorTy()) {                            \
+      errs() << "Warning: unhandled vector overflow arithmetic " << I          \
+             << "; the result will be concretized\n";                          \
+      break;                                                                   \
+    }                                                                          \
+                                                                               \
     IRBuilder<> IRB(&I);                                                       \
                                                                                \
     bool isSigned =                                                            \
@@ -298,10 +387,9 @@ void Symbolizer::handleIntrinsicCall(CallBase &I) {
 // Saturating arithmetic
 #define DEF_SAT_ARITH_BUILDER(intrinsic_op, runtime_name)                      \
   case Intrinsic::intrinsic_op##_sat: {                                        \
-    IRBuilder<> IRB(&I);                                                       \
-    auto result = buildRuntimeCall(IRB, runtime.build##runtime_name,           \
-                                   {I.getOperand(0), I.getOperand(1)});        \
-    registerSymbolicComputation(result, &I);                                   \
+    symbolizeWithRuntimeCall(                                                  \
+        I, runtime.build##runtime_name,                                        \
+        {{I.getOperand(0), true}, {I.getOperand(1), true}});                   \
     break;                                                                     \
   }
 
@@ -318,25 +406,58 @@ void Symbolizer::handleIntrinsicCall(CallBase &I) {
 
   case Intrinsic::fshl:
   case Intrinsic::fshr: {
-    IRBuilder<> IRB(&I);
-    auto funnelShift = buildRuntimeCall(
-        IRB,
-        I.getIntrinsicID() == Intrinsic::fshl ? runtime.buildFshl
-                                              : runtime.buildFshr,
-        {I.getOperand(0), I.getOperand(1), I.getOperand(2)});
-    registerSymbolicComputation(funnelShift, &I);
+    symbolizeWithRuntimeCall(I,
+                             I.getIntrinsicID() == Intrinsic::fshl
+                                 ? runtime.buildFshl
+                                 : runtime.buildFshr,
+                             {{I.getOperand(0), true},
+                              {I.getOperand(1), true},
+                              {I.getOperand(2), true}});
     break;
   }
 #if LLVM_VERSION_MAJOR > 11
   case Intrinsic::abs: {
     // Integer absolute value
 
-    IRBuilder<> IRB(&I);
-    auto abs = buildRuntimeCall(IRB, runtime.buildAbs, I.getOperand(0));
-    registerSymbolicComputation(abs, &I);
+    symbolizeWithRuntimeCall(I, runtime.buildAbs, {{I.getOperand(0), true}});
     break;
   }
+  case Intrinsic::vector_reduce_add:
+    buildVectorReduction(I, runtime.binaryOperatorHandlers[Instruction::Add]);
+    break;
+  case Intrinsic::vector_reduce_mul:
+    buildVectorReduction(I, runtime.binaryOperatorHandlers[Instruction::Mul]);
+    break;
+  case Intrinsic::vector_reduce_and:
+    buildVectorReduction(I, runtime.binaryOperatorHandlers[Instruction::And]);
+    break;
+  case Intrinsic::vector_reduce_or:
+    buildVectorReduction(I, runtime.binaryOperatorHandlers[Instruction::Or]);
+    break;
+  case Intrinsic::vector_reduce_xor:
+    buildVectorReduction(I, runtime.binaryOperatorHandlers[Instruction::Xor]);
+    break;
 #endif
+  case Intrinsic::masked_store: {
+    // We don't track which elements are written, so we concretize the entire
+    // target range in shadow memory; otherwise, later loads would see stale
+    // expressions.
+
+    IRBuilder<> IRB(&I);
+    auto *stored = I.getOperand(0);
+    auto *addr = I.getOperand(1);
+    tryAlternative(IRB, addr);
+    errs() << "Warning: unhandled masked store " << I
+           << "; the stored values will be concretized\n";
+    IRB.CreateCall(runtime.writeMemory,
+                   {IRB.CreatePtrToInt(addr, intPtrType),
+                    ConstantInt::get(intPtrType,
+                                     dataLayout.getTypeStoreSize(
+                                         stored->getType())),
+                    ConstantPointerNull::get(IRB.getInt8PtrTy()),
+                    IRB.getInt1(dataLayout.isLittleEndian() ? 1 : 0)});
+    break;
+  }
   default:
     errs() << "Warning: unhandled LLVM intrinsic " << callee->getName()
            << "; the result will be concretized\n";
@@ -362,17 +483,23 @@ void Symbolizer::handleFunctionCall(CallBase &I, Instruction *returnPoint) {
   }
 
   IRBuilder<> IRB(returnPoint);
-  IRB.CreateCall(runtime.notifyRet, getTargetPreferredInt(&I));
+  if (callTracing() == CallTracing::Full) {
+    IRB.CreateCall(runtime.notifyRet, getTargetPreferredInt(&I));
+    IRB.SetInsertPoint(&I);
+    IRB.CreateCall(runtime.notifyCall, getTargetPreferredInt(&I));
+  }
+  if (callTracing() != CallTracing::None)
+    updateCallContext(I, returnPoint);
   IRB.SetInsertPoint(&I);
-  IRB.CreateCall(runtime.notifyCall, getTargetPreferredInt(&I));
 
   if (callee == nullptr)
     tryAlternative(IRB, I.getCalledOperand());
+  else if (concreteClones())
+    dispatchToConcreteClone(IRB, I);
 
   for (Use &arg : I.args())
-    IRB.CreateCall(runtime.setParameterExpression,
-                   {ConstantInt::get(IRB.getInt8Ty(), arg.getOperandNo()),
-                    getSymbolicExpressionOrNull(arg)});
+    storeParameterExpression(IRB, arg.getOperandNo(),
+                             getSymbolicExpressionOrNull(arg));
 
   if (!I.user_empty()) {
     // The result of the function is used somewhere later on. Since we have no
@@ -383,18 +510,69 @@ void Symbolizer::handleFunctionCall(CallBase &I, Instruction *returnPoint) {
     // order to avoid accidentally using whatever is stored there from the
     // previous function call. (If the function is instrumented, it will just
     // override our null with the real expression.)
-    IRB.CreateCall(runtime.setReturnExpression,
-                   ConstantPointerNull::get(IRB.getInt8PtrTy()));
+    storeReturnExpression(IRB, ConstantPointerNull::get(IRB.getInt8PtrTy()));
     IRB.SetInsertPoint(returnPoint);
-    symbolicExpressions[&I] = IRB.CreateCall(runtime.getReturnExpression);
+    symbolicExpressions[&I] = loadReturnExpression(IRB);
   }
 }
 
+Value *Symbolizer::loadParameterExpression(IRBuilder<> &IRB, unsigned index) {
+  // Arguments beyond the last slot are treated as concrete.
+  if (index >= runtime.parameterSlotsType->getNumElements())
+    return ConstantPointerNull::get(IRB.getInt8PtrTy());
+
+  auto *slot = IRB.CreateConstInBoundsGEP2_32(runtime.parameterSlotsType,
+                                              runtime.parameterSlots, 0, index);
+  return IRB.CreateLoad(IRB.getInt8PtrTy(), slot);
+}
+
+void Symbolizer::storeParameterExpression(IRBuilder<> &IRB, unsigned index,
+                                          Value *expr) {
+  if (index >= runtime.parameterSlotsType->getNumElements())
+    return;
+
+  auto *slot = IRB.CreateConstInBoundsGEP2_32(runtime.parameterSlotsType,
+                                              runtime.parameterSlots, 0, index);
+  IRB.CreateStore(expr, slot);
+}
+
+Value *Symbolizer::loadReturnExpression(IRBuilder<> &IRB) {
+  auto *expr = IRB.CreateLoad(IRB.getInt8PtrTy(), runtime.returnSlot);
+  // Clear the slot so that a stale expression can't be mistaken for the result
+  // of an uninstrumented function later.
+  IRB.CreateStore(ConstantPointerNull::get(IRB.getInt8PtrTy()),
+                  runtime.returnSlot);
+  return expr;
+}
+
+void Symbolizer::storeReturnExpression(IRBuilder<> &IRB, Value *expr) {
+  IRB.CreateStore(expr, runtime.returnSlot);
+}
+
 void Symbolizer::visitBinaryOperator(BinaryOperator &I) {
   // Binary operators propagate into the symbolic expression.
 
   IRBuilder<> IRB(&I);
   SymFnT handler = runtime.binaryOperatorHandlers.at(I.getOpcode());
+  assert(handler && "Unable to handle binary operator");
+
+  if (I.getType()->isVectorTy()) {
+    if (isUnsupportedVectorType(I, I.getType()))
+      return;
+
+    // Bitwise operations don't care about element boundaries, so they can
+    // work on the vector expression directly.
+    if (I.isBitwiseLogicOp()) {
+      auto runtimeCall =
+          buildRuntimeCall(IRB, handler, {I.getOperand(0), I.getOperand(1)});
+      registerSymbolicComputation(runtimeCall, &I);
+      return;
+    }
+
+    symbolizeWithRuntimeCall(
+        I, handler, {{I.getOperand(0), true}, {I.getOperand(1), true}});
+    return;
+  }
 
   // Special case: the run-time library distinguishes between "and" and "or"
   // on Boolean values and bit vectors.
@@ -416,25 +594,38 @@ void Symbolizer::visitBinaryOperator(BinaryOperator &I) {
     }
   }
 
-  assert(handler && "Unable to handle binary operator");
   auto runtimeCall =
       buildRuntimeCall(IRB, handler, {I.getOperand(0), I.getOperand(1)});
   registerSymbolicComputation(runtimeCall, &I);
 }
 
 void Symbolizer::visitUnaryOperator(UnaryOperator &I) {
-  IRBuilder<> IRB(&I);
   SymFnT handler = runtime.unaryOperatorHandlers.at(I.getOpcode());
 
   assert(handler && "Unable to handle unary operator");
-  auto runtimeCall = buildRuntimeCall(IRB, handler, I.getOperand(0));
-  registerSymbolicComputation(runtimeCall, &I);
+  symbolizeWithRuntimeCall(I, handler, {{I.getOperand(0), true}});
 }
 
 void Symbolizer::visitSelectInst(SelectInst &I) {
   // Select is like the ternary operator ("?:") in C. We push the (potentially
   // negated) condition to the path constraints and copy the symbolic
   // expression over from the chosen argument.
+  //
+  // A vector condition selects each element separately. There is no control
+  // flow involved in that case, so we build an if-then-else expression per
+  // element instead of pushing path constraints.
+
+  if (I.getCondition()->getType()->isVectorTy()) {
+    buildElementwiseComputation(
+        I, {I.getCondition(), I.getTrueValue(), I.getFalseValue()},
+        [this](IRBuilder<> &IRB, ArrayRef<Value *> elements) {
+          return IRB.CreateCall(
+              runtime.buildIte,
+              {IRB.CreateCall(runtime.buildBitToBool, elements[0]),
+               elements[1], elements[2]});
+        });
+    return;
+  }
 
   IRBuilder<> IRB(&I);
   auto runtimeCall = buildRuntimeCall(IRB, runtime.pushPathConstraint,
@@ -458,6 +649,16 @@ void Symbolizer::visitCmpInst(CmpInst &I) {
   IRBuilder<> IRB(&I);
   SymFnT handler = runtime.comparisonHandlers.at(I.getPredicate());
   assert(handler && "Unable to handle icmp/fcmp variant");
+  if (I.getType()->isVectorTy()) {
+    buildElementwiseComputation(
+        I, {I.getOperand(0), I.getOperand(1)},
+        [&](IRBuilder<> &IRB, ArrayRef<Value *> elements) {
+          return IRB.CreateCall(runtime.buildBoolToBit,
+                                IRB.CreateCall(handler, elements));
+        });
+    return;
+  }
+
   auto runtimeCall =
       buildRuntimeCall(IRB, handler, {I.getOperand(0), I.getOperand(1)});
   registerSymbolicComputation(runtimeCall, &I);
@@ -469,13 +670,11 @@ void Symbolizer::visitReturnInst(ReturnInst &I) {
   if (I.getReturnValue() == nullptr)
     return;
 
-  // We can't short-circuit this call because the return expression needs to
+  // We can't short-circuit this store because the return expression needs to
   // be set even if it's null; otherwise we break the caller. Therefore,
-  // create the call directly without registering it for short-circuit
-  // processing.
+  // create it directly without registering it for short-circuit processing.
   IRBuilder<> IRB(&I);
-  IRB.CreateCall(runtime.setReturnExpression,
-                 getSymbolicExpressionOrNull(I.getReturnValue()));
+  storeReturnExpression(IRB, getSymbolicExpressionOrNull(I.getReturnValue()));
 }
 
 void Symbolizer::visitBranchInst(BranchInst &I) {
@@ -524,6 +723,11 @@ void Symbolizer::visitAllocaInst(AllocaInst & /*unused*/) {
 }
 
 void Symbolizer::visitLoadInst(LoadInst &I) {
+  // Local variables that only ever receive concrete values don't need to be
+  // looked up in shadow memory.
+  if (concreteness.isConcrete(&I))
+    return;
+
   IRBuilder<> IRB(&I);
 
   auto *addr = I.getPointerOperand();
@@ -576,6 +780,12 @@ void Symbolizer::visitGetElementPtrInst(GetElementPtrInst &I) {
     return;
   }
 
+  if (I.getType()->isVectorTy()) {
+    errs() << "Warning: unhandled vector GEP " << I
+           << "; the result will be concretized\n";
+    return;
+  }
+
   // If there are no indices or if they are all zero we can return early as
   // well.
   if (std::all_of(I.idx_begin(), I.idx_end(), [](Value *index) {
@@ -590,10 +800,23 @@ void Symbolizer::visitGetElementPtrInst(GetElementPtrInst &I) {
   SymbolicComputation symbolicComputation;
   Value *currentAddress = I.getPointerOperand();
 
+  // Contributions of constant indices (including struct member offsets) are
+  // known at compile time, so we sum them up here and add them to the address
+  // with a single runtime call at the end. As in the concrete computation,
+  // the arithmetic wraps around at the pointer width.
+  APInt constantOffset(ptrBits, 0);
+
+  auto addToAddress = [&](Value *contribution, bool contributionIsSymbolic) {
+    symbolicComputation.merge(forceBuildRuntimeCall(
+        IRB, runtime.binaryOperatorHandlers[Instruction::Add],
+        {{contribution, contributionIsSymbolic},
+         {currentAddress, (currentAddress == I.getPointerOperand())}}));
+    currentAddress = symbolicComputation.lastInstruction;
+  };
+
   for (auto type_it = gep_type_begin(I), type_end = gep_type_end(I);
        type_it != type_end; ++type_it) {
     auto *index = type_it.getOperand();
-    std::pair<Value *, bool> addressContribution;
 
     // There are two cases for the calculation:
     // 1. If the indexed type is a struct, we need to add the offset of the
@@ -605,56 +828,68 @@ void Symbolizer::visitGetElementPtrInst(GetElementPtrInst &I) {
       // (https://llvm.org/docs/LangRef.html#getelementptr-instruction).
 
       unsigned memberIndex = cast<ConstantInt>(index)->getZExtValue();
-      unsigned memberOffset =
+      uint64_t memberOffset =
           dataLayout.getStructLayout(structType)->getElementOffset(memberIndex);
-      addressContribution = {ConstantInt::get(intPtrType, memberOffset), true};
-    } else {
-      if (auto *ci = dyn_cast<ConstantInt>(index);
-          ci != nullptr && ci->isZero()) {
-        // Fast path: an index of zero means that no calculations are
-        // performed.
-        continue;
-      }
+      constantOffset += APInt(ptrBits, memberOffset);
+      continue;
+    }
 
-      // TODO optimize? If the index is constant, we can perform the
-      // multiplication ourselves instead of having the solver do it. Also, if
-      // the element size is 1, we can omit the multiplication.
+    uint64_t elementSize =
+        dataLayout.getTypeAllocSize(type_it.getIndexedType());
+    if (auto *ci = dyn_cast<ConstantInt>(index)) {
+      // GEP indices are sign-extended to the pointer width.
+      constantOffset +=
+          ci->getValue().sextOrTrunc(ptrBits) * APInt(ptrBits, elementSize);
+      continue;
+    }
 
-      unsigned elementSize =
-          dataLayout.getTypeAllocSize(type_it.getIndexedType());
-      if (auto indexWidth = index->getType()->getIntegerBitWidth();
-          indexWidth != ptrBits) {
-        symbolicComputation.merge(forceBuildRuntimeCall(
-            IRB, runtime.buildZExt,
-            {{index, true},
-             {ConstantInt::get(IRB.getInt8Ty(), ptrBits - indexWidth),
-              false}}));
-        symbolicComputation.merge(forceBuildRuntimeCall(
-            IRB, runtime.binaryOperatorHandlers[Instruction::Mul],
-            {{symbolicComputation.lastInstruction, false},
-             {ConstantInt::get(intPtrType, elementSize), true}}));
-      } else {
-        symbolicComputation.merge(forceBuildRuntimeCall(
-            IRB, runtime.binaryOperatorHandlers[Instruction::Mul],
-            {{index, true},
-             {ConstantInt::get(intPtrType, elementSize), true}}));
-      }
+    Value *scaledIndex = index;
+    bool scaledIndexIsSymbolic = true;
+    if (auto indexWidth = index->getType()->getIntegerBitWidth();
+        indexWidth != ptrBits) {
+      symbolicComputation.merge(forceBuildRuntimeCall(
+          IRB, runtime.buildZExt,
+          {{index, true},
+           {ConstantInt::get(IRB.getInt8Ty(), ptrBits - indexWidth),
+            false}}));
+      scaledIndex = symbolicComputation.lastInstruction;
+      scaledIndexIsSymbolic = false;
+    }
 
-      addressContribution = {symbolicComputation.lastInstruction, false};
+    // For elements of size 1, the index is the offset already.
+    if (elementSize != 1) {
+      symbolicComputation.merge(forceBuildRuntimeCall(
+          IRB, runtime.binaryOperatorHandlers[Instruction::Mul],
+          {{scaledIndex, scaledIndexIsSymbolic},
+           {ConstantInt::get(intPtrType, elementSize), true}}));
+      scaledIndex = symbolicComputation.lastInstruction;
+      scaledIndexIsSymbolic = false;
     }
 
-    symbolicComputation.merge(forceBuildRuntimeCall(
-        IRB, runtime.binaryOperatorHandlers[Instruction::Add],
-        {addressContribution,
-         {currentAddress, (currentAddress == I.getPointerOperand())}}));
-    currentAddress = symbolicComputation.lastInstruction;
+    addToAddress(scaledIndex, scaledIndexIsSymbolic);
+  }
+
+  if (constantOffset != 0)
+    addToAddress(ConstantInt::get(intPtrType, constantOffset), true);
+
+  // The constant offsets may cancel out, leaving the pointer unchanged.
+  if (currentAddress == I.getPointerOperand()) {
+    symbolicExpressions[&I] = getSymbolicExpression(I.getPointerOperand());
+    return;
   }
 
   registerSymbolicComputation(symbolicComputation, &I);
 }
 
 void Symbolizer::visitBitCastInst(BitCastInst &I) {
-  if (I.getSrcTy()->isIntegerTy() && I.getDestTy()->isFloatingPointTy()) {
+  // Integers and vectors are both represented by bit vectors (see the
+  // documentation of vector expressions), whereas scalar floating-point values
+  // need a conversion.
+  auto isBitVectorType = [](Type *T) {
+    return T->isIntegerTy() || T->isVectorTy();
+  };
+
+  if (isBitVectorType(I.getSrcTy()) && I.getDestTy()->isFloatingPointTy()) {
     IRBuilder<> IRB(&I);
     auto conversion =
         buildRuntimeCall(IRB, runtime.buildBitsToFloat,
@@ -664,11 +899,17 @@ void Symbolizer::visitBitCastInst(BitCastInst &I) {
     return;
   }
 
-  if (I.getSrcTy()->isFloatingPointTy() && I.getDestTy()->isIntegerTy()) {
+  if (I.getSrcTy()->isFloatingPointTy() && isBitVectorType(I.getDestTy())) {
     IRBuilder<> IRB(&I);
     auto conversion = buildRuntimeCall(IRB, runtime.buildFloatToBits,
                                        {{I.getOperand(0), true}});
-    registerSymbolicComputation(conversion);
+    registerSymbolicComputation(conversion, &I);
+    return;
+  }
+
+  if (isBitVectorType(I.getSrcTy()) && isBitVectorType(I.getDestTy())) {
+    if (auto *expr = getSymbolicExpression(I.getOperand(0)))
+      symbolicExpressions[&I] = expr;
     return;
   }
 
@@ -681,6 +922,16 @@ void Symbolizer::visitBitCastInst(BitCastInst &I) {
 void Symbolizer::visitTruncInst(TruncInst &I) {
   IRBuilder<> IRB(&I);
 
+  if (I.getType()->isVectorTy()) {
+    // Elements of type i1 are represented by bit vectors in vector
+    // expressions, so we don't need to convert to Booleans.
+    symbolizeWithRuntimeCall(
+        I, runtime.buildTrunc,
+        {{I.getOperand(0), true},
+         {IRB.getInt8(I.getDestTy()->getScalarSizeInBits()), false}});
+    return;
+  }
+
   if (getSymbolicExpression(I.getOperand(0)) == nullptr)
     return;
 
@@ -715,58 +966,52 @@ void Symbolizer::visitPtrToIntInst(PtrToIntInst &I) {
 
 void Symbolizer::visitSIToFPInst(SIToFPInst &I) {
   IRBuilder<> IRB(&I);
-  auto conversion =
-      buildRuntimeCall(IRB, runtime.buildIntToFloat,
-                       {{I.getOperand(0), true},
-                        {IRB.getInt1(I.getDestTy()->isDoubleTy()), false},
-                        {/* is_signed */ IRB.getInt1(true), false}});
-  registerSymbolicComputation(conversion, &I);
+  symbolizeWithRuntimeCall(
+      I, runtime.buildIntToFloat,
+      {{I.getOperand(0), true},
+       {IRB.getInt1(I.getDestTy()->getScalarType()->isDoubleTy()), false},
+       {/* is_signed */ IRB.getInt1(true), false}});
 }
 
 void Symbolizer::visitUIToFPInst(UIToFPInst &I) {
   IRBuilder<> IRB(&I);
-  auto conversion =
-      buildRuntimeCall(IRB, runtime.buildIntToFloat,
-                       {{I.getOperand(0), true},
-                        {IRB.getInt1(I.getDestTy()->isDoubleTy()), false},
-                        {/* is_signed */ IRB.getInt1(false), false}});
-  registerSymbolicComputation(conversion, &I);
+  symbolizeWithRuntimeCall(
+      I, runtime.buildIntToFloat,
+      {{I.getOperand(0), true},
+       {IRB.getInt1(I.getDestTy()->getScalarType()->isDoubleTy()), false},
+       {/* is_signed */ IRB.getInt1(false), false}});
 }
 
 void Symbolizer::visitFPExtInst(FPExtInst &I) {
   IRBuilder<> IRB(&I);
-  auto conversion =
-      buildRuntimeCall(IRB, runtime.buildFloatToFloat,
-                       {{I.getOperand(0), true},
-                        {IRB.getInt1(I.getDestTy()->isDoubleTy()), false}});
-  registerSymbolicComputation(conversion, &I);
+  symbolizeWithRuntimeCall(
+      I, runtime.buildFloatToFloat,
+      {{I.getOperand(0), true},
+       {IRB.getInt1(I.getDestTy()->getScalarType()->isDoubleTy()), false}});
 }
 
 void Symbolizer::visitFPTruncInst(FPTruncInst &I) {
   IRBuilder<> IRB(&I);
-  auto conversion =
-      buildRuntimeCall(IRB, runtime.buildFloatToFloat,
-                       {{I.getOperand(0), true},
-                        {IRB.getInt1(I.getDestTy()->isDoubleTy()), false}});
-  registerSymbolicComputation(conversion, &I);
+  symbolizeWithRuntimeCall(
+      I, runtime.buildFloatToFloat,
+      {{I.getOperand(0), true},
+       {IRB.getInt1(I.getDestTy()->getScalarType()->isDoubleTy()), false}});
 }
 
 void Symbolizer::visitFPToSI(FPToSIInst &I) {
   IRBuilder<> IRB(&I);
-  auto conversion = buildRuntimeCall(
-      IRB, runtime.buildFloatToSignedInt,
+  symbolizeWithRuntimeCall(
+      I, runtime.buildFloatToSignedInt,
       {{I.getOperand(0), true},
-       {IRB.getInt8(I.getType()->getIntegerBitWidth()), false}});
-  registerSymbolicComputation(conversion, &I);
+       {IRB.getInt8(I.getType()->getScalarSizeInBits()), false}});
 }
 
 void Symbolizer::visitFPToUI(FPToUIInst &I) {
   IRBuilder<> IRB(&I);
-  auto conversion = buildRuntimeCall(
-      IRB, runtime.buildFloatToUnsignedInt,
+  symbolizeWithRuntimeCall(
+      I, runtime.buildFloatToUnsignedInt,
       {{I.getOperand(0), true},
-       {IRB.getInt8(I.getType()->getIntegerBitWidth()), false}});
-  registerSymbolicComputation(conversion, &I);
+       {IRB.getInt8(I.getType()->getScalarSizeInBits()), false}});
 }
 
 void Symbolizer::visitCastInst(CastInst &I) {
@@ -791,6 +1036,17 @@ void Symbolizer::visitCastInst(CastInst &I) {
     llvm_unreachable("Unknown cast opcode");
   }
 
+  // Vector elements are bit vectors even if they're of type i1.
+  if (I.getType()->isVectorTy()) {
+    symbolizeWithRuntimeCall(
+        I, target,
+        {{I.getOperand(0), true},
+         {IRB.getInt8(I.getDestTy()->getScalarSizeInBits() -
+                      I.getSrcTy()->getScalarSizeInBits()),
+          false}});
+    return;
+  }
+
   // LLVM bitcode represents Boolean values as i1. In Z3, those are a not a
   // bit-vector sort, so trying to cast one into a bit vector of any length
   // raises an error. The run-time library provides a dedicated conversion
@@ -822,6 +1078,12 @@ void Symbolizer::visitPHINode(PHINode &I) {
   // PHI nodes just assign values based on the origin of the last jump, so we
   // assign the corresponding symbolic expression the same way.
 
+  // There is nothing to do for concrete values (e.g., loop counters). Since we
+  // don't create an expression, computations that depend on the value only
+  // through other concrete values don't get an expression either.
+  if (concreteness.isConcrete(&I))
+    return;
+
   phiNodes.push_back(&I); // to be finalized later, see finalizePHINodes
 
   IRBuilder<> IRB(&I);
@@ -896,6 +1158,136 @@ void Symbolizer::visitExtractValueInst(ExtractValueInst &I) {
       {extractedBits, result, {{target, 0, extractedBits}}}, &I);
 }
 
+void Symbolizer::visitExtractElementInst(ExtractElementInst &I) {
+  IRBuilder<> IRB(&I);
+  auto *vector = I.getVectorOperand();
+  auto *index = I.getIndexOperand();
+
+  // Like a memory access at a symbolic address, a symbolic index is
+  // concretized, and we try an alternative value.
+  tryAlternative(IRB, index);
+
+  auto *vectorExpr = getSymbolicExpression(vector);
+  if (vectorExpr == nullptr || isUnsupportedVectorType(I, vector->getType()))
+    return;
+
+  // The result is poison if the index is out of range, so any element will
+  // do in that case.
+  auto *vectorType = cast<FixedVectorType>(vector->getType());
+  auto *numElements = ConstantInt::get(index->getType(),
+                                       vectorType->getNumElements());
+  auto *safeIndex =
+      IRB.CreateSelect(IRB.CreateICmpULT(index, numElements), index,
+                       ConstantInt::get(index->getType(), 0));
+
+  auto *elementBits =
+      extractVectorElementBits(IRB, vectorExpr, vectorType, safeIndex);
+  auto *result = convertBitVectorExprForType(IRB, elementBits, I.getType());
+  registerSymbolicComputation(
+      {elementBits, result, {{vector, 0, elementBits}}}, &I);
+}
+
+void Symbolizer::visitInsertElementInst(InsertElementInst &I) {
+  IRBuilder<> IRB(&I);
+  auto *vector = I.getOperand(0);
+  auto *element = I.getOperand(1);
+  auto *index = I.getOperand(2);
+
+  tryAlternative(IRB, index);
+
+  if (getSymbolicExpression(vector) == nullptr &&
+      getSymbolicExpression(element) == nullptr)
+    return;
+
+  if (isUnsupportedVectorType(I, I.getType()))
+    return;
+
+  // An out-of-range index produces poison; we just concretize.
+  auto numElements = cast<FixedVectorType>(I.getType())->getNumElements();
+  auto *constantIndex = dyn_cast<ConstantInt>(index);
+  if (constantIndex != nullptr && constantIndex->getValue().uge(numElements))
+    return;
+
+  auto *previous = I.getPrevNode();
+  SymbolicComputation computation;
+
+  SmallVector<int, 16> indices;
+  for (unsigned i = 0; i < numElements; i++) {
+    if (constantIndex == nullptr || !constantIndex->equalsInt(i))
+      indices.push_back(i);
+  }
+  auto vectorElements = getVectorElementBits(IRB, vector, indices, computation);
+  auto *elementBits = getScalarElementBits(IRB, element, computation);
+
+  SmallVector<Value *, 16> resultElements;
+  auto *vectorElement = vectorElements.begin();
+  for (unsigned i = 0; i < numElements; i++) {
+    if (constantIndex != nullptr) {
+      resultElements.push_back(constantIndex->equalsInt(i) ? elementBits
+                                                           : *vectorElement++);
+    } else {
+      // The index is concrete by now, so we can decide at run time which
+      // element to replace.
+      resultElements.push_back(IRB.CreateSelect(
+          IRB.CreateICmpEQ(index, ConstantInt::get(index->getType(), i)),
+          elementBits, *vectorElement++));
+    }
+  }
+
+  registerVectorComputation(I, previous,
+                            concatVectorElementBits(IRB, resultElements),
+                            computation);
+}
+
+void Symbolizer::visitShuffleVectorInst(ShuffleVectorInst &I) {
+  auto *first = I.getOperand(0);
+  auto *second = I.getOperand(1);
+
+  if (isUnsupportedVectorType(I, first->getType()))
+    return;
+
+  // Find out which elements the mask takes from each operand; undefined mask
+  // elements (i.e., negative ones) can take any element.
+  SmallVector<int, 16> mask;
+  I.getShuffleMask(mask);
+  int firstSize = cast<FixedVectorType>(first->getType())->getNumElements();
+  SmallVector<int, 16> firstIndices, secondIndices;
+  for (int maskElement : mask) {
+    if (maskElement < firstSize)
+      firstIndices.push_back(maskElement);
+    else
+      secondIndices.push_back(maskElement - firstSize);
+  }
+
+  auto usesSymbolicElements = [this](Value *V, ArrayRef<int> indices) {
+    return !indices.empty() && getSymbolicExpression(V) != nullptr;
+  };
+  if (!usesSymbolicElements(first, firstIndices) &&
+      !usesSymbolicElements(second, secondIndices))
+    return;
+
+  IRBuilder<> IRB(&I);
+  auto *previous = I.getPrevNode();
+  SymbolicComputation computation;
+
+  auto firstElements =
+      getVectorElementBits(IRB, first, firstIndices, computation);
+  auto secondElements =
+      getVectorElementBits(IRB, second, secondIndices, computation);
+
+  SmallVector<Value *, 16> resultElements;
+  auto *firstElement = firstElements.begin();
+  auto *secondElement = secondElements.begin();
+  for (int maskElement : mask) {
+    resultElements.push_back(maskElement < firstSize ? *firstElement++
+                                                     : *secondElement++);
+  }
+
+  registerVectorComputation(I, previous,
+                            concatVectorElementBits(IRB, resultElements),
+                            computation);
+}
+
 void Symbolizer::visitSwitchInst(SwitchInst &I) {
   // Switch compares a value against a set of integer constants; duplicate
   // constants are not allowed
@@ -981,6 +1373,16 @@ Instruction *Symbolizer::createValueExpression(Value *V, IRBuilder<> &IRB) {
         {IRB.CreatePtrToInt(V, IRB.getInt64Ty()), IRB.getInt8(ptrBits)});
   }
 
+  if (auto *vectorType = dyn_cast<FixedVectorType>(valueType)) {
+    SmallVector<Value *, 16> elements;
+    for (unsigned i = 0; i < vectorType->getNumElements(); i++) {
+      elements.push_back(
+          createVectorElementBits(IRB.CreateExtractElement(V, i), IRB));
+    }
+
+    return concatVectorElementBits(IRB, elements);
+  }
+
   if (auto structType = dyn_cast<StructType>(valueType)) {
     // In unoptimized code we may see structures in SSA registers. What we
     // want is a single bit-vector expression describing their contents, but
@@ -1134,6 +1536,13 @@ Instruction *Symbolizer::convertBitVectorExprForType(llvm::IRBuilder<> &IRB,
     result = IRB.CreateCall(runtime.buildTrunc,
                             {I, ConstantInt::get(IRB.getInt8Ty(), 1)});
     result = IRB.CreateCall(runtime.buildBitToBool, {result});
+  } else if (T->isVectorTy()) {
+    // Vectors of i1 don't fill the bytes that they occupy in memory.
+    auto bits = vectorExpressionBits(T);
+    if (bits < dataLayout.getTypeStoreSizeInBits(T)) {
+      result = IRB.CreateCall(runtime.buildTrunc,
+                              {I, ConstantInt::get(IRB.getInt8Ty(), bits)});
+    }
   }
 
   return result;
@@ -1155,7 +1564,264 @@ Symbolizer::convertExprForTypeToBitVectorExpr(IRBuilder<> &IRB, Value *V,
     auto bitVectorExpr = IRB.CreateCall(runtime.buildZExt,
                                         {bitExpr, IRB.getInt8(7 /* 1 byte */)});
     return SymbolicComputation(bitExpr, bitVectorExpr, {Input(V, 0, bitExpr)});
+  } else if (T->isVectorTy() && vectorExpressionBits(T) <
+                                    dataLayout.getTypeStoreSizeInBits(T)) {
+    auto bitVectorExpr = IRB.CreateCall(
+        runtime.buildZExt,
+        {Expr, IRB.getInt8(dataLayout.getTypeStoreSizeInBits(T) -
+                           vectorExpressionBits(T))});
+    return SymbolicComputation(bitVectorExpr, bitVectorExpr,
+                               {Input(V, 0, bitVectorExpr)});
   } else {
     return {};
   }
 }
+
+unsigned Symbolizer::vectorExpressionBits(Type *T) const {
+  if (auto *vectorType = dyn_cast<FixedVectorType>(T))
+    return vectorType->getNumElements() *
+           vectorExpressionBits(vectorType->getElementType());
+
+  return T->isPointerTy() ? ptrBits : T->getPrimitiveSizeInBits();
+}
+
+Instruction *Symbolizer::extractVectorElementBits(IRBuilder<> &IRB,
+                                                  Value *vectorExpr,
+                                                  FixedVectorType *vectorType,
+                                                  Value *index) const {
+  auto elementBits = vectorExpressionBits(vectorType->getElementType());
+  auto *position = IRB.CreateZExtOrTrunc(index, intPtrType);
+  if (!dataLayout.isLittleEndian()) {
+    position = IRB.CreateSub(
+        ConstantInt::get(intPtrType, vectorType->getNumElements() - 1),
+        position);
+  }
+
+  auto *lowBit = IRB.CreateMul(position, ConstantInt::get(intPtrType,
+                                                          elementBits));
+  auto *highBit =
+      IRB.CreateAdd(lowBit, ConstantInt::get(intPtrType, elementBits - 1));
+  return IRB.CreateCall(runtime.buildExtractBits,
+                        {vectorExpr, highBit, lowBit});
+}
+
+Instruction *
+Symbolizer::concatVectorElementBits(IRBuilder<> &IRB,
+                                    ArrayRef<Value *> elementBits) const {
+  // Element zero ends up in the least significant bits on little-endian
+  // targets.
+  Value *result = elementBits.front();
+  for (auto *element : elementBits.drop_front()) {
+    result = dataLayout.isLittleEndian()
+                 ? IRB.CreateCall(runtime.buildConcat, {element, result})
+                 : IRB.CreateCall(runtime.buildConcat, {result, element});
+  }
+
+  return cast<Instruction>(result);
+}
+
+Value *Symbolizer::vectorElementFromBits(IRBuilder<> &IRB, Value *bits,
+                                         Type *elementType) const {
+  if (elementType->isFloatingPointTy())
+    return IRB.CreateCall(runtime.buildBitsToFloat,
+                          {bits, IRB.getInt1(elementType->isDoubleTy())});
+
+  return bits;
+}
+
+Value *Symbolizer::vectorElementToBits(IRBuilder<> &IRB, Value *expr,
+                                       Type *elementType) const {
+  if (elementType->isFloatingPointTy())
+    return IRB.CreateCall(runtime.buildFloatToBits, {expr});
+
+  return expr;
+}
+
+Value *Symbolizer::createVectorElementBits(Value *element,
+                                           IRBuilder<> &IRB) {
+  auto *expr = createValueExpression(element, IRB);
+  if (element->getType()->isIntegerTy(1))
+    return IRB.CreateCall(runtime.buildBoolToBit, {expr});
+
+  return vectorElementToBits(IRB, expr, element->getType());
+}
+
+SmallVector<Value *, 16>
+Symbolizer::getVectorElementBits(IRBuilder<> &IRB, Value *V,
+                                 ArrayRef<int> indices,
+                                 SymbolicComputation &computation) {
+  SmallVector<Value *, 16> result;
+  if (indices.empty())
+    return result;
+
+  auto *vectorType = cast<FixedVectorType>(V->getType());
+  Value *vectorExpr = nullptr;
+  if (auto *expr = getSymbolicExpression(V)) {
+    // Extracting all bits is a no-op for the backends, but it gives us a
+    // single user of the expression to record as input of the computation.
+    auto *allBits = IRB.CreateCall(
+        runtime.buildExtractBits,
+        {expr,
+         ConstantInt::get(intPtrType, vectorExpressionBits(vectorType) - 1),
+         ConstantInt::get(intPtrType, 0)});
+    computation.inputs.push_back(Input(V, 0, allBits));
+    vectorExpr = allBits;
+  }
+
+  DenseMap<int, Value *> elements;
+  for (int index : indices) {
+    index = std::max(index, 0);
+    auto &element = elements[index];
+    if (element == nullptr) {
+      element = vectorExpr ? extractVectorElementBits(IRB, vectorExpr,
+                                                      vectorType,
+                                                      IRB.getInt32(index))
+                           : createVectorElementBits(
+                                 IRB.CreateExtractElement(V, index), IRB);
+    }
+    result.push_back(element);
+  }
+
+  return result;
+}
+
+Value *Symbolizer::getScalarElementBits(IRBuilder<> &IRB, Value *V,
+                                        SymbolicComputation &computation) {
+  auto *expr = getSymbolicExpression(V);
+  if (expr == nullptr)
+    return createVectorElementBits(V, IRB);
+
+  // We need a conversion anyway for floats and Booleans; for other types, we
+  // extract all bits to obtain a single user of the expression (see
+  // getVectorElementBits).
+  auto *type = V->getType();
+  Instruction *bits;
+  if (type->isFloatingPointTy()) {
+    bits = IRB.CreateCall(runtime.buildFloatToBits, {expr});
+  } else if (type->isIntegerTy(1)) {
+    bits = IRB.CreateCall(runtime.buildBoolToBit, {expr});
+  } else {
+    bits = IRB.CreateCall(
+        runtime.buildExtractBits,
+        {expr, ConstantInt::get(intPtrType, vectorExpressionBits(type) - 1),
+         ConstantInt::get(intPtrType, 0)});
+  }
+
+  computation.inputs.push_back(Input(V, 0, bits));
+  return bits;
+}
+
+void Symbolizer::registerVectorComputation(Instruction &I,
+                                           Instruction *previous,
+                                           Instruction *result,
+                                           SymbolicComputation &computation) {
+  assert(result == I.getPrevNode() &&
+         "The result must be the last instruction of the computation");
+
+  computation.firstInstruction =
+      previous ? previous->getNextNode() : &I.getParent()->front();
+  computation.lastInstruction = result;
+  registerSymbolicComputation(computation, &I);
+}
+
+void Symbolizer::buildElementwiseComputation(
+    Instruction &I, ArrayRef<Value *> operands,
+    function_ref<Value *(IRBuilder<> &, ArrayRef<Value *>)> buildElement) {
+  if (std::all_of(operands.begin(), operands.end(), [this](Value *operand) {
+        return (getSymbolicExpression(operand) == nullptr);
+      })) {
+    return;
+  }
+
+  auto *resultType = I.getType();
+  if (isUnsupportedVectorType(I, resultType))
+    return;
+
+  IRBuilder<> IRB(&I);
+  auto *previous = I.getPrevNode();
+  SymbolicComputation computation;
+
+  auto numElements = cast<FixedVectorType>(resultType)->getNumElements();
+  SmallVector<int, 16> indices(numElements);
+  std::iota(indices.begin(), indices.end(), 0);
+  std::vector<SmallVector<Value *, 16>> operandElements;
+  for (auto *operand : operands) {
+    operandElements.push_back(
+        getVectorElementBits(IRB, operand, indices, computation));
+  }
+
+  SmallVector<Value *, 16> resultElements;
+  for (unsigned i = 0; i < numElements; i++) {
+    SmallVector<Value *, 3> elements;
+    for (unsigned j = 0; j < operands.size(); j++) {
+      elements.push_back(
+          vectorElementFromBits(IRB, operandElements[j][i],
+                                operands[j]->getType()->getScalarType()));
+    }
+
+    resultElements.push_back(vectorElementToBits(
+        IRB, buildElement(IRB, elements), resultType->getScalarType()));
+  }
+
+  registerVectorComputation(I, previous,
+                            concatVectorElementBits(IRB, resultElements),
+                            computation);
+}
+
+void Symbolizer::symbolizeWithRuntimeCall(
+    Instruction &I, SymFnT function, ArrayRef<std::pair<Value *, bool>> args) {
+  if (!I.getType()->isVectorTy()) {
+    IRBuilder<> IRB(&I);
+    registerSymbolicComputation(buildRuntimeCall(IRB, function, args), &I);
+    return;
+  }
+
+  SmallVector<Value *, 3> operands;
+  for (const auto &[arg, symbolic] : args) {
+    if (symbolic)
+      operands.push_back(arg);
+  }
+
+  buildElementwiseComputation(
+      I, operands, [&](IRBuilder<> &IRB, ArrayRef<Value *> elements) {
+        std::vector<Value *> functionArgs;
+        auto *element = elements.begin();
+        for (const auto &[arg, symbolic] : args)
+          functionArgs.push_back(symbolic ? *element++ : arg);
+        return IRB.CreateCall(function, functionArgs);
+      });
+}
+
+void Symbolizer::buildVectorReduction(CallBase &I, SymFnT handler) {
+  auto *vector = I.getArgOperand(0);
+  if (getSymbolicExpression(vector) == nullptr ||
+      isUnsupportedVectorType(I, vector->getType()))
+    return;
+
+  IRBuilder<> IRB(&I);
+  auto *previous = I.getPrevNode();
+  SymbolicComputation computation;
+
+  SmallVector<int, 16> indices(
+      cast<FixedVectorType>(vector->getType())->getNumElements());
+  std::iota(indices.begin(), indices.end(), 0);
+  auto elements = getVectorElementBits(IRB, vector, indices, computation);
+
+  Value *result = elements.front();
+  for (auto *element : ArrayRef<Value *>(elements).drop_front())
+    result = IRB.CreateCall(handler, {result, element});
+
+  registerVectorComputation(
+      I, previous,
+      convertBitVectorExprForType(IRB, cast<Instruction>(result), I.getType()),
+      computation);
+}
+
+bool Symbolizer::isUnsupportedVectorType(Instruction &I, Type *T) const {
+  if (!T->isVectorTy() || isa<FixedVectorType>(T))
+    return false;
+
+  errs() << "Warning: unhandled scalable vector in " << I
+         << "; the result will be concretized\n";
+  return true;
+}
@@ -15,6 +15,7 @@
 #ifndef SYMBOLIZE_H
 #define SYMBOLIZE_H
 
+#include <llvm/ADT/SmallPtrSet.h>
 #include <llvm/IR/BasicBlock.h>
 #include <llvm/IR/IRBuilder.h>
 #include <llvm/IR/InstVisitor.h>
@@ -22,12 +23,20 @@
 #include <llvm/Support/raw_ostream.h>
 #include <optional>
 
+#include "ConcretenessAnalysis.h"
 #include "Runtime.h"
 
+#if LLVM_VERSION_MAJOR < 11
+namespace llvm {
+// Scalable vectors were introduced along with this name in LLVM 11.
+using FixedVectorType = VectorType;
+} // namespace llvm
+#endif
+
 class Symbolizer : public llvm::InstVisitor<Symbolizer> {
 public:
-  explicit Symbolizer(llvm::Module &M)
-      : runtime(M), dataLayout(M.getDataLayout()),
+  Symbolizer(llvm::Module &M, const ConcretenessAnalysis &concreteness)
+      : runtime(M), concreteness(concreteness), dataLayout(M.getDataLayout()),
         ptrBits(M.getDataLayout().getPointerSizeInBits()),
         intPtrType(M.getDataLayout().getIntPtrType(M.getContext())) {}
 
@@ -95,6 +104,11 @@ public:
   /// operations without symbolic data.
   void shortCircuitExpressionUses();
 
+  /// Prepare a function that we don't instrument (e.g., a concrete clone; see
+  /// concreteClones) for calls to and from instrumented code, and make it call
+  /// concrete clones while there is no symbolic data.
+  void prepareConcreteFunction(llvm::Function &F);
+
   void handleIntrinsicCall(llvm::CallBase &I);
   void handleInlineAssembly(llvm::CallInst &I);
   void handleFunctionCall(llvm::CallBase &I, llvm::Instruction *returnPoint);
@@ -129,6 +143,9 @@ public:
   void visitPHINode(llvm::PHINode &I);
   void visitInsertValueInst(llvm::InsertValueInst &I);
   void visitExtractValueInst(llvm::ExtractValueInst &I);
+  void visitExtractElementInst(llvm::ExtractElementInst &I);
+  void visitInsertElementInst(llvm::InsertElementInst &I);
+  void visitShuffleVectorInst(llvm::ShuffleVectorInst &I);
   void visitSwitchInst(llvm::SwitchInst &I);
   void visitUnreachableInst(llvm::UnreachableInst &);
   void visitInstruction(llvm::Instruction &I);
@@ -280,9 +297,26 @@ private:
       registerSymbolicComputation(*computation, concrete);
   }
 
+  /// Generate code that accesses the run-time library's slots for parameter
+  /// and return expressions. Loading the return expression also clears the
+  /// slot, like _sym_get_return_expression.
+  llvm::Value *loadParameterExpression(llvm::IRBuilder<> &IRB, unsigned index);
+  void storeParameterExpression(llvm::IRBuilder<> &IRB, unsigned index,
+                                llvm::Value *expr);
+  llvm::Value *loadReturnExpression(llvm::IRBuilder<> &IRB);
+  void storeReturnExpression(llvm::IRBuilder<> &IRB, llvm::Value *expr);
+
   /// Generate code that makes the solver try an alternative value for V.
   void tryAlternative(llvm::IRBuilder<> &IRB, llvm::Value *V);
 
+  /// Make a call go to the concrete clone of the callee, if there is one, as
+  /// long as the program hasn't seen any symbolic data.
+  void dispatchToConcreteClone(llvm::IRBuilder<> &IRB, llvm::CallBase &I);
+
+  /// Update the hash of the calling context for a call, and restore it when
+  /// the call returns or unwinds to a landing pad.
+  void updateCallContext(llvm::CallBase &I, llvm::Instruction *returnPoint);
+
   /// Helper to use a pointer to a host object as integer (truncating!).
   ///
   /// Note that the conversion will truncate the most significant bits of the
@@ -329,8 +363,99 @@ private:
   convertExprForTypeToBitVectorExpr(llvm::IRBuilder<> &IRB, llvm::Value *V,
                                     llvm::Value *Expr) const;
 
+  //
+  // Vectors
+  //
+  // The expression for a vector is a single bit vector that holds the elements
+  // side by side, the way a bit cast to an integer would arrange them: element
+  // zero occupies the least significant bits on little-endian targets and the
+  // most significant bits on big-endian ones. Elements of type i1 take a single
+  // bit each, and floating-point elements are represented by their bits. Code
+  // working on individual elements uses bit-vector expressions for integers and
+  // pointers (including i1) and floating-point expressions for floats.
+  //
+
+  /// Return the number of bits that a value of the (first-class, non-aggregate)
+  /// type occupies in a vector expression.
+  unsigned vectorExpressionBits(llvm::Type *T) const;
+
+  /// Emit code that extracts the bits of the element at the given index from
+  /// the vector expression. The index must be in range.
+  llvm::Instruction *extractVectorElementBits(llvm::IRBuilder<> &IRB,
+                                              llvm::Value *vectorExpr,
+                                              llvm::FixedVectorType *vectorType,
+                                              llvm::Value *index) const;
+
+  /// Emit code that concatenates element bits into a vector expression.
+  llvm::Instruction *
+  concatVectorElementBits(llvm::IRBuilder<> &IRB,
+                          llvm::ArrayRef<llvm::Value *> elementBits) const;
+
+  /// Convert between the bits of a vector element and the expression that
+  /// element-wise computations work on (see above).
+  llvm::Value *vectorElementFromBits(llvm::IRBuilder<> &IRB, llvm::Value *bits,
+                                     llvm::Type *elementType) const;
+  llvm::Value *vectorElementToBits(llvm::IRBuilder<> &IRB, llvm::Value *expr,
+                                   llvm::Type *elementType) const;
+
+  /// Emit code that builds the bits of a vector element from its concrete
+  /// value.
+  llvm::Value *createVectorElementBits(llvm::Value *element,
+                                       llvm::IRBuilder<> &IRB);
+
+  /// Emit code that provides the bits of the selected elements of vector V as
+  /// part of a symbolic computation.
+  ///
+  /// If V has a symbolic expression, we take it apart and record the use in
+  /// the computation's inputs, so that the short-circuit check covers the
+  /// whole vector at once; otherwise, we build the elements from the concrete
+  /// values. Negative indices (i.e., undefined elements) select element zero.
+  llvm::SmallVector<llvm::Value *, 16>
+  getVectorElementBits(llvm::IRBuilder<> &IRB, llvm::Value *V,
+                       llvm::ArrayRef<int> indices,
+                       SymbolicComputation &computation);
+
+  /// Like getVectorElementBits, but for a scalar V.
+  llvm::Value *getScalarElementBits(llvm::IRBuilder<> &IRB, llvm::Value *V,
+                                    SymbolicComputation &computation);
+
+  /// Register a computation that has been emitted right before I, starting
+  /// after the instruction "previous" (or at the beginning of the basic block
+  /// if there is none) and ending with "result".
+  void registerVectorComputation(llvm::Instruction &I,
+                                 llvm::Instruction *previous,
+                                 llvm::Instruction *result,
+                                 SymbolicComputation &computation);
+
+  /// Symbolize an instruction that applies the same operation to each element
+  /// of its vector operands.
+  ///
+  /// The callback builds the expression for one element of the result from the
+  /// corresponding elements of the operands.
+  void buildElementwiseComputation(
+      llvm::Instruction &I, llvm::ArrayRef<llvm::Value *> operands,
+      llvm::function_ref<llvm::Value *(llvm::IRBuilder<> &,
+                                       llvm::ArrayRef<llvm::Value *>)>
+          buildElement);
+
+  /// Call the run-time function like buildRuntimeCall and register the result
+  /// for I; if I produces a vector, call the function for each element of the
+  /// symbolic arguments instead.
+  void symbolizeWithRuntimeCall(
+      llvm::Instruction &I, SymFnT function,
+      llvm::ArrayRef<std::pair<llvm::Value *, bool>> args);
+
+  /// Symbolize a reduction of a vector to a scalar with a binary operation.
+  void buildVectorReduction(llvm::CallBase &I, SymFnT handler);
+
+  /// Return true if the vector type can't be symbolized, printing a warning.
+  bool isUnsupportedVectorType(llvm::Instruction &I, llvm::Type *T) const;
+
   const Runtime runtime;
 
+  /// The values of the current function that are known to be concrete.
+  const ConcretenessAnalysis &concreteness;
+
   /// The data layout of the currently processed module.
   const llvm::DataLayout &dataLayout;
 
@@ -370,6 +495,14 @@ private:
   /// Therefore, we keep a record of all the places that construct expressions
   /// and insert the fast path later.
   std::vector<SymbolicComputation> expressionUses;
+
+  /// The hash of the calling context on entry to the current function, loaded
+  /// on demand; every call restores it when it returns, so it's valid
+  /// throughout the function.
+  llvm::Value *entryCallContext = nullptr;
+
+  /// The landing pads where we have already restored the calling context.
+  llvm::SmallPtrSet<llvm::BasicBlock *, 4> restoredLandingPads;
 };
 
 #endif
@@ -0,0 +1,147 @@
+// This file is part of the SymCC runtime.
+//
+// The SymCC runtime is free software: you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// The SymCC runtime is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+// for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with SymCC. If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+/// A bump-pointer allocator for bookkeeping that is freed all at once.
+///
+/// Node-based containers (e.g., std::unordered_map) make one heap allocation
+/// per entry, which shows up prominently in profiles when they are filled on
+/// every path constraint. An arena hands out memory from large chunks instead
+/// and never frees individual objects; all memory is released when the arena
+/// is reset or destroyed. This only pays off for data whose lifetime ends at a
+/// well-defined point, such as the end of an operation or a snapshot restore.
+///
+/// Destructors of objects in the arena are not run, so it must only hold
+/// objects whose destructors don't release other resources.
+class Arena {
+public:
+  explicit Arena(size_t chunkSize = kDefaultChunkSize)
+      : chunkSize_(chunkSize) {}
+  ~Arena() { releaseChunks(head_); }
+
+  Arena(const Arena &) = delete;
+  Arena &operator=(const Arena &) = delete;
+
+  void *allocate(size_t size, size_t alignment) {
+    assert((alignment & (alignment - 1)) == 0 &&
+           "Alignment must be a power of 2");
+    auto start = (next_ + alignment - 1) & ~(alignment - 1);
+    if (start + size > end_ || start < next_)
+      start = grow(size, alignment);
+
+    next_ = start + size;
+    return reinterpret_cast<void *>(start);
+  }
+
+  /// Release all memory handed out so far. The first chunk is kept, so that
+  /// an arena that is reset regularly doesn't go back to the system each time.
+  void reset() {
+    if (head_ == nullptr)
+      return;
+
+    releaseChunks(head_->next);
+    head_->next = nullptr;
+    next_ = head_->begin();
+    end_ = head_->end();
+  }
+
+private:
+  static constexpr size_t kDefaultChunkSize = 64 * 1024;
+
+  struct alignas(std::max_align_t) Chunk {
+    Chunk *next;
+    size_t size;
+
+    uintptr_t begin() { return reinterpret_cast<uintptr_t>(this + 1); }
+    uintptr_t end() { return begin() + size; }
+  };
+
+  /// Start a new chunk that can hold an allocation of the given size, and
+  /// return the address of the allocation.
+  uintptr_t grow(size_t size, size_t alignment) {
+    auto chunkSize = chunkSize_;
+    while (chunkSize < size + alignment)
+      chunkSize *= 2;
+
+    auto *chunk = static_cast<Chunk *>(std::malloc(sizeof(Chunk) + chunkSize));
+    if (chunk == nullptr)
+      throw std::bad_alloc{};
+    chunk->size = chunkSize;
+
+    // The first chunk stays at the head of the list because reset keeps it.
+    if (head_ == nullptr) {
+      chunk->next = nullptr;
+      head_ = chunk;
+    } else {
+      chunk->next = head_->next;
+      head_->next = chunk;
+    }
+
+    end_ = chunk->end();
+    return (chunk->begin() + alignment - 1) & ~(alignment - 1);
+  }
+
+  static void releaseChunks(Chunk *chunk) {
+    while (chunk != nullptr) {
+      auto *next = chunk->next;
+      std::free(chunk);
+      chunk = next;
+    }
+  }
+
+  size_t chunkSize_;
+  Chunk *head_ = nullptr;
+  uintptr_t next_ = 0;
+  uintptr_t end_ = 0;
+};
+
+/// A standard-library allocator that takes its memory from an arena, so that
+/// containers can use the arena (e.g., std::vector<T, ArenaAllocator<T>>).
+/// Deallocation is a no-op; memory is only reclaimed with the arena.
+template <typename T> class ArenaAllocator {
+public:
+  using value_type = T;
+
+  explicit ArenaAllocator(Arena &arena) : arena_(&arena) {}
+  template <typename U>
+  ArenaAllocator(const ArenaAllocator<U> &other) : arena_(other.arena_) {}
+
+  T *allocate(size_t n) {
+    return static_cast<T *>(arena_->allocate(n * sizeof(T), alignof(T)));
+  }
+  void deallocate(T *, size_t) {}
+
+  template <typename U> bool operator==(const ArenaAllocator<U> &other) const {
+    return arena_ == other.arena_;
+  }
+  template <typename U> bool operator!=(const ArenaAllocator<U> &other) const {
+    return arena_ != other.arena_;
+  }
+
+private:
+  template <typename U> friend class ArenaAllocator;
+
+  Arena *arena_;
+};
+
+#endif
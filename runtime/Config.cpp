@@ -38,6 +38,75 @@ bool checkFlagString(std::string value) {
   throw std::runtime_error(msg.str());
 }
 
+/// Parse the non-negative integer value of an option.
+unsigned long parseUnsigned(const char *option, const std::string &value) {
+  size_t end;
+  unsigned long result;
+  try {
+    result = std::stoul(value, &end);
+  } catch (std::invalid_argument &) {
+    end = 0;
+  } catch (std::out_of_range &) {
+    std::stringstream msg;
+    msg << "The value " << value << " of " << option << " is too large";
+    throw std::runtime_error(msg.str());
+  }
+
+  if (end == 0 || end != value.size() || value[0] == '-') {
+    std::stringstream msg;
+    msg << "Can't convert " << value << " (for " << option
+        << ") to a non-negative integer";
+    throw std::runtime_error(msg.str());
+  }
+
+  return result;
+}
+
+/// Parse a size in bytes with an optional binary suffix (K, M, G or T).
+size_t parseSize(const std::string &value) {
+  size_t suffixStart;
+  unsigned long long size;
+  try {
+    size = std::stoull(value, &suffixStart);
+  } catch (std::invalid_argument &) {
+    std::stringstream msg;
+    msg << "Can't convert " << value << " to a size";
+    throw std::runtime_error(msg.str());
+  } catch (std::out_of_range &) {
+    std::stringstream msg;
+    msg << "The size " << value << " is too large";
+    throw std::runtime_error(msg.str());
+  }
+
+  auto suffix = value.substr(suffixStart);
+  std::transform(suffix.begin(), suffix.end(), suffix.begin(),
+                 [](unsigned char c) { return std::toupper(c); });
+  unsigned shift;
+  if (suffix.empty() || suffix == "B")
+    shift = 0;
+  else if (suffix == "K" || suffix == "KB")
+    shift = 10;
+  else if (suffix == "M" || suffix == "MB")
+    shift = 20;
+  else if (suffix == "G" || suffix == "GB")
+    shift = 30;
+  else if (suffix == "T" || suffix == "TB")
+    shift = 40;
+  else {
+    std::stringstream msg;
+    msg << "Unknown size suffix in " << value;
+    throw std::runtime_error(msg.str());
+  }
+
+  if (size > (std::numeric_limits<size_t>::max() >> shift)) {
+    std::stringstream msg;
+    msg << "The size " << value << " is too large";
+    throw std::runtime_error(msg.str());
+  }
+
+  return static_cast<size_t>(size) << shift;
+}
+
 } // namespace
 
 Config g_config;
@@ -68,14 +137,75 @@ void loadConfig() {
   if (logFile != nullptr)
     g_config.logFile = logFile;
 
+  auto *logQueries = getenv("SYMCC_LOG_QUERIES");
+  if (logQueries != nullptr)
+    g_config.logQueries = checkFlagString(logQueries);
+
+  auto *traceFile = getenv("SYMCC_TRACE_FILE");
+  if (traceFile != nullptr)
+    g_config.traceFile = traceFile;
+
+  auto *traceExpressions = getenv("SYMCC_TRACE_EXPRESSIONS");
+  if (traceExpressions != nullptr)
+    g_config.traceExpressions = checkFlagString(traceExpressions);
+
   auto *pruning = getenv("SYMCC_ENABLE_LINEARIZATION");
   if (pruning != nullptr)
     g_config.pruning = checkFlagString(pruning);
 
+  auto *preSolver = getenv("SYMCC_PRE_SOLVER");
+  if (preSolver != nullptr)
+    g_config.preSolver = checkFlagString(preSolver);
+
   auto *aflCoverageMap = getenv("SYMCC_AFL_COVERAGE_MAP");
   if (aflCoverageMap != nullptr)
     g_config.aflCoverageMap = aflCoverageMap;
 
+  auto *constraintSlicing = getenv("SYMCC_CONSTRAINT_SLICING");
+  if (constraintSlicing != nullptr)
+    g_config.constraintSlicing = checkFlagString(constraintSlicing);
+
+  auto *solverThreads = getenv("SYMCC_SOLVER_THREADS");
+  if (solverThreads != nullptr) {
+    auto threads = parseUnsigned("SYMCC_SOLVER_THREADS", solverThreads);
+    if (threads > 1024)
+      throw std::runtime_error{"SYMCC_SOLVER_THREADS must be at most 1024"};
+    g_config.solverThreads = threads;
+  }
+
+  auto *queryCacheFile = getenv("SYMCC_QUERY_CACHE");
+  if (queryCacheFile != nullptr)
+    g_config.queryCacheFile = queryCacheFile;
+
+  auto *solverTimeout = getenv("SYMCC_SOLVER_TIMEOUT");
+  if (solverTimeout != nullptr) {
+    auto timeout = parseUnsigned("SYMCC_SOLVER_TIMEOUT", solverTimeout);
+    if (timeout == 0 || timeout > std::numeric_limits<unsigned>::max())
+      throw std::runtime_error{
+          "SYMCC_SOLVER_TIMEOUT must be a positive 32-bit number"};
+    g_config.solverTimeout = timeout;
+  }
+
+  auto *solverBudget = getenv("SYMCC_SOLVER_BUDGET");
+  if (solverBudget != nullptr)
+    g_config.solverBudget = parseUnsigned("SYMCC_SOLVER_BUDGET", solverBudget);
+
+  auto *solverStatsFile = getenv("SYMCC_SOLVER_STATS");
+  if (solverStatsFile != nullptr)
+    g_config.solverStatsFile = solverStatsFile;
+
+  auto *statsFile = getenv("SYMCC_STATS");
+  if (statsFile != nullptr)
+    g_config.statsFile = statsFile;
+
+  auto *forkserverSocket = getenv("SYMCC_FORKSERVER");
+  if (forkserverSocket != nullptr)
+    g_config.forkserverSocket = forkserverSocket;
+
+  auto *testCaseRing = getenv("SYMCC_TESTCASE_RING");
+  if (testCaseRing != nullptr)
+    g_config.testCaseRing = testCaseRing;
+
   auto *garbageCollectionThreshold = getenv("SYMCC_GC_THRESHOLD");
   if (garbageCollectionThreshold != nullptr) {
     try {
@@ -92,4 +222,8 @@ void loadConfig() {
       throw std::runtime_error(msg.str());
     }
   }
+
+  auto *memoryLimit = getenv("SYMCC_MEMORY_LIMIT");
+  if (memoryLimit != nullptr)
+    g_config.memoryLimit = parseSize(memoryLimit);
 }
@@ -46,15 +46,58 @@ struct Config {
   /// The file to log constraint solving information to.
   std::string logFile = "";
 
+  /// Do we write the full solver queries and models to the log (simple backend
+  /// only)?
+  bool logQueries = false;
+
+  /// The file receiving the binary trace of path constraints and queries
+  /// (simple backend only); empty to disable (see ConstraintTrace.h).
+  std::string traceFile = "";
+
+  /// Do we include the path constraints and input bytes in the trace, for
+  /// use with symcc-replay?
+  bool traceExpressions = false;
+
   /// Do we prune expressions on hot paths?
   bool pruning = false;
 
+  /// Do we try cheap candidate inputs before querying the solver (QSYM backend
+  /// only)?
+  bool preSolver = false;
+
   /// The AFL coverage map to initialize with.
   ///
   /// Specifying a file name here allows us to track already covered program
   /// locations across multiple program executions.
   std::string aflCoverageMap = "";
 
+  /// Do we pass only the relevant path constraints to the solver (simple
+  /// backend only)?
+  bool constraintSlicing = true;
+
+  /// The number of threads solving queries in the background, or 0 to solve
+  /// them synchronously (simple backend only).
+  unsigned solverThreads = 0;
+
+  /// The file for caching solver results across executions (simple backend
+  /// only); empty to disable caching.
+  std::string queryCacheFile = "";
+
+  /// The timeout for each solver query, in milliseconds (simple backend only).
+  unsigned solverTimeout = 10000;
+
+  /// The total solver time per execution, in milliseconds, or 0 for no limit
+  /// (simple backend only).
+  unsigned long solverBudget = 0;
+
+  /// The file receiving per-site solver statistics at exit (simple backend
+  /// only); empty to disable.
+  std::string solverStatsFile = "";
+
+  /// The file receiving run-time statistics as JSON at exit and on SIGUSR1,
+  /// or empty to disable counting (see Statistics.h).
+  std::string statsFile = "";
+
   /// The garbage collection threshold.
   ///
   /// We will start collecting unused symbolic expressions if the total number
@@ -65,7 +108,24 @@ struct Config {
   /// empirically determined constant is to keep peek memory consumption below
   /// 2GB on most workloads because requiring that amount of memory per core
   /// participating in the analysis seems reasonable.
+  ///
+  /// This is only the initial value; the collector raises the threshold when
+  /// collections don't free much (see GarbageCollection.h).
   size_t garbageCollectionThreshold = 5'000'000;
+
+  /// The Unix socket to serve fork requests on, or empty to run normally (see
+  /// Forkserver.h).
+  std::string forkserverSocket = "";
+
+  /// The shared file to pass new test cases through instead of writing them
+  /// to outputDir, or empty to always write files (see TestCaseRing.h).
+  std::string testCaseRing = "";
+
+  /// The memory budget of the process in bytes, or 0 for no limit.
+  ///
+  /// When set, we sample the resident set size and collect garbage whenever it
+  /// gets close to the limit, regardless of the number of expressions.
+  size_t memoryLimit = 0;
 };
 
 /// The global configuration object.
@@ -0,0 +1,256 @@
+// This file is part of the SymCC runtime.
+//
+// The SymCC runtime is free software: you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// The SymCC runtime is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+// for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with SymCC. If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef EXPRESSIONTABLE_H
+#define EXPRESSIONTABLE_H
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "Threads.h"
+
+/// The value type for expression tables that don't need to associate any data
+/// with the expressions.
+struct NoValue {};
+
+/// A hash table for the registry of expressions that we have handed out to
+/// client code.
+///
+/// Registration happens on every expression that the backends build, so we
+/// want it to be as cheap as possible. The table uses open addressing with
+/// linear probing; keys and values are stored in separate arrays so that
+/// probing only touches the (densely packed) keys. Deletion shifts subsequent
+/// entries back instead of leaving tombstones, which keeps lookups fast after
+/// many garbage collections.
+///
+/// Keys are pointers, and null is reserved to mark empty slots.
+template <typename Key, typename Value = NoValue> class ExpressionTable {
+  static_assert(std::is_pointer_v<Key>, "Expression tables map pointers");
+
+public:
+  ExpressionTable() { allocate(kInitialCapacity); }
+  ExpressionTable(const ExpressionTable &) = delete;
+  ExpressionTable &operator=(const ExpressionTable &) = delete;
+
+  size_t size() const { return size_; }
+
+  /// Insert a new entry; return false (and leave the table unmodified) if
+  /// there is an entry for the key already.
+  ///
+  /// The value is moved into the table, so callers that pass a temporary hand
+  /// over ownership without copying (which, for reference-counted values,
+  /// saves a pair of atomic updates per registration).
+  bool insert(Key key, Value value = {}) {
+    assert(key != nullptr && "Null can't be used as a key");
+    auto slot = find(key);
+    if (keys_[slot] == key)
+      return false;
+
+    keys_[slot] = key;
+    values_[slot] = std::move(value);
+    size_++;
+
+    if (size_ * kMaxLoadDenominator > capacity() * kMaxLoadNumerator)
+      rehash(capacity() * 2);
+    return true;
+  }
+
+  bool contains(Key key) const { return keys_[find(key)] == key; }
+
+  /// Look up the value for a key, which must be in the table.
+  const Value &at(Key key) const {
+    auto slot = find(key);
+    if (keys_[slot] != key)
+      throw std::out_of_range("Unknown expression");
+    return values_[slot];
+  }
+
+  /// Remove the entry for a key, if any.
+  bool erase(Key key) {
+    auto slot = find(key);
+    if (keys_[slot] != key)
+      return false;
+
+    // Shift back the entries that follow in the same cluster if the removed
+    // slot is on their probe path.
+    auto mask = capacity() - 1;
+    for (auto next = (slot + 1) & mask; keys_[next] != nullptr;
+         next = (next + 1) & mask) {
+      auto home = indexOf(keys_[next]);
+      bool slotOnPath = (slot <= next) ? (home <= slot || home > next)
+                                       : (home <= slot && home > next);
+      if (slotOnPath) {
+        keys_[slot] = keys_[next];
+        values_[slot] = std::move(values_[next]);
+        slot = next;
+      }
+    }
+
+    keys_[slot] = nullptr;
+    values_[slot] = Value{};
+    size_--;
+    return true;
+  }
+
+  /// Remove all entries except the ones for the given keys and return the
+  /// number of removed entries. Keys that aren't in the table are ignored.
+  ///
+  /// This is the sweep phase of a full garbage collection: looking up the
+  /// (usually few) reachable expressions is much cheaper than testing every
+  /// entry of the table for reachability. For large sets of survivors, the
+  /// lookups run concurrently on several threads; values are only ever moved
+  /// and destroyed on the calling thread. The helper threads are the
+  /// runtime's own, so they don't make the program multithreaded.
+  size_t retainOnly(const std::vector<Key> &survivors) {
+    return retainOnly(survivors, [](Key) {});
+  }
+
+  /// Like retainOnly above, but call the given function on each removed key.
+  template <typename F>
+  size_t retainOnly(const std::vector<Key> &survivors, F &&onRemove) {
+    std::vector<size_t> survivorSlots(survivors.size());
+    auto lookUp = [&](size_t begin, size_t end) {
+      for (auto i = begin; i < end; i++) {
+        auto slot = find(survivors[i]);
+        survivorSlots[i] =
+            (keys_[slot] == survivors[i]) ? slot : kNotFound;
+      }
+    };
+
+    auto threads = std::min<size_t>(std::thread::hardware_concurrency(),
+                                    kMaxSweepThreads);
+    if (survivors.size() < kParallelSweepThreshold || threads < 2) {
+      lookUp(0, survivors.size());
+    } else {
+      InternalThreadCreation internal;
+      std::vector<std::thread> workers;
+      auto chunk = survivors.size() / threads;
+      for (size_t i = 0; i < threads; i++) {
+        auto end = (i == threads - 1) ? survivors.size() : (i + 1) * chunk;
+        workers.emplace_back(lookUp, i * chunk, end);
+      }
+      for (auto &worker : workers)
+        worker.join();
+    }
+
+    auto oldKeys = std::move(keys_);
+    auto oldValues = std::move(values_);
+    auto oldSize = size_;
+    auto oldCapacity = capacity();
+
+    auto newCapacity = kInitialCapacity;
+    while (survivors.size() * kMaxLoadDenominator >
+           newCapacity * kMaxLoadNumerator / 2)
+      newCapacity *= 2;
+    allocate(newCapacity);
+
+    for (size_t i = 0; i < survivors.size(); i++) {
+      auto slot = survivorSlots[i];
+      if (slot != kNotFound && oldKeys[slot] != nullptr) {
+        moveIn(oldKeys[slot], std::move(oldValues[slot]));
+        // Guard against duplicates in the list of survivors.
+        oldKeys[slot] = nullptr;
+      }
+    }
+
+    // Only the removed keys are left in the old table.
+    for (size_t slot = 0; slot < oldCapacity; slot++) {
+      if (oldKeys[slot] != nullptr)
+        onRemove(oldKeys[slot]);
+    }
+
+    return oldSize - size_;
+  }
+
+  /// Call the given function on every key in the table.
+  template <typename F> void forEachKey(F &&f) const {
+    for (size_t slot = 0; slot < capacity(); slot++) {
+      if (keys_[slot] != nullptr)
+        f(keys_[slot]);
+    }
+  }
+
+private:
+  static constexpr size_t kInitialCapacity = 1024;
+  static constexpr size_t kMaxLoadNumerator = 1;
+  static constexpr size_t kMaxLoadDenominator = 2;
+  static constexpr size_t kParallelSweepThreshold = size_t(1) << 16;
+  static constexpr size_t kNotFound = ~size_t(0);
+  static constexpr size_t kMaxSweepThreads = 8;
+
+  size_t capacity() const { return mask_ + 1; }
+
+  size_t indexOf(Key key) const {
+    // Fibonacci hashing: the multiplication mixes the (mostly aligned) pointer
+    // bits into the high bits of the product, which we use as the index.
+    return (uint64_t(reinterpret_cast<uintptr_t>(key)) *
+            11400714819323198485llu) >>
+           shift_;
+  }
+
+  /// Find the slot holding the given key, or the empty slot where it would be
+  /// inserted.
+  size_t find(Key key) const {
+    auto slot = indexOf(key);
+    while (keys_[slot] != nullptr && keys_[slot] != key)
+      slot = (slot + 1) & mask_;
+    return slot;
+  }
+
+  void allocate(size_t capacity) {
+    assert((capacity & (capacity - 1)) == 0 && "Capacity must be a power of 2");
+    keys_.reset(new Key[capacity]());
+    values_.reset(new Value[capacity]());
+    mask_ = capacity - 1;
+    shift_ = 64 - __builtin_ctzll(capacity);
+    size_ = 0;
+  }
+
+  /// Insert an entry whose key is known not to be in the table, without
+  /// checking the load factor.
+  void moveIn(Key key, Value &&value) {
+    auto slot = find(key);
+    keys_[slot] = key;
+    values_[slot] = std::move(value);
+    size_++;
+  }
+
+  void rehash(size_t newCapacity) {
+    auto oldKeys = std::move(keys_);
+    auto oldValues = std::move(values_);
+    auto oldCapacity = capacity();
+    allocate(newCapacity);
+
+    for (size_t slot = 0; slot < oldCapacity; slot++) {
+      if (oldKeys[slot] != nullptr)
+        moveIn(oldKeys[slot], std::move(oldValues[slot]));
+    }
+  }
+
+  std::unique_ptr<Key[]> keys_;
+  std::unique_ptr<Value[]> values_;
+  size_t mask_;
+  unsigned shift_;
+  size_t size_;
+};
+
+#endif
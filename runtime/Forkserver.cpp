@@ -0,0 +1,157 @@
+// This file is part of the SymCC runtime.
+//
+// The SymCC runtime is free software: you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// The SymCC runtime is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+// for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with the SymCC runtime. If not, see <https://www.gnu.org/licenses/>.
+
+#include "Forkserver.h"
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "Config.h"
+
+namespace {
+
+/// Read exactly the requested number of bytes; returns false on EOF or error.
+bool readAll(int fd, void *buffer, size_t size) {
+  auto *bytes = static_cast<char *>(buffer);
+  while (size > 0) {
+    auto result = read(fd, bytes, size);
+    if (result < 0 && errno == EINTR)
+      continue;
+    if (result <= 0)
+      return false;
+    bytes += result;
+    size -= result;
+  }
+  return true;
+}
+
+bool writeAll(int fd, const void *buffer, size_t size) {
+  auto *bytes = static_cast<const char *>(buffer);
+  while (size > 0) {
+    auto result = write(fd, bytes, size);
+    if (result < 0 && errno == EINTR)
+      continue;
+    if (result <= 0)
+      return false;
+    bytes += result;
+    size -= result;
+  }
+  return true;
+}
+
+bool readUint32(int fd, uint32_t &value) {
+  uint8_t bytes[4];
+  if (!readAll(fd, bytes, sizeof(bytes)))
+    return false;
+  value = bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) |
+          (uint32_t(bytes[3]) << 24);
+  return true;
+}
+
+bool writeUint32(int fd, uint32_t value) {
+  uint8_t bytes[4] = {uint8_t(value), uint8_t(value >> 8),
+                      uint8_t(value >> 16), uint8_t(value >> 24)};
+  return writeAll(fd, bytes, sizeof(bytes));
+}
+
+bool readString(int fd, std::string &value) {
+  uint32_t length;
+  if (!readUint32(fd, length) || length > 4096)
+    return false;
+  value.resize(length);
+  return readAll(fd, value.data(), length);
+}
+
+int connectToHelper(const std::string &path) {
+  sockaddr_un address{};
+  address.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(address.sun_path))
+    throw std::runtime_error("The fork-server socket path " + path +
+                             " is too long");
+  strcpy(address.sun_path, path.c_str());
+
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0 ||
+      connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0)
+    throw std::runtime_error("Failed to connect to the fork-server socket " +
+                             path + ": " + strerror(errno));
+  return fd;
+}
+
+/// Replace the given file descriptor with a newly opened file.
+void redirect(int target, const std::string &path, int flags) {
+  if (path.empty())
+    return;
+
+  int fd = open(path.c_str(), flags, 0644);
+  if (fd < 0) {
+    fprintf(stderr, "Fork server: failed to open %s: %s\n", path.c_str(),
+            strerror(errno));
+    _exit(-1);
+  }
+  dup2(fd, target);
+  close(fd);
+}
+
+} // namespace
+
+void runForkserver() {
+  if (g_config.forkserverSocket.empty())
+    return;
+
+  int helper = connectToHelper(g_config.forkserverSocket);
+
+  while (true) {
+    std::string stdinFile, stderrFile;
+    if (!readString(helper, stdinFile) || !readString(helper, stderrFile))
+      _exit(0);
+
+    // Output buffered so far would otherwise be duplicated in every child.
+    fflush(nullptr);
+
+    auto child = fork();
+    if (child < 0) {
+      fprintf(stderr, "Fork server: fork failed: %s\n", strerror(errno));
+      _exit(-1);
+    }
+
+    if (child == 0) {
+      close(helper);
+      redirect(STDIN_FILENO, stdinFile, O_RDONLY);
+      redirect(STDERR_FILENO, stderrFile, O_WRONLY | O_CREAT | O_TRUNC);
+      return;
+    }
+
+    int status;
+    if (!writeUint32(helper, child))
+      _exit(0);
+    while (waitpid(child, &status, 0) < 0) {
+      if (errno != EINTR)
+        _exit(-1);
+    }
+    if (!writeUint32(helper, status))
+      _exit(0);
+  }
+}
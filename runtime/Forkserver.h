@@ -0,0 +1,39 @@
+// This file is part of the SymCC runtime.
+//
+// The SymCC runtime is free software: you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// The SymCC runtime is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+// for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with the SymCC runtime. If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef FORKSERVER_H
+#define FORKSERVER_H
+
+/// Run the fork server if one is configured.
+///
+/// Initializing the runtime (and the target's dynamic loading) costs
+/// considerable time on every execution. In fork-server mode, the process stops
+/// after initialization and connects to the Unix socket named in
+/// g_config.forkserverSocket; for each request that it receives there, it
+/// forks a child that runs the program on the next input, reports the child's
+/// PID, and finally the child's wait status. The function returns only in the
+/// children; the server exits when the socket is closed.
+///
+/// Each request consists of two strings, each preceded by its length as a
+/// 32-bit little-endian integer: the file to use as the child's standard input
+/// and the file to redirect its standard error to (either may be empty to keep
+/// the server's). Responses are 32-bit little-endian integers.
+///
+/// The backend must call this before starting any threads, since only the
+/// calling thread survives the fork. Throws std::runtime_error if the server
+/// can't connect to the socket.
+void runForkserver();
+
+#endif
@@ -15,11 +15,17 @@
 
 #include "GarbageCollection.h"
 
+#include <algorithm>
+#include <cstdio>
 #include <vector>
 
+#include <unistd.h>
+
 #include <Runtime.h>
 #include <Shadow.h>
 
+#include "Config.h"
+
 /// A list of memory regions that are known to contain symbolic expressions.
 std::vector<ExpressionRegion> expressionRegions;
 
@@ -27,13 +33,13 @@ void registerExpressionRegion(ExpressionRegion r) {
   expressionRegions.push_back(std::move(r));
 }
 
-std::set<SymExpr> collectReachableExpressions() {
-  std::set<SymExpr> reachableExpressions;
+std::vector<SymExpr> collectReachableExpressions(bool fullCollection) {
+  std::vector<SymExpr> reachableExpressions;
   auto collectReachableExpressions = [&](ExpressionRegion r) {
     auto *end = r.first + r.second;
     for (SymExpr *expr_ptr = r.first; expr_ptr < end; expr_ptr++) {
       if (*expr_ptr != nullptr) {
-        reachableExpressions.insert(*expr_ptr);
+        reachableExpressions.push_back(*expr_ptr);
       }
     }
   };
@@ -42,9 +48,129 @@ std::set<SymExpr> collectReachableExpressions() {
     collectReachableExpressions(r);
   }
 
-  for (const auto &mapping : g_shadow_pages) {
-    collectReachableExpressions({mapping.second, kPageSize});
+  auto collectFromPage = [&](const ShadowPage *page) {
+    page->forEachSymbolicByte([&](size_t, SymExpr expr) {
+      reachableExpressions.push_back(expr);
+    });
+  };
+
+  // The saved shadow comes back into use when the snapshot is restored.
+  for (auto &page : shadowSnapshot())
+    collectFromPage(&page);
+
+  // The collector runs at a point where no shadow iterators are live, so it's a
+  // good opportunity to get rid of shadow pages that became concrete.
+  dropEmptyShadowPages(!fullCollection);
+  if (fullCollection) {
+    g_shadow_pages.forEach(
+        [&](uintptr_t, const ShadowPage *page) { collectFromPage(page); });
+  } else {
+    for (auto *page : g_modified_shadow_pages) {
+      // Skip pages that have been dropped in the meantime.
+      if (g_shadow_pages.find(page->address) == page)
+        collectFromPage(page);
+    }
   }
 
+  for (auto *page : g_modified_shadow_pages)
+    page->modified = false;
+  g_modified_shadow_pages.clear();
+
+  std::sort(reachableExpressions.begin(), reachableExpressions.end());
+  reachableExpressions.erase(
+      std::unique(reachableExpressions.begin(), reachableExpressions.end()),
+      reachableExpressions.end());
   return reachableExpressions;
 }
+
+namespace {
+
+/// How often we sample the resident set size, in calls to the policy.
+constexpr unsigned kMemorySamplingInterval = 1024;
+
+/// The fraction of the memory limit (in percent) that we consider "close".
+constexpr size_t kMemoryPressurePercent = 80;
+
+/// A collection that frees less than this percentage of the expressions
+/// reclaims "little".
+constexpr size_t kMinReclaimedPercent = 50;
+
+/// The current collection threshold; 0 until the first decision.
+size_t g_collection_threshold = 0;
+
+/// The number of expressions that survived the last collection.
+size_t g_survivors = 0;
+
+unsigned g_calls_since_sample = 0;
+
+/// Return the resident set size of the process in bytes, or 0 if we can't
+/// determine it.
+size_t residentSetSize() {
+  static const size_t pageSize = sysconf(_SC_PAGESIZE);
+
+  // The second field of statm is the number of resident pages.
+  FILE *statm = fopen("/proc/self/statm", "r");
+  if (statm == nullptr)
+    return 0;
+
+  unsigned long size, resident;
+  int fields = fscanf(statm, "%lu %lu", &size, &resident);
+  fclose(statm);
+  return (fields == 2) ? resident * pageSize : 0;
+}
+
+bool underMemoryPressure() {
+  if (g_config.memoryLimit == 0)
+    return false;
+
+  return residentSetSize() >=
+         g_config.memoryLimit / 100 * kMemoryPressurePercent;
+}
+
+} // namespace
+
+CollectionKind garbageCollectionDue(size_t allExpressions,
+                                    size_t youngExpressions) {
+  if (g_collection_threshold == 0)
+    g_collection_threshold = std::max<size_t>(
+        g_config.garbageCollectionThreshold, 1);
+
+  if (allExpressions >= g_collection_threshold) {
+    // If old expressions take up a large part of the budget, sweeping just the
+    // young ones won't free enough.
+    return ((allExpressions - youngExpressions) >= g_collection_threshold / 2)
+               ? CollectionKind::Full
+               : CollectionKind::Minor;
+  }
+
+  if (g_config.memoryLimit == 0 ||
+      ++g_calls_since_sample < kMemorySamplingInterval)
+    return CollectionKind::None;
+  g_calls_since_sample = 0;
+
+  // Memory that we've freed isn't necessarily returned to the system, so the
+  // resident set size may stay high after a collection. Don't bother
+  // collecting again unless there is a reasonable amount of new garbage.
+  if (allExpressions < g_survivors + g_survivors / 8 + 1024)
+    return CollectionKind::None;
+
+  // The young generation is typically small compared to the old one when we
+  // run out of memory, so only a full collection can help.
+  return underMemoryPressure() ? CollectionKind::Full : CollectionKind::None;
+}
+
+void garbageCollectionFinished(size_t expressionsBefore,
+                               size_t expressionsAfter) {
+  g_survivors = expressionsAfter;
+  g_calls_since_sample = 0;
+
+  auto reclaimed = expressionsBefore - expressionsAfter;
+  if (reclaimed >= expressionsBefore / 100 * kMinReclaimedPercent)
+    return;
+
+  // The threshold needs to stay well above the number of live expressions, or
+  // we'll collect all the time.
+  if (expressionsAfter * 2 > g_collection_threshold && !underMemoryPressure())
+    g_collection_threshold =
+        std::max(g_collection_threshold * 2, expressionsAfter * 2);
+}
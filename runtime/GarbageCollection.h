@@ -17,7 +17,7 @@
 #define GARBAGECOLLECTION_H
 
 #include <utility>
-#include <set>
+#include <vector>
 
 #include <Runtime.h>
 
@@ -29,7 +29,41 @@ using ExpressionRegion = std::pair<SymExpr *, size_t>;
 /// expressions.
 void registerExpressionRegion(ExpressionRegion r);
 
-/// Return the set of currently reachable symbolic expressions.
-std::set<SymExpr> collectReachableExpressions();
+/// Return the currently reachable symbolic expressions, sorted and without
+/// duplicates.
+///
+/// We collect garbage generationally: most expressions are short-lived, so it
+/// usually suffices to sweep the "young" ones, i.e., the expressions that have
+/// been registered since the last collection. A minor collection only looks at
+/// the registered expression regions and the shadow pages that have been
+/// modified since the last collection (which is where any reference to a young
+/// expression must be); the result contains all reachable young expressions
+/// but may miss old ones, so only young expressions may be swept. A full
+/// collection considers all roots.
+std::vector<SymExpr> collectReachableExpressions(bool fullCollection);
+
+/// The kinds of garbage collection.
+enum class CollectionKind { None, Minor, Full };
+
+/// Decide whether to collect garbage now and which kind of collection to run,
+/// given the total number of registered expressions and the number of young
+/// ones among them.
+///
+/// The decision is cheap enough to be made very frequently. We collect when
+/// the number of expressions exceeds a threshold that starts at
+/// g_config.garbageCollectionThreshold; if a memory limit is configured, we
+/// additionally sample the resident set size and run a full collection when it
+/// approaches the limit.
+CollectionKind garbageCollectionDue(size_t allExpressions,
+                                    size_t youngExpressions);
+
+/// Let the collection policy know how many expressions a collection left
+/// alive.
+///
+/// If a collection reclaims little, most expressions are genuinely live, and
+/// collecting again at the same threshold would just waste time; we therefore
+/// raise the threshold unless we're close to the memory limit.
+void garbageCollectionFinished(size_t expressionsBefore,
+                               size_t expressionsAfter);
 
 #endif
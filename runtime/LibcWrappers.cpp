@@ -29,12 +29,16 @@
 // matching the libc function's semantics, and finally return the wrapped
 // function's result.
 
+#include <algorithm>
 #include <cassert>
+#include <cstdint>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <iostream>
 #include <string>
+#include <tuple>
+#include <utility>
 #include <variant>
 #include <vector>
 
@@ -46,6 +50,7 @@
 
 #include "Config.h"
 #include "Shadow.h"
+#include "Threads.h"
 #include <Runtime.h>
 
 #define SYM(x) x##_symbolized
@@ -58,6 +63,10 @@ int inputFileDescriptor = -1;
 /// The current position in the (symbolic) input.
 uint64_t inputOffset = 0;
 
+/// The input state saved by snapshotInputState.
+int savedInputFileDescriptor = -1;
+uint64_t savedInputOffset = 0;
+
 /// Tell the solver to try an alternative value than the given one.
 template <typename V, typename F>
 void tryAlternative(V value, SymExpr valueExpr, F caller) {
@@ -75,6 +84,178 @@ void tryAlternative(E *value, SymExpr valueExpr, F caller) {
   tryAlternative(reinterpret_cast<intptr_t>(value), valueExpr, caller);
 }
 
+/// Add a term to a conjunction, which is null if it doesn't have any terms yet.
+SymExpr buildAnd(SymExpr conjunction, SymExpr term) {
+  return conjunction ? _sym_build_bool_and(conjunction, term) : term;
+}
+
+/// Call the given function with the position and the expressions of each byte
+/// where at least one of the two memory regions is symbolic, in ascending
+/// order. For the concrete side, if any, the expression is a constant.
+template <typename F>
+void forEachSymbolicPair(const void *a, const void *b, size_t n, F &&f) {
+  std::vector<std::pair<size_t, SymExpr>> aBytes, bBytes;
+  forEachSymbolicByte(a, n, [&](size_t position, SymExpr expr) {
+    aBytes.emplace_back(position, expr);
+  });
+  forEachSymbolicByte(b, n, [&](size_t position, SymExpr expr) {
+    bBytes.emplace_back(position, expr);
+  });
+
+  auto *aData = static_cast<const uint8_t *>(a);
+  auto *bData = static_cast<const uint8_t *>(b);
+  for (auto aIt = aBytes.begin(), bIt = bBytes.begin();
+       aIt != aBytes.end() || bIt != bBytes.end();) {
+    auto aPosition = (aIt != aBytes.end()) ? aIt->first : n;
+    auto bPosition = (bIt != bBytes.end()) ? bIt->first : n;
+    auto position = std::min(aPosition, bPosition);
+
+    auto *aExpr = (aPosition == position)
+                      ? (aIt++)->second
+                      : _sym_build_integer(aData[position], 8);
+    auto *bExpr = (bPosition == position)
+                      ? (bIt++)->second
+                      : _sym_build_integer(bData[position], 8);
+    f(position, aExpr, bExpr);
+  }
+}
+
+/// Build an expression that is true if and only if the two memory regions are
+/// equal, or return null if the comparison doesn't depend on symbolic data.
+///
+/// Only positions where at least one of the regions is symbolic contribute to
+/// the expression. If the concrete bytes differ anywhere else, the regions are
+/// unequal no matter what the symbolic bytes are, so we don't build anything.
+SymExpr buildRegionsEqual(const void *a, const void *b, size_t n) {
+  auto *aData = static_cast<const uint8_t *>(a);
+  auto *bData = static_cast<const uint8_t *>(b);
+  SymExpr allEqual = nullptr;
+  size_t concreteStart = 0;
+  bool concreteMismatch = false;
+  forEachSymbolicPair(a, b, n,
+                      [&](size_t position, SymExpr aExpr, SymExpr bExpr) {
+                        concreteMismatch |=
+                            memcmp(aData + concreteStart, bData + concreteStart,
+                                   position - concreteStart) != 0;
+                        concreteStart = position + 1;
+                        if (!concreteMismatch)
+                          allEqual = buildAnd(allEqual,
+                                              _sym_build_equal(aExpr, bExpr));
+                      });
+
+  if (concreteMismatch || memcmp(aData + concreteStart, bData + concreteStart,
+                                 n - concreteStart) != 0)
+    return nullptr;
+
+  return allEqual;
+}
+
+/// Build a constraint describing the outcome of a search for a character in
+/// the first length bytes of data: all bytes differ from the character, except
+/// for the last one if the search found it. The character's expression is
+/// null if it's concrete. Return null if the outcome doesn't depend on symbolic
+/// data.
+///
+/// In contrast to pushing one constraint per examined byte, this results in a
+/// single solver query whose negation covers all other outcomes.
+SymExpr buildSearchConstraint(const void *data, size_t length, bool found,
+                              uint8_t c, SymExpr cExpr) {
+  SymExpr constraint = nullptr;
+  auto addTerm = [&](size_t position, SymExpr byteExpr) {
+    constraint = buildAnd(constraint,
+                          (found && position == length - 1)
+                              ? _sym_build_equal(byteExpr, cExpr)
+                              : _sym_build_not_equal(byteExpr, cExpr));
+  };
+
+  if (cExpr == nullptr) {
+    // Concrete bytes are known to compare correctly with a concrete character.
+    if (isConcrete(data, length))
+      return nullptr;
+
+    cExpr = _sym_build_integer(c, 8);
+    forEachSymbolicByte(data, length, addTerm);
+    return constraint;
+  }
+
+  // With a symbolic character, every byte matters, but each concrete value
+  // only needs to be excluded once.
+  auto *bytes = static_cast<const uint8_t *>(data);
+  bool excluded[256] = {};
+  auto shadow = ReadOnlyShadow(data, length);
+  auto shadowIt = shadow.begin();
+  for (size_t i = 0; i < length; i++, ++shadowIt) {
+    auto *byteExpr = *shadowIt;
+    if (byteExpr == nullptr) {
+      bool isMatch = found && i == length - 1;
+      if (!isMatch && excluded[bytes[i]])
+        continue;
+      if (!isMatch)
+        excluded[bytes[i]] = true;
+      byteExpr = _sym_build_integer(bytes[i], 8);
+    }
+
+    addTerm(i, byteExpr);
+  }
+
+  return constraint;
+}
+
+/// Compare two strings like strncmp and build the expression of the result.
+///
+/// The result is the difference between the first differing characters (or
+/// zero), which has the sign that the C standard requires. Its expression is a
+/// lexicographic comparison: a chain of if-then-else over the symbolic
+/// positions up to where the concrete comparison stopped, falling back to the
+/// concrete outcome. Concrete positions before that point are equal by
+/// definition, so they don't show up in the expression.
+int compareStrings(const char *a, const char *b, size_t n, SymExpr &resultExpr) {
+  auto *aData = reinterpret_cast<const uint8_t *>(a);
+  auto *bData = reinterpret_cast<const uint8_t *>(b);
+  size_t stop = 0;
+  while (stop < n && aData[stop] == bData[stop] && aData[stop] != 0)
+    stop++;
+  int result = (stop < n) ? aData[stop] - bData[stop] : 0;
+
+  auto difference = [](SymExpr x, SymExpr y) {
+    constexpr uint8_t kExtension = sizeof(int) * 8 - 8;
+    return _sym_build_sub(_sym_build_zext(x, kExtension),
+                          _sym_build_zext(y, kExtension));
+  };
+
+  std::vector<std::tuple<size_t, SymExpr, SymExpr>> pairs;
+  forEachSymbolicPair(a, b, std::min(stop + 1, n),
+                      [&](size_t position, SymExpr aExpr, SymExpr bExpr) {
+                        pairs.emplace_back(position, aExpr, bExpr);
+                      });
+  if (pairs.empty()) {
+    resultExpr = nullptr;
+    return result;
+  }
+
+  SymExpr tail;
+  if (auto &[position, aExpr, bExpr] = pairs.back(); position == stop) {
+    tail = difference(aExpr, bExpr);
+    pairs.pop_back();
+  } else {
+    tail = _sym_build_integer(result, sizeof(int) * 8);
+  }
+
+  for (auto it = pairs.rbegin(); it != pairs.rend(); ++it) {
+    auto &[position, aExpr, bExpr] = *it;
+    tail = _sym_build_ite(_sym_build_not_equal(aExpr, bExpr),
+                          difference(aExpr, bExpr), tail);
+  }
+
+  resultExpr = tail;
+  return result;
+}
+
+/// The maximum number of byte comparisons that we spend on the constraint for
+/// an unsuccessful strstr. Beyond this, the solver query becomes too large to
+/// be useful.
+constexpr size_t kMaxSearchComparisons = 1 << 16;
+
 void maybeSetInputFile(const char *path, int fd) {
   auto *fileInput = std::get_if<FileInput>(&g_config.input);
   if (fileInput == nullptr)
@@ -101,8 +282,21 @@ void initLibcWrappers() {
   }
 }
 
+void snapshotInputState() {
+  savedInputFileDescriptor = inputFileDescriptor;
+  savedInputOffset = inputOffset;
+}
+
+void restoreInputState() {
+  inputFileDescriptor = savedInputFileDescriptor;
+  inputOffset = savedInputOffset;
+}
+
 extern "C" {
 
+// The wrappers take the runtime lock (see Threads.h) only after calling the
+// wrapped function, which may block.
+
 void *SYM(malloc)(size_t size) {
   auto *result = malloc(size);
 
@@ -128,6 +322,7 @@ void *SYM(calloc)(size_t nmemb, size_t size) {
 void *SYM(mmap64)(void *addr, size_t len, int prot, int flags, int fildes,
                   uint64_t off) {
   auto *result = mmap64(addr, len, prot, flags, fildes, off);
+  RuntimeLock lock;
   _sym_set_return_expression(nullptr);
 
   if (result == MAP_FAILED) // mmap failed
@@ -141,11 +336,7 @@ void *SYM(mmap64)(void *addr, size_t len, int prot, int flags, int fildes,
      */
     inputOffset = off + len;
     // Reading symbolic input.
-    ReadWriteShadow shadow(result, len);
-    uint8_t *resultBytes = (uint8_t *)result;
-    std::generate(shadow.begin(), shadow.end(), [resultBytes, i = 0]() mutable {
-      return _sym_get_input_byte(inputOffset, resultBytes[i++]);
-    });
+    _sym_make_symbolic(result, len, off);
   } else if (!isConcrete(result, len)) {
     ReadWriteShadow shadow(result, len);
     std::fill(shadow.begin(), shadow.end(), nullptr);
@@ -163,6 +354,7 @@ void *SYM(mmap)(void *addr, size_t len, int prot, int flags, int fildes,
 
 int SYM(open)(const char *path, int oflag, mode_t mode) {
   auto result = open(path, oflag, mode);
+  RuntimeLock lock;
   _sym_set_return_expression(nullptr);
 
   if (result >= 0)
@@ -176,6 +368,7 @@ ssize_t SYM(read)(int fildes, void *buf, size_t nbyte) {
   tryAlternative(nbyte, _sym_get_parameter_expression(2), SYM(read));
 
   auto result = read(fildes, buf, nbyte);
+  RuntimeLock lock;
   _sym_set_return_expression(nullptr);
 
   if (result < 0)
@@ -209,6 +402,7 @@ ssize_t SYM(read)(int fildes, void *buf, size_t nbyte) {
 
 uint64_t SYM(lseek64)(int fd, uint64_t offset, int whence) {
   auto result = lseek64(fd, offset, whence);
+  RuntimeLock lock;
   _sym_set_return_expression(nullptr);
   if (result == (off_t)-1)
     return result;
@@ -237,6 +431,7 @@ uint32_t SYM(lseek)(int fd, uint32_t offset, int whence) {
 
 FILE *SYM(fopen)(const char *pathname, const char *mode) {
   auto *result = fopen(pathname, mode);
+  RuntimeLock lock;
   _sym_set_return_expression(nullptr);
 
   if (result != nullptr)
@@ -247,6 +442,7 @@ FILE *SYM(fopen)(const char *pathname, const char *mode) {
 
 FILE *SYM(fopen64)(const char *pathname, const char *mode) {
   auto *result = fopen64(pathname, mode);
+  RuntimeLock lock;
   _sym_set_return_expression(nullptr);
 
   if (result != nullptr)
@@ -261,6 +457,7 @@ size_t SYM(fread)(void *ptr, size_t size, size_t nmemb, FILE *stream) {
   tryAlternative(nmemb, _sym_get_parameter_expression(2), SYM(fread));
 
   auto result = fread(ptr, size, nmemb, stream);
+  RuntimeLock lock;
   _sym_set_return_expression(nullptr);
 
   if (fileno(stream) == inputFileDescriptor) {
@@ -280,6 +477,7 @@ char *SYM(fgets)(char *str, int n, FILE *stream) {
   tryAlternative(n, _sym_get_parameter_expression(1), SYM(fgets));
 
   auto result = fgets(str, n, stream);
+  RuntimeLock lock;
   _sym_set_return_expression(_sym_get_parameter_expression(0));
 
   if (fileno(stream) == inputFileDescriptor) {
@@ -297,6 +495,7 @@ char *SYM(fgets)(char *str, int n, FILE *stream) {
 
 void SYM(rewind)(FILE *stream) {
   rewind(stream);
+  RuntimeLock lock;
   _sym_set_return_expression(nullptr);
 
   if (fileno(stream) == inputFileDescriptor) {
@@ -308,6 +507,7 @@ int SYM(fseek)(FILE *stream, long offset, int whence) {
   tryAlternative(offset, _sym_get_parameter_expression(1), SYM(fseek));
 
   auto result = fseek(stream, offset, whence);
+  RuntimeLock lock;
   _sym_set_return_expression(nullptr);
   if (result == -1)
     return result;
@@ -326,6 +526,7 @@ int SYM(fseeko)(FILE *stream, off_t offset, int whence) {
   tryAlternative(offset, _sym_get_parameter_expression(1), SYM(fseeko));
 
   auto result = fseeko(stream, offset, whence);
+  RuntimeLock lock;
   _sym_set_return_expression(nullptr);
   if (result == -1)
     return result;
@@ -344,6 +545,7 @@ int SYM(fseeko64)(FILE *stream, uint64_t offset, int whence) {
   tryAlternative(offset, _sym_get_parameter_expression(1), SYM(fseeko64));
 
   auto result = fseeko64(stream, offset, whence);
+  RuntimeLock lock;
   _sym_set_return_expression(nullptr);
   if (result == -1)
     return result;
@@ -360,6 +562,7 @@ int SYM(fseeko64)(FILE *stream, uint64_t offset, int whence) {
 
 int SYM(getc)(FILE *stream) {
   auto result = getc(stream);
+  RuntimeLock lock;
   if (result == EOF) {
     _sym_set_return_expression(nullptr);
     return result;
@@ -376,6 +579,7 @@ int SYM(getc)(FILE *stream) {
 
 int SYM(fgetc)(FILE *stream) {
   auto result = fgetc(stream);
+  RuntimeLock lock;
   if (result == EOF) {
     _sym_set_return_expression(nullptr);
     return result;
@@ -394,6 +598,7 @@ int SYM(getchar)(void) { return SYM(getc)(stdin); }
 
 int SYM(ungetc)(int c, FILE *stream) {
   auto result = ungetc(c, stream);
+  RuntimeLock lock;
   _sym_set_return_expression(_sym_get_parameter_expression(0));
 
   if (fileno(stream) == inputFileDescriptor && result != EOF)
@@ -404,6 +609,7 @@ int SYM(ungetc)(int c, FILE *stream) {
 
 void *SYM(memcpy)(void *dest, const void *src, size_t n) {
   auto *result = memcpy(dest, src, n);
+  RuntimeLock lock;
 
   tryAlternative(dest, _sym_get_parameter_expression(0), SYM(memcpy));
   tryAlternative(src, _sym_get_parameter_expression(1), SYM(memcpy));
@@ -417,6 +623,7 @@ void *SYM(memcpy)(void *dest, const void *src, size_t n) {
 
 void *SYM(memset)(void *s, int c, size_t n) {
   auto *result = memset(s, c, n);
+  RuntimeLock lock;
 
   tryAlternative(s, _sym_get_parameter_expression(0), SYM(memset));
   tryAlternative(n, _sym_get_parameter_expression(2), SYM(memset));
@@ -428,6 +635,7 @@ void *SYM(memset)(void *s, int c, size_t n) {
 
 void SYM(bzero)(void *s, size_t n) {
   bzero(s, n);
+  RuntimeLock lock;
 
   // No return value, hence no corresponding expression.
   _sym_set_return_expression(nullptr);
@@ -446,6 +654,7 @@ void *SYM(memmove)(void *dest, const void *src, size_t n) {
   tryAlternative(n, _sym_get_parameter_expression(2), SYM(memmove));
 
   auto *result = memmove(dest, src, n);
+  RuntimeLock lock;
   _sym_memmove(static_cast<uint8_t *>(dest), static_cast<const uint8_t *>(src),
                n);
 
@@ -459,6 +668,7 @@ void SYM(bcopy)(const void *src, void *dest, size_t n) {
   tryAlternative(n, _sym_get_parameter_expression(2), SYM(bcopy));
 
   bcopy(src, dest, n);
+  RuntimeLock lock;
 
   // bcopy is mostly equivalent to memmove, so we can use our symbolic version
   // of memmove to copy any symbolic expressions over to the destination.
@@ -475,6 +685,7 @@ char *SYM(strncpy)(char *dest, const char *src, size_t n) {
   tryAlternative(n, _sym_get_parameter_expression(2), SYM(strncpy));
 
   auto *result = strncpy(dest, src, n);
+  RuntimeLock lock;
   _sym_set_return_expression(nullptr);
 
   size_t srcLen = strnlen(src, n);
@@ -482,14 +693,11 @@ char *SYM(strncpy)(char *dest, const char *src, size_t n) {
   if (isConcrete(src, copied) && isConcrete(dest, n))
     return result;
 
-  auto srcShadow = ReadOnlyShadow(src, copied);
-  auto destShadow = ReadWriteShadow(dest, n);
-
-  std::copy(srcShadow.begin(), srcShadow.end(), destShadow.begin());
-  if (copied < n) {
-    ReadWriteShadow destRestShadow(dest + copied, n - copied);
-    std::fill(destRestShadow.begin(), destRestShadow.end(), nullptr);
-  }
+  copyShadow(reinterpret_cast<uintptr_t>(dest),
+             reinterpret_cast<uintptr_t>(src), copied);
+  if (copied < n)
+    fillShadow(reinterpret_cast<uintptr_t>(dest + copied), nullptr,
+               n - copied);
 
   return result;
 }
@@ -499,28 +707,45 @@ const char *SYM(strchr)(const char *s, int c) {
   tryAlternative(c, _sym_get_parameter_expression(1), SYM(strchr));
 
   auto *result = strchr(s, c);
+  RuntimeLock lock;
   _sym_set_return_expression(nullptr);
 
   auto *cExpr = _sym_get_parameter_expression(1);
-  if (isConcrete(s, result != nullptr ? (result - s) : strlen(s)) &&
-      cExpr == nullptr)
-    return result;
+  size_t length = result != nullptr ? (result - s) : strlen(s);
+  if (cExpr == nullptr) {
+    // Concrete characters of the string differ from c anyway, so only the
+    // symbolic ones give rise to constraints.
+    if (isConcrete(s, length))
+      return result;
 
-  if (cExpr == nullptr)
     cExpr = _sym_build_integer(c, 8);
-  else
-    cExpr = _sym_build_trunc(cExpr, 8);
+    forEachSymbolicByte(s, length, [&](size_t, SymExpr charExpr) {
+      _sym_push_path_constraint(_sym_build_not_equal(charExpr, cExpr),
+                                /*taken*/ 1,
+                                reinterpret_cast<uintptr_t>(SYM(strchr)));
+    });
+    return result;
+  }
 
-  size_t length = result != nullptr ? (result - s) : strlen(s);
+  // With a symbolic c, every character matters, but each concrete value only
+  // needs to be excluded once.
+  cExpr = _sym_build_trunc(cExpr, 8);
+  bool excluded[256] = {};
   auto shadow = ReadOnlyShadow(s, length);
   auto shadowIt = shadow.begin();
-  for (size_t i = 0; i < length; i++) {
-    _sym_push_path_constraint(
-        _sym_build_not_equal(
-            (*shadowIt != nullptr) ? *shadowIt : _sym_build_integer(s[i], 8),
-            cExpr),
-        /*taken*/ 1, reinterpret_cast<uintptr_t>(SYM(strchr)));
-    ++shadowIt;
+  for (size_t i = 0; i < length; i++, ++shadowIt) {
+    auto *charExpr = *shadowIt;
+    if (charExpr == nullptr) {
+      auto value = static_cast<uint8_t>(s[i]);
+      if (excluded[value])
+        continue;
+      excluded[value] = true;
+      charExpr = _sym_build_integer(value, 8);
+    }
+
+    _sym_push_path_constraint(_sym_build_not_equal(charExpr, cExpr),
+                              /*taken*/ 1,
+                              reinterpret_cast<uintptr_t>(SYM(strchr)));
   }
 
   return result;
@@ -532,23 +757,15 @@ int SYM(memcmp)(const void *a, const void *b, size_t n) {
   tryAlternative(n, _sym_get_parameter_expression(2), SYM(memcmp));
 
   auto result = memcmp(a, b, n);
+  RuntimeLock lock;
   _sym_set_return_expression(nullptr);
 
   if (isConcrete(a, n) && isConcrete(b, n))
     return result;
 
-  auto aShadowIt = ReadOnlyShadow(a, n).begin_non_null();
-  auto bShadowIt = ReadOnlyShadow(b, n).begin_non_null();
-  auto *allEqual = _sym_build_equal(*aShadowIt, *bShadowIt);
-  for (size_t i = 1; i < n; i++) {
-    ++aShadowIt;
-    ++bShadowIt;
-    allEqual =
-        _sym_build_bool_and(allEqual, _sym_build_equal(*aShadowIt, *bShadowIt));
-  }
-
-  _sym_push_path_constraint(allEqual, result == 0,
-                            reinterpret_cast<uintptr_t>(SYM(memcmp)));
+  if (auto *allEqual = buildRegionsEqual(a, b, n))
+    _sym_push_path_constraint(allEqual, result == 0,
+                              reinterpret_cast<uintptr_t>(SYM(memcmp)));
   return result;
 }
 
@@ -558,6 +775,7 @@ int SYM(bcmp)(const void *a, const void *b, size_t n) {
   tryAlternative(n, _sym_get_parameter_expression(2), SYM(bcmp));
 
   auto result = bcmp(a, b, n);
+  RuntimeLock lock;
 
   // bcmp returns zero if the input regions are equal and an unspecified
   // non-zero value otherwise. Instead of expressing this symbolically, we
@@ -574,18 +792,112 @@ int SYM(bcmp)(const void *a, const void *b, size_t n) {
   if (isConcrete(a, n) && isConcrete(b, n))
     return result;
 
-  auto aShadowIt = ReadOnlyShadow(a, n).begin_non_null();
-  auto bShadowIt = ReadOnlyShadow(b, n).begin_non_null();
-  auto *allEqual = _sym_build_equal(*aShadowIt, *bShadowIt);
-  for (size_t i = 1; i < n; i++) {
-    ++aShadowIt;
-    ++bShadowIt;
-    allEqual =
-        _sym_build_bool_and(allEqual, _sym_build_equal(*aShadowIt, *bShadowIt));
+  if (auto *allEqual = buildRegionsEqual(a, b, n))
+    _sym_push_path_constraint(allEqual, result == 0,
+                              reinterpret_cast<uintptr_t>(SYM(bcmp)));
+  return result;
+}
+
+size_t SYM(strlen)(const char *s) {
+  tryAlternative(s, _sym_get_parameter_expression(0), SYM(strlen));
+
+  auto result = strlen(s);
+  RuntimeLock lock;
+  _sym_set_return_expression(nullptr);
+
+  // The length is the position of the first null byte.
+  if (auto *constraint = buildSearchConstraint(s, result + 1, true, 0, nullptr))
+    _sym_push_path_constraint(constraint, /*taken*/ 1,
+                              reinterpret_cast<uintptr_t>(SYM(strlen)));
+
+  return result;
+}
+
+int SYM(strcmp)(const char *a, const char *b) {
+  tryAlternative(a, _sym_get_parameter_expression(0), SYM(strcmp));
+  tryAlternative(b, _sym_get_parameter_expression(1), SYM(strcmp));
+
+  RuntimeLock lock;
+  SymExpr resultExpr;
+  auto result = compareStrings(a, b, SIZE_MAX, resultExpr);
+  _sym_set_return_expression(resultExpr);
+  return result;
+}
+
+int SYM(strncmp)(const char *a, const char *b, size_t n) {
+  tryAlternative(a, _sym_get_parameter_expression(0), SYM(strncmp));
+  tryAlternative(b, _sym_get_parameter_expression(1), SYM(strncmp));
+  tryAlternative(n, _sym_get_parameter_expression(2), SYM(strncmp));
+
+  RuntimeLock lock;
+  SymExpr resultExpr;
+  auto result = compareStrings(a, b, n, resultExpr);
+  _sym_set_return_expression(resultExpr);
+  return result;
+}
+
+const void *SYM(memchr)(const void *s, int c, size_t n) {
+  tryAlternative(s, _sym_get_parameter_expression(0), SYM(memchr));
+  tryAlternative(n, _sym_get_parameter_expression(2), SYM(memchr));
+
+  auto *result = memchr(s, c, n);
+  RuntimeLock lock;
+  _sym_set_return_expression(nullptr);
+
+  auto *cExpr = _sym_get_parameter_expression(1);
+  if (cExpr != nullptr)
+    cExpr = _sym_build_trunc(cExpr, 8);
+
+  size_t examined = (result != nullptr) ? (static_cast<const char *>(result) -
+                                           static_cast<const char *>(s) + 1)
+                                        : n;
+  if (auto *constraint = buildSearchConstraint(
+          s, examined, result != nullptr, static_cast<uint8_t>(c), cExpr))
+    _sym_push_path_constraint(constraint, /*taken*/ 1,
+                              reinterpret_cast<uintptr_t>(SYM(memchr)));
+
+  return result;
+}
+
+const char *SYM(strstr)(const char *haystack, const char *needle) {
+  tryAlternative(haystack, _sym_get_parameter_expression(0), SYM(strstr));
+  tryAlternative(needle, _sym_get_parameter_expression(1), SYM(strstr));
+
+  auto *result = strstr(haystack, needle);
+  RuntimeLock lock;
+  _sym_set_return_expression(nullptr);
+
+  size_t haystackLength = strlen(haystack), needleLength = strlen(needle);
+  if (isConcrete(haystack, haystackLength) && isConcrete(needle, needleLength))
+    return result;
+
+  if (result != nullptr) {
+    // Ask for inputs that don't contain the needle at this position.
+    if (auto *match = buildRegionsEqual(result, needle, needleLength))
+      _sym_push_path_constraint(match, /*taken*/ 1,
+                                reinterpret_cast<uintptr_t>(SYM(strstr)));
+    return result;
+  }
+
+  // Ask for inputs that contain the needle anywhere in the haystack: the
+  // constraint is a disjunction over all positions where the needle can match,
+  // i.e., where the concrete bytes don't rule it out.
+  if (needleLength == 0 || needleLength > haystackLength)
+    return result;
+  size_t positions = haystackLength - needleLength + 1;
+  if (positions * needleLength > kMaxSearchComparisons)
+    return result;
+
+  SymExpr anyMatch = nullptr;
+  for (size_t position = 0; position < positions; position++) {
+    if (auto *match =
+            buildRegionsEqual(haystack + position, needle, needleLength))
+      anyMatch = anyMatch ? _sym_build_bool_or(anyMatch, match) : match;
   }
 
-  _sym_push_path_constraint(allEqual, result == 0,
-                            reinterpret_cast<uintptr_t>(SYM(bcmp)));
+  if (anyMatch != nullptr)
+    _sym_push_path_constraint(anyMatch, /*taken*/ 0,
+                              reinterpret_cast<uintptr_t>(SYM(strstr)));
   return result;
 }
 
@@ -22,4 +22,9 @@
 /// to symbolic input.
 void initLibcWrappers();
 
+/// Save and restore the state of the symbolic input, i.e., the input file and
+/// the current position in it (see symcc_snapshot).
+void snapshotInputState();
+void restoreInputState();
+
 #endif
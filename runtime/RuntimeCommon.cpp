@@ -19,24 +19,21 @@
 #include <array>
 #include <cassert>
 #include <cstddef>
+#include <iterator>
 #include <numeric>
 #include <stdexcept>
 #include <variant>
 
 #include "Config.h"
 #include "GarbageCollection.h"
+#include "LibcWrappers.h"
 #include "RuntimeCommon.h"
 #include "Shadow.h"
+#include "Snapshot.h"
+#include "Threads.h"
 
 namespace {
 
-constexpr int kMaxFunctionArguments = 256;
-
-/// Global storage for function parameters and the return value.
-SymExpr g_return_value;
-std::array<SymExpr, kMaxFunctionArguments> g_function_arguments;
-// TODO make thread-local
-
 SymExpr buildMinSignedInt(uint8_t bits) {
   return _sym_build_integer((uint64_t)(1) << (bits - 1), bits);
 }
@@ -82,40 +79,145 @@ SymExpr buildOverflowResult(SymExpr result_expr, SymExpr overflow,
                                 : _sym_concat_helper(padding, overflow_byte));
 }
 
+/// A direct-mapped cache of multi-byte values in memory.
+///
+/// Shadow memory only stores byte expressions, so reading a value means
+/// concatenating the bytes, and writing it means extracting them again. When a
+/// program repeatedly loads a field, or copies a value from one variable to
+/// another, we would build the same chains of concatenations and extractions
+/// over and over. Instead, we remember for recently accessed values which byte
+/// expressions represent them in memory; if the shadow still contains exactly
+/// those bytes, we can return the original value directly (and store it again
+/// without splitting).
+///
+/// The cached expressions are registered with the garbage collector as an
+/// expression region, so they remain valid as long as they're in the cache.
+class ValueCache {
+public:
+  static constexpr size_t kMaxValueLength = 8;
+
+  /// Find a cached value by the key it was stored under.
+  const SymExpr *lookup(uintptr_t key, size_t length, bool littleEndian) {
+    auto index = indexOf(key);
+    auto &tag = tags_[index];
+    if (tag.key != key || tag.length != length ||
+        tag.littleEndian != littleEndian)
+      return nullptr;
+
+    return values_[index].data();
+  }
+
+  /// Remember a value (at index 0) with its bytes in memory order (at indices
+  /// 1 to length).
+  void insert(uintptr_t key, size_t length, bool littleEndian,
+              const SymExpr *value) {
+    if (!registered_) {
+      registerExpressionRegion(
+          {values_[0].data(), sizeof(values_) / sizeof(SymExpr)});
+      registered_ = true;
+    }
+
+    auto index = indexOf(key);
+    tags_[index] = {key, static_cast<uint8_t>(length), littleEndian};
+    std::copy(value, value + length + 1, values_[index].begin());
+  }
+
+  /// Forget all cached values.
+  void clear() {
+    tags_.fill({});
+    for (auto &value : values_)
+      value.fill(nullptr);
+  }
+
+private:
+  static constexpr unsigned kIndexBits = 10;
+  static constexpr size_t kEntries = size_t(1) << kIndexBits;
+
+  static size_t indexOf(uintptr_t key) {
+    // Fibonacci hashing spreads keys with lots of zero bits (like aligned
+    // addresses and pointers) across the table.
+    return (uint64_t(key) * 11400714819323198485llu) >> (64 - kIndexBits);
+  }
+
+  struct Tag {
+    uintptr_t key;
+    uint8_t length;
+    bool littleEndian;
+  };
+
+  std::array<Tag, kEntries> tags_{};
+  std::array<std::array<SymExpr, kMaxValueLength + 1>, kEntries> values_{};
+  bool registered_ = false;
+};
+static_assert(sizeof(std::array<SymExpr, 2>) == 2 * sizeof(SymExpr),
+              "The value cache must be scannable as an expression region");
+
+/// Values by the address they were accessed at (used for reading).
+ValueCache g_values_by_address;
+
+/// Values by their expression (used for writing).
+ValueCache g_values_by_expression;
+
+/// Check whether a memory region is concrete without taking the runtime lock,
+/// which is only worth it in multithreaded programs (see Threads.h). A false
+/// result means that we don't know.
+template <typename T> bool isConcreteWithoutLock(T *addr, size_t length) {
+  return runtimeIsMultithreaded() && !mayBeSymbolic(addr, length);
+}
+
+/// The offset of the next input bytes passed to symcc_make_symbolic.
+size_t g_memory_input_offset = 0;
+
+/// The value of g_memory_input_offset when the last snapshot was taken.
+size_t g_saved_memory_input_offset = 0;
+
 } // namespace
 
-void _sym_set_return_expression(SymExpr expr) { g_return_value = expr; }
+// Per-thread storage for function parameters and the return value.
+__thread SymExpr _sym_parameter_slots[256];
+__thread SymExpr _sym_return_slot;
+
+__thread uintptr_t _sym_call_context = 0;
+bool _sym_symbolic_data_seen = false;
+
+void _sym_set_return_expression(SymExpr expr) { _sym_return_slot = expr; }
 
 SymExpr _sym_get_return_expression(void) {
-  auto *result = g_return_value;
+  auto *result = _sym_return_slot;
   // TODO this is a safeguard that can eventually be removed
-  g_return_value = nullptr;
+  _sym_return_slot = nullptr;
   return result;
 }
 
 void _sym_set_parameter_expression(uint8_t index, SymExpr expr) {
-  g_function_arguments[index] = expr;
+  _sym_parameter_slots[index] = expr;
 }
 
 SymExpr _sym_get_parameter_expression(uint8_t index) {
-  return g_function_arguments[index];
+  return _sym_parameter_slots[index];
 }
 
 void _sym_memcpy(uint8_t *dest, const uint8_t *src, size_t length) {
+  if (isConcreteWithoutLock(src, length) && isConcreteWithoutLock(dest, length))
+    return;
+
+  RuntimeLock lock;
   if (isConcrete(src, length) && isConcrete(dest, length))
     return;
 
-  ReadOnlyShadow srcShadow(src, length);
-  ReadWriteShadow destShadow(dest, length);
-  std::copy(srcShadow.begin(), srcShadow.end(), destShadow.begin());
+  copyShadow(reinterpret_cast<uintptr_t>(dest),
+             reinterpret_cast<uintptr_t>(src), length);
 }
 
 void _sym_memset(uint8_t *memory, SymExpr value, size_t length) {
+  if ((value == nullptr) && isConcreteWithoutLock(memory, length))
+    return;
+
+  RuntimeLock lock;
   if ((value == nullptr) && isConcrete(memory, length))
     return;
 
-  ReadWriteShadow shadow(memory, length);
-  std::fill(shadow.begin(), shadow.end(), value);
+  fillShadow(reinterpret_cast<uintptr_t>(memory), value, length);
 }
 
 void _sym_memmove(uint8_t *dest, const uint8_t *src, size_t length) {
@@ -123,15 +225,15 @@ void _sym_memmove(uint8_t *dest, const uint8_t *src, size_t length) {
   // regions, we need to copy the symbolic expressions over. (In the case where
   // only the destination is symbolic, this means making it concrete.)
 
+  if (isConcreteWithoutLock(src, length) && isConcreteWithoutLock(dest, length))
+    return;
+
+  RuntimeLock lock;
   if (isConcrete(src, length) && isConcrete(dest, length))
     return;
 
-  ReadOnlyShadow srcShadow(src, length);
-  ReadWriteShadow destShadow(dest, length);
-  if (dest > src)
-    std::copy_backward(srcShadow.begin(), srcShadow.end(), destShadow.end());
-  else
-    std::copy(srcShadow.begin(), srcShadow.end(), destShadow.begin());
+  copyShadow(reinterpret_cast<uintptr_t>(dest),
+             reinterpret_cast<uintptr_t>(src), length);
 }
 
 SymExpr _sym_read_memory(uint8_t *addr, size_t length, bool little_endian) {
@@ -145,20 +247,48 @@ SymExpr _sym_read_memory(uint8_t *addr, size_t length, bool little_endian) {
 
   // If the entire memory region is concrete, don't create a symbolic expression
   // at all.
+  if (isConcreteWithoutLock(addr, length))
+    return nullptr;
+
+  RuntimeLock lock;
   if (isConcrete(addr, length))
     return nullptr;
 
   ReadOnlyShadow shadow(addr, length);
-  return std::accumulate(shadow.begin_non_null(), shadow.end_non_null(),
-                         static_cast<SymExpr>(nullptr),
-                         [&](SymExpr result, SymExpr byteExpr) {
-                           if (result == nullptr)
-                             return byteExpr;
+  bool cacheable = (length > 1 && length <= ValueCache::kMaxValueLength);
+  auto key = reinterpret_cast<uintptr_t>(addr);
+  if (cacheable) {
+    if (auto *cached = g_values_by_address.lookup(key, length, little_endian);
+        cached != nullptr &&
+        std::equal(shadow.begin(), shadow.end(), cached + 1))
+      return cached[0];
+  }
+
+  auto result = std::accumulate(
+      shadow.begin_non_null(), shadow.end_non_null(),
+      static_cast<SymExpr>(nullptr), [&](SymExpr result, SymExpr byteExpr) {
+        if (result == nullptr)
+          return byteExpr;
+
+        return little_endian ? _sym_concat_helper(byteExpr, result)
+                             : _sym_concat_helper(result, byteExpr);
+      });
+
+  if (cacheable) {
+    std::array<SymExpr, ValueCache::kMaxValueLength + 1> value;
+    value[0] = result;
+    std::copy(shadow.begin(), shadow.end(), value.begin() + 1);
+    // Concrete bytes don't have an expression in the shadow, so we can only
+    // cache fully symbolic values.
+    if (std::find(value.begin() + 1, value.begin() + length + 1, nullptr) ==
+        value.begin() + length + 1) {
+      g_values_by_address.insert(key, length, little_endian, value.data());
+      g_values_by_expression.insert(reinterpret_cast<uintptr_t>(result), length,
+                                    little_endian, value.data());
+    }
+  }
 
-                           return little_endian
-                                      ? _sym_concat_helper(byteExpr, result)
-                                      : _sym_concat_helper(result, byteExpr);
-                         });
+  return result;
 }
 
 void _sym_write_memory(uint8_t *addr, size_t length, SymExpr expr,
@@ -171,15 +301,41 @@ void _sym_write_memory(uint8_t *addr, size_t length, SymExpr expr,
   dump_known_regions();
 #endif
 
+  if (expr == nullptr && isConcreteWithoutLock(addr, length))
+    return;
+
+  RuntimeLock lock;
   if (expr == nullptr && isConcrete(addr, length))
     return;
 
   ReadWriteShadow shadow(addr, length);
   if (expr == nullptr) {
     std::fill(shadow.begin(), shadow.end(), nullptr);
+  } else if (length == 1) {
+    *shadow.begin() = expr;
+  } else if (length <= ValueCache::kMaxValueLength) {
+    auto exprKey = reinterpret_cast<uintptr_t>(expr);
+    auto *cached = g_values_by_expression.lookup(exprKey, length, little_endian);
+    std::array<SymExpr, ValueCache::kMaxValueLength + 1> value;
+    if (cached == nullptr) {
+      value[0] = expr;
+      for (size_t i = 0; i < length; i++) {
+        value[i + 1] = little_endian
+                           ? _sym_extract_helper(expr, 8 * (i + 1) - 1, 8 * i)
+                           : _sym_extract_helper(expr, (length - i) * 8 - 1,
+                                                 (length - i - 1) * 8);
+      }
+      g_values_by_expression.insert(exprKey, length, little_endian,
+                                    value.data());
+      cached = value.data();
+    }
+
+    std::copy(cached + 1, cached + length + 1, shadow.begin());
+    g_values_by_address.insert(reinterpret_cast<uintptr_t>(addr), length,
+                               little_endian, cached);
   } else {
     size_t i = 0;
-    for (SymExpr &byteShadow : shadow) {
+    for (auto &&byteShadow : shadow) {
       byteShadow = little_endian
                        ? _sym_extract_helper(expr, 8 * (i + 1) - 1, 8 * i)
                        : _sym_extract_helper(expr, (length - i) * 8 - 1,
@@ -435,18 +591,21 @@ SymExpr _sym_build_mul_overflow(SymExpr a, SymExpr b, bool is_signed,
 SymExpr _sym_build_funnel_shift_left(SymExpr a, SymExpr b, SymExpr c) {
   size_t bits = _sym_bits_helper(c);
   SymExpr concat = _sym_concat_helper(a, b);
-  SymExpr shift = _sym_build_unsigned_rem(c, _sym_build_integer(bits, bits));
+  SymExpr shift = _sym_build_zext(
+      _sym_build_unsigned_rem(c, _sym_build_integer(bits, bits)), bits);
 
-  return _sym_extract_helper(_sym_build_shift_left(concat, shift), 0, bits);
+  return _sym_extract_helper(_sym_build_shift_left(concat, shift),
+                             2 * bits - 1, bits);
 }
 
 SymExpr _sym_build_funnel_shift_right(SymExpr a, SymExpr b, SymExpr c) {
   size_t bits = _sym_bits_helper(c);
   SymExpr concat = _sym_concat_helper(a, b);
-  SymExpr shift = _sym_build_unsigned_rem(c, _sym_build_integer(bits, bits));
+  SymExpr shift = _sym_build_zext(
+      _sym_build_unsigned_rem(c, _sym_build_integer(bits, bits)), bits);
 
-  return _sym_extract_helper(_sym_build_logical_shift_right(concat, shift), 0,
-                             bits);
+  return _sym_extract_helper(_sym_build_logical_shift_right(concat, shift),
+                             bits - 1, 0);
 }
 
 SymExpr _sym_build_abs(SymExpr expr) {
@@ -457,16 +616,18 @@ SymExpr _sym_build_abs(SymExpr expr) {
 }
 
 void _sym_register_expression_region(SymExpr *start, size_t length) {
+  RuntimeLock lock;
   registerExpressionRegion({start, length});
 }
 
 void _sym_make_symbolic(const void *data, size_t byte_length,
                         size_t input_offset) {
-  ReadWriteShadow shadow(data, byte_length);
-  const uint8_t *data_bytes = reinterpret_cast<const uint8_t *>(data);
-  std::generate(shadow.begin(), shadow.end(), [&, i = 0]() mutable {
-    return _sym_get_input_byte(input_offset++, data_bytes[i++]);
-  });
+  RuntimeLock lock;
+  // The backend needs the concrete values right away, but the expressions are
+  // only created when the program accesses the data.
+  _sym_get_input_bytes(input_offset, static_cast<const uint8_t *>(data),
+                       byte_length, nullptr);
+  setInputShadow(reinterpret_cast<uintptr_t>(data), byte_length, input_offset);
 }
 
 void symcc_make_symbolic(const void *start, size_t byte_length) {
@@ -474,9 +635,33 @@ void symcc_make_symbolic(const void *start, size_t byte_length) {
     throw std::runtime_error{"Calls to symcc_make_symbolic aren't allowed when "
                              "SYMCC_MEMORY_INPUT isn't set"};
 
-  static size_t inputOffset = 0; // track the offset across calls
-  _sym_make_symbolic(start, byte_length, inputOffset);
-  inputOffset += byte_length;
+  RuntimeLock lock;
+  _sym_make_symbolic(start, byte_length, g_memory_input_offset);
+  g_memory_input_offset += byte_length;
+}
+
+void symcc_snapshot(void) {
+  RuntimeLock lock;
+  snapshotShadow();
+  snapshotInputState();
+  g_saved_memory_input_offset = g_memory_input_offset;
+  snapshotBackend();
+}
+
+void symcc_restore(void) {
+  RuntimeLock lock;
+  restoreShadow();
+  restoreInputState();
+  g_memory_input_offset = g_saved_memory_input_offset;
+
+  // The caches would keep expressions from the last iteration alive.
+  g_values_by_address.clear();
+  g_values_by_expression.clear();
+  _sym_return_slot = nullptr;
+  std::fill(std::begin(_sym_parameter_slots), std::end(_sym_parameter_slots),
+            nullptr);
+
+  restoreBackend();
 }
 
 SymExpr _sym_build_bit_to_bool(SymExpr expr) {
@@ -174,12 +174,40 @@ SymExpr _sym_get_parameter_expression(uint8_t index);
 void _sym_set_return_expression(nullable SymExpr expr);
 SymExpr _sym_get_return_expression(void);
 
+/*
+ * The storage behind the function-call helpers, one set per thread.
+ * Instrumented code accesses it directly, which saves a call into the runtime
+ * for every argument and return value; the compiler pass assumes that there
+ * are 256 parameter slots and the initial-exec TLS model.
+ */
+extern __thread nullable SymExpr _sym_parameter_slots[256]
+    __attribute__((tls_model("initial-exec")));
+extern __thread nullable SymExpr _sym_return_slot
+    __attribute__((tls_model("initial-exec")));
+
+/*
+ * Set by the backend when it creates the first symbolic input. Until then,
+ * no expressions exist, and code compiled with SYMCC_CONCRETE_CLONES runs
+ * uninstrumented copies of its functions.
+ */
+extern bool _sym_symbolic_data_seen;
+
 /*
  * Constraint handling
  */
 void _sym_push_path_constraint(nullable SymExpr constraint, int taken,
                                uintptr_t site_id);
 SymExpr _sym_get_input_byte(size_t offset, uint8_t concrete_value);
+/* Like _sym_get_input_byte, but for length consecutive bytes; the expressions
+ * are stored in result. This is what symbolic input goes through, so backends
+ * should make it cheaper than the equivalent sequence of single-byte calls.
+ *
+ * Expressions for input bytes are created lazily, so the two halves can also
+ * be requested separately: if result is null, the backend only records the
+ * concrete values; if concrete_values is null, it creates the expressions for
+ * bytes whose values it has recorded before. */
+void _sym_get_input_bytes(size_t offset, nullable const uint8_t *concrete_values,
+                          size_t length, nullable SymExpr *result);
 void _sym_make_symbolic(const void *data, size_t byte_length,
                         size_t input_offset);
 
@@ -201,6 +229,11 @@ SymExpr _sym_build_extract(SymExpr expr, uint64_t offset, uint64_t length,
 /*
  * Call-stack tracing
  */
+/* A hash of the calling context, which instrumented code updates inline around
+ * each call and restores on return (see SYMCC_CALL_TRACING). The compiler pass
+ * assumes the initial-exec TLS model. */
+extern __thread uintptr_t _sym_call_context
+    __attribute__((tls_model("initial-exec")));
 void _sym_notify_call(uintptr_t site_id);
 void _sym_notify_ret(uintptr_t site_id);
 void _sym_notify_basic_block(uintptr_t site_id);
@@ -227,6 +260,18 @@ void symcc_make_symbolic(const void *start, size_t byte_length);
 typedef void (*TestCaseHandler)(const void *, size_t);
 void symcc_set_test_case_handler(TestCaseHandler handler);
 
+/*
+ * Persistent execution
+ *
+ * A program that processes many inputs in a loop can take a snapshot of the
+ * runtime's state before reading the first input and restore it after each
+ * iteration: the restore discards the shadow memory, path constraints and input
+ * position accumulated since the snapshot. The program's own memory is not
+ * restored, and expression regions registered by the program are left alone.
+ */
+void symcc_snapshot(void);
+void symcc_restore(void);
+
 #ifdef __cplusplus
 }
 #endif
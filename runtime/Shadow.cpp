@@ -15,4 +15,399 @@
 
 #include "Shadow.h"
 
-std::map<uintptr_t, SymExpr *> g_shadow_pages;
+#include <algorithm>
+#include <iterator>
+#include <new>
+#include <vector>
+
+#include <sys/mman.h>
+
+ShadowPageTable g_shadow_pages;
+std::vector<ShadowPage *> g_modified_shadow_pages;
+
+namespace {
+
+/// The number of shadow pages that we reserve at a time.
+constexpr size_t kShadowPagesPerChunk = sizeof(void *) == 8 ? 32768 : 256;
+
+/// The part of the current chunk that hasn't been handed out yet.
+ShadowPage *g_chunk_next = nullptr;
+ShadowPage *g_chunk_end = nullptr;
+
+/// Shadow pages that have been dropped and can be reused. They are empty, so
+/// their bitmap is clear and all their expressions are null. Some have had
+/// their memory returned to the system (see releaseShadowPage), whereas
+/// dropPage leaves it alone. The address is stale until createShadowPage sets
+/// it. The modified flag is kept either way: dropping doesn't remove a page
+/// from g_modified_shadow_pages, and a set flag means that the page is still in
+/// there.
+std::vector<ShadowPage *> g_free_pages;
+
+/// The copies of the shadow pages saved by snapshotShadow, sorted by address.
+std::vector<ShadowPage> g_shadow_snapshot;
+
+/// The lazy pages at the time of the last snapshot.
+std::vector<std::pair<uintptr_t, LazyInput *>> g_lazy_snapshot;
+
+/// Regions smaller than this get their input expressions right away; deferring
+/// them would cost more than it saves.
+constexpr size_t kMinLazyInputLength = kPageSize;
+
+/// Return a page's memory to the system and make the page available for reuse.
+/// The page must not be registered in g_shadow_pages anymore.
+void releaseShadowPage(ShadowPage *page) {
+  // The kernel zeroes the page, including the modified flag. If the page is
+  // still in g_modified_shadow_pages, we need to set the flag again, or
+  // markModified would add the page a second time after reuse.
+  bool modified = page->modified;
+  madvise(page, sizeof(ShadowPage), MADV_DONTNEED);
+  if (modified)
+    page->modified = true;
+  g_free_pages.push_back(page);
+}
+
+} // namespace
+
+/// A region of memory whose contents are consecutive input bytes (see
+/// setInputShadow).
+struct LazyInput {
+  uintptr_t address;
+  size_t length;
+  size_t inputOffset;
+
+  /// The number of lazy pages and snapshot entries that refer to the input.
+  size_t references;
+};
+
+namespace {
+
+void releaseLazyInput(LazyInput *input) {
+  if (--input->references == 0)
+    delete input;
+}
+
+/// If the page containing the indicated run is lazy and the run covers all of
+/// the page's input bytes, drop the lazy entry; the caller is about to
+/// overwrite the bytes, so their expressions would only be thrown away.
+void dropOverwrittenLazyPage(uintptr_t address, size_t length) {
+  auto pageAddress = pageStart(address);
+  auto *input = g_shadow_pages.findLazy(pageAddress);
+  if (input == nullptr)
+    return;
+
+  auto begin = std::max(pageAddress, input->address);
+  auto end =
+      std::min(pageAddress + kPageSize, input->address + input->length);
+  if (address <= begin && address + length >= end)
+    releaseLazyInput(g_shadow_pages.takeLazy(pageAddress));
+}
+
+} // namespace
+
+ShadowPage *allocateShadowPage() {
+  countShadowPage();
+  if (!g_free_pages.empty()) {
+    auto *page = g_free_pages.back();
+    g_free_pages.pop_back();
+    return page;
+  }
+
+  if (g_chunk_next == g_chunk_end) {
+    size_t chunkSize = kShadowPagesPerChunk * sizeof(ShadowPage);
+    auto *chunk = mmap(nullptr, chunkSize, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (chunk == MAP_FAILED)
+      throw std::bad_alloc{};
+
+    g_chunk_next = static_cast<ShadowPage *>(chunk);
+    g_chunk_end = g_chunk_next + kShadowPagesPerChunk;
+  }
+
+  return g_chunk_next++;
+}
+
+ShadowPage *createShadowPage(uintptr_t address) {
+  auto *page = allocateShadowPage();
+  page->address = address;
+  g_shadow_pages.insert(address, page);
+  return page;
+}
+
+void dropEmptyShadowPages(bool onlyModified) {
+  std::vector<uintptr_t> emptyPages;
+  if (onlyModified) {
+    // The list may contain pages that have been dropped already.
+    for (auto *page : g_modified_shadow_pages) {
+      if (page->empty() && g_shadow_pages.find(page->address) == page)
+        emptyPages.push_back(page->address);
+    }
+  } else {
+    g_shadow_pages.forEach([&](uintptr_t address, ShadowPage *page) {
+      if (page->empty())
+        emptyPages.push_back(address);
+    });
+  }
+
+  // Empty pages only contain null expressions already; we just want the
+  // physical memory back.
+  for (auto address : emptyPages)
+    releaseShadowPage(g_shadow_pages.erase(address));
+}
+
+void snapshotShadow() {
+  std::vector<ShadowPage> snapshot;
+  g_shadow_pages.forEach([&](uintptr_t, const ShadowPage *page) {
+    if (!page->empty())
+      snapshot.push_back(*page);
+  });
+  std::sort(snapshot.begin(), snapshot.end(),
+            [](auto &a, auto &b) { return a.address < b.address; });
+  g_shadow_snapshot = std::move(snapshot);
+
+  for (auto &[address, input] : g_lazy_snapshot)
+    releaseLazyInput(input);
+  g_lazy_snapshot.clear();
+  g_shadow_pages.forEachLazy([](uintptr_t address, LazyInput *input) {
+    input->references++;
+    g_lazy_snapshot.emplace_back(address, input);
+  });
+}
+
+void restoreShadow() {
+  auto restorePage = [](ShadowPage *page, const ShadowPage &saved) {
+    std::copy(std::begin(saved.expressions), std::end(saved.expressions),
+              page->expressions);
+    std::copy(std::begin(saved.symbolicBytes), std::end(saved.symbolicBytes),
+              page->symbolicBytes);
+    page->symbolicCount = saved.symbolicCount;
+    page->markModified();
+  };
+  auto findSaved = [](uintptr_t address) -> const ShadowPage * {
+    auto it = std::lower_bound(
+        g_shadow_snapshot.begin(), g_shadow_snapshot.end(), address,
+        [](auto &page, uintptr_t address) { return page.address < address; });
+    return (it != g_shadow_snapshot.end() && it->address == address) ? &*it
+                                                                     : nullptr;
+  };
+
+  // Lazy pages go back to the state of the snapshot, so we don't need to
+  // create their shadows.
+  std::vector<uintptr_t> lazyPages;
+  g_shadow_pages.forEachLazy(
+      [&](uintptr_t address, LazyInput *) { lazyPages.push_back(address); });
+  for (auto address : lazyPages)
+    releaseLazyInput(g_shadow_pages.takeLazy(address));
+
+  std::vector<uintptr_t> stalePages;
+  g_shadow_pages.forEach([&](uintptr_t address, ShadowPage *page) {
+    if (auto *saved = findSaved(address))
+      restorePage(page, *saved);
+    else
+      stalePages.push_back(address);
+  });
+  for (auto address : stalePages)
+    releaseShadowPage(g_shadow_pages.erase(address));
+
+  for (auto &saved : g_shadow_snapshot) {
+    if (!g_shadow_pages.contains(saved.address))
+      restorePage(createShadowPage(saved.address), saved);
+  }
+
+  for (auto &[address, input] : g_lazy_snapshot) {
+    input->references++;
+    g_shadow_pages.insertLazy(address, input);
+  }
+}
+
+const std::vector<ShadowPage> &shadowSnapshot() { return g_shadow_snapshot; }
+
+void ShadowPage::updateBitmap(size_t offset, size_t length) {
+  markModified();
+  for (auto end = offset + length; offset < end;) {
+    auto word = offset / 64;
+    auto wordEnd = std::min(end, (word + 1) * 64);
+    auto bits = symbolicBytes[word];
+    symbolicCount -= __builtin_popcountll(bits);
+    for (; offset < wordEnd; offset++) {
+      auto bit = uint64_t(1) << (offset % 64);
+      bits = expressions[offset] != nullptr ? (bits | bit) : (bits & ~bit);
+    }
+    symbolicBytes[word] = bits;
+    symbolicCount += __builtin_popcountll(bits);
+  }
+}
+
+void ShadowPage::clear(size_t offset, size_t length) {
+  for (auto end = offset + length; offset < end;) {
+    auto word = offset / 64;
+    auto wordEnd = std::min(end, (word + 1) * 64);
+    // Most words in a partially symbolic page are usually all zero, so we only
+    // touch the expressions where there is something to clear.
+    if (symbolicBytes[word] != 0) {
+      std::fill(expressions + offset, expressions + wordEnd, nullptr);
+      updateBitmap(offset, wordEnd - offset);
+    }
+    offset = wordEnd;
+  }
+}
+
+namespace {
+
+/// Drop the shadow of a page that has become concrete. In contrast to
+/// dropEmptyShadowPages, we keep the memory because the program is likely to
+/// store symbolic data in the vicinity again soon.
+void dropPage(uintptr_t address) {
+  auto *page = g_shadow_pages.erase(address);
+  assert(page->empty() && "Only empty pages can be dropped");
+  g_free_pages.push_back(page);
+}
+
+/// Copy a run of shadow bytes that doesn't cross page boundaries.
+void copyShadowRun(uintptr_t dest, uintptr_t src, size_t length) {
+  // The source bytes only need a shadow if they're symbolic. We look at them
+  // before dropping the destination's lazy entry because the two may share a
+  // page.
+  const LazyInput *srcLazy;
+  auto *srcPage = g_shadow_pages.peek(pageStart(src), srcLazy);
+  if (srcLazy != nullptr && lazyInputOverlaps(srcLazy, src, length))
+    srcPage = g_shadow_pages.lookup(pageStart(src));
+  dropOverwrittenLazyPage(dest, length);
+  auto *destPage = g_shadow_pages.lookup(pageStart(dest));
+
+  if (srcPage == nullptr || srcPage->isConcrete(pageOffset(src), length)) {
+    if (destPage != nullptr) {
+      destPage->clear(pageOffset(dest), length);
+      if (destPage->empty())
+        dropPage(pageStart(dest));
+    }
+    return;
+  }
+
+  if (destPage == nullptr)
+    destPage = createShadowPage(pageStart(dest));
+
+  memmove(destPage->expressions + pageOffset(dest),
+          srcPage->expressions + pageOffset(src), length * sizeof(SymExpr));
+  destPage->updateBitmap(pageOffset(dest), length);
+}
+
+/// The length of the longest run starting at the given addresses that doesn't
+/// cross a page boundary in either region.
+size_t runLength(uintptr_t dest, uintptr_t src, size_t remaining) {
+  return std::min({remaining, kPageSize - pageOffset(dest),
+                   kPageSize - pageOffset(src)});
+}
+
+/// Like runLength, but for runs ending (exclusively) at the given addresses.
+size_t runLengthBackward(uintptr_t destEnd, uintptr_t srcEnd,
+                         size_t remaining) {
+  return std::min({remaining, pageOffset(destEnd - 1) + 1,
+                   pageOffset(srcEnd - 1) + 1});
+}
+
+} // namespace
+
+void copyShadow(uintptr_t dest, uintptr_t src, size_t length) {
+  if (dest == src)
+    return;
+
+  if (dest < src || dest >= src + length) {
+    while (length > 0) {
+      auto run = runLength(dest, src, length);
+      copyShadowRun(dest, src, run);
+      dest += run;
+      src += run;
+      length -= run;
+    }
+  } else {
+    // The destination overlaps the end of the source, so we have to copy
+    // backwards.
+    auto destEnd = dest + length, srcEnd = src + length;
+    while (length > 0) {
+      auto run = runLengthBackward(destEnd, srcEnd, length);
+      destEnd -= run;
+      srcEnd -= run;
+      copyShadowRun(destEnd, srcEnd, run);
+      length -= run;
+    }
+  }
+}
+
+void fillShadow(uintptr_t dest, SymExpr value, size_t length) {
+  while (length > 0) {
+    auto offset = pageOffset(dest);
+    auto run = std::min(length, kPageSize - offset);
+    dropOverwrittenLazyPage(dest, run);
+    auto *page = g_shadow_pages.lookup(pageStart(dest));
+
+    if (value == nullptr) {
+      if (page != nullptr) {
+        page->clear(offset, run);
+        // In particular, this drops the page if we've just overwritten all of
+        // it with concrete data.
+        if (page->empty())
+          dropPage(pageStart(dest));
+      }
+    } else {
+      if (page == nullptr)
+        page = createShadowPage(pageStart(dest));
+
+      std::fill(page->expressions + offset, page->expressions + offset + run,
+                value);
+      page->updateBitmap(offset, run);
+    }
+
+    dest += run;
+    length -= run;
+  }
+}
+
+ShadowPage *materializeLazyPage(uintptr_t address) {
+  auto *input = g_shadow_pages.takeLazy(address);
+  auto *page = createShadowPage(address);
+
+  auto begin = std::max(address, input->address);
+  auto end = std::min(address + kPageSize, input->address + input->length);
+  _sym_get_input_bytes(input->inputOffset + (begin - input->address), nullptr,
+                       end - begin, page->expressions + pageOffset(begin));
+  page->updateBitmap(pageOffset(begin), end - begin);
+
+  releaseLazyInput(input);
+  return page;
+}
+
+bool lazyInputOverlaps(const LazyInput *input, uintptr_t address,
+                       size_t length) {
+  return address < input->address + input->length &&
+         input->address < address + length;
+}
+
+void setInputShadow(uintptr_t address, size_t length, size_t inputOffset) {
+  LazyInput *input = nullptr;
+  for (size_t done = 0; done < length;) {
+    auto pageAddress = pageStart(address + done);
+    auto offset = pageOffset(address + done);
+    auto run = std::min(length - done, kPageSize - offset);
+
+    // A lazy page that we overwrite completely can just take the new input.
+    if (run == kPageSize && g_shadow_pages.contains(pageAddress) &&
+        g_shadow_pages.find(pageAddress) == nullptr)
+      releaseLazyInput(g_shadow_pages.takeLazy(pageAddress));
+
+    if (length >= kMinLazyInputLength && !g_shadow_pages.contains(pageAddress)) {
+      if (input == nullptr)
+        input = new LazyInput{address, length, inputOffset, 0};
+      input->references++;
+      g_shadow_pages.insertLazy(pageAddress, input);
+    } else {
+      auto *page = g_shadow_pages.lookup(pageAddress);
+      if (page == nullptr)
+        page = createShadowPage(pageAddress);
+      _sym_get_input_bytes(inputOffset + done, nullptr, run,
+                           page->expressions + offset);
+      page->updateBitmap(offset, run);
+    }
+
+    done += run;
+  }
+}
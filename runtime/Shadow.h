@@ -18,18 +18,25 @@
 
 #include <algorithm>
 #include <cassert>
+#include <cstdint>
+#include <cstdlib>
 #include <cstring>
 #include <map>
+#include <utility>
+#include <vector>
 
 #include <Runtime.h>
 
 #include <z3.h>
 
+#include "Statistics.h"
+
 //
 // This file is dedicated to the management of shadow memory.
 //
-// We manage shadows at page granularity. Since the shadow for each page is
-// malloc'ed and thus at an unpredictable location in memory, we need special
+// We manage shadows at page granularity (see ShadowPageTable for the mapping
+// from pages to shadows). Since the shadow for each page is allocated
+// separately and thus at an unpredictable location in memory, we need special
 // handling for memory allocations that cross page boundaries. This header
 // provides iterators over shadow memory that automatically handle jumps between
 // memory pages (and thus shadow regions). They should work with the C++
@@ -51,9 +58,473 @@ constexpr uintptr_t pageOffset(uintptr_t addr) {
   return (addr & (kPageSize - 1));
 }
 
-/// A mapping from page addresses to the corresponding shadow regions. Each
-/// shadow is large enough to hold one expression per byte on the shadowed page.
-extern std::map<uintptr_t, SymExpr *> g_shadow_pages;
+struct ShadowPage;
+
+/// The shadow pages that have been modified since the last garbage collection.
+/// This serves as the remembered set for minor collections (see
+/// collectReachableExpressions).
+extern std::vector<ShadowPage *> g_modified_shadow_pages;
+
+/// The shadow of a single page of memory.
+///
+/// Besides one expression per byte on the page, we maintain a bitmap of
+/// symbolic bytes (i.e., bytes with a non-null expression), so that checking a
+/// memory region for concreteness only requires a few word tests. The bitmap is
+/// kept up to date by the write iterators; code that modifies the expressions
+/// directly has to use the setters below.
+struct alignas(kPageSize) ShadowPage {
+  static constexpr size_t kBitmapWords = kPageSize / 64;
+
+  SymExpr expressions[kPageSize];
+  uint64_t symbolicBytes[kBitmapWords];
+
+  /// The number of bits set in the bitmap.
+  size_t symbolicCount;
+
+  /// The address of the shadowed page.
+  uintptr_t address;
+
+  /// Whether the page is in g_modified_shadow_pages.
+  bool modified;
+
+  /// Record that the page has been modified (which is implied by the setters
+  /// below).
+  void markModified() {
+    if (!modified) {
+      modified = true;
+      g_modified_shadow_pages.push_back(this);
+    }
+  }
+
+  /// Set the expression for the byte at the given offset.
+  void set(size_t offset, SymExpr expr) {
+    markModified();
+    auto &slot = expressions[offset];
+    auto bit = uint64_t(1) << (offset % 64);
+    if (slot == nullptr && expr != nullptr) {
+      symbolicBytes[offset / 64] |= bit;
+      symbolicCount++;
+    } else if (slot != nullptr && expr == nullptr) {
+      symbolicBytes[offset / 64] &= ~bit;
+      symbolicCount--;
+    }
+
+    slot = expr;
+  }
+
+  /// Check whether the page contains any symbolic bytes. Pages without
+  /// symbolic bytes can be dropped.
+  bool empty() const { return symbolicCount == 0; }
+
+  /// Check whether the given range on the page is free of symbolic bytes.
+  bool isConcrete(size_t offset, size_t length) const {
+    assert(offset + length <= kPageSize && "Range exceeds the page");
+    if (empty() || length == 0)
+      return true;
+
+    auto end = offset + length;
+    auto firstWord = offset / 64, lastWord = (end - 1) / 64;
+    auto firstMask = ~uint64_t(0) << (offset % 64);
+    auto lastMask = ~uint64_t(0) >> (63 - (end - 1) % 64);
+    if (firstWord == lastWord)
+      return (symbolicBytes[firstWord] & firstMask & lastMask) == 0;
+
+    // Or-ing the words in the middle (instead of exiting early) allows the
+    // compiler to vectorize the loop.
+    auto symbolic = (symbolicBytes[firstWord] & firstMask) |
+                    (symbolicBytes[lastWord] & lastMask);
+    for (auto word = firstWord + 1; word < lastWord; word++)
+      symbolic |= symbolicBytes[word];
+    return symbolic == 0;
+  }
+
+  /// Recompute the bitmap for the given range after modifying the
+  /// corresponding expressions directly.
+  void updateBitmap(size_t offset, size_t length);
+
+  /// Concretize the given range on the page.
+  void clear(size_t offset, size_t length);
+
+  /// Call the given function with the offset and the expression of each
+  /// symbolic byte on the page.
+  template <typename F> void forEachSymbolicByte(F &&f) const {
+    forEachSymbolicByte(0, kPageSize, std::forward<F>(f));
+  }
+
+  /// Like forEachSymbolicByte, but restricted to the given range on the page.
+  template <typename F>
+  void forEachSymbolicByte(size_t offset, size_t length, F &&f) const {
+    assert(offset + length <= kPageSize && "Range exceeds the page");
+    if (empty() || length == 0)
+      return;
+
+    auto end = offset + length;
+    for (auto word = offset / 64, lastWord = (end - 1) / 64; word <= lastWord;
+         word++) {
+      auto bits = symbolicBytes[word];
+      if (word == offset / 64)
+        bits &= ~uint64_t(0) << (offset % 64);
+      if (word == lastWord)
+        bits &= ~uint64_t(0) >> (63 - (end - 1) % 64);
+
+      for (; bits != 0; bits &= bits - 1) {
+        auto byte = word * 64 + __builtin_ctzll(bits);
+        f(byte, expressions[byte]);
+      }
+    }
+  }
+};
+
+struct LazyInput;
+
+/// Create the shadow of a lazy page, i.e., a page whose shadow consists of
+/// input bytes that we haven't created expressions for yet (see
+/// setInputShadow), and register it in place of the lazy entry.
+ShadowPage *materializeLazyPage(uintptr_t page);
+
+/// Check whether a lazy input has any bytes in the indicated memory range.
+/// Bytes of a lazy page outside the input are concrete.
+bool lazyInputOverlaps(const LazyInput *input, uintptr_t address,
+                       size_t length);
+
+/// A mapping from page addresses to the corresponding shadows.
+///
+/// Shadow lookups happen on every memory access of the target program, so we
+/// can't afford a balanced tree here. Instead, we use a two-level page table
+/// keyed by page number: the first level is a static directory, and the second
+/// level consists of tables that we allocate on demand (each covering a large
+/// contiguous part of the address space). A lookup is thus two dependent loads.
+/// Since consecutive accesses tend to hit the same page, we additionally cache
+/// the result of the last lookup.
+///
+/// Addresses beyond the range covered by the table (i.e., beyond 48 bits on
+/// 64-bit systems) are handled by a slow fallback map.
+///
+/// Besides real shadows, an entry can refer to a lazy input (tagged in the
+/// lowest bit, which is always clear in pointers to shadows). Lookups create
+/// the shadow of such pages on first access, so that the rest of the runtime
+/// never sees lazy entries.
+///
+/// In multithreaded programs, all accesses require the runtime lock, except for
+/// mayContain (see Threads.h). The table reads and writes its entries
+/// atomically to make that possible; this compiles to plain loads and stores.
+class ShadowPageTable {
+public:
+  ShadowPageTable() = default;
+  ShadowPageTable(const ShadowPageTable &) = delete;
+  ShadowPageTable &operator=(const ShadowPageTable &) = delete;
+
+  /// Find the shadow of the page starting at the given address, or return null
+  /// if the page doesn't have a shadow.
+  ShadowPage *lookup(uintptr_t page) {
+    assert(pageOffset(page) == 0 && "Page addresses must be aligned");
+    if (page == cachedPage_)
+      return cachedShadow_;
+
+    auto *shadow = entry(page);
+    if (isLazy(shadow))
+      return materializeLazyPage(page);
+
+    cachedPage_ = page;
+    cachedShadow_ = shadow;
+    return shadow;
+  }
+
+  /// Like lookup, but treat lazy pages as unshadowed instead of creating their
+  /// shadow.
+  ShadowPage *find(uintptr_t page) const {
+    assert(pageOffset(page) == 0 && "Page addresses must be aligned");
+    auto *shadow = entry(page);
+    return isLazy(shadow) ? nullptr : shadow;
+  }
+
+  /// Like lookup, but don't create the shadow of a lazy page; return null and
+  /// set lazy to the page's input instead. For callers that only need to know
+  /// whether bytes are symbolic.
+  ShadowPage *peek(uintptr_t page, const LazyInput *&lazy) {
+    assert(pageOffset(page) == 0 && "Page addresses must be aligned");
+    lazy = nullptr;
+    if (page == cachedPage_)
+      return cachedShadow_;
+
+    auto *shadow = entry(page);
+    if (isLazy(shadow)) {
+      lazy = lazyInput(shadow);
+      return nullptr;
+    }
+
+    cachedPage_ = page;
+    cachedShadow_ = shadow;
+    return shadow;
+  }
+
+  /// Return the input of the page starting at the given address if the page
+  /// is lazy, or null otherwise.
+  LazyInput *findLazy(uintptr_t page) const {
+    assert(pageOffset(page) == 0 && "Page addresses must be aligned");
+    auto *shadow = entry(page);
+    return isLazy(shadow) ? lazyInput(shadow) : nullptr;
+  }
+
+  /// Check whether the page starting at the given address has any entry, be it
+  /// a shadow or a lazy input.
+  bool contains(uintptr_t page) const {
+    assert(pageOffset(page) == 0 && "Page addresses must be aligned");
+    return entry(page) != nullptr;
+  }
+
+  /// Like contains, but safe to call without the runtime lock while another
+  /// thread modifies the table. Pages beyond the range of the table are
+  /// assumed to have an entry.
+  bool mayContain(uintptr_t page) const {
+    auto pageNumber = page / kPageSize;
+    if (pageNumber >= kMaxPageNumber)
+      return true;
+
+    auto *table = loadTable(pageNumber);
+    return table != nullptr && loadEntry(table, pageNumber) != nullptr;
+  }
+
+  /// Register the shadow for the page starting at the given address. The page
+  /// must not have a shadow yet.
+  void insert(uintptr_t page, ShadowPage *shadow) {
+    assert(pageOffset(page) == 0 && "Page addresses must be aligned");
+    assert(!contains(page) && "Page is already shadowed");
+    assert(shadow != nullptr && "Shadows can't be null");
+
+    setEntry(page, shadow);
+    cachedPage_ = page;
+    cachedShadow_ = shadow;
+    size_++;
+  }
+
+  /// Remove the shadow of the page starting at the given address and return
+  /// it, or null if the page wasn't shadowed. The page must not be lazy.
+  ShadowPage *erase(uintptr_t page) {
+    assert(pageOffset(page) == 0 && "Page addresses must be aligned");
+
+    auto *shadow = entry(page);
+    assert(!isLazy(shadow) && "Lazy pages can't be erased");
+    setEntry(page, nullptr);
+
+    if (page == cachedPage_)
+      cachedShadow_ = nullptr;
+    if (shadow != nullptr)
+      size_--;
+    return shadow;
+  }
+
+  /// Make the page starting at the given address lazy, i.e., its shadow will
+  /// be created from the given input on first access. The page must not have
+  /// an entry yet.
+  void insertLazy(uintptr_t page, LazyInput *input) {
+    assert(pageOffset(page) == 0 && "Page addresses must be aligned");
+    assert(!contains(page) && "Page is already shadowed");
+
+    setEntry(page, reinterpret_cast<ShadowPage *>(
+                       reinterpret_cast<uintptr_t>(input) | kLazyTag));
+    // The cache may remember that the page doesn't have a shadow.
+    if (page == cachedPage_)
+      cachedPage_ = 1;
+  }
+
+  /// Remove the lazy entry of the page starting at the given address and
+  /// return its input.
+  LazyInput *takeLazy(uintptr_t page) {
+    assert(pageOffset(page) == 0 && "Page addresses must be aligned");
+
+    auto *shadow = entry(page);
+    assert(isLazy(shadow) && "Page is not lazy");
+    setEntry(page, nullptr);
+    return lazyInput(shadow);
+  }
+
+  /// Call the given function with the address and the shadow of each
+  /// shadowed page, in ascending order of addresses. Lazy pages are skipped.
+  template <typename F> void forEach(F &&f) const {
+    forEachEntry([&](uintptr_t page, ShadowPage *shadow) {
+      if (!isLazy(shadow))
+        f(page, shadow);
+    });
+  }
+
+  /// Call the given function with the address and the input of each lazy
+  /// page.
+  template <typename F> void forEachLazy(F &&f) const {
+    forEachEntry([&](uintptr_t page, ShadowPage *shadow) {
+      if (isLazy(shadow))
+        f(page, lazyInput(shadow));
+    });
+  }
+
+  /// The number of shadowed pages, not counting lazy ones.
+  size_t size() const { return size_; }
+
+private:
+  static constexpr uintptr_t kLazyTag = 1;
+
+  static bool isLazy(const ShadowPage *shadow) {
+    return (reinterpret_cast<uintptr_t>(shadow) & kLazyTag) != 0;
+  }
+
+  static LazyInput *lazyInput(const ShadowPage *shadow) {
+    return reinterpret_cast<LazyInput *>(reinterpret_cast<uintptr_t>(shadow) &
+                                         ~kLazyTag);
+  }
+
+  /// The second-level table for the page number, or null if there is none.
+  ShadowPage **loadTable(uintptr_t pageNumber) const {
+    // Pairs with the release store in setEntry, so that concurrent readers see
+    // the cleared table.
+    return __atomic_load_n(&directory_[pageNumber >> kTableBits],
+                           __ATOMIC_ACQUIRE);
+  }
+
+  static ShadowPage *loadEntry(ShadowPage **table, uintptr_t pageNumber) {
+    return __atomic_load_n(&table[pageNumber & kTableMask], __ATOMIC_RELAXED);
+  }
+
+  /// The raw table entry for the page, or null if there is none.
+  ShadowPage *entry(uintptr_t page) const {
+    if (auto pageNumber = page / kPageSize; pageNumber < kMaxPageNumber) {
+      if (auto *table = loadTable(pageNumber))
+        return loadEntry(table, pageNumber);
+    } else if (auto it = fallback_.find(page); it != fallback_.end()) {
+      return it->second;
+    }
+
+    return nullptr;
+  }
+
+  /// Set the raw table entry for the page; null removes the entry.
+  void setEntry(uintptr_t page, ShadowPage *value) {
+    if (auto pageNumber = page / kPageSize; pageNumber < kMaxPageNumber) {
+      auto *table = loadTable(pageNumber);
+      if (table == nullptr) {
+        if (value == nullptr)
+          return;
+        table = static_cast<ShadowPage **>(
+            calloc(kTableSize, sizeof(ShadowPage *)));
+        __atomic_store_n(&directory_[pageNumber >> kTableBits], table,
+                         __ATOMIC_RELEASE);
+      }
+      __atomic_store_n(&table[pageNumber & kTableMask], value,
+                       __ATOMIC_RELAXED);
+    } else if (value != nullptr) {
+      fallback_[page] = value;
+    } else {
+      fallback_.erase(page);
+    }
+  }
+
+  template <typename F> void forEachEntry(F &&f) const {
+    for (uintptr_t tableIndex = 0; tableIndex < kDirectorySize; tableIndex++) {
+      auto *table = directory_[tableIndex];
+      if (table == nullptr)
+        continue;
+
+      for (uintptr_t entry = 0; entry < kTableSize; entry++) {
+        if (table[entry] != nullptr)
+          f(((tableIndex << kTableBits) | entry) * kPageSize, table[entry]);
+      }
+    }
+
+    for (const auto &[page, shadow] : fallback_)
+      f(page, shadow);
+  }
+
+  /// The number of page-number bits that the table can resolve.
+  static constexpr unsigned kPageNumberBits =
+      (sizeof(uintptr_t) == 8 ? 48 : 32) - 12;
+  static_assert(kPageSize == (uintptr_t(1) << 12),
+                "The page table assumes 4 KiB pages");
+
+  /// The number of page-number bits resolved by the second level.
+  static constexpr unsigned kTableBits = kPageNumberBits / 2;
+
+  static constexpr uintptr_t kMaxPageNumber = uintptr_t(1) << kPageNumberBits;
+  static constexpr uintptr_t kTableSize = uintptr_t(1) << kTableBits;
+  static constexpr uintptr_t kTableMask = kTableSize - 1;
+  static constexpr uintptr_t kDirectorySize =
+      uintptr_t(1) << (kPageNumberBits - kTableBits);
+
+  /// The first level of the table. Second-level tables are allocated lazily
+  /// and never freed. We don't initialize the directory explicitly because
+  /// that would make the compiler clear it at run time; the global table lives
+  /// in static storage and is thus zero-initialized anyway.
+  ShadowPage **directory_[kDirectorySize];
+
+  /// Pages that the table can't represent.
+  std::map<uintptr_t, ShadowPage *> fallback_;
+
+  /// The result of the most recent lookup, which is never a lazy entry.
+  uintptr_t cachedPage_ = 1; // never a valid page address
+  ShadowPage *cachedShadow_ = nullptr;
+
+  size_t size_ = 0;
+};
+
+extern ShadowPageTable g_shadow_pages;
+
+/// Allocate the shadow for a page, initialized to all null.
+///
+/// Shadow pages are carved out of large anonymous mappings that we reserve
+/// without committing memory, so the parts of a shadow that are never written
+/// remain backed by the kernel's zero page and don't cost any physical memory.
+/// It also means that we don't need to clear new shadows explicitly.
+ShadowPage *allocateShadowPage();
+
+/// Allocate the shadow for the page starting at the given address and register
+/// it in g_shadow_pages, which must not have a shadow for the page yet.
+ShadowPage *createShadowPage(uintptr_t address);
+
+/// Remove the shadows of all pages that don't contain symbolic bytes anymore,
+/// returning their memory to the system. Optionally, only consider the pages in
+/// g_modified_shadow_pages (any page that became empty must have been modified
+/// at some point).
+///
+/// Dropping pages invalidates any shadow iterators pointing to them, so this
+/// must only be called at points where no iterators are live.
+void dropEmptyShadowPages(bool onlyModified = false);
+
+/// Copy the shadow of a memory region to another one, with the semantics of
+/// memmove (i.e., the regions may overlap).
+///
+/// In contrast to copying via shadow iterators, this works on whole runs of
+/// bytes within a page at a time. Destination pages that end up without
+/// symbolic bytes are dropped.
+void copyShadow(uintptr_t dest, uintptr_t src, size_t length);
+
+/// Set all bytes in a memory region to the same expression, which may be null
+/// to concretize the region. Like copyShadow, this works on page-sized runs and
+/// drops pages that become concrete.
+void fillShadow(uintptr_t dest, SymExpr value, size_t length);
+
+/// Set the shadow of a memory region to consecutive input bytes, starting at
+/// the given input offset. The backend must know the concrete values of the
+/// input bytes already (see _sym_get_input_bytes).
+///
+/// Programs often map or read large inputs but only look at a small part of
+/// them, so we don't create the expressions right away: pages that don't have
+/// a shadow become lazy, and their shadow is only created on first access.
+/// Memory and time are thus proportional to the input that the program
+/// actually examines. Small regions, as well as parts of the region that
+/// share a page with existing shadow, are handled eagerly.
+void setInputShadow(uintptr_t address, size_t length, size_t inputOffset);
+
+/// Save a copy of all shadow pages for restoreShadow (see symcc_snapshot).
+void snapshotShadow();
+
+/// Reset the shadow memory to the state saved by snapshotShadow.
+///
+/// Pages that are in the snapshot get their saved contents back, and other
+/// pages are dropped, so the cost is proportional to the number of live shadow
+/// pages. Like dropEmptyShadowPages, this invalidates shadow iterators.
+void restoreShadow();
+
+/// The shadow pages saved by the last snapshot, sorted by address. Their
+/// expressions must be kept alive.
+const std::vector<ShadowPage> &shadowSnapshot();
 
 /// An iterator that walks over the shadow bytes corresponding to a memory
 /// region. If there is no shadow for any given memory address, it just returns
@@ -61,7 +532,7 @@ extern std::map<uintptr_t, SymExpr *> g_shadow_pages;
 class ReadShadowIterator {
 public:
   explicit ReadShadowIterator(uintptr_t address)
-      : address_(address), shadow_(getShadow(address)) {}
+      : address_(address), page_(getPage(address)) {}
 
   // The STL requires iterator types to expose the following type definitions
   // (see std::iterator_traits). Before C++17, it was possible to get them by
@@ -75,28 +546,25 @@ public:
   using reference = SymExpr &;
 
   ReadShadowIterator &operator++() {
-    auto previousAddress = address_++;
-    if (shadow_ != nullptr)
-      shadow_++;
-    if (pageStart(address_) != pageStart(previousAddress))
-      shadow_ = getShadow(address_);
+    address_++;
+    if (pageOffset(address_) == 0)
+      page_ = getPage(address_);
     return *this;
   }
 
   ReadShadowIterator &operator--() {
-    auto previousAddress = address_--;
-    if (shadow_ != nullptr)
-      shadow_--;
-    if (pageStart(address_) != pageStart(previousAddress))
-      shadow_ = getShadow(address_);
+    address_--;
+    if (pageOffset(address_) == kPageSize - 1)
+      page_ = getPage(address_);
     return *this;
   }
 
   SymExpr operator*() {
-    assert((shadow_ == nullptr || *shadow_ == nullptr ||
-            _sym_bits_helper(*shadow_) == 8) &&
+    auto *expr =
+        page_ != nullptr ? page_->expressions[pageOffset(address_)] : nullptr;
+    assert((expr == nullptr || _sym_bits_helper(expr) == 8) &&
            "Shadow memory always represents bytes");
-    return shadow_ != nullptr ? *shadow_ : nullptr;
+    return expr;
   }
 
   bool operator==(const ReadShadowIterator &other) const {
@@ -108,16 +576,12 @@ public:
   }
 
 protected:
-  static SymExpr *getShadow(uintptr_t address) {
-    if (auto shadowPageIt = g_shadow_pages.find(pageStart(address));
-        shadowPageIt != g_shadow_pages.end())
-      return shadowPageIt->second + pageOffset(address);
-
-    return nullptr;
+  static ShadowPage *getPage(uintptr_t address) {
+    return g_shadow_pages.lookup(pageStart(address));
   }
 
   uintptr_t address_;
-  SymExpr *shadow_;
+  ShadowPage *page_;
 };
 
 /// Like ReadShadowIterator, but return an expression for the concrete memory
@@ -136,42 +600,64 @@ public:
 };
 
 /// An iterator that walks over the shadow corresponding to a memory region and
-/// exposes it for modification. If there is no shadow yet, it creates a new
-/// one.
+/// exposes it for modification. If there is no shadow yet, it creates a new one
+/// as soon as a symbolic expression is written; writing null to memory without
+/// shadow is a no-op, so concretizing memory never allocates shadow pages.
 class WriteShadowIterator : public ReadShadowIterator {
 public:
-  WriteShadowIterator(uintptr_t address) : ReadShadowIterator(address) {
-    shadow_ = getOrCreateShadow(address);
-  }
+  /// A reference to a shadow byte that may not exist yet.
+  class Reference {
+  public:
+    explicit Reference(WriteShadowIterator &iterator) : iterator_(iterator) {}
+
+    Reference &operator=(SymExpr expr) {
+      if (iterator_.page_ == nullptr) {
+        if (expr == nullptr)
+          return *this;
+
+        iterator_.page_ = getOrCreatePage(iterator_.address_);
+      }
+
+      iterator_.page_->set(pageOffset(iterator_.address_), expr);
+      return *this;
+    }
+
+    Reference &operator=(const Reference &other) {
+      return *this = static_cast<SymExpr>(other);
+    }
+
+    operator SymExpr() const {
+      return iterator_.page_ != nullptr
+                 ? iterator_.page_->expressions[pageOffset(iterator_.address_)]
+                 : nullptr;
+    }
+
+  private:
+    WriteShadowIterator &iterator_;
+  };
+
+  using reference = Reference;
+
+  WriteShadowIterator(uintptr_t address) : ReadShadowIterator(address) {}
 
   WriteShadowIterator &operator++() {
-    auto previousAddress = address_++;
-    shadow_++;
-    if (pageStart(address_) != pageStart(previousAddress))
-      shadow_ = getOrCreateShadow(address_);
+    ReadShadowIterator::operator++();
     return *this;
   }
 
   WriteShadowIterator &operator--() {
-    auto previousAddress = address_--;
-    shadow_--;
-    if (pageStart(address_) != pageStart(previousAddress))
-      shadow_ = getOrCreateShadow(address_);
+    ReadShadowIterator::operator--();
     return *this;
   }
 
-  SymExpr &operator*() { return *shadow_; }
+  Reference operator*() { return Reference(*this); }
 
 protected:
-  static SymExpr *getOrCreateShadow(uintptr_t address) {
-    if (auto *shadow = getShadow(address))
-      return shadow;
+  static ShadowPage *getOrCreatePage(uintptr_t address) {
+    if (auto *page = getPage(address))
+      return page;
 
-    auto *newShadow =
-        static_cast<SymExpr *>(malloc(kPageSize * sizeof(SymExpr)));
-    memset(newShadow, 0, kPageSize * sizeof(SymExpr));
-    g_shadow_pages[pageStart(address)] = newShadow;
-    return newShadow + pageOffset(address);
+    return createShadowPage(pageStart(address));
   }
 };
 
@@ -211,17 +697,64 @@ template <typename T> struct ReadWriteShadow {
 };
 
 /// Check whether the indicated memory range is concrete, i.e., there is no
-/// symbolic byte in the entire region.
+/// symbolic byte in the entire region. Lazy pages are answered from their
+/// input, without creating their shadow.
 template <typename T> bool isConcrete(T *addr, size_t nbytes) {
-  // Fast path for allocations within one page.
-  auto byteBuf = reinterpret_cast<uintptr_t>(addr);
-  if (pageStart(byteBuf) == pageStart(byteBuf + nbytes) &&
-      !g_shadow_pages.count(pageStart(byteBuf)))
-    return true;
-
-  ReadOnlyShadow shadow(addr, nbytes);
-  return std::all_of(shadow.begin(), shadow.end(),
-                     [](SymExpr expr) { return (expr == nullptr); });
+  auto address = reinterpret_cast<uintptr_t>(addr);
+  while (nbytes > 0) {
+    auto offset = pageOffset(address);
+    auto length = std::min<size_t>(nbytes, kPageSize - offset);
+    const LazyInput *lazy;
+    auto *page = g_shadow_pages.peek(pageStart(address), lazy);
+    if ((page != nullptr && !page->isConcrete(offset, length)) ||
+        (lazy != nullptr && lazyInputOverlaps(lazy, address, length))) {
+      countConcretenessCheck(false);
+      return false;
+    }
+
+    address += length;
+    nbytes -= length;
+  }
+
+  countConcretenessCheck(true);
+  return true;
+}
+
+/// Check whether any page of the indicated memory range has a shadow or lazy
+/// input. In contrast to isConcrete, this doesn't need the runtime lock and
+/// doesn't modify any state, so accesses to unshadowed memory in multithreaded
+/// programs can skip the lock (see Threads.h). A page that another thread
+/// shadows at the same time may or may not be seen, but then the program races
+/// on the memory anyway.
+template <typename T> bool mayBeSymbolic(T *addr, size_t nbytes) {
+  auto address = reinterpret_cast<uintptr_t>(addr);
+  for (auto page = pageStart(address); page < address + nbytes;
+       page += kPageSize) {
+    if (g_shadow_pages.mayContain(page))
+      return true;
+  }
+
+  return false;
+}
+
+/// Call the given function with the position (relative to the start of the
+/// region) and the expression of each symbolic byte in the indicated memory
+/// range, in ascending order. Like isConcrete, this skips concrete data a
+/// bitmap word at a time.
+template <typename T, typename F>
+void forEachSymbolicByte(T *addr, size_t nbytes, F &&f) {
+  auto address = reinterpret_cast<uintptr_t>(addr);
+  for (size_t done = 0; done < nbytes;) {
+    auto offset = pageOffset(address + done);
+    auto length = std::min<size_t>(nbytes - done, kPageSize - offset);
+    if (auto *page = g_shadow_pages.lookup(pageStart(address + done))) {
+      page->forEachSymbolicByte(offset, length, [&](size_t byte, SymExpr expr) {
+        f(done + (byte - offset), expr);
+      });
+    }
+
+    done += length;
+  }
 }
 
 #endif
@@ -0,0 +1,32 @@
+// This file is part of the SymCC runtime.
+//
+// The SymCC runtime is free software: you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// The SymCC runtime is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+// for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with the SymCC runtime. If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+//
+// The backend-specific parts of symcc_snapshot and symcc_restore. The common
+// runtime saves and restores the shadow memory and the input state; each
+// backend implements these functions for its solver state.
+//
+
+/// Save the backend's path constraints and input bytes.
+void snapshotBackend();
+
+/// Return to the state saved by snapshotBackend, and free all expressions that
+/// aren't reachable anymore. Called after the shadow memory has been restored.
+void restoreBackend();
+
+#endif
@@ -0,0 +1,320 @@
+// This file is part of the SymCC runtime.
+//
+// The SymCC runtime is free software: you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// The SymCC runtime is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+// for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with the SymCC runtime. If not, see <https://www.gnu.org/licenses/>.
+
+#include "Statistics.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <utility>
+#include <vector>
+
+#include <sys/resource.h>
+
+#include "Config.h"
+#include "Threads.h"
+
+bool g_statistics_enabled = false;
+thread_local ThreadStatistics *t_statistics = nullptr;
+volatile std::sig_atomic_t g_statistics_dump_requested = 0;
+
+namespace {
+
+/// The counters of all threads, and the names of expression kinds.
+///
+/// The registry is never destroyed because threads may still count events
+/// while the process runs its exit handlers. For the same reason, the counters
+/// of a thread stay around after the thread has finished, which also keeps its
+/// events in the output.
+struct Registry {
+  std::mutex mutex;
+  std::vector<ThreadStatistics *> threads;
+  std::unordered_map<uint32_t, std::string> kindNames;
+};
+
+Registry &registry() {
+  static auto *registry = new Registry;
+  return *registry;
+}
+
+/// Serializes writers of the statistics file.
+std::mutex g_dump_mutex;
+
+uint64_t microseconds(std::chrono::steady_clock::duration time) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(time).count();
+}
+
+/// Print a string as a JSON string literal.
+void printJsonString(std::ostream &out, const std::string &s) {
+  out << '"';
+  for (unsigned char c : s) {
+    if (c == '"' || c == '\\') {
+      out << '\\' << c;
+    } else if (c < 0x20) {
+      char escaped[8];
+      snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+      out << escaped;
+    } else {
+      out << c;
+    }
+  }
+  out << '"';
+}
+
+/// The statistics of all threads, added up.
+struct Totals {
+  std::unordered_map<std::string, uint64_t> expressionsByKind;
+  uint64_t expressions = 0;
+  uint64_t otherExpressions = 0;
+  uint64_t registeredExpressions = 0;
+  uint64_t shadowPages = 0;
+  uint64_t concretenessChecks = 0;
+  uint64_t concreteRegions = 0;
+  uint64_t minorCollections = 0;
+  uint64_t fullCollections = 0;
+  uint64_t collectedExpressions = 0;
+  uint64_t collectionTime = 0;
+  uint64_t longestCollection = 0;
+  uint64_t largestRegistry = 0;
+  std::unordered_map<uintptr_t, SiteTotals> sites;
+};
+
+Totals addUpThreads() {
+  std::vector<ThreadStatistics *> threads;
+  std::unordered_map<uint32_t, std::string> kindNames;
+  {
+    auto &r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    threads = r.threads;
+    kindNames = r.kindNames;
+  }
+
+  Totals totals;
+  for (auto *stats : threads) {
+    for (auto &entry : stats->expressionsByKind) {
+      auto key = entry.key.load(std::memory_order_acquire);
+      if (key == 0)
+        continue;
+
+      auto count = entry.count.get();
+      totals.expressionsByKind[kindNames[key - 1]] += count;
+      totals.expressions += count;
+    }
+
+    totals.otherExpressions += stats->otherExpressions.get();
+    totals.expressions += stats->otherExpressions.get();
+    totals.registeredExpressions += stats->registeredExpressions.get();
+    totals.shadowPages += stats->shadowPages.get();
+    totals.concretenessChecks += stats->concretenessChecks.get();
+    totals.concreteRegions += stats->concreteRegions.get();
+    totals.minorCollections += stats->minorCollections.get();
+    totals.fullCollections += stats->fullCollections.get();
+    totals.collectedExpressions += stats->collectedExpressions.get();
+    totals.collectionTime += stats->collectionTime.get();
+    totals.longestCollection =
+        std::max(totals.longestCollection, stats->longestCollection.get());
+    totals.largestRegistry =
+        std::max(totals.largestRegistry, stats->largestRegistry.get());
+
+    std::lock_guard<std::mutex> lock(stats->sitesMutex);
+    for (auto &[site, siteTotals] : stats->sites) {
+      auto &sum = totals.sites[site];
+      sum.sat += siteTotals.sat;
+      sum.unsat += siteTotals.unsat;
+      sum.timeouts += siteTotals.timeouts;
+      sum.time += siteTotals.time;
+    }
+  }
+
+  return totals;
+}
+
+void printStatistics(std::ostream &out, const Totals &totals) {
+  std::vector<std::pair<std::string, uint64_t>> kinds(
+      totals.expressionsByKind.begin(), totals.expressionsByKind.end());
+  std::sort(kinds.begin(), kinds.end(),
+            [](auto &a, auto &b) { return a.second > b.second; });
+  if (totals.otherExpressions != 0)
+    kinds.emplace_back("other", totals.otherExpressions);
+
+  out << "{\n  \"expressions\": {\n"
+      << "    \"built\": " << totals.expressions << ",\n"
+      << "    \"registered\": " << totals.registeredExpressions << ",\n"
+      << "    \"by_kind\": {";
+  for (size_t i = 0; i < kinds.size(); i++) {
+    out << ((i == 0) ? "\n      " : ",\n      ");
+    printJsonString(out, kinds[i].first);
+    out << ": " << kinds[i].second;
+  }
+  out << "\n    }\n  },\n";
+
+  // Expressions leave the registry only when they are collected.
+  auto registrySize =
+      totals.registeredExpressions - totals.collectedExpressions;
+  out << "  \"registry\": {\n"
+      << "    \"size\": " << registrySize << ",\n"
+      << "    \"largest\": " << std::max(registrySize, totals.largestRegistry)
+      << "\n  },\n";
+
+  auto concreteRate =
+      (totals.concretenessChecks == 0)
+          ? 0.0
+          : double(totals.concreteRegions) / totals.concretenessChecks;
+  out << "  \"shadow\": {\n"
+      << "    \"pages_allocated\": " << totals.shadowPages << ",\n"
+      << "    \"concreteness_checks\": " << totals.concretenessChecks
+      << ",\n"
+      << "    \"concrete\": " << totals.concreteRegions << ",\n"
+      << "    \"concrete_rate\": " << concreteRate << "\n  },\n";
+
+  out << "  \"gc\": {\n"
+      << "    \"minor\": " << totals.minorCollections << ",\n"
+      << "    \"full\": " << totals.fullCollections << ",\n"
+      << "    \"collected\": " << totals.collectedExpressions << ",\n"
+      << "    \"pause_us\": " << totals.collectionTime << ",\n"
+      << "    \"longest_pause_us\": " << totals.longestCollection
+      << "\n  },\n";
+
+  std::vector<std::pair<uintptr_t, SiteTotals>> sites(totals.sites.begin(),
+                                                      totals.sites.end());
+  std::sort(sites.begin(), sites.end(), [](auto &a, auto &b) {
+    return a.second.time > b.second.time;
+  });
+
+  SiteTotals sum;
+  for (auto &[site, siteTotals] : sites) {
+    sum.sat += siteTotals.sat;
+    sum.unsat += siteTotals.unsat;
+    sum.timeouts += siteTotals.timeouts;
+    sum.time += siteTotals.time;
+  }
+
+  out << "  \"solver\": {\n"
+      << "    \"queries\": " << (sum.sat + sum.unsat + sum.timeouts) << ",\n"
+      << "    \"sat\": " << sum.sat << ",\n"
+      << "    \"unsat\": " << sum.unsat << ",\n"
+      << "    \"timeout\": " << sum.timeouts << ",\n"
+      << "    \"time_us\": " << microseconds(sum.time) << ",\n"
+      << "    \"sites\": [";
+  for (size_t i = 0; i < sites.size(); i++) {
+    auto &[site, siteTotals] = sites[i];
+    out << ((i == 0) ? "\n      " : ",\n      ") << "{\"site\": \"0x"
+        << std::hex << site << std::dec << "\", \"sat\": " << siteTotals.sat
+        << ", \"unsat\": " << siteTotals.unsat
+        << ", \"timeout\": " << siteTotals.timeouts
+        << ", \"time_us\": " << microseconds(siteTotals.time) << "}";
+  }
+  out << (sites.empty() ? "" : "\n    ") << "]\n  },\n";
+
+  // The kernel reports the maximum resident set size in kilobytes.
+  struct rusage usage = {};
+  getrusage(RUSAGE_SELF, &usage);
+  out << "  \"process\": {\n"
+      << "    \"peak_rss_kb\": " << usage.ru_maxrss << ",\n"
+      << "    \"multithreaded\": "
+      << (runtimeIsMultithreaded() ? "true" : "false") << "\n  }\n}\n";
+}
+
+void handleDumpSignal(int) { g_statistics_dump_requested = 1; }
+
+void dumpStatisticsAtExit() {
+  if (g_statistics_enabled)
+    dumpStatistics();
+}
+
+} // namespace
+
+ThreadStatistics *registerThreadStatistics() {
+  auto *stats = new ThreadStatistics;
+  auto &r = registry();
+  std::lock_guard<std::mutex> lock(r.mutex);
+  r.threads.push_back(stats);
+  return stats;
+}
+
+void initStatistics() {
+  if (g_config.statsFile.empty())
+    return;
+
+  g_statistics_enabled = true;
+  atexit(dumpStatisticsAtExit);
+
+  // We can't write the file in the signal handler, so we just take note of
+  // the request; the next counted event handles it.
+  struct sigaction action = {};
+  action.sa_handler = handleDumpSignal;
+  action.sa_flags = SA_RESTART;
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGUSR1, &action, nullptr);
+}
+
+void dumpStatistics() {
+  std::lock_guard<std::mutex> lock(g_dump_mutex);
+  g_statistics_dump_requested = 0;
+
+  std::ofstream out(g_config.statsFile);
+  if (!out) {
+    std::cerr << "Can't write statistics to " << g_config.statsFile << ": "
+              << strerror(errno) << std::endl;
+    return;
+  }
+
+  printStatistics(out, addUpThreads());
+}
+
+void nameExpressionKind(uint32_t kind, std::string name) {
+  auto &r = registry();
+  std::lock_guard<std::mutex> lock(r.mutex);
+  r.kindNames.try_emplace(kind, std::move(name));
+}
+
+void recordQuery(uintptr_t site, QueryOutcome outcome,
+                 std::chrono::steady_clock::duration time) {
+  if (!statisticsEnabled())
+    return;
+
+  auto &stats = threadStatistics();
+  {
+    std::lock_guard<std::mutex> lock(stats.sitesMutex);
+    auto &siteTotals = stats.sites[site];
+    if (outcome == QueryOutcome::Sat)
+      siteTotals.sat++;
+    else if (outcome == QueryOutcome::Unsat)
+      siteTotals.unsat++;
+    else
+      siteTotals.timeouts++;
+    siteTotals.time += time;
+  }
+
+  dumpStatisticsIfRequested();
+}
+
+void recordCollection(bool full, std::chrono::steady_clock::duration time,
+                      size_t expressionsBefore, size_t expressionsAfter) {
+  if (!statisticsEnabled())
+    return;
+
+  auto &stats = threadStatistics();
+  (full ? stats.fullCollections : stats.minorCollections).add();
+  stats.collectedExpressions.add(expressionsBefore - expressionsAfter);
+  stats.collectionTime.add(microseconds(time));
+  stats.longestCollection.raiseTo(microseconds(time));
+  stats.largestRegistry.raiseTo(expressionsBefore);
+  dumpStatisticsIfRequested();
+}
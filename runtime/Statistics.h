@@ -0,0 +1,201 @@
+// This file is part of the SymCC runtime.
+//
+// The SymCC runtime is free software: you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// The SymCC runtime is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+// for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with the SymCC runtime. If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef STATISTICS_H
+#define STATISTICS_H
+
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+//
+// Run-time statistics
+//
+// When g_config.statsFile is set, the runtime counts what happens on its hot
+// paths (expression construction, shadow memory, solver queries and garbage
+// collection) and writes the numbers as JSON to that file at exit, or whenever
+// the process receives SIGUSR1.
+//
+// The counters live in a cache-aligned block per thread, so counting is a
+// plain increment without synchronization. Only the owning thread writes a
+// block; the thread that writes the statistics merely reads it. When counting
+// is disabled, each call site costs a load and a branch.
+//
+
+/// Is counting enabled? Set once by initStatistics.
+extern bool g_statistics_enabled;
+
+inline bool statisticsEnabled() { return g_statistics_enabled; }
+
+/// A counter that is written by a single thread but may be read by others.
+class StatisticsCounter {
+public:
+  void add(uint64_t n = 1) {
+    value_.store(value_.load(std::memory_order_relaxed) + n,
+                 std::memory_order_relaxed);
+  }
+
+  void raiseTo(uint64_t n) {
+    if (n > value_.load(std::memory_order_relaxed))
+      value_.store(n, std::memory_order_relaxed);
+  }
+
+  uint64_t get() const { return value_.load(std::memory_order_relaxed); }
+
+private:
+  std::atomic<uint64_t> value_{0};
+};
+
+enum class QueryOutcome { Sat, Unsat, Timeout };
+
+/// The per-site solver statistics.
+struct SiteTotals {
+  uint64_t sat = 0;
+  uint64_t unsat = 0;
+  uint64_t timeouts = 0;
+  std::chrono::steady_clock::duration time{};
+};
+
+/// The counters of one thread.
+struct alignas(64) ThreadStatistics {
+  /// The number of slots for expression kinds; kinds are backend-specific, and
+  /// neither backend produces more than a few dozen.
+  static constexpr size_t kExpressionKinds = 128;
+
+  /// Expressions built, by kind (open addressing on the kind plus one, so that
+  /// zero marks a free slot).
+  struct {
+    std::atomic<uint32_t> key{0};
+    StatisticsCounter count;
+  } expressionsByKind[kExpressionKinds];
+
+  /// Expressions of kinds that didn't fit into the table.
+  StatisticsCounter otherExpressions;
+
+  /// Built expressions that were new to the expression registry.
+  StatisticsCounter registeredExpressions;
+
+  StatisticsCounter shadowPages;
+  StatisticsCounter concretenessChecks;
+  StatisticsCounter concreteRegions;
+
+  StatisticsCounter minorCollections;
+  StatisticsCounter fullCollections;
+  StatisticsCounter collectedExpressions;
+  StatisticsCounter collectionTime; // in microseconds
+  StatisticsCounter longestCollection; // in microseconds
+  StatisticsCounter largestRegistry;
+
+  /// Solver statistics by site; solving is orders of magnitude slower than an
+  /// uncontended lock.
+  std::mutex sitesMutex;
+  std::unordered_map<uintptr_t, SiteTotals> sites;
+};
+
+/// The calling thread's counters, or null before its first event.
+extern thread_local ThreadStatistics *t_statistics;
+
+/// Create the calling thread's counters.
+ThreadStatistics *registerThreadStatistics();
+
+inline ThreadStatistics &threadStatistics() {
+  if (t_statistics == nullptr)
+    t_statistics = registerThreadStatistics();
+  return *t_statistics;
+}
+
+/// Enable counting if configured, and arrange for the statistics to be
+/// written. Call after loadConfig.
+void initStatistics();
+
+/// Write the statistics that the process has collected so far.
+void dumpStatistics();
+
+/// Set by the SIGUSR1 handler; the next event writes the statistics.
+extern volatile std::sig_atomic_t g_statistics_dump_requested;
+
+inline void dumpStatisticsIfRequested() {
+  if (g_statistics_dump_requested != 0)
+    dumpStatistics();
+}
+
+/// Remember the name of a backend-specific expression kind, for the output.
+void nameExpressionKind(uint32_t kind, std::string name);
+
+/// Count the construction of an expression of the given kind; isNew indicates
+/// whether it was added to the expression registry. The name is computed only
+/// the first time that the thread sees the kind.
+///
+/// Callers check statisticsEnabled before computing the kind.
+template <typename NameFn>
+void countExpression(uint32_t kind, bool isNew, NameFn &&name) {
+  auto &stats = threadStatistics();
+  if (isNew)
+    stats.registeredExpressions.add();
+
+  auto key = kind + 1;
+  auto slot = (key * 0x9e3779b1u) % ThreadStatistics::kExpressionKinds;
+  for (size_t i = 0; i < ThreadStatistics::kExpressionKinds; i++) {
+    auto &entry = stats.expressionsByKind[slot];
+    auto current = entry.key.load(std::memory_order_relaxed);
+    if (current == key) {
+      entry.count.add();
+      dumpStatisticsIfRequested();
+      return;
+    }
+
+    if (current == 0) {
+      nameExpressionKind(kind, name());
+      entry.key.store(key, std::memory_order_release);
+      entry.count.add();
+      return;
+    }
+
+    slot = (slot + 1) % ThreadStatistics::kExpressionKinds;
+  }
+
+  stats.otherExpressions.add();
+}
+
+inline void countShadowPage() {
+  if (statisticsEnabled())
+    threadStatistics().shadowPages.add();
+}
+
+inline void countConcretenessCheck(bool concrete) {
+  if (!statisticsEnabled())
+    return;
+
+  auto &stats = threadStatistics();
+  stats.concretenessChecks.add();
+  if (concrete)
+    stats.concreteRegions.add();
+}
+
+/// Record a query that was sent to the solver at the given site.
+void recordQuery(uintptr_t site, QueryOutcome outcome,
+                 std::chrono::steady_clock::duration time);
+
+/// Record a garbage collection, given the size of the expression registry
+/// before and after.
+void recordCollection(bool full, std::chrono::steady_clock::duration time,
+                      size_t expressionsBefore, size_t expressionsAfter);
+
+#endif
@@ -0,0 +1,135 @@
+// This file is part of the SymCC runtime.
+//
+// The SymCC runtime is free software: you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// The SymCC runtime is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+// for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with the SymCC runtime. If not, see <https://www.gnu.org/licenses/>.
+
+#include "TestCaseRing.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Config.h"
+
+namespace {
+
+struct RingHeader {
+  uint64_t magic;
+  uint64_t capacity;
+  alignas(64) std::atomic<uint64_t> head;
+  alignas(64) std::atomic<uint64_t> tail;
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free,
+              "The ring must be usable across processes");
+static_assert(offsetof(RingHeader, head) == 64 &&
+                  offsetof(RingHeader, tail) == 128,
+              "The header layout must match the documentation");
+static_assert(sizeof(RingHeader) <= kTestCaseRingDataOffset,
+              "The header must not overlap the data area");
+
+/// Serializes producers (e.g., the solver threads of the simple backend).
+std::mutex g_ring_mutex;
+
+/// The mapped ring, or null if we haven't mapped it (yet).
+RingHeader *g_ring = nullptr;
+uint8_t *g_ring_data = nullptr;
+
+/// Set when the ring can't be used, so that we only warn once.
+bool g_ring_unusable = false;
+
+bool mapRing() {
+  auto disable = [](const char *reason) {
+    fprintf(stderr, "Not using the test-case ring %s: %s\n",
+            g_config.testCaseRing.c_str(), reason);
+    g_ring_unusable = true;
+    return false;
+  };
+
+  int fd = open(g_config.testCaseRing.c_str(), O_RDWR | O_CLOEXEC);
+  if (fd == -1)
+    return disable(strerror(errno));
+
+  struct stat info;
+  if (fstat(fd, &info) == -1) {
+    close(fd);
+    return disable(strerror(errno));
+  }
+
+  auto size = static_cast<size_t>(info.st_size);
+  if (size <= kTestCaseRingDataOffset) {
+    close(fd);
+    return disable("the file is too small");
+  }
+
+  auto *mapping =
+      mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED)
+    return disable(strerror(errno));
+
+  auto *header = static_cast<RingHeader *>(mapping);
+  if (header->magic != kTestCaseRingMagic ||
+      header->capacity != size - kTestCaseRingDataOffset ||
+      header->capacity % 8 != 0) {
+    munmap(mapping, size);
+    return disable("invalid header");
+  }
+
+  g_ring = header;
+  g_ring_data = static_cast<uint8_t *>(mapping) + kTestCaseRingDataOffset;
+  return true;
+}
+
+/// Copy data into the ring at the given (unwrapped) position.
+void copyToRing(uint64_t position, const void *data, size_t size) {
+  auto capacity = g_ring->capacity;
+  auto offset = position % capacity;
+  auto first = std::min<uint64_t>(size, capacity - offset);
+  memcpy(g_ring_data + offset, data, first);
+  memcpy(g_ring_data, static_cast<const uint8_t *>(data) + first,
+         size - first);
+}
+
+} // namespace
+
+bool pushTestCaseToRing(const uint8_t *data, size_t size) {
+  if (g_config.testCaseRing.empty() || size > UINT32_MAX)
+    return false;
+
+  std::lock_guard<std::mutex> lock(g_ring_mutex);
+  if (g_ring == nullptr && (g_ring_unusable || !mapRing()))
+    return false;
+
+  uint64_t recordSize = (sizeof(uint32_t) + size + 7) & ~uint64_t(7);
+  auto head = g_ring->head.load(std::memory_order_relaxed);
+  auto tail = g_ring->tail.load(std::memory_order_acquire);
+  if (recordSize > g_ring->capacity - (head - tail))
+    return false;
+
+  uint8_t length[4] = {uint8_t(size), uint8_t(size >> 8), uint8_t(size >> 16),
+                       uint8_t(size >> 24)};
+  copyToRing(head, length, sizeof(length));
+  copyToRing(head + sizeof(length), data, size);
+  g_ring->head.store(head + recordSize, std::memory_order_release);
+  return true;
+}
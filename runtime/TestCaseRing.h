@@ -0,0 +1,55 @@
+// This file is part of the SymCC runtime.
+//
+// The SymCC runtime is free software: you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// The SymCC runtime is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+// for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with the SymCC runtime. If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef TESTCASERING_H
+#define TESTCASERING_H
+
+#include <cstddef>
+#include <cstdint>
+
+//
+// Delivery of test cases through shared memory
+//
+// Writing every new test case to a file of its own means that the consumer
+// (usually the fuzzing helper) has to list the output directory and read each
+// file back. Instead, the consumer can create a ring buffer in a file and name
+// it in g_config.testCaseRing; we map the file and append test cases to it.
+//
+// The file starts with a header of 64-bit little-endian integers:
+//   - offset 0: the magic number kTestCaseRingMagic;
+//   - offset 8: the capacity of the data area in bytes (a multiple of 8);
+//   - offset 64: the head, i.e., the total number of bytes ever written;
+//   - offset 128: the tail, i.e., the total number of bytes ever consumed.
+// The data area begins at kTestCaseRingDataOffset. Each record is the length of
+// the test case as a 32-bit little-endian integer, followed by the test case
+// itself, padded to a multiple of 8 bytes. Positions in the data area are the
+// head and tail modulo the capacity, so records may wrap around.
+//
+// We only ever advance the head, and only after the record is complete; the
+// consumer only advances the tail. Consumers may therefore read the ring while
+// the target is running, or simply drain it after each execution.
+//
+
+constexpr uint64_t kTestCaseRingMagic = 0x474e4952434d5953; // "SYMCRING"
+constexpr size_t kTestCaseRingDataOffset = 4096;
+
+/// Append a test case to the ring buffer named in g_config.testCaseRing.
+///
+/// Returns false if no ring is configured, if it can't be used, or if it
+/// doesn't have enough free space; the caller should then write a file as
+/// usual.
+bool pushTestCaseToRing(const uint8_t *data, size_t size);
+
+#endif
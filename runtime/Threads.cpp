@@ -0,0 +1,70 @@
+// This file is part of the SymCC runtime.
+//
+// The SymCC runtime is free software: you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// The SymCC runtime is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+// for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with the SymCC runtime. If not, see <https://www.gnu.org/licenses/>.
+
+#include "Threads.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+#include <dlfcn.h>
+#include <pthread.h>
+
+std::atomic<bool> g_multithreaded{false};
+std::recursive_mutex g_runtime_mutex;
+
+namespace {
+
+/// Set while the current thread creates threads for the runtime.
+thread_local bool t_internal_thread_creation = false;
+
+using PthreadCreateFn = int (*)(pthread_t *, const pthread_attr_t *,
+                                void *(*)(void *), void *);
+
+PthreadCreateFn realPthreadCreate() {
+  static auto *fn =
+      reinterpret_cast<PthreadCreateFn>(dlsym(RTLD_NEXT, "pthread_create"));
+  if (fn == nullptr) {
+    fprintf(stderr, "Failed to find pthread_create: %s\n", dlerror());
+    abort();
+  }
+
+  return fn;
+}
+
+} // namespace
+
+void lockRuntime() noexcept { g_runtime_mutex.lock(); }
+
+void unlockRuntime() noexcept { g_runtime_mutex.unlock(); }
+
+InternalThreadCreation::InternalThreadCreation()
+    : outer_(t_internal_thread_creation) {
+  t_internal_thread_creation = true;
+}
+
+InternalThreadCreation::~InternalThreadCreation() {
+  t_internal_thread_creation = outer_;
+}
+
+// The runtime comes before libc in the lookup order of the target program, so
+// this definition takes precedence over the real pthread_create everywhere in
+// the process.
+extern "C" int pthread_create(pthread_t *thread, const pthread_attr_t *attr,
+                              void *(*start)(void *), void *arg) noexcept {
+  if (!t_internal_thread_creation)
+    g_multithreaded.store(true, std::memory_order_relaxed);
+
+  return realPthreadCreate()(thread, attr, start, arg);
+}
@@ -0,0 +1,101 @@
+// This file is part of the SymCC runtime.
+//
+// The SymCC runtime is free software: you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// The SymCC runtime is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+// for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with the SymCC runtime. If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef THREADS_H
+#define THREADS_H
+
+#include <atomic>
+#include <mutex>
+
+//
+// Support for multithreaded target programs.
+//
+// Each thread has its own parameter and return slots and calling context (see
+// RuntimeCommon.h), but the rest of the runtime's state is shared: the shadow
+// memory, the expressions and the solver. Neither backend can build
+// expressions concurrently (the simple backend shares one Z3 context, and
+// QSYM's expression builder has global caches), so we serialize all of the
+// runtime's entry points on a single lock. Memory accesses that don't touch
+// shadowed pages, which are the vast majority, don't need the lock (see
+// mayBeSymbolic in Shadow.h).
+//
+// The lock costs a little on every call, so we only take it once the program
+// has started another thread. We notice that by intercepting pthread_create,
+// which also catches threads started from uninstrumented code such as the
+// C++ standard library.
+//
+
+// The globals are hidden so that the checks on the hot paths don't have to go
+// through the GOT.
+
+/// Whether the program has started a thread; never reset.
+extern std::atomic<bool> g_multithreaded __attribute__((visibility("hidden")));
+
+/// The lock that serializes the runtime's entry points. It's recursive because
+/// entry points call each other (e.g., the libc wrappers build expressions).
+extern std::recursive_mutex g_runtime_mutex
+    __attribute__((visibility("hidden")));
+
+/// Whether the runtime needs to synchronize with other threads.
+///
+/// A relaxed load is enough: the first thread raises the flag before starting
+/// the second, and pthread_create orders everything after it for both.
+inline bool runtimeIsMultithreaded() {
+  return g_multithreaded.load(std::memory_order_relaxed);
+}
+
+/// Take and release the runtime lock. They're out of line to keep the code
+/// for the single-threaded case small.
+void lockRuntime() noexcept;
+void unlockRuntime() noexcept;
+
+/// Hold the runtime lock for the current scope if the program is
+/// multithreaded.
+class RuntimeLock {
+public:
+  RuntimeLock() : locked_(runtimeIsMultithreaded()) {
+    if (locked_)
+      lockRuntime();
+  }
+
+  ~RuntimeLock() {
+    if (locked_)
+      unlockRuntime();
+  }
+
+  RuntimeLock(const RuntimeLock &) = delete;
+  RuntimeLock &operator=(const RuntimeLock &) = delete;
+
+private:
+  bool locked_;
+};
+
+/// Mark threads created in the current scope as the runtime's own, e.g., the
+/// background solvers or the helpers of the garbage collector. They never run
+/// instrumented code, so they don't make the program multithreaded. Scopes may
+/// nest.
+class InternalThreadCreation {
+public:
+  InternalThreadCreation();
+  ~InternalThreadCreation();
+
+  InternalThreadCreation(const InternalThreadCreation &) = delete;
+  InternalThreadCreation &operator=(const InternalThreadCreation &) = delete;
+
+private:
+  bool outer_;
+};
+
+#endif
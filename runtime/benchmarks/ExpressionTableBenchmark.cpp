@@ -0,0 +1,213 @@
+// This file is part of the SymCC runtime.
+//
+// The SymCC runtime is free software: you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// The SymCC runtime is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+// for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with SymCC. If not, see <https://www.gnu.org/licenses/>.
+
+//
+// Compare the expression registry against the standard containers that the
+// backends used to rely on. The workload mimics the runtime: expressions are
+// registered (often repeatedly, because the backends hash-cons), looked up
+// when building new expressions, and swept by the garbage collector; the node
+// containers are swept by testing every entry for reachability, like the
+// backends used to do.
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <map>
+#include <memory>
+#include <random>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+#include "ExpressionTable.h"
+
+namespace {
+
+/// Stand-in for the backends' expression nodes.
+struct Node {
+  uint64_t payload[4];
+};
+
+using Key = Node *;
+
+constexpr size_t kExpressions = 1 << 20;
+constexpr size_t kLookupsPerExpression = 4;
+constexpr unsigned kCollections = 8;
+
+struct Workload {
+  std::vector<std::unique_ptr<Node>> storage;
+  /// The shared pointers that the QSYM backend would register, indexed by the
+  /// first word of the node's payload.
+  std::vector<std::shared_ptr<Node>> references;
+  /// Registration order, including re-registrations of known expressions.
+  std::vector<Key> registrations;
+  std::vector<Key> lookups;
+  /// Sorted, like the output of collectReachableExpressions.
+  std::vector<Key> reachable;
+};
+
+Workload makeWorkload() {
+  Workload w;
+  std::mt19937_64 rng(42);
+
+  for (size_t i = 0; i < kExpressions; i++) {
+    w.storage.emplace_back(new Node{{i, 0, 0, 0}});
+    w.references.emplace_back(w.storage.back().get(), [](Node *) {});
+  }
+
+  for (size_t i = 0; i < kExpressions; i++) {
+    w.registrations.push_back(w.storage[i].get());
+    // Hash-consing frequently hands out an expression we know already.
+    if (rng() % 4 == 0)
+      w.registrations.push_back(w.storage[rng() % (i + 1)].get());
+  }
+
+  for (size_t i = 0; i < kExpressions * kLookupsPerExpression; i++)
+    w.lookups.push_back(w.storage[rng() % kExpressions].get());
+
+  for (auto &node : w.storage) {
+    if (rng() % 8 == 0)
+      w.reachable.push_back(node.get());
+  }
+  std::sort(w.reachable.begin(), w.reachable.end());
+
+  return w;
+}
+
+double millisecondsOf(const std::function<void()> &f) {
+  auto start = std::chrono::steady_clock::now();
+  f();
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+template <typename Insert, typename Lookup, typename Sweep, typename Clear>
+void run(const char *name, const Workload &w, Insert insert, Lookup lookup,
+         Sweep sweep, Clear clear) {
+  double insertTime = 0, lookupTime = 0, sweepTime = 0;
+  uint64_t checksum = 0;
+
+  auto isGarbage = [&](Key key) {
+    return !std::binary_search(w.reachable.begin(), w.reachable.end(), key);
+  };
+
+  for (unsigned round = 0; round < kCollections; round++) {
+    insertTime += millisecondsOf([&] {
+      for (auto key : w.registrations)
+        insert(key);
+    });
+    lookupTime += millisecondsOf([&] {
+      for (auto key : w.lookups)
+        checksum += lookup(key);
+    });
+    sweepTime += millisecondsOf([&] { sweep(isGarbage); });
+    clear();
+  }
+
+  std::printf("%-24s %10.1f %10.1f %10.1f %10.1f   (%llu)\n", name,
+              insertTime / kCollections, lookupTime / kCollections,
+              sweepTime / kCollections,
+              (insertTime + lookupTime + sweepTime) / kCollections,
+              static_cast<unsigned long long>(checksum));
+}
+
+} // namespace
+
+int main() {
+  auto w = makeWorkload();
+
+  std::printf("%zu registrations, %zu lookups, %zu reachable; times in ms\n",
+              w.registrations.size(), w.lookups.size(), w.reachable.size());
+  std::printf("%-24s %10s %10s %10s %10s\n", "container", "register",
+              "lookup", "sweep", "total");
+
+  {
+    std::set<Key> set;
+    run(
+        "std::set", w,
+        [&](Key key) {
+          if (set.count(key) == 0)
+            set.insert(key);
+        },
+        [&](Key key) { return set.count(key); },
+        [&](auto &isGarbage) {
+          for (auto it = set.begin(); it != set.end();)
+            it = isGarbage(*it) ? set.erase(it) : std::next(it);
+        },
+        [&] { set.clear(); });
+  }
+
+  {
+    std::map<Key, std::shared_ptr<Node>> map;
+    run(
+        "std::map", w,
+        [&](Key key) {
+          if (map.count(key) == 0)
+            map[key] = w.references[key->payload[0]];
+        },
+        [&](Key key) { return map.at(key) != nullptr; },
+        [&](auto &isGarbage) {
+          for (auto it = map.begin(); it != map.end();)
+            it = isGarbage(it->first) ? map.erase(it) : std::next(it);
+        },
+        [&] { map.clear(); });
+  }
+
+  {
+    std::unordered_map<Key, std::shared_ptr<Node>> map;
+    run(
+        "std::unordered_map", w,
+        [&](Key key) {
+          if (map.count(key) == 0)
+            map[key] = w.references[key->payload[0]];
+        },
+        [&](Key key) { return map.at(key) != nullptr; },
+        [&](auto &isGarbage) {
+          for (auto it = map.begin(); it != map.end();)
+            it = isGarbage(it->first) ? map.erase(it) : std::next(it);
+        },
+        [&] { map.clear(); });
+  }
+
+  {
+    auto table = std::make_unique<ExpressionTable<Key>>();
+    run(
+        "ExpressionTable", w, [&](Key key) { table->insert(key); },
+        [&](Key key) { return table->contains(key); },
+        [&](auto &) { table->retainOnly(w.reachable); },
+        [&] { table = std::make_unique<ExpressionTable<Key>>(); });
+  }
+
+  {
+    auto table =
+        std::make_unique<ExpressionTable<Key, std::shared_ptr<Node>>>();
+    run(
+        "ExpressionTable (values)", w,
+        [&](Key key) {
+          table->insert(key, w.references[key->payload[0]]);
+        },
+        [&](Key key) { return table->at(key) != nullptr; },
+        [&](auto &) { table->retainOnly(w.reachable); },
+        [&] {
+          table =
+              std::make_unique<ExpressionTable<Key, std::shared_ptr<Node>>>();
+        });
+  }
+
+  return 0;
+}
@@ -0,0 +1,338 @@
+// This file is part of the SymCC runtime.
+//
+// The SymCC runtime is free software: you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// The SymCC runtime is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+// for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with SymCC. If not, see <https://www.gnu.org/licenses/>.
+
+//
+// Measure the hot paths of the runtime on fixed synthetic workloads: memory
+// accesses, the concreteness checks behind them, the libc wrappers, expression
+// construction and garbage collection. The benchmark only uses the public
+// interface of the runtime, so it works with either backend; configure a build
+// directory per backend to compare them.
+//
+// Each workload runs several times, and we report the fastest run. To catch
+// regressions, save the results of a known-good build with "--save FILE" and
+// compare later builds against them with "--compare FILE"; the program then
+// fails if a workload got slower by more than the tolerance (10% by default,
+// "--tolerance PERCENT").
+//
+// None of the workloads ask the solver anything, so the results are stable
+// enough to compare across builds on the same machine.
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+typedef void *SymExpr;
+#include <RuntimeCommon.h>
+
+extern "C" {
+void *memcpy_symbolized(void *dest, const void *src, size_t n);
+void *memset_symbolized(void *s, int c, size_t n);
+size_t strlen_symbolized(const char *s);
+const void *memchr_symbolized(const void *s, int c, size_t n);
+}
+
+namespace {
+
+constexpr unsigned kRepetitions = 5;
+
+constexpr size_t kLargeBuffer = 1 << 20;
+constexpr size_t kSmallBuffer = 1 << 16;
+constexpr size_t kExpressions = 1 << 20;
+
+/// The number of expressions that the garbage collector has to examine; this
+/// is the backends' default collection threshold.
+constexpr size_t kCollectionSize = 5'000'000;
+
+/// The number of symbolic input bytes; their pairwise sums give us enough
+/// distinct expressions for the collection workload.
+constexpr size_t kInputBytes = 3200;
+
+struct Workload {
+  const char *name;
+  /// Prepare a run; not measured.
+  std::function<void()> setup;
+  std::function<void()> run;
+};
+
+/// Keep the compiler from optimizing away results.
+volatile uintptr_t g_sink;
+
+std::vector<uint8_t> g_source(kLargeBuffer, 'a');
+std::vector<uint8_t> g_destination(kLargeBuffer);
+std::vector<SymExpr> g_roots;
+
+/// Symbolic input bytes.
+std::vector<SymExpr> g_bytes;
+
+/// Call f with count distinct sums of two input bytes. (Expressions with
+/// fresh constants would be more obvious, but Z3 makes numerals expensive.)
+template <typename F> void forEachSum(size_t count, F f) {
+  size_t n = 0;
+  for (size_t i = 0; i < kInputBytes; i++) {
+    for (size_t j = i + 1; j < kInputBytes; j++) {
+      if (n == count)
+        return;
+      f(n++, _sym_build_add(g_bytes[i], g_bytes[j]));
+    }
+  }
+}
+
+/// Make the beginning of g_source symbolic (lazily, like the input).
+void makeSourceSymbolic(size_t length) {
+  _sym_make_symbolic(g_source.data(), length, 0);
+}
+
+/// Make the buffers concrete again.
+void concretizeBuffers() {
+  _sym_write_memory(g_source.data(), kLargeBuffer, nullptr, true);
+  _sym_write_memory(g_destination.data(), kLargeBuffer, nullptr, true);
+}
+
+void clearParameters() {
+  for (uint8_t i = 0; i < 3; i++)
+    _sym_set_parameter_expression(i, nullptr);
+}
+
+std::vector<Workload> makeWorkloads() {
+  return {
+      {"read_memory concrete 1B", concretizeBuffers,
+       [] {
+         for (size_t i = 0; i < kLargeBuffer; i++)
+           g_sink = g_sink +
+                    reinterpret_cast<uintptr_t>(
+                        _sym_read_memory(&g_source[i], 1, true));
+       }},
+      {"read_memory concrete 8B", concretizeBuffers,
+       [] {
+         for (size_t i = 0; i < kLargeBuffer; i += 8)
+           g_sink = g_sink +
+                    reinterpret_cast<uintptr_t>(
+                        _sym_read_memory(&g_source[i], 8, true));
+       }},
+      {"read_memory symbolic 1B",
+       [] {
+         concretizeBuffers();
+         makeSourceSymbolic(kSmallBuffer);
+       },
+       [] {
+         for (size_t i = 0; i < kSmallBuffer; i++)
+           g_sink = g_sink +
+                    reinterpret_cast<uintptr_t>(
+                        _sym_read_memory(&g_source[i], 1, true));
+       }},
+      {"read_memory symbolic 4B",
+       [] {
+         concretizeBuffers();
+         makeSourceSymbolic(kSmallBuffer);
+       },
+       [] {
+         for (size_t i = 0; i < kSmallBuffer; i += 4)
+           g_sink = g_sink +
+                    reinterpret_cast<uintptr_t>(
+                        _sym_read_memory(&g_source[i], 4, true));
+       }},
+      {"write_memory concrete 1B", concretizeBuffers,
+       [] {
+         for (size_t i = 0; i < kLargeBuffer; i++)
+           _sym_write_memory(&g_destination[i], 1, nullptr, true);
+       }},
+      {"write_memory symbolic 1B", concretizeBuffers,
+       [] {
+         for (size_t i = 0; i < kSmallBuffer; i++)
+           _sym_write_memory(&g_destination[i], 1, g_bytes[0], true);
+       }},
+      {"memcpy concrete 1MB",
+       [] {
+         concretizeBuffers();
+         clearParameters();
+       },
+       [] {
+         memcpy_symbolized(g_destination.data(), g_source.data(),
+                           kLargeBuffer);
+       }},
+      {"memcpy symbolic 1MB",
+       [] {
+         concretizeBuffers();
+         makeSourceSymbolic(kLargeBuffer);
+         clearParameters();
+       },
+       [] {
+         memcpy_symbolized(g_destination.data(), g_source.data(),
+                           kLargeBuffer);
+       }},
+      {"memset symbolic 1MB",
+       [] {
+         concretizeBuffers();
+         clearParameters();
+         _sym_set_parameter_expression(1, g_bytes[0]);
+       },
+       [] { memset_symbolized(g_destination.data(), 'a', kLargeBuffer); }},
+      {"strlen concrete 64KB",
+       [] {
+         concretizeBuffers();
+         clearParameters();
+         g_source[kSmallBuffer] = 0;
+       },
+       [] {
+         g_sink = strlen_symbolized(
+             reinterpret_cast<const char *>(g_source.data()));
+       }},
+      {"memchr concrete 1MB",
+       [] {
+         concretizeBuffers();
+         clearParameters();
+       },
+       [] {
+         g_sink = reinterpret_cast<uintptr_t>(
+             memchr_symbolized(g_source.data(), 'b', kLargeBuffer));
+       }},
+      {"build expressions 1M", [] {},
+       [] {
+         forEachSum(kExpressions, [](size_t, SymExpr sum) {
+           g_sink = g_sink + reinterpret_cast<uintptr_t>(sum);
+         });
+       }},
+      {"collect garbage 5M",
+       [] {
+         // Keep every eighth expression alive.
+         forEachSum(kCollectionSize, [](size_t i, SymExpr sum) {
+           if (i % 8 == 0)
+             g_roots[i / 8] = sum;
+         });
+       },
+       [] { _sym_collect_garbage(); }},
+  };
+}
+
+double millisecondsOf(const std::function<void()> &f) {
+  auto start = std::chrono::steady_clock::now();
+  f();
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+std::map<std::string, double> loadResults(const char *path) {
+  std::map<std::string, double> results;
+  std::ifstream in(path);
+  if (!in) {
+    std::fprintf(stderr, "Can't read %s\n", path);
+    std::exit(2);
+  }
+
+  // Each line holds the time in milliseconds followed by the name.
+  double time;
+  std::string name;
+  while (in >> time && std::getline(in >> std::ws, name))
+    results[name] = time;
+  return results;
+}
+
+void saveResults(const char *path, const std::map<std::string, double> &r) {
+  std::ofstream out(path);
+  for (auto &[name, time] : r)
+    out << time << ' ' << name << '\n';
+  if (!out) {
+    std::fprintf(stderr, "Can't write %s\n", path);
+    std::exit(2);
+  }
+}
+
+[[noreturn]] void usage(const char *program) {
+  std::fprintf(stderr,
+               "Usage: %s [--save FILE] [--compare FILE] "
+               "[--tolerance PERCENT]\n",
+               program);
+  std::exit(2);
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  const char *savePath = nullptr;
+  const char *comparePath = nullptr;
+  double tolerance = 10;
+  for (int i = 1; i < argc; i++) {
+    if (i + 1 == argc)
+      usage(argv[0]);
+    if (std::strcmp(argv[i], "--save") == 0)
+      savePath = argv[++i];
+    else if (std::strcmp(argv[i], "--compare") == 0)
+      comparePath = argv[++i];
+    else if (std::strcmp(argv[i], "--tolerance") == 0)
+      tolerance = std::atof(argv[++i]);
+    else
+      usage(argv[0]);
+  }
+
+  std::map<std::string, double> baseline;
+  if (comparePath != nullptr)
+    baseline = loadResults(comparePath);
+
+  // The runtime mustn't read the benchmark's standard input, and the QSYM
+  // backend insists on an output directory.
+  char outputDir[] = "/tmp/symcc-bench-XXXXXX";
+  if (mkdtemp(outputDir) == nullptr) {
+    std::perror("mkdtemp");
+    return 2;
+  }
+  setenv("SYMCC_OUTPUT_DIR", outputDir, 1);
+  setenv("SYMCC_MEMORY_INPUT", "1", 1);
+  _sym_initialize();
+
+  for (size_t i = 0; i < kInputBytes; i++)
+    g_bytes.push_back(_sym_get_input_byte(i, 'a'));
+  g_roots.resize(kCollectionSize / 8);
+  _sym_register_expression_region(g_roots.data(), g_roots.size());
+
+  std::printf("%-28s %12s %12s\n", "workload", "time (ms)", "baseline");
+  std::map<std::string, double> results;
+  bool regressed = false;
+  for (auto &w : makeWorkloads()) {
+    double best = 0;
+    for (unsigned i = 0; i < kRepetitions; i++) {
+      w.setup();
+      auto time = millisecondsOf(w.run);
+      best = (i == 0) ? time : std::min(best, time);
+    }
+    results[w.name] = best;
+
+    std::printf("%-28s %12.3f", w.name, best);
+    if (auto it = baseline.find(w.name); it != baseline.end()) {
+      auto change = (best - it->second) / it->second * 100;
+      bool slower = change > tolerance;
+      regressed |= slower;
+      std::printf(" %12.3f %+6.1f%%%s", it->second, change,
+                  slower ? "  REGRESSION" : "");
+    }
+    std::printf("\n");
+    std::fflush(stdout);
+  }
+
+  rmdir(outputDir);
+  if (savePath != nullptr)
+    saveResults(savePath, results);
+  return regressed ? 1 : 0;
+}
@@ -0,0 +1,331 @@
+// This file is part of the SymCC runtime.
+//
+// The SymCC runtime is free software: you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// The SymCC runtime is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+// for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with SymCC. If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef EXPRESSIONPOOL_H
+#define EXPRESSIONPOOL_H
+
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include "Runtime.h"
+
+/// The binary operations of the expression pool: the QSYM name of each
+/// operation, and whether it yields a Boolean (as opposed to a bit vector of
+/// the operands' width).
+#define EXPRESSION_POOL_BINARY_KINDS(X)                                        \
+  X(Add, false)                                                                \
+  X(Sub, false)                                                                \
+  X(Mul, false)                                                                \
+  X(UDiv, false)                                                               \
+  X(SDiv, false)                                                               \
+  X(URem, false)                                                               \
+  X(SRem, false)                                                               \
+  X(Shl, false)                                                                \
+  X(LShr, false)                                                               \
+  X(AShr, false)                                                               \
+  X(And, false)                                                                \
+  X(Or, false)                                                                 \
+  X(Xor, false)                                                                \
+  X(Concat, false)                                                             \
+  X(Slt, true)                                                                 \
+  X(Sle, true)                                                                 \
+  X(Sgt, true)                                                                 \
+  X(Sge, true)                                                                 \
+  X(Ult, true)                                                                 \
+  X(Ule, true)                                                                 \
+  X(Ugt, true)                                                                 \
+  X(Uge, true)                                                                 \
+  X(Equal, true)                                                               \
+  X(Distinct, true)                                                            \
+  X(LAnd, true)                                                                \
+  X(LOr, true)
+
+/// The operations with a single operand; the result width is given
+/// explicitly.
+#define EXPRESSION_POOL_UNARY_KINDS(X)                                         \
+  X(Neg)                                                                       \
+  X(Not)                                                                       \
+  X(ZExt)                                                                      \
+  X(SExt)                                                                      \
+  X(Trunc)                                                                     \
+  X(Extract)                                                                   \
+  X(BoolToBit)
+
+/// The expressions that the QSYM backend hands out to instrumented code.
+///
+/// QSYM allocates each of its expressions separately behind a std::shared_ptr,
+/// with a vector of children and a number of caches, so an expression costs two
+/// heap objects and well over a hundred bytes, and every copy of a reference
+/// updates an atomic counter. Most expressions that a target program builds
+/// never reach a branch, though. We therefore keep our own DAG: fixed-size
+/// nodes in a pool, addressed by 32-bit indices, with intrusive reference
+/// counts that don't need to be atomic because the runtime lock serializes all
+/// accesses (see Threads.h). The backend translates a node to QSYM (and thus
+/// Z3) only when the solver needs it.
+///
+/// A SymExpr is the index of a node disguised as a pointer; index 0 is never
+/// used, so null still means "concrete". Nodes live in chunks that never move,
+/// and freed nodes are recycled through a free list.
+class ExpressionPool {
+public:
+  enum class Kind : uint8_t {
+    Free,
+    Constant, // operands: value (low word, high word)
+    Bool,     // operands: value
+    Read,     // operands: input offset (low word, high word)
+    Ite,      // operands: condition, true value, false value
+#define DECLARE_BINARY_KIND(name, isBool) name,
+#define DECLARE_UNARY_KIND(name) name,
+    EXPRESSION_POOL_BINARY_KINDS(DECLARE_BINARY_KIND)
+    EXPRESSION_POOL_UNARY_KINDS(DECLARE_UNARY_KIND) // Extract: operand, low bit
+#undef DECLARE_BINARY_KIND
+#undef DECLARE_UNARY_KIND
+  };
+
+  struct Node {
+    /// References from client code (through the backend's registry) and from
+    /// parent nodes.
+    uint32_t refs;
+    Kind kind;
+    /// Set by the backend if it keeps data for the node elsewhere, so that it
+    /// only needs to look for the data when the node is freed.
+    bool cached;
+    uint16_t unused;
+    uint32_t bits;
+    /// Child indices or immediate data, depending on the kind; the next free
+    /// node for free nodes.
+    uint32_t operands[3];
+
+    uint64_t value() const {
+      return operands[0] | (uint64_t(operands[1]) << 32);
+    }
+
+    SymExpr child(unsigned i) const { return handle(operands[i]); }
+  };
+
+  static_assert(sizeof(Node) == 24, "Expression nodes should stay compact");
+
+  ExpressionPool() = default;
+  ExpressionPool(const ExpressionPool &) = delete;
+  ExpressionPool &operator=(const ExpressionPool &) = delete;
+
+  /// The number of live nodes.
+  size_t size() const { return size_; }
+
+  static const char *kindName(Kind kind) {
+    switch (kind) {
+    case Kind::Free:
+      return "Free";
+    case Kind::Constant:
+      return "Constant";
+    case Kind::Bool:
+      return "Bool";
+    case Kind::Read:
+      return "Read";
+    case Kind::Ite:
+      return "Ite";
+#define BINARY_KIND_NAME(name, isBool)                                         \
+  case Kind::name:                                                             \
+    return #name;
+#define UNARY_KIND_NAME(name)                                                  \
+  case Kind::name:                                                             \
+    return #name;
+      EXPRESSION_POOL_BINARY_KINDS(BINARY_KIND_NAME)
+      EXPRESSION_POOL_UNARY_KINDS(UNARY_KIND_NAME)
+#undef BINARY_KIND_NAME
+#undef UNARY_KIND_NAME
+    default:
+      return "Unknown";
+    }
+  }
+
+  static unsigned arity(Kind kind) {
+    switch (kind) {
+    case Kind::Free:
+    case Kind::Constant:
+    case Kind::Bool:
+    case Kind::Read:
+      return 0;
+    case Kind::Ite:
+      return 3;
+#define BINARY_ARITY(name, isBool) case Kind::name:
+      EXPRESSION_POOL_BINARY_KINDS(BINARY_ARITY)
+#undef BINARY_ARITY
+      return 2;
+    default:
+      return 1;
+    }
+  }
+
+  static bool yieldsBool(Kind kind) {
+    switch (kind) {
+    case Kind::Bool:
+      return true;
+#define IS_BOOL(name, isBool)                                                  \
+  case Kind::name:                                                             \
+    return isBool;
+      EXPRESSION_POOL_BINARY_KINDS(IS_BOOL)
+#undef IS_BOOL
+    default:
+      return false;
+    }
+  }
+
+  const Node &node(SymExpr expr) const { return at(index(expr)); }
+
+  void markCached(SymExpr expr) { at(index(expr)).cached = true; }
+
+  //
+  // Node creation
+  //
+  // All functions return a node with a single reference, which belongs to the
+  // caller. Nodes take a reference to each of their children.
+  //
+
+  SymExpr createConstant(uint64_t value, uint32_t bits) {
+    return create(Kind::Constant, bits, uint32_t(value), uint32_t(value >> 32));
+  }
+
+  SymExpr createBool(bool value) { return create(Kind::Bool, 1, value); }
+
+  SymExpr createRead(uint64_t offset) {
+    return create(Kind::Read, 8, uint32_t(offset), uint32_t(offset >> 32));
+  }
+
+  /// Create a binary operation; the width of the result follows from the kind
+  /// and the operands.
+  SymExpr createBinary(Kind kind, SymExpr a, SymExpr b) {
+    assert(arity(kind) == 2 && "Not a binary operation");
+    uint32_t bits;
+    if (yieldsBool(kind))
+      bits = 1;
+    else if (kind == Kind::Concat)
+      bits = node(a).bits + node(b).bits;
+    else
+      bits = node(a).bits;
+
+    return create(kind, bits, retain(a), retain(b));
+  }
+
+  SymExpr createUnary(Kind kind, SymExpr expr, uint32_t bits) {
+    assert(arity(kind) == 1 && kind != Kind::Extract &&
+           "Not a unary operation");
+    return create(kind, bits, retain(expr));
+  }
+
+  SymExpr createExtract(SymExpr expr, uint32_t lowBit, uint32_t bits) {
+    return create(Kind::Extract, bits, retain(expr), lowBit);
+  }
+
+  SymExpr createIte(SymExpr cond, SymExpr a, SymExpr b) {
+    return create(Kind::Ite, node(a).bits, retain(cond), retain(a), retain(b));
+  }
+
+  //
+  // Reference counting
+  //
+
+  /// Take another reference to the node, and return its index.
+  uint32_t retain(SymExpr expr) {
+    auto i = index(expr);
+    at(i).refs++;
+    return i;
+  }
+
+  /// Drop a reference to the node, freeing it and (transitively) its children
+  /// when they aren't referenced anymore. The function is called on each node
+  /// that is about to be freed.
+  template <typename F> void release(SymExpr expr, F &&onFree) {
+    releasePending_.push_back(index(expr));
+    while (!releasePending_.empty()) {
+      auto i = releasePending_.back();
+      releasePending_.pop_back();
+
+      auto &n = at(i);
+      assert(n.refs != 0 && "Releasing a free expression");
+      if (--n.refs != 0)
+        continue;
+
+      onFree(handle(i), static_cast<const Node &>(n));
+      for (unsigned k = 0; k < arity(n.kind); k++)
+        releasePending_.push_back(n.operands[k]);
+
+      n.kind = Kind::Free;
+      n.cached = false;
+      n.operands[0] = freeList_;
+      freeList_ = i;
+      size_--;
+    }
+  }
+
+private:
+  static constexpr unsigned kChunkBits = 16;
+  static constexpr uint32_t kChunkSize = uint32_t(1) << kChunkBits;
+
+  static SymExpr handle(uint32_t index) {
+    return reinterpret_cast<SymExpr>(uintptr_t(index));
+  }
+
+  static uint32_t index(SymExpr expr) {
+    assert(expr != nullptr && "Concrete values aren't in the pool");
+    return uint32_t(reinterpret_cast<uintptr_t>(expr));
+  }
+
+  Node &at(uint32_t i) {
+    return chunks_[i >> kChunkBits][i & (kChunkSize - 1)];
+  }
+
+  const Node &at(uint32_t i) const {
+    return chunks_[i >> kChunkBits][i & (kChunkSize - 1)];
+  }
+
+  SymExpr create(Kind kind, uint32_t bits, uint32_t op0 = 0, uint32_t op1 = 0,
+                 uint32_t op2 = 0) {
+    uint32_t i;
+    if (freeList_ != 0) {
+      i = freeList_;
+      freeList_ = at(i).operands[0];
+    } else {
+      if (next_ == 0)
+        throw std::length_error("Too many expressions");
+      if ((next_ & (kChunkSize - 1)) == 0 || chunks_.empty())
+        chunks_.emplace_back(new Node[kChunkSize]);
+      i = next_++;
+    }
+
+    at(i) = Node{1, kind, false, 0, bits, {op0, op1, op2}};
+    size_++;
+    return handle(i);
+  }
+
+  std::vector<std::unique_ptr<Node[]>> chunks_;
+
+  /// The first node that has never been used (wrapping around to 0 when the
+  /// indices are exhausted); node 0 is reserved.
+  uint32_t next_ = 1;
+
+  /// The most recently freed node, or 0 if there is none.
+  uint32_t freeList_ = 0;
+
+  size_t size_ = 0;
+
+  /// The nodes waiting to be released, kept to avoid allocations.
+  std::vector<uint32_t> releasePending_;
+};
+
+#endif
@@ -18,7 +18,9 @@
 //
 
 #include "Runtime.h"
+#include "ExpressionPool.h"
 #include "GarbageCollection.h"
+#include "TestCaseRing.h"
 
 // C++
 #if __has_include(<filesystem>)
@@ -29,13 +31,19 @@
 #error "We need either <filesystem> or the older <experimental/filesystem>."
 #endif
 
+#include <algorithm>
 #include <atomic>
+#include <chrono>
+#include <deque>
 #include <fstream>
 #include <iostream>
 #include <iterator>
-#include <map>
+#include <optional>
+#include <set>
+#include <unordered_map>
 #include <unordered_set>
 #include <variant>
+#include <vector>
 
 #if HAVE_FILESYSTEM
 #include <filesystem>
@@ -43,10 +51,6 @@
 #include <experimental/filesystem>
 #endif
 
-#ifdef DEBUG_RUNTIME
-#include <chrono>
-#endif
-
 // C
 #include <cstdint>
 #include <cstdio>
@@ -63,8 +67,13 @@
 
 // Runtime
 #include <Config.h>
+#include <ExpressionTable.h>
+#include <Forkserver.h>
 #include <LibcWrappers.h>
 #include <Shadow.h>
+#include <Snapshot.h>
+#include <Statistics.h>
+#include <Threads.h>
 
 namespace qsym {
 
@@ -80,27 +89,133 @@ namespace {
 /// Indicate whether the runtime has been initialized.
 std::atomic_flag g_initialized = ATOMIC_FLAG_INIT;
 
-/// A mapping of all expressions that we have ever received from QSYM to the
-/// corresponding shared pointers on the heap.
-///
-/// We can't expect C clients to handle std::shared_ptr, so we maintain a single
-/// copy per expression in order to keep the expression alive. The garbage
-/// collector decides when to release our shared pointer.
-///
-/// std::map seems to perform slightly better than std::unordered_map on our
-/// workload.
-std::map<SymExpr, qsym::ExprRef> allocatedExpressions;
+using NodeKind = ExpressionPool::Kind;
+
+/// The nodes of all expressions that we have handed out.
+ExpressionPool g_expressions;
+
+/// The expressions that client code may still hold. The registry holds a
+/// reference to each of them; the garbage collector decides when to release
+/// it.
+ExpressionTable<SymExpr> allocatedExpressions;
 
-SymExpr registerExpression(const qsym::ExprRef &expr) {
-  SymExpr rawExpr = expr.get();
+/// The expressions registered since the last garbage collection.
+std::vector<SymExpr> youngExpressions;
 
-  if (allocatedExpressions.count(rawExpr) == 0) {
-    // We don't know this expression yet. Create a copy of the shared pointer to
-    // keep the expression alive.
-    allocatedExpressions[rawExpr] = expr;
+/// QSYM's versions of the expressions that we have translated so far (i.e.,
+/// those with the cached flag). They're removed when the node is freed.
+ExpressionTable<SymExpr, qsym::ExprRef> g_translations;
+
+/// Build QSYM's version of a node whose children have been translated already.
+qsym::ExprRef buildQsymExpression(const ExpressionPool::Node &node) {
+  auto *builder = qsym::g_expr_builder;
+  auto child = [&](unsigned i) { return g_translations.at(node.child(i)); };
+
+  switch (node.kind) {
+  case NodeKind::Constant:
+    // QSYM's API takes uintptr_t, so we need to be careful when compiling for
+    // 32-bit systems: the compiler would helpfully truncate our uint64_t to fit
+    // into 32 bits.
+    if constexpr (sizeof(uint64_t) == sizeof(uintptr_t)) {
+      // 64-bit case: all good.
+      return builder->createConstant(node.value(), node.bits);
+    } else {
+      // 32-bit case: use the regular API if possible, otherwise create an
+      // llvm::APInt.
+      if (uintptr_t value32 = node.value(); value32 == node.value())
+        return builder->createConstant(value32, node.bits);
+
+      return builder->createConstant({64, node.value()}, node.bits);
+    }
+  case NodeKind::Bool:
+    return builder->createBool(node.value() != 0);
+  case NodeKind::Read:
+    return builder->createRead(node.value());
+  case NodeKind::Ite:
+    return builder->createIte(child(0), child(1), child(2));
+#define TRANSLATE_BINARY(name, isBool)                                         \
+  case NodeKind::name:                                                         \
+    return builder->create##name(child(0), child(1));
+    EXPRESSION_POOL_BINARY_KINDS(TRANSLATE_BINARY)
+#undef TRANSLATE_BINARY
+  case NodeKind::Neg:
+    return builder->createNeg(child(0));
+  case NodeKind::Not:
+    return builder->createNot(child(0));
+  case NodeKind::ZExt:
+    return builder->createZExt(child(0), node.bits);
+  case NodeKind::SExt:
+    return builder->createSExt(child(0), node.bits);
+  case NodeKind::Trunc:
+    return builder->createTrunc(child(0), node.bits);
+  case NodeKind::Extract:
+    return builder->createExtract(child(0), node.operands[1], node.bits);
+  case NodeKind::BoolToBit:
+    return builder->boolToBit(child(0), node.bits);
+  default:
+    throw std::logic_error("Translating an expression that has been freed");
   }
+}
+
+/// Translate an expression to QSYM, reusing the translations of shared
+/// subexpressions. Expressions can be very deep (think of a checksum over the
+/// input), so we walk the DAG with an explicit stack instead of recursing.
+qsym::ExprRef translate(SymExpr expr) {
+  static std::vector<SymExpr> pending;
+
+  pending.push_back(expr);
+  while (!pending.empty()) {
+    auto current = pending.back();
+    const auto &node = g_expressions.node(current);
+    if (node.cached) {
+      pending.pop_back();
+      continue;
+    }
 
-  return rawExpr;
+    bool childrenReady = true;
+    for (unsigned i = 0; i < ExpressionPool::arity(node.kind); i++) {
+      if (!g_expressions.node(node.child(i)).cached) {
+        pending.push_back(node.child(i));
+        childrenReady = false;
+      }
+    }
+    if (!childrenReady)
+      continue;
+
+    pending.pop_back();
+    g_translations.insert(current, buildQsymExpression(node));
+    g_expressions.markCached(current);
+  }
+
+  return g_translations.at(expr);
+}
+
+/// Drop a reference to an expression, forgetting the translations of the nodes
+/// that are freed as a result.
+void releaseExpression(SymExpr expr) {
+  g_expressions.release(expr, [](SymExpr freed, const ExpressionPool::Node &n) {
+    if (n.cached)
+      g_translations.erase(freed);
+  });
+}
+
+/// Register a new node with its initial reference.
+SymExpr registerExpression(SymExpr expr) {
+  allocatedExpressions.insert(expr);
+  youngExpressions.push_back(expr);
+
+  auto kind = g_expressions.node(expr).kind;
+  if (statisticsEnabled())
+    countExpression(static_cast<uint32_t>(kind), true,
+                    [&] { return ExpressionPool::kindName(kind); });
+
+  // QSYM's pruning decides whether to concretize an expression based on the
+  // call stack at the time of its creation, so we can't defer the
+  // translation.
+  if (g_config.pruning)
+    translate(expr);
+
+  return expr;
 }
 
 /// The user-provided test case handler, if any.
@@ -109,8 +224,44 @@ SymExpr registerExpression(const qsym::ExprRef &expr) {
 /// writing the test case to a file in the output directory.
 TestCaseHandler g_test_case_handler = nullptr;
 
+/// The timeout for queries to the incremental solver, in milliseconds (the same
+/// as QSYM's).
+constexpr unsigned kSolverTimeout = 10000;
+
+/// The number of recently generated test cases that we try on new branches
+/// before asking the solver.
+constexpr size_t kModelCacheSize = 8;
+
+/// Statistics on the pre-solver stage (see
+/// EnhancedQsymSolver::tryWithoutSolver).
+///
+/// They are kept outside the solver because restoring a snapshot replaces it.
+struct {
+  /// Branches that a recently generated test case already flips.
+  uint64_t modelReuse = 0;
+  /// Branches that we flipped by changing the byte in a byte comparison.
+  uint64_t byteLocal = 0;
+  /// Branches that required a solver query.
+  uint64_t misses = 0;
+} g_pre_solver_stats;
+
 /// A QSYM solver that doesn't require the entire input on initialization.
-class EnhancedQsymSolver : public qsym::Solver {
+///
+/// For every branch that it wants to negate, qsym::Solver resets Z3 and asserts
+/// all constraints related to the branch condition again, so the solver work
+/// grows quadratically with the length of the path. We keep the path
+/// constraints asserted in a separate incremental Z3 solver instead: each new
+/// constraint is added exactly once, and each query only adds the negated
+/// branch condition in a scope of its own. This way, Z3 keeps what it has
+/// learned about the common prefix. QSYM's own solver is still used for its
+/// bookkeeping and for optimistic solving.
+///
+/// Moreover, many branches are trivial to flip, so we can try some cheap
+/// candidate inputs before querying the solver at all (SYMCC_PRE_SOLVER). The
+/// path constraints are also indexed by the input bytes they depend on: since
+/// the current input satisfies all of them, a candidate that changes only a
+/// few bytes just needs to satisfy the constraints on those bytes.
+class EnhancedQsymSolver final : public qsym::Solver {
   // Warning!
   //
   // Before we can override methods of qsym::Solver, we need to declare them
@@ -124,7 +275,71 @@ class EnhancedQsymSolver : public qsym::Solver {
 
 public:
   EnhancedQsymSolver()
-      : qsym::Solver("/dev/null", g_config.outputDir, g_config.aflCoverageMap) {
+      : qsym::Solver("/dev/null", g_config.outputDir, g_config.aflCoverageMap),
+        pathSolver_(context_, "QF_BV") {
+    z3::params params(context_);
+    params.set(":timeout", kSolverTimeout);
+    pathSolver_.set(params);
+  }
+
+  /// Add a path constraint, trying to negate it first if it's interesting.
+  ///
+  /// This replaces qsym::Solver::addJcc.
+  void addPathConstraint(const qsym::ExprRef &e, bool taken, uintptr_t site) {
+    last_pc_ = site;
+    if (e->isConcrete() || e->kind() == qsym::Bool)
+      return;
+
+    // QSYM uses a site ID of zero for constraints that belong to the previous
+    // branch.
+    bool isInteresting =
+        (site == 0) ? last_interested_ : isInterestingJcc(e, taken, site);
+
+    e->simplify();
+    auto condition = e->toZ3Expr();
+    auto &deps = e->getDeps();
+    std::vector<size_t> dependencies(deps.begin(), deps.end());
+    if (isInteresting) {
+      auto goal = taken ? !condition : condition;
+      bool flipped = g_config.preSolver &&
+                     tryWithoutSolver(e, taken, goal, dependencies);
+      if (!flipped) {
+        pathSolver_.push();
+        pathSolver_.add(goal);
+        if (checkPath(site) == z3::sat) {
+          auto change = changeFromModel(pathSolver_.get_model());
+          saveTestCase(applyChange(change), "");
+          rememberModel(std::move(change));
+        } else {
+          // Like QSYM, try to negate the branch condition on its own.
+          reset();
+          addToSolver(e, !taken);
+          checkAndSave("optimistic");
+        }
+        pathSolver_.pop();
+      }
+
+      if (g_config.preSolver)
+        std::cerr << "[STAT] pre-solver: { \"model_reuse\": "
+                  << g_pre_solver_stats.modelReuse
+                  << ", \"byte_local\": " << g_pre_solver_stats.byteLocal
+                  << ", \"misses\": " << g_pre_solver_stats.misses << " }"
+                  << std::endl;
+    }
+
+    addConstraint(e, taken, isInteresting);
+    recordConstraint(taken ? condition : !condition, std::move(dependencies));
+  }
+
+  /// Check whether the expression is satisfiable together with the current
+  /// path constraints.
+  bool feasible(const qsym::ExprRef &e) {
+    e->simplify();
+    pathSolver_.push();
+    pathSolver_.add(e->toZ3Expr());
+    bool result = (checkPath(last_pc_) == z3::sat);
+    pathSolver_.pop();
+    return result;
   }
 
   void pushInputByte(size_t offset, uint8_t value) {
@@ -134,9 +349,237 @@ public:
     inputs_[offset] = value;
   }
 
+  void pushInputBytes(size_t offset, const uint8_t *values, size_t length) {
+    if (inputs_.size() < offset + length)
+      inputs_.resize(offset + length);
+
+    std::copy(values, values + length, inputs_.begin() + offset);
+  }
+
   void saveValues(const std::string &suffix) override {
+    saveTestCase(getConcreteValues(), suffix);
+  }
+
+  /// A path constraint together with the input bytes that it depends on.
+  struct PathConstraint {
+    z3::expr condition;
+    std::vector<size_t> dependencies;
+  };
+
+  /// What a snapshot needs to preserve: the input bytes and the path
+  /// constraints on them. QSYM's own bookkeeping (e.g., for optimistic
+  /// solving) isn't included; it starts afresh after a restore.
+  struct State {
+    std::vector<uint8_t> inputs;
+    std::vector<PathConstraint> pathConstraints;
+  };
+
+  State state() const { return {inputs_, pathConstraints_}; }
+
+  /// Take over the input bytes and path constraints of an earlier state; call
+  /// only on a fresh solver.
+  void load(const State &state) {
+    inputs_ = state.inputs;
+    for (const auto &constraint : state.pathConstraints)
+      recordConstraint(constraint.condition, constraint.dependencies);
+  }
+
+private:
+  /// A candidate input, described by how it differs from the input at the time
+  /// it was created.
+  struct InputChange {
+    size_t inputSize;
+    std::vector<std::pair<size_t, uint8_t>> bytes;
+  };
+
+  void recordConstraint(z3::expr condition, std::vector<size_t> dependencies) {
+    pathSolver_.add(condition);
+
+    auto index = pathConstraints_.size();
+    for (auto offset : dependencies)
+      constraintsByByte_[offset].push_back(index);
+    pathConstraints_.push_back({std::move(condition), std::move(dependencies)});
+  }
+
+  /// Try to flip a branch without querying the solver.
+  ///
+  /// First, if one of the test cases that we generated recently takes the
+  /// current path up to the branch and then the other direction, there's
+  /// nothing left to do. Otherwise, if the branch compares an input byte with
+  /// a constant, we try to change just that byte. Returns true if the branch
+  /// is already covered or we've saved a new test case for it.
+  bool tryWithoutSolver(const qsym::ExprRef &e, bool taken,
+                        const z3::expr &goal,
+                        const std::vector<size_t> &dependencies) {
+    for (const auto &model : recentModels_) {
+      if (satisfiesPath(model, goal, dependencies)) {
+        g_pre_solver_stats.modelReuse++;
+        return true;
+      }
+    }
+
+    auto change = flipByteComparison(e, taken);
+    if (!change.has_value() || !satisfiesPath(*change, goal, dependencies)) {
+      g_pre_solver_stats.misses++;
+      return false;
+    }
+
+    g_pre_solver_stats.byteLocal++;
+    saveTestCase(applyChange(*change), "");
+    rememberModel(std::move(*change));
+    return true;
+  }
+
+  /// Compute the change that makes a comparison of an input byte with a
+  /// constant go the other way, if the expression is such a comparison.
+  std::optional<InputChange> flipByteComparison(const qsym::ExprRef &e,
+                                                bool taken) {
+    if (e->kind() != qsym::Equal && e->kind() != qsym::Distinct)
+      return std::nullopt;
+
+    auto read = inputByte(e->getChild(0));
+    auto constant = qsym::castAs<qsym::ConstantExpr>(e->getChild(1));
+    if (read == nullptr || constant == nullptr) {
+      read = inputByte(e->getChild(1));
+      constant = qsym::castAs<qsym::ConstantExpr>(e->getChild(0));
+    }
+    if (read == nullptr || constant == nullptr ||
+        read->index() >= inputs_.size())
+      return std::nullopt;
+
+    auto value = constant->value();
+    bool wantEqual = (e->kind() == qsym::Equal) != taken;
+    if (wantEqual && value.getActiveBits() > 8)
+      return std::nullopt;
+
+    auto byte = static_cast<uint8_t>(value.getLoBits(8).getZExtValue());
+    return InputChange{inputs_.size(),
+                       {{read->index(), wantEqual ? byte : byte ^ 1}}};
+  }
+
+  /// Return the input byte that the expression reads, possibly after zero
+  /// extension, or null if it's something else.
+  static std::shared_ptr<qsym::ReadExpr> inputByte(qsym::ExprRef e) {
+    while (e->kind() == qsym::ZExt)
+      e = e->getChild(0);
+    return qsym::castAs<qsym::ReadExpr>(e);
+  }
+
+  /// Check whether the changed input satisfies the goal and all path
+  /// constraints.
+  bool satisfiesPath(const InputChange &change, const z3::expr &goal,
+                     const std::vector<size_t> &goalDependencies) {
+    if (change.inputSize != inputs_.size() ||
+        !holds(goal, goalDependencies, change))
+      return false;
+
+    // Constraints on bytes that the change leaves alone are satisfied already.
+    std::set<size_t> affected;
+    for (auto [offset, value] : change.bytes) {
+      if (auto it = constraintsByByte_.find(offset);
+          it != constraintsByByte_.end())
+        affected.insert(it->second.begin(), it->second.end());
+    }
+
+    return std::all_of(affected.begin(), affected.end(), [&](size_t index) {
+      const auto &constraint = pathConstraints_[index];
+      return holds(constraint.condition, constraint.dependencies, change);
+    });
+  }
+
+  /// Evaluate a condition on the changed input.
+  bool holds(const z3::expr &condition, const std::vector<size_t> &dependencies,
+             const InputChange &change) {
+    z3::expr_vector variables(context_), values(context_);
+    for (auto offset : dependencies) {
+      uint8_t value = offset < inputs_.size() ? inputs_[offset] : 0;
+      for (auto [changedOffset, changedValue] : change.bytes) {
+        if (changedOffset == offset)
+          value = changedValue;
+      }
+
+      variables.push_back(context_.constant(
+          context_.int_symbol(static_cast<int>(offset)), context_.bv_sort(8)));
+      values.push_back(context_.bv_val(static_cast<unsigned>(value), 8));
+    }
+
+    return z3::expr(condition)
+        .substitute(variables, values)
+        .simplify()
+        .is_true();
+  }
+
+  void rememberModel(InputChange change) {
+    if (recentModels_.size() == kModelCacheSize)
+      recentModels_.pop_back();
+    recentModels_.push_front(std::move(change));
+  }
+
+  /// Check the incremental solver for a query at the given site, accounting
+  /// for the time and logging it like qsym::Solver::check does.
+  z3::check_result checkPath(uintptr_t site) {
+    using std::chrono::duration_cast;
+    using std::chrono::microseconds;
+
+    auto before = std::chrono::steady_clock::now();
+    std::cerr << "[STAT] SMT: { \"solving_time\": " << solving_time_
+              << ", \"total_time\": "
+              << duration_cast<microseconds>(before - startTime_).count()
+              << " }" << std::endl;
+
+    z3::check_result result;
+    try {
+      result = pathSolver_.check();
+    } catch (z3::exception &e) {
+      std::cerr << "Solver error: " << e.msg() << std::endl;
+      result = z3::unknown;
+    }
+
+    auto time = std::chrono::steady_clock::now() - before;
+    solving_time_ += duration_cast<microseconds>(time).count();
+
+    auto outcome = QueryOutcome::Timeout;
+    if (result == z3::sat)
+      outcome = QueryOutcome::Sat;
+    else if (result == z3::unsat)
+      outcome = QueryOutcome::Unsat;
+    recordQuery(site, outcome, time);
+
+    std::cerr << "[STAT] SMT: { \"solving_time\": " << solving_time_ << " }"
+              << std::endl;
+    return result;
+  }
+
+  /// Compute the change to the input that a model describes; bytes that the
+  /// model doesn't mention keep their values.
+  InputChange changeFromModel(const z3::model &model) {
+    InputChange change{inputs_.size(), {}};
+    for (unsigned i = 0; i < model.num_consts(); i++) {
+      auto decl = model.get_const_decl(i);
+      auto name = decl.name();
+      if (name.kind() != Z3_INT_SYMBOL)
+        continue;
+
+      auto offset = static_cast<size_t>(name.to_int());
+      auto value = static_cast<uint8_t>(
+          model.get_const_interp(decl).get_numeral_uint());
+      if (offset < inputs_.size() && inputs_[offset] != value)
+        change.bytes.emplace_back(offset, value);
+    }
+
+    return change;
+  }
+
+  std::vector<uint8_t> applyChange(const InputChange &change) {
+    std::vector<uint8_t> values(inputs_.begin(), inputs_.end());
+    for (auto [offset, value] : change.bytes)
+      values[offset] = value;
+    return values;
+  }
+
+  void saveTestCase(const std::vector<uint8_t> &values,
+                    const std::string &suffix) {
     if (auto handler = g_test_case_handler) {
-      auto values = getConcreteValues();
       // The test-case handler may be instrumented, so let's call it with
       // argument expressions to meet instrumented code's expectations.
       // Otherwise, we might end up erroneously using whatever expression was
@@ -144,14 +587,50 @@ public:
       _sym_set_parameter_expression(0, nullptr);
       _sym_set_parameter_expression(1, nullptr);
       handler(values.data(), values.size());
-    } else {
-      Solver::saveValues(suffix);
+      return;
     }
+
+    if (pushTestCaseToRing(values.data(), values.size()))
+      return;
+
+    // Write a file and log it the way qsym::Solver::saveValues does; we can't
+    // call it because it takes the values from the model of QSYM's own
+    // solver.
+    char name[16];
+    snprintf(name, sizeof(name), "%06d", static_cast<int>(num_generated_++));
+    auto path = out_dir_ + "/" + name + (suffix.empty() ? "" : "-" + suffix);
+    std::cerr << "[INFO] New testcase: " << path << std::endl;
+    std::ofstream file(path, std::ios::binary);
+    file.write(reinterpret_cast<const char *>(values.data()), values.size());
+    if (!file)
+      std::cerr << "Failed to write the test case " << path << std::endl;
   }
+
+  /// Holds the path constraints incrementally.
+  z3::solver pathSolver_;
+
+  /// When we were created, for QSYM's statistics.
+  std::chrono::steady_clock::time_point startTime_ =
+      std::chrono::steady_clock::now();
+
+  /// The path constraints in the order of their creation.
+  std::vector<PathConstraint> pathConstraints_;
+
+  /// For each input byte, the indices of the path constraints that depend on
+  /// it.
+  std::unordered_map<size_t, std::vector<size_t>> constraintsByByte_;
+
+  /// The most recently generated test cases, newest first.
+  std::deque<InputChange> recentModels_;
 };
 
 EnhancedQsymSolver *g_enhanced_solver;
 
+/// The solver state saved by the last snapshot. Like the pre-solver
+/// statistics, it lives outside the solver because restoring replaces the
+/// solver.
+EnhancedQsymSolver::State g_saved_solver_state;
+
 } // namespace
 
 using namespace qsym;
@@ -186,6 +665,12 @@ void _sym_initialize(void) {
   }
 
   g_z3_context = new z3::context{};
+
+  // The solver loads the AFL coverage map, which must happen once per
+  // execution so that we see the updates of previous executions.
+  runForkserver();
+  initStatistics();
+
   g_enhanced_solver = new EnhancedQsymSolver{};
   g_solver = g_enhanced_solver; // for QSYM-internal use
   g_expr_builder = g_config.pruning ? PruneExprBuilder::create()
@@ -193,49 +678,49 @@ void _sym_initialize(void) {
 }
 
 SymExpr _sym_build_integer(uint64_t value, uint8_t bits) {
-  // QSYM's API takes uintptr_t, so we need to be careful when compiling for
-  // 32-bit systems: the compiler would helpfully truncate our uint64_t to fit
-  // into 32 bits.
-  if constexpr (sizeof(uint64_t) == sizeof(uintptr_t)) {
-    // 64-bit case: all good.
-    return registerExpression(g_expr_builder->createConstant(value, bits));
-  } else {
-    // 32-bit case: use the regular API if possible, otherwise create an
-    // llvm::APInt.
-    if (uintptr_t value32 = value; value32 == value)
-      return registerExpression(g_expr_builder->createConstant(value32, bits));
-
-    return registerExpression(
-        g_expr_builder->createConstant({64, value}, bits));
-  }
+  RuntimeLock lock;
+  return registerExpression(g_expressions.createConstant(value, bits));
 }
 
 SymExpr _sym_build_integer128(uint64_t high, uint64_t low) {
-  std::array<uint64_t, 2> words = {low, high};
-  return registerExpression(g_expr_builder->createConstant({128, words}, 128));
+  RuntimeLock lock;
+  // QSYM's constant folding merges the halves when it translates the
+  // concatenation.
+  auto highExpr = g_expressions.createConstant(high, 64);
+  auto lowExpr = g_expressions.createConstant(low, 64);
+  auto result =
+      g_expressions.createBinary(NodeKind::Concat, highExpr, lowExpr);
+  releaseExpression(highExpr);
+  releaseExpression(lowExpr);
+  return registerExpression(result);
 }
 
 SymExpr _sym_build_null_pointer() {
+  RuntimeLock lock;
   return registerExpression(
-      g_expr_builder->createConstant(0, sizeof(uintptr_t) * 8));
+      g_expressions.createConstant(0, sizeof(uintptr_t) * 8));
 }
 
 SymExpr _sym_build_true() {
-  return registerExpression(g_expr_builder->createTrue());
+  RuntimeLock lock;
+  return registerExpression(g_expressions.createBool(true));
 }
 
 SymExpr _sym_build_false() {
-  return registerExpression(g_expr_builder->createFalse());
+  RuntimeLock lock;
+  return registerExpression(g_expressions.createBool(false));
 }
 
 SymExpr _sym_build_bool(bool value) {
-  return registerExpression(g_expr_builder->createBool(value));
+  RuntimeLock lock;
+  return registerExpression(g_expressions.createBool(value));
 }
 
-#define DEF_BINARY_EXPR_BUILDER(name, qsymName)                                \
+#define DEF_BINARY_EXPR_BUILDER(name, kind)                                    \
   SymExpr _sym_build_##name(SymExpr a, SymExpr b) {                            \
-    return registerExpression(g_expr_builder->create##qsymName(                \
-        allocatedExpressions.at(a), allocatedExpressions.at(b)));              \
+    RuntimeLock lock;                                                          \
+    return registerExpression(                                                 \
+        g_expressions.createBinary(NodeKind::kind, a, b));                     \
   }
 
 DEF_BINARY_EXPR_BUILDER(add, Add)
@@ -271,76 +756,102 @@ DEF_BINARY_EXPR_BUILDER(xor, Xor)
 #undef DEF_BINARY_EXPR_BUILDER
 
 SymExpr _sym_build_neg(SymExpr expr) {
-  return registerExpression(
-      g_expr_builder->createNeg(allocatedExpressions.at(expr)));
+  RuntimeLock lock;
+  return registerExpression(g_expressions.createUnary(
+      NodeKind::Neg, expr, g_expressions.node(expr).bits));
 }
 
 SymExpr _sym_build_not(SymExpr expr) {
-  return registerExpression(
-      g_expr_builder->createNot(allocatedExpressions.at(expr)));
+  RuntimeLock lock;
+  return registerExpression(g_expressions.createUnary(
+      NodeKind::Not, expr, g_expressions.node(expr).bits));
 }
 
 SymExpr _sym_build_ite(SymExpr cond, SymExpr a, SymExpr b) {
-  return registerExpression(g_expr_builder->createIte(
-      allocatedExpressions.at(cond), allocatedExpressions.at(a),
-      allocatedExpressions.at(b)));
+  RuntimeLock lock;
+  return registerExpression(g_expressions.createIte(cond, a, b));
 }
 
 SymExpr _sym_build_sext(SymExpr expr, uint8_t bits) {
+  RuntimeLock lock;
   if (expr == nullptr)
     return nullptr;
 
-  return registerExpression(g_expr_builder->createSExt(
-      allocatedExpressions.at(expr), bits + expr->bits()));
+  return registerExpression(g_expressions.createUnary(
+      NodeKind::SExt, expr, bits + g_expressions.node(expr).bits));
 }
 
 SymExpr _sym_build_zext(SymExpr expr, uint8_t bits) {
+  RuntimeLock lock;
   if (expr == nullptr)
     return nullptr;
 
-  return registerExpression(g_expr_builder->createZExt(
-      allocatedExpressions.at(expr), bits + expr->bits()));
+  return registerExpression(g_expressions.createUnary(
+      NodeKind::ZExt, expr, bits + g_expressions.node(expr).bits));
 }
 
 SymExpr _sym_build_trunc(SymExpr expr, uint8_t bits) {
+  RuntimeLock lock;
   if (expr == nullptr)
     return nullptr;
 
   return registerExpression(
-      g_expr_builder->createTrunc(allocatedExpressions.at(expr), bits));
+      g_expressions.createUnary(NodeKind::Trunc, expr, bits));
 }
 
 void _sym_push_path_constraint(SymExpr constraint, int taken,
                                uintptr_t site_id) {
+  RuntimeLock lock;
   if (constraint == nullptr)
     return;
 
-  g_solver->addJcc(allocatedExpressions.at(constraint), taken != 0, site_id);
+  g_enhanced_solver->addPathConstraint(translate(constraint), taken != 0,
+                                       site_id);
 }
 
 SymExpr _sym_get_input_byte(size_t offset, uint8_t value) {
+  RuntimeLock lock;
+  _sym_symbolic_data_seen = true;
   g_enhanced_solver->pushInputByte(offset, value);
-  return registerExpression(g_expr_builder->createRead(offset));
+  return registerExpression(g_expressions.createRead(offset));
+}
+
+void _sym_get_input_bytes(size_t offset, const uint8_t *values, size_t length,
+                          SymExpr *result) {
+  RuntimeLock lock;
+  _sym_symbolic_data_seen = true;
+  if (values != nullptr)
+    g_enhanced_solver->pushInputBytes(offset, values, length);
+  if (result == nullptr)
+    return;
+
+  for (size_t i = 0; i < length; i++)
+    result[i] = registerExpression(g_expressions.createRead(offset + i));
 }
 
 SymExpr _sym_concat_helper(SymExpr a, SymExpr b) {
-  return registerExpression(g_expr_builder->createConcat(
-      allocatedExpressions.at(a), allocatedExpressions.at(b)));
+  RuntimeLock lock;
+  return registerExpression(g_expressions.createBinary(NodeKind::Concat, a, b));
 }
 
 SymExpr _sym_extract_helper(SymExpr expr, size_t first_bit, size_t last_bit) {
-  return registerExpression(g_expr_builder->createExtract(
-      allocatedExpressions.at(expr), last_bit, first_bit - last_bit + 1));
+  RuntimeLock lock;
+  return registerExpression(g_expressions.createExtract(
+      expr, last_bit, first_bit - last_bit + 1));
 }
 
-size_t _sym_bits_helper(SymExpr expr) { return expr->bits(); }
+size_t _sym_bits_helper(SymExpr expr) {
+  RuntimeLock lock;
+  return g_expressions.node(expr).bits;
+}
 
 SymExpr _sym_build_bool_to_bit(SymExpr expr) {
+  RuntimeLock lock;
   if (expr == nullptr)
     return nullptr;
 
   return registerExpression(
-      g_expr_builder->boolToBit(allocatedExpressions.at(expr), 1));
+      g_expressions.createUnary(NodeKind::BoolToBit, expr, 1));
 }
 
 //
@@ -354,11 +865,12 @@ SymExpr _sym_build_bool_to_bit(SymExpr expr) {
 // them.
 
 SymExpr _sym_build_float(double, int is_double) {
+  RuntimeLock lock;
   // We create an all-zeros bit vector, mainly to capture the length of the
   // value. This is compatible with our dummy implementation of
   // _sym_build_float_to_bits.
   return registerExpression(
-      g_expr_builder->createConstant(0, is_double ? 64 : 32));
+      g_expressions.createConstant(0, is_double ? 64 : 32));
 }
 
 SymExpr _sym_build_float_to_bits(SymExpr expr) { return expr; }
@@ -401,14 +913,17 @@ UNSUPPORTED(SymExpr _sym_build_float_to_unsigned_integer(SymExpr, uint8_t))
 //
 
 void _sym_notify_call(uintptr_t site_id) {
+  RuntimeLock lock;
   g_call_stack_manager.visitCall(site_id);
 }
 
 void _sym_notify_ret(uintptr_t site_id) {
+  RuntimeLock lock;
   g_call_stack_manager.visitRet(site_id);
 }
 
 void _sym_notify_basic_block(uintptr_t site_id) {
+  RuntimeLock lock;
   g_call_stack_manager.visitBasicBlock(site_id);
 }
 
@@ -417,9 +932,10 @@ void _sym_notify_basic_block(uintptr_t site_id) {
 //
 
 const char *_sym_expr_to_string(SymExpr expr) {
+  RuntimeLock lock;
   static char buffer[4096];
 
-  auto expr_string = expr->toString();
+  auto expr_string = translate(expr)->toString();
   auto copied = expr_string.copy(
       buffer, std::min(expr_string.length(), sizeof(buffer) - 1));
   buffer[copied] = '\0';
@@ -428,42 +944,50 @@ const char *_sym_expr_to_string(SymExpr expr) {
 }
 
 bool _sym_feasible(SymExpr expr) {
-  expr->simplify();
-
-  g_solver->push();
-  g_solver->add(expr->toZ3Expr());
-  bool feasible = (g_solver->check() == z3::sat);
-  g_solver->pop();
-
-  return feasible;
+  RuntimeLock lock;
+  return g_enhanced_solver->feasible(translate(expr));
 }
 
 //
 // Garbage collection
 //
 
-void _sym_collect_garbage() {
-  if (allocatedExpressions.size() < g_config.garbageCollectionThreshold)
-    return;
-
-#ifdef DEBUG_RUNTIME
-  auto start = std::chrono::high_resolution_clock::now();
-#endif
+namespace {
 
-  auto reachableExpressions = collectReachableExpressions();
-  for (auto expr_it = allocatedExpressions.begin();
-       expr_it != allocatedExpressions.end();) {
-    if (reachableExpressions.count(expr_it->first) == 0) {
-      expr_it = allocatedExpressions.erase(expr_it);
-    } else {
-      ++expr_it;
+/// Sweep the expressions that aren't reachable anymore; a minor collection only
+/// considers the young ones (see collectReachableExpressions).
+void collectGarbage(bool fullCollection) {
+  auto start = std::chrono::steady_clock::now();
+
+  auto startSize = allocatedExpressions.size();
+  auto reachableExpressions = collectReachableExpressions(fullCollection);
+  auto isReachable = [&](SymExpr expr) {
+    return std::binary_search(reachableExpressions.begin(),
+                              reachableExpressions.end(), expr);
+  };
+
+  // The registry holds a reference to each of its expressions.
+  if (fullCollection) {
+    allocatedExpressions.retainOnly(reachableExpressions, releaseExpression);
+  } else {
+    // Young expressions that survive are promoted to the old generation.
+    for (auto expr : youngExpressions) {
+      if (!isReachable(expr) && allocatedExpressions.erase(expr))
+        releaseExpression(expr);
     }
   }
 
+  youngExpressions.clear();
+  garbageCollectionFinished(startSize, allocatedExpressions.size());
+
+  auto end = std::chrono::steady_clock::now();
+  recordCollection(fullCollection, end - start, startSize,
+                   allocatedExpressions.size());
+
 #ifdef DEBUG_RUNTIME
-  auto end = std::chrono::high_resolution_clock::now();
 
-  std::cerr << "After garbage collection: " << allocatedExpressions.size()
+  std::cerr << "After " << (fullCollection ? "full" : "minor")
+            << " garbage collection: " << allocatedExpressions.size()
             << " expressions remain" << std::endl
             << "\t(collection took "
             << std::chrono::duration_cast<std::chrono::milliseconds>(end -
@@ -473,6 +997,40 @@ void _sym_collect_garbage() {
 #endif
 }
 
+} // namespace
+
+void _sym_collect_garbage() {
+  RuntimeLock lock;
+  auto kind = garbageCollectionDue(allocatedExpressions.size(),
+                                   youngExpressions.size());
+  if (kind != CollectionKind::None)
+    collectGarbage(kind == CollectionKind::Full);
+}
+
+//
+// Snapshots
+//
+
+void snapshotBackend() {
+  if (g_enhanced_solver != nullptr)
+    g_saved_solver_state = g_enhanced_solver->state();
+}
+
+void restoreBackend() {
+  if (g_enhanced_solver == nullptr)
+    return; // fully concrete execution
+
+  // A new solver starts with a clean slate in QSYM's bookkeeping and reloads
+  // the AFL coverage map; we then bring back the saved input bytes and path
+  // constraints, which the restored shadow memory refers to.
+  delete g_enhanced_solver;
+  g_enhanced_solver = new EnhancedQsymSolver{};
+  g_solver = g_enhanced_solver;
+  g_enhanced_solver->load(g_saved_solver_state);
+
+  collectGarbage(true);
+}
+
 //
 // Test-case handling
 //
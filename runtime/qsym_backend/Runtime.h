@@ -16,9 +16,9 @@
 #ifndef RUNTIME_H
 #define RUNTIME_H
 
-#include "expr.h"
-
-typedef qsym::Expr *SymExpr;
+/// An expression in the backend's own pool (see ExpressionPool.h). The type
+/// is never defined: a SymExpr holds the index of a node in the pool.
+typedef struct ExpressionHandle *SymExpr;
 #include <RuntimeCommon.h>
 
 #endif
@@ -0,0 +1,140 @@
+// This file is part of the SymCC runtime.
+//
+// The SymCC runtime is free software: you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// The SymCC runtime is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+// for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with the SymCC runtime. If not, see <https://www.gnu.org/licenses/>.
+
+#include "ConstraintSlicer.h"
+
+#include <algorithm>
+#include <unordered_set>
+#include <utility>
+
+ConstraintSlicer::~ConstraintSlicer() {
+  for (auto *constraint : constraints_)
+    Z3_dec_ref(context_, constraint);
+}
+
+void ConstraintSlicer::add(Z3_ast constraint) {
+  Z3_inc_ref(context_, constraint);
+  auto index = constraints_.size();
+  constraints_.push_back(constraint);
+
+  auto variables = variablesOf(constraint);
+  if (variables.empty())
+    return;
+
+  auto representative = find(variables[0]);
+  for (size_t i = 1; i < variables.size(); i++)
+    representative = merge(representative, find(variables[i]));
+  constraintsOf_[representative].push_back(index);
+}
+
+std::vector<Z3_ast> ConstraintSlicer::relevantTo(Z3_ast expr) {
+  std::vector<unsigned> representatives;
+  for (auto variable : variablesOf(expr))
+    representatives.push_back(find(variable));
+  std::sort(representatives.begin(), representatives.end());
+  representatives.erase(
+      std::unique(representatives.begin(), representatives.end()),
+      representatives.end());
+
+  std::vector<size_t> indices;
+  for (auto representative : representatives) {
+    auto &set = constraintsOf_[representative];
+    indices.insert(indices.end(), set.begin(), set.end());
+  }
+  // Each set is sorted already.
+  if (representatives.size() > 1)
+    std::sort(indices.begin(), indices.end());
+
+  std::vector<Z3_ast> result;
+  result.reserve(indices.size());
+  for (auto index : indices)
+    result.push_back(constraints_[index]);
+  return result;
+}
+
+std::vector<unsigned> ConstraintSlicer::variablesOf(Z3_ast expr) {
+  scratch_.reset();
+  std::vector<unsigned> variables;
+  std::unordered_set<unsigned, std::hash<unsigned>, std::equal_to<unsigned>,
+                     ArenaAllocator<unsigned>>
+      visited(0, std::hash<unsigned>(), std::equal_to<unsigned>(),
+              ArenaAllocator<unsigned>(scratch_));
+  std::vector<Z3_ast, ArenaAllocator<Z3_ast>> worklist(
+      1, expr, ArenaAllocator<Z3_ast>(scratch_));
+
+  // Expressions are DAGs with a lot of sharing, so we make sure to visit each
+  // node only once.
+  while (!worklist.empty()) {
+    auto *current = worklist.back();
+    worklist.pop_back();
+    if (!visited.insert(Z3_get_ast_id(context_, current)).second)
+      continue;
+    if (Z3_get_ast_kind(context_, current) != Z3_APP_AST)
+      continue;
+
+    auto *app = Z3_to_app(context_, current);
+    auto numArgs = Z3_get_app_num_args(context_, app);
+    if (numArgs == 0) {
+      auto *decl = Z3_get_app_decl(context_, app);
+      if (Z3_get_decl_kind(context_, decl) != Z3_OP_UNINTERPRETED)
+        continue;
+
+      auto [it, inserted] = nodeOfVariable_.try_emplace(
+          Z3_get_ast_id(context_, current), parent_.size());
+      if (inserted) {
+        parent_.push_back(it->second);
+        rank_.push_back(0);
+        constraintsOf_.emplace_back();
+      }
+      variables.push_back(it->second);
+      continue;
+    }
+
+    for (unsigned i = 0; i < numArgs; i++)
+      worklist.push_back(Z3_get_app_arg(context_, app, i));
+  }
+
+  return variables;
+}
+
+unsigned ConstraintSlicer::find(unsigned node) {
+  while (parent_[node] != node) {
+    // Path halving keeps the trees flat.
+    parent_[node] = parent_[parent_[node]];
+    node = parent_[node];
+  }
+  return node;
+}
+
+unsigned ConstraintSlicer::merge(unsigned a, unsigned b) {
+  if (a == b)
+    return a;
+
+  if (rank_[a] < rank_[b])
+    std::swap(a, b);
+  if (rank_[a] == rank_[b])
+    rank_[a]++;
+  parent_[b] = a;
+
+  // Keep the constraint list sorted by age.
+  auto &into = constraintsOf_[a];
+  auto &from = constraintsOf_[b];
+  auto middle = into.size();
+  into.insert(into.end(), from.begin(), from.end());
+  std::inplace_merge(into.begin(), into.begin() + middle, into.end());
+  from.clear();
+  from.shrink_to_fit();
+  return a;
+}
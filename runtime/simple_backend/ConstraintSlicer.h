@@ -0,0 +1,100 @@
+// This file is part of the SymCC runtime.
+//
+// The SymCC runtime is free software: you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// The SymCC runtime is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+// for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with the SymCC runtime. If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef CONSTRAINTSLICER_H
+#define CONSTRAINTSLICER_H
+
+#include <cstddef>
+#include <functional>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <z3.h>
+
+#include "Arena.h"
+
+/// The path constraints of the current execution, partitioned into independent
+/// sets.
+///
+/// Two constraints are dependent if they share a variable, and dependence is
+/// transitive. When we solve a query, constraints that are independent of it
+/// can't influence the result (given that the path constraints as a whole are
+/// satisfiable), so we only need to pass the dependent ones to the solver. On
+/// long paths, this often reduces the query to a handful of constraints.
+///
+/// We track the partition with a union-find structure over the variables; each
+/// representative keeps the list of constraints in its set.
+class ConstraintSlicer {
+public:
+  explicit ConstraintSlicer(Z3_context context)
+      : context_(context),
+        nodeOfVariable_(0, std::hash<unsigned>(), std::equal_to<unsigned>(),
+                        ArenaAllocator<std::pair<const unsigned, unsigned>>(
+                            variableNodes_)) {}
+  ~ConstraintSlicer();
+
+  ConstraintSlicer(const ConstraintSlicer &) = delete;
+  ConstraintSlicer &operator=(const ConstraintSlicer &) = delete;
+
+  /// Add a path constraint. The slicer keeps a reference to it.
+  void add(Z3_ast constraint);
+
+  /// Return the constraints that the given expression depends on, in the
+  /// order in which they were added.
+  std::vector<Z3_ast> relevantTo(Z3_ast expr);
+
+  /// Return all constraints, in the order in which they were added.
+  const std::vector<Z3_ast> &constraints() const { return constraints_; }
+
+  size_t size() const { return constraints_.size(); }
+
+private:
+  /// Return the union-find nodes of all variables in the expression.
+  std::vector<unsigned> variablesOf(Z3_ast expr);
+
+  /// Return the representative of the node's set.
+  unsigned find(unsigned node);
+
+  /// Merge the sets of two representatives and return the new one.
+  unsigned merge(unsigned a, unsigned b);
+
+  Z3_context context_;
+
+  /// All constraints, in the order in which they were added.
+  std::vector<Z3_ast> constraints_;
+
+  /// The memory for nodeOfVariable_, which only grows until the slicer is
+  /// destroyed (i.e., at exit or on a snapshot restore).
+  Arena variableNodes_;
+
+  /// The union-find node of each variable, by AST ID.
+  std::unordered_map<unsigned, unsigned, std::hash<unsigned>,
+                     std::equal_to<unsigned>,
+                     ArenaAllocator<std::pair<const unsigned, unsigned>>>
+      nodeOfVariable_;
+
+  /// Temporary memory for the traversal in variablesOf, which runs on every
+  /// path constraint and every query; it is reset on each call.
+  Arena scratch_;
+
+  std::vector<unsigned> parent_;
+  std::vector<unsigned> rank_;
+
+  /// For representatives, the indices of the constraints in their set.
+  std::vector<std::vector<size_t>> constraintsOf_;
+};
+
+#endif
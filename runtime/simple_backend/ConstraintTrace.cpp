@@ -0,0 +1,109 @@
+// This file is part of the SymCC runtime.
+//
+// The SymCC runtime is free software: you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// The SymCC runtime is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+// for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with the SymCC runtime. If not, see <https://www.gnu.org/licenses/>.
+
+#include "ConstraintTrace.h"
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <unistd.h>
+
+namespace {
+
+/// The stdio buffer of the trace file; records are small, so we want to write
+/// them out in large batches.
+constexpr size_t kBufferSize = 64 * 1024;
+
+} // namespace
+
+ConstraintTrace::~ConstraintTrace() {
+  if (file_ != nullptr)
+    fclose(file_);
+}
+
+void ConstraintTrace::open(const std::string &path) {
+  file_ = fopen(path.c_str(), "wb");
+  if (file_ == nullptr)
+    throw std::runtime_error("Failed to create the constraint trace " + path +
+                             ": " + strerror(errno));
+
+  setvbuf(file_, nullptr, _IOFBF, kBufferSize);
+  fwrite(trace::kMagic, sizeof(trace::kMagic), 1, file_);
+  // Children of the forkserver share the file, so the header must not linger
+  // in our buffer.
+  fflush(file_);
+}
+
+void ConstraintTrace::beginExecution() {
+  nextConstraint_ = 0;
+
+  auto now = std::chrono::system_clock::now().time_since_epoch();
+  trace::ExecutionRecord record{};
+  record.pid = getpid();
+  record.startTime =
+      std::chrono::duration_cast<std::chrono::microseconds>(now).count();
+  write(trace::RecordKind::Execution, 0, record);
+}
+
+uint64_t ConstraintTrace::addConstraint(uintptr_t site, uint64_t context,
+                                        bool taken) {
+  trace::ConstraintRecord record{nextConstraint_, site, context};
+  write(trace::RecordKind::Constraint, taken ? trace::kTaken : 0, record);
+  return nextConstraint_++;
+}
+
+void ConstraintTrace::addQuery(uint64_t constraint, uintptr_t site,
+                               trace::QueryResult result,
+                               std::chrono::steady_clock::duration time) {
+  trace::QueryRecord record{
+      constraint, site,
+      static_cast<uint64_t>(
+          std::chrono::duration_cast<std::chrono::microseconds>(time).count())};
+  write(trace::RecordKind::Query, static_cast<uint16_t>(result), record);
+}
+
+void ConstraintTrace::addInput(size_t offset, uint8_t value) {
+  trace::InputRecord record{static_cast<uint32_t>(offset), value};
+  write(trace::RecordKind::Input, 0, record);
+}
+
+void ConstraintTrace::addExpression(uint64_t constraint, const char *smtlib) {
+  auto length = strlen(smtlib);
+  writeHeader(trace::RecordKind::Expression, 0, sizeof(constraint) + length);
+  fwrite(&constraint, sizeof(constraint), 1, file_);
+  fwrite(smtlib, 1, length, file_);
+}
+
+void ConstraintTrace::addSnapshot() {
+  writeHeader(trace::RecordKind::Snapshot, 0, 0);
+}
+
+void ConstraintTrace::addRestore() {
+  writeHeader(trace::RecordKind::Restore, 0, 0);
+}
+
+template <typename Payload>
+void ConstraintTrace::write(trace::RecordKind kind, uint16_t flags,
+                            const Payload &payload) {
+  writeHeader(kind, flags, sizeof(Payload));
+  fwrite(&payload, sizeof(payload), 1, file_);
+}
+
+void ConstraintTrace::writeHeader(trace::RecordKind kind, uint16_t flags,
+                                  size_t size) {
+  trace::RecordHeader header{kind, flags, static_cast<uint32_t>(size)};
+  fwrite(&header, sizeof(header), 1, file_);
+}
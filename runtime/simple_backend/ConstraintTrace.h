@@ -0,0 +1,179 @@
+// This file is part of the SymCC runtime.
+//
+// The SymCC runtime is free software: you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// The SymCC runtime is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+// for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with the SymCC runtime. If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef CONSTRAINTTRACE_H
+#define CONSTRAINTTRACE_H
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+//
+// An append-only binary log of the path constraints and solver queries of an
+// execution, for analysis after the fact (see util/decode_constraint_trace.py).
+//
+// The file starts with the 8-byte magic "SYMCCTR1". Records follow back to
+// back, each consisting of a RecordHeader and a payload of the given size; all
+// numbers are in the byte order of the machine that ran the program. Readers
+// should skip records of unknown kinds, so that we can add new ones later.
+//
+// Writing a record costs a few dozen bytes of buffered output, as opposed to
+// serializing the whole solver for every branch, so the trace is cheap enough
+// to leave on. Optionally, the trace also contains the path constraints
+// themselves and the values of the input bytes, which is enough for
+// symcc-replay to solve the queries again without the target program (see
+// Replay.cpp); printing the constraints costs time proportional to their size.
+//
+
+namespace trace {
+
+constexpr char kMagic[8] = {'S', 'Y', 'M', 'C', 'C', 'T', 'R', '1'};
+
+enum class RecordKind : uint16_t {
+  /// The start of an execution (ExecutionRecord). In forkserver mode, every
+  /// child process appends its records to the same file, each starting with
+  /// one of these.
+  Execution = 1,
+  /// A path constraint (ConstraintRecord).
+  Constraint = 2,
+  /// A query for the alternative of a path constraint (QueryRecord).
+  Query = 3,
+  /// The concrete value of an input byte (InputRecord).
+  Input = 4,
+  /// The expression of a path constraint, following its ConstraintRecord: the
+  /// 8-byte constraint ID, then an SMT-LIB benchmark asserting the branch
+  /// condition (which must be negated if the branch wasn't taken).
+  Expression = 5,
+  /// A snapshot of the path constraints and input bytes (no payload; see
+  /// symcc_snapshot).
+  Snapshot = 6,
+  /// A return to the last snapshot (no payload; see symcc_restore).
+  Restore = 7,
+};
+
+/// What became of a query.
+enum class QueryResult : uint16_t {
+  Sat = 0,
+  Unsat = 1,
+  /// The solver gave up, usually because of the timeout.
+  Unknown = 2,
+  /// Answered from the query cache.
+  CachedSat = 3,
+  CachedUnsat = 4,
+  /// Not solved because of the solver budget or the back-off for unproductive
+  /// sites.
+  Skipped = 5,
+  /// Not solved because too many queries were pending in the background.
+  Dropped = 6,
+};
+
+struct RecordHeader {
+  RecordKind kind;
+  /// Kind-specific flags.
+  uint16_t flags;
+  /// The size of the payload in bytes.
+  uint32_t size;
+};
+
+struct ExecutionRecord {
+  uint32_t pid;
+  uint32_t reserved;
+  /// Wall-clock time in microseconds since the Unix epoch.
+  uint64_t startTime;
+};
+
+/// Flags of a ConstraintRecord.
+constexpr uint16_t kTaken = 1;
+
+struct ConstraintRecord {
+  /// Numbers the non-trivial path constraints of an execution, starting at 0.
+  uint64_t id;
+  /// The site ID that the compiler assigned to the branch.
+  uint64_t site;
+  /// The hash of the calling context at the branch.
+  uint64_t context;
+};
+
+/// The flags of a QueryRecord hold the QueryResult.
+struct QueryRecord {
+  /// The path constraint whose alternative we tried to solve.
+  uint64_t constraint;
+  uint64_t site;
+  /// Solver time in microseconds; 0 for queries that didn't reach the solver.
+  uint64_t time;
+};
+
+struct InputRecord {
+  uint32_t offset;
+  uint32_t value;
+};
+
+static_assert(sizeof(RecordHeader) == 8 && sizeof(ExecutionRecord) == 16 &&
+                  sizeof(ConstraintRecord) == 24 && sizeof(QueryRecord) == 24 &&
+                  sizeof(InputRecord) == 8,
+              "The trace format must not depend on padding");
+
+} // namespace trace
+
+/// The writer for the constraint trace.
+class ConstraintTrace {
+public:
+  ConstraintTrace() = default;
+  ~ConstraintTrace();
+
+  ConstraintTrace(const ConstraintTrace &) = delete;
+  ConstraintTrace &operator=(const ConstraintTrace &) = delete;
+
+  /// Create the trace file (overwriting any existing one); throws
+  /// std::runtime_error on failure.
+  void open(const std::string &path);
+
+  /// Whether the trace has been opened; the functions below may only be
+  /// called if so.
+  bool enabled() const { return file_ != nullptr; }
+
+  /// Start a new execution; this also resets the constraint IDs.
+  void beginExecution();
+
+  /// Record a path constraint and return its ID.
+  uint64_t addConstraint(uintptr_t site, uint64_t context, bool taken);
+
+  /// Record the result of a query for the alternative of a path constraint.
+  void addQuery(uint64_t constraint, uintptr_t site, trace::QueryResult result,
+                std::chrono::steady_clock::duration time = {});
+
+  /// Record the value of an input byte.
+  void addInput(size_t offset, uint8_t value);
+
+  /// Record the expression of a path constraint, given as an SMT-LIB
+  /// benchmark.
+  void addExpression(uint64_t constraint, const char *smtlib);
+
+  /// Record a snapshot or a restore.
+  void addSnapshot();
+  void addRestore();
+
+private:
+  template <typename Payload>
+  void write(trace::RecordKind kind, uint16_t flags, const Payload &payload);
+
+  void writeHeader(trace::RecordKind kind, uint16_t flags, size_t size);
+
+  FILE *file_ = nullptr;
+  uint64_t nextConstraint_ = 0;
+};
+
+#endif
@@ -0,0 +1,110 @@
+// This file is part of the SymCC runtime.
+//
+// The SymCC runtime is free software: you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// The SymCC runtime is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+// for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with the SymCC runtime. If not, see <https://www.gnu.org/licenses/>.
+
+#include "CoverageMap.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+#include <unistd.h>
+
+namespace {
+
+/// The finalizer of MurmurHash3, which mixes all input bits into all output
+/// bits.
+uint64_t mix(uint64_t value) {
+  value ^= value >> 33;
+  value *= 0xff51afd7ed558ccdULL;
+  value ^= value >> 33;
+  value *= 0xc4ceb9fe1a85ec53ULL;
+  value ^= value >> 33;
+  return value;
+}
+
+/// Read a map file into the buffer; returns false if the file doesn't exist.
+bool readMapFile(const std::string &path, std::vector<uint8_t> &buffer) {
+  FILE *file = fopen(path.c_str(), "rb");
+  if (file == nullptr) {
+    if (errno == ENOENT)
+      return false;
+    throw std::runtime_error("Failed to open the coverage map " + path + ": " +
+                             strerror(errno));
+  }
+
+  // Read one byte more than expected to detect oversized files.
+  std::vector<uint8_t> contents(buffer.size() + 1);
+  auto size = fread(contents.data(), 1, contents.size(), file);
+  fclose(file);
+  if (size == 0)
+    return false;
+  if (size != buffer.size())
+    throw std::runtime_error("The file " + path +
+                             " is not a coverage map of the simple backend");
+
+  buffer.assign(contents.begin(), contents.begin() + size);
+  return true;
+}
+
+} // namespace
+
+CoverageMap::CoverageMap() : map_(kMapSize) {}
+
+size_t CoverageMap::indexOf(uintptr_t site, bool taken,
+                            uintptr_t context) const {
+  uint64_t edge = (uint64_t(site) << 1) | (taken ? 1 : 0);
+  return mix(edge ^ mix(context)) >> (64 - kMapBits);
+}
+
+bool CoverageMap::cover(uintptr_t site, bool taken, uintptr_t context) {
+  auto index = indexOf(site, taken, context);
+  uint8_t bit = 1 << (index % 8);
+  bool isNew = (map_[index / 8] & bit) == 0;
+  map_[index / 8] |= bit;
+  return isNew;
+}
+
+void CoverageMap::load(const std::string &path) {
+  std::vector<uint8_t> stored(kMapSize);
+  if (!readMapFile(path, stored))
+    return;
+
+  for (size_t i = 0; i < kMapSize; i++)
+    map_[i] |= stored[i];
+}
+
+void CoverageMap::save(const std::string &path) {
+  // Other executions may have saved their maps since we loaded ours, so we
+  // merge with the current contents. Writing to a temporary file and renaming
+  // it keeps readers from seeing a partial map; concurrent writers may still
+  // lose each other's updates, which only costs a few redundant queries.
+  load(path);
+
+  auto temporary = path + "." + std::to_string(getpid());
+  FILE *file = fopen(temporary.c_str(), "wb");
+  if (file == nullptr)
+    throw std::runtime_error("Failed to write the coverage map " + temporary +
+                             ": " + strerror(errno));
+
+  bool written = fwrite(map_.data(), 1, map_.size(), file) == map_.size();
+  written = (fclose(file) == 0) && written;
+  if (!written || rename(temporary.c_str(), path.c_str()) != 0) {
+    auto error = std::string(strerror(errno));
+    unlink(temporary.c_str());
+    throw std::runtime_error("Failed to write the coverage map " + path + ": " +
+                             error);
+  }
+}
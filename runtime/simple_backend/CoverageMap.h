@@ -0,0 +1,60 @@
+// This file is part of the SymCC runtime.
+//
+// The SymCC runtime is free software: you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// The SymCC runtime is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+// for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with the SymCC runtime. If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef COVERAGEMAP_H
+#define COVERAGEMAP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/// A record of the branch directions that we've seen or tried to solve.
+///
+/// Each branch edge is identified by its site, its direction, and the calling
+/// context (i.e., the hash of the call stack that instrumented code maintains
+/// in _sym_call_context), and it occupies a single bit in a
+/// fixed-size bitmap. Hash collisions only cause us to skip a query that we
+/// might have solved, so a small map serves well. The map can be loaded from a
+/// file and saved back at exit, which lets consecutive executions of a fuzzing
+/// campaign share their knowledge.
+class CoverageMap {
+public:
+  CoverageMap();
+
+  /// Mark the edge as covered in the given calling context; returns true if it
+  /// was new.
+  bool cover(uintptr_t site, bool taken, uintptr_t context);
+
+  /// Merge the map from a file into this one, if the file exists.
+  ///
+  /// Throws std::runtime_error if the file exists but isn't a coverage map.
+  void load(const std::string &path);
+
+  /// Save the map to a file, merging it with the file's current contents.
+  ///
+  /// Throws std::runtime_error if the file can't be written.
+  void save(const std::string &path);
+
+private:
+  static constexpr unsigned kMapBits = 19;
+  static constexpr size_t kMapSize = (size_t(1) << kMapBits) / 8;
+
+  size_t indexOf(uintptr_t site, bool taken, uintptr_t context) const;
+
+  std::vector<uint8_t> map_;
+};
+
+#endif
@@ -0,0 +1,205 @@
+// This file is part of the SymCC runtime.
+//
+// The SymCC runtime is free software: you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// The SymCC runtime is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+// for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with the SymCC runtime. If not, see <https://www.gnu.org/licenses/>.
+
+#include "QueryCache.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+struct QueryCache::Header {
+  char magic[8];
+  uint64_t entries;
+};
+
+namespace {
+
+constexpr char kMagic[8] = {'S', 'Y', 'M', 'Q', 'C', '0', '0', '2'};
+
+/// The final mixing step of MurmurHash3.
+uint64_t mix(uint64_t h) {
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdllu;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53llu;
+  h ^= h >> 33;
+  return h;
+}
+
+} // namespace
+
+QueryCache::Key QueryCache::keyOf(Z3_context context,
+                                  Z3_ast_vector assertions) {
+  // Combine the hashes of the assertions in order, using two independent
+  // lanes.
+  auto size = Z3_ast_vector_size(context, assertions);
+  uint64_t h1 = 0x9e3779b97f4a7c15llu ^ size;
+  uint64_t h2 = 0xc2b2ae3d27d4eb4fllu;
+  for (unsigned i = 0; i < size; i++) {
+    uint64_t word =
+        (uint64_t(i) << 32) |
+        Z3_get_ast_hash(context, Z3_ast_vector_get(context, assertions, i));
+    h1 = (h1 ^ mix(word)) * 0x100000001b3llu;
+    h2 = (h2 + word) * 0x87c37b91114253d5llu;
+    h2 ^= h2 >> 29;
+  }
+
+  h1 = mix(h1);
+  h2 = mix(h2 + h1);
+  // Zero marks empty entries.
+  return {h1, (h2 == 0) ? 1 : h2};
+}
+
+QueryCache::QueryCache(const std::string &path) {
+  int fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+  if (fd == -1) {
+    std::stringstream msg;
+    msg << "Can't open the query cache " << path << ": " << strerror(errno);
+    throw std::runtime_error(msg.str());
+  }
+
+  // The header occupies the first entry-sized block of the file.
+  size_t size = (kEntries + 1) * sizeof(Entry);
+  struct stat st;
+  if (fstat(fd, &st) == -1 ||
+      (static_cast<size_t>(st.st_size) < size && ftruncate(fd, size) == -1)) {
+    std::stringstream msg;
+    msg << "Can't resize the query cache " << path << ": " << strerror(errno);
+    close(fd);
+    throw std::runtime_error(msg.str());
+  }
+
+  void *mapping =
+      mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    std::stringstream msg;
+    msg << "Can't map the query cache " << path << ": " << strerror(errno);
+    throw std::runtime_error(msg.str());
+  }
+
+  header_ = static_cast<Header *>(mapping);
+  entries_ = reinterpret_cast<Entry *>(static_cast<char *>(mapping) +
+                                       sizeof(Entry));
+  static_assert(sizeof(Header) <= sizeof(Entry), "Header too large");
+
+  // A new file is all zeros, which is a valid empty cache. Concurrent
+  // initializations write the same data, so they don't need to be coordinated.
+  static const char zeros[sizeof(kMagic)] = {};
+  if (memcmp(header_->magic, zeros, sizeof(kMagic)) == 0) {
+    header_->entries = kEntries;
+    memcpy(header_->magic, kMagic, sizeof(kMagic));
+  }
+
+  if (memcmp(header_->magic, kMagic, sizeof(kMagic)) != 0 ||
+      header_->entries != kEntries) {
+    munmap(mapping, size);
+    std::stringstream msg;
+    msg << path << " exists but isn't a compatible query cache";
+    throw std::runtime_error(msg.str());
+  }
+}
+
+QueryCache::~QueryCache() {
+  munmap(header_, (kEntries + 1) * sizeof(Entry));
+}
+
+QueryCache::Result QueryCache::lookup(const Key &key, uint64_t fingerprint,
+                                      Model &model) const {
+  auto bucket = (key[0] % (kEntries / kWays)) * kWays;
+  for (size_t way = 0; way < kWays; way++) {
+    auto &entry = entries_[bucket + way];
+
+    // Read the entry optimistically, and ignore it if it was modified in the
+    // meantime.
+    auto version = entry.version.load(std::memory_order_acquire);
+    if (version & 1)
+      continue;
+
+    if (entry.key[0] != key[0] || entry.key[1] != key[1])
+      continue;
+
+    auto result = entry.result;
+    auto entryFingerprint = entry.fingerprint;
+    size_t modelSize = std::min<size_t>(entry.modelSize, kMaxModelSize);
+    Model entryModel;
+    for (size_t i = 0; i < modelSize; i++)
+      entryModel.emplace_back(entry.offsets[i], entry.values[i]);
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (entry.version.load(std::memory_order_relaxed) != version)
+      continue;
+
+    if (result == Result::Sat) {
+      // The model isn't valid for this input; there is only one entry per
+      // query, so don't bother looking further.
+      if (entryFingerprint != fingerprint)
+        return Result::Unknown;
+      model = std::move(entryModel);
+    }
+    return result;
+  }
+
+  return Result::Unknown;
+}
+
+void QueryCache::insert(const Key &key, uint64_t fingerprint, Result result,
+                        const Model &model) {
+  if (result == Result::Unknown ||
+      (result == Result::Sat && model.size() > kMaxModelSize))
+    return;
+
+  // Update an existing entry for the query, or use the first free entry in the
+  // bucket, or evict a pseudo-random one.
+  auto bucket = (key[0] % (kEntries / kWays)) * kWays;
+  Entry *entry = nullptr;
+  for (size_t way = 0; way < kWays; way++) {
+    auto &candidate = entries_[bucket + way];
+    if (candidate.key[0] == key[0] && candidate.key[1] == key[1]) {
+      entry = &candidate;
+      break;
+    }
+    if (entry == nullptr && candidate.key[1] == 0)
+      entry = &candidate;
+  }
+  if (entry == nullptr)
+    entry = &entries_[bucket + key[1] % kWays];
+
+  // If someone else is updating the entry, we simply don't record the result.
+  auto version = entry->version.load(std::memory_order_relaxed);
+  if ((version & 1) ||
+      !entry->version.compare_exchange_strong(version, version + 1,
+                                              std::memory_order_acquire))
+    return;
+
+  entry->key[0] = key[0];
+  entry->key[1] = key[1];
+  entry->fingerprint = fingerprint;
+  entry->result = result;
+  entry->modelSize = model.size();
+  for (size_t i = 0; i < model.size(); i++) {
+    entry->offsets[i] = model[i].first;
+    entry->values[i] = model[i].second;
+  }
+
+  entry->version.store(version + 2, std::memory_order_release);
+}
@@ -0,0 +1,110 @@
+// This file is part of the SymCC runtime.
+//
+// The SymCC runtime is free software: you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// The SymCC runtime is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+// for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with the SymCC runtime. If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef QUERYCACHE_H
+#define QUERYCACHE_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <z3.h>
+
+/// A persistent cache of solver results.
+///
+/// Fuzzing runs execute the same program over and over, so the same queries
+/// come up again and again. We remember their results in a memory-mapped file
+/// that can be shared by any number of concurrently running processes; this
+/// way, a repeated query costs a hash-table lookup instead of a solver call.
+///
+/// Queries are identified by a 128-bit key computed from Z3's structural hashes
+/// of their assertions, which Z3 maintains for every expression, so we don't
+/// need the text of the query. For satisfiable queries, we store the model as
+/// the list of input bytes that need to change, relative to the input that the
+/// query was solved for, if it's small enough. This is only valid for inputs
+/// that agree on the remaining bytes mentioned by the query, so satisfiable
+/// entries also record a fingerprint of those bytes' values; unsatisfiable
+/// queries don't depend on the input. The cache is lossy: when a bucket is
+/// full, new entries evict old ones.
+class QueryCache {
+public:
+  enum class Result : uint8_t { Unknown = 0, Unsat, Sat };
+
+  /// A model, i.e., a list of input offsets and their new values.
+  using Model = std::vector<std::pair<uint32_t, uint8_t>>;
+
+  /// The key of a query (see keyOf).
+  using Key = std::array<uint64_t, 2>;
+
+  /// Compute the key of the query that consists of the given assertions.
+  ///
+  /// Z3's hashes depend only on the structure of the expressions, so the key
+  /// is the same in every process. They're only 32 bits wide, though: two
+  /// queries that differ in a single assertion collide with a probability of
+  /// about 2^-32.
+  static Key keyOf(Z3_context context, Z3_ast_vector assertions);
+
+  /// Open the cache file, creating it if necessary.
+  ///
+  /// Throws std::runtime_error if the file can't be opened or mapped, or if it
+  /// exists but doesn't look like a query cache.
+  explicit QueryCache(const std::string &path);
+  ~QueryCache();
+
+  QueryCache(const QueryCache &) = delete;
+  QueryCache &operator=(const QueryCache &) = delete;
+
+  /// Look up a query, given the fingerprint of the relevant input bytes; on a
+  /// hit, the model is stored in the last argument if the query is
+  /// satisfiable. Returns Result::Unknown on a miss.
+  Result lookup(const Key &key, uint64_t fingerprint, Model &model) const;
+
+  /// Record the result of a query. Satisfiable queries are only recorded if
+  /// their model is small enough to be stored in the cache.
+  void insert(const Key &key, uint64_t fingerprint, Result result,
+              const Model &model = {});
+
+private:
+  static constexpr size_t kMaxModelSize = 19;
+  static constexpr size_t kEntries = size_t(1) << 16;
+  static constexpr size_t kWays = 4;
+
+  struct alignas(64) Entry {
+    /// A sequence lock for concurrent access: odd while an update is in
+    /// progress.
+    std::atomic<uint32_t> version;
+    Result result;
+    uint8_t modelSize;
+    uint64_t key[2];
+    uint64_t fingerprint;
+    uint32_t offsets[kMaxModelSize];
+    uint8_t values[kMaxModelSize];
+  };
+
+  static_assert(sizeof(Entry) == 128, "Unexpected cache entry size");
+  static_assert(std::atomic<uint32_t>::is_always_lock_free,
+                "Cache entries are shared between processes");
+
+  struct Header;
+
+  Header *header_;
+  Entry *entries_;
+};
+
+#endif
@@ -0,0 +1,533 @@
+// This file is part of the SymCC runtime.
+//
+// The SymCC runtime is free software: you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// The SymCC runtime is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+// for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with the SymCC runtime. If not, see <https://www.gnu.org/licenses/>.
+
+//
+// symcc-replay: solve the queries of recorded executions again, without
+// running the target program.
+//
+// The input is a constraint trace with expressions (see ConstraintTrace.h and
+// SYMCC_TRACE_EXPRESSIONS). For each recorded path, we try to flip the branches
+// that the runtime queried (or all of them, with "--all"), using the same
+// constraint slicing and background solvers as the simple backend, but with
+// our own settings for timeouts and parallelism. New inputs are written
+// to the output directory in the same way as the runtime's default test-case
+// handler does it.
+//
+// This makes it possible to record traces on the machines that run the target
+// and to move the expensive solving elsewhere.
+//
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <z3.h>
+
+#include "ConstraintSlicer.h"
+#include "ConstraintTrace.h"
+#include "SolverPool.h"
+
+namespace {
+
+struct Options {
+  std::string tracePath;
+  std::string outputDir = "/tmp/output";
+  unsigned jobs = std::max(1u, std::thread::hardware_concurrency());
+  unsigned timeout = 10000;
+  bool slicing = true;
+  bool allBranches = false;
+};
+
+/// A path constraint from the trace.
+struct Constraint {
+  uintptr_t site;
+  uint64_t context;
+  bool taken;
+  /// The branch condition, with a reference; null until we've seen the
+  /// expression record.
+  Z3_ast condition = nullptr;
+};
+
+/// A sequence of path constraints to replay: an execution, or the part of an
+/// execution after a restore.
+struct Path {
+  /// Indices into the table of all constraints, in path order.
+  std::vector<size_t> constraints;
+  /// The positions in the path whose branches we try to flip, in ascending
+  /// order.
+  std::vector<size_t> flips;
+  /// The concrete input of the execution.
+  std::vector<uint8_t> input;
+};
+
+class TraceLoader {
+public:
+  TraceLoader(Z3_context context, bool allBranches)
+      : context_(context), allBranches_(allBranches) {}
+
+  /// Read the trace and return the paths to replay; throws std::runtime_error
+  /// if the trace is malformed. The constraints end up in constraints().
+  std::vector<Path> load(const std::string &path);
+
+  const std::vector<Constraint> &constraints() const { return constraints_; }
+
+private:
+  void handleRecord(trace::RecordKind kind, uint16_t flags, const char *data,
+                    size_t size);
+
+  /// Add the current path to the results if there's anything to flip in it.
+  void finishPath();
+
+  /// The constraint with the given ID in the current execution.
+  Constraint &constraintWithId(uint64_t id);
+
+  Z3_ast parseCondition(const char *text, size_t length);
+
+  Z3_context context_;
+  bool allBranches_;
+
+  std::vector<Constraint> constraints_;
+  std::vector<Path> paths_;
+
+  Path current_;
+  std::optional<Path> snapshot_;
+
+  struct ConstraintLocation {
+    /// The index into the table of all constraints.
+    size_t index;
+    /// The position in the current path.
+    size_t position;
+  };
+
+  /// The constraints of the current execution, by ID.
+  std::unordered_map<uint64_t, ConstraintLocation> constraintsById_;
+};
+
+std::vector<Path> TraceLoader::load(const std::string &path) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file)
+    throw std::runtime_error("Can't open " + path + ": " + strerror(errno));
+  std::vector<char> data{std::istreambuf_iterator<char>(file),
+                         std::istreambuf_iterator<char>()};
+
+  if (data.size() < sizeof(trace::kMagic) ||
+      memcmp(data.data(), trace::kMagic, sizeof(trace::kMagic)) != 0)
+    throw std::runtime_error(path + " is not a SymCC constraint trace");
+
+  size_t position = sizeof(trace::kMagic);
+  while (position < data.size()) {
+    trace::RecordHeader header;
+    if (data.size() - position < sizeof(header))
+      throw std::runtime_error("Truncated record header in " + path);
+    memcpy(&header, data.data() + position, sizeof(header));
+    position += sizeof(header);
+
+    if (data.size() - position < header.size)
+      throw std::runtime_error("Truncated record in " + path);
+    handleRecord(header.kind, header.flags, data.data() + position,
+                 header.size);
+    position += header.size;
+  }
+
+  finishPath();
+  for (auto &constraint : constraints_) {
+    if (constraint.condition == nullptr)
+      throw std::runtime_error(
+          "The trace doesn't contain the path constraints (record it with "
+          "SYMCC_TRACE_EXPRESSIONS=1)");
+  }
+
+  return std::move(paths_);
+}
+
+void TraceLoader::handleRecord(trace::RecordKind kind, uint16_t flags,
+                               const char *data, size_t size) {
+  switch (kind) {
+  case trace::RecordKind::Execution:
+    finishPath();
+    current_ = {};
+    snapshot_.reset();
+    constraintsById_.clear();
+    break;
+
+  case trace::RecordKind::Constraint: {
+    trace::ConstraintRecord record;
+    if (size < sizeof(record))
+      throw std::runtime_error("Malformed constraint record");
+    memcpy(&record, data, sizeof(record));
+
+    bool taken = flags & trace::kTaken;
+    constraintsById_[record.id] = {constraints_.size(),
+                                   current_.constraints.size()};
+    if (allBranches_)
+      current_.flips.push_back(current_.constraints.size());
+    current_.constraints.push_back(constraints_.size());
+    constraints_.push_back({record.site, record.context, taken});
+    break;
+  }
+
+  case trace::RecordKind::Query: {
+    // The runtime records a query for every branch that it decided to flip,
+    // whatever became of it; with background solvers, the records may arrive
+    // after later constraints of the path, but always before the next restore
+    // or execution.
+    if (allBranches_)
+      break;
+
+    trace::QueryRecord record;
+    if (size < sizeof(record))
+      throw std::runtime_error("Malformed query record");
+    memcpy(&record, data, sizeof(record));
+
+    auto it = constraintsById_.find(record.constraint);
+    if (it == constraintsById_.end())
+      throw std::runtime_error("Query for unknown constraint " +
+                               std::to_string(record.constraint));
+    current_.flips.push_back(it->second.position);
+    break;
+  }
+
+  case trace::RecordKind::Expression: {
+    uint64_t id;
+    if (size < sizeof(id))
+      throw std::runtime_error("Malformed expression record");
+    memcpy(&id, data, sizeof(id));
+
+    auto &constraint = constraintWithId(id);
+    if (constraint.condition != nullptr)
+      Z3_dec_ref(context_, constraint.condition);
+    constraint.condition =
+        parseCondition(data + sizeof(id), size - sizeof(id));
+    break;
+  }
+
+  case trace::RecordKind::Input: {
+    trace::InputRecord record;
+    if (size < sizeof(record))
+      throw std::runtime_error("Malformed input record");
+    memcpy(&record, data, sizeof(record));
+
+    if (record.offset >= current_.input.size())
+      current_.input.resize(record.offset + 1);
+    current_.input[record.offset] = record.value;
+    break;
+  }
+
+  case trace::RecordKind::Snapshot:
+    snapshot_ = current_;
+    snapshot_->flips.clear();
+    break;
+
+  case trace::RecordKind::Restore:
+    if (!snapshot_)
+      throw std::runtime_error("Restore without a snapshot in the trace");
+    finishPath();
+    current_ = *snapshot_;
+    break;
+
+  default:
+    // We skip records of unknown kinds for compatibility with future versions.
+    break;
+  }
+}
+
+void TraceLoader::finishPath() {
+  if (!current_.flips.empty()) {
+    auto &flips = current_.flips;
+    std::sort(flips.begin(), flips.end());
+    flips.erase(std::unique(flips.begin(), flips.end()), flips.end());
+    paths_.push_back(current_);
+  }
+  current_.flips.clear();
+}
+
+Constraint &TraceLoader::constraintWithId(uint64_t id) {
+  auto it = constraintsById_.find(id);
+  if (it == constraintsById_.end())
+    throw std::runtime_error("Expression for unknown constraint " +
+                             std::to_string(id));
+  return constraints_[it->second.index];
+}
+
+Z3_ast TraceLoader::parseCondition(const char *text, size_t length) {
+  std::string benchmark(text, length);
+  auto *assertions = Z3_parse_smtlib2_string(context_, benchmark.c_str(), 0,
+                                             nullptr, nullptr, 0, nullptr,
+                                             nullptr);
+  if (Z3_get_error_code(context_) != Z3_OK)
+    throw std::runtime_error("Can't parse a path constraint: " +
+                             std::string(Z3_get_error_msg(
+                                 context_, Z3_get_error_code(context_))));
+  Z3_ast_vector_inc_ref(context_, assertions);
+
+  auto count = Z3_ast_vector_size(context_, assertions);
+  std::vector<Z3_ast> conjuncts;
+  for (unsigned i = 0; i < count; i++)
+    conjuncts.push_back(Z3_ast_vector_get(context_, assertions, i));
+  auto *condition = (count == 1)
+                        ? conjuncts[0]
+                        : Z3_mk_and(context_, count, conjuncts.data());
+  Z3_inc_ref(context_, condition);
+  Z3_ast_vector_dec_ref(context_, assertions);
+  return condition;
+}
+
+/// Sends the queries of the paths to the background solvers and writes the
+/// resulting test cases.
+class Replayer {
+public:
+  Replayer(Z3_context context, const Options &options,
+           const std::vector<Constraint> &constraints)
+      : context_(context), options_(options), constraints_(constraints),
+        pool_(options.jobs, options.timeout) {}
+
+  void replay(const std::vector<Path> &paths);
+
+  void printSummary(std::chrono::steady_clock::duration elapsed) const;
+
+private:
+  void replayPath(size_t pathIndex);
+
+  void submit(std::string query, size_t pathIndex, uintptr_t site);
+
+  void handleResults();
+
+  void saveTestCase(const Path &path, const QueryCache::Model &assignment);
+
+  Z3_context context_;
+  const Options &options_;
+  const std::vector<Constraint> &constraints_;
+  const std::vector<Path> *paths_ = nullptr;
+  SolverPool pool_;
+
+  unsigned queries_ = 0;
+  unsigned sat_ = 0;
+  unsigned unsat_ = 0;
+  unsigned unknown_ = 0;
+  unsigned testCases_ = 0;
+  std::chrono::steady_clock::duration solverTime_{};
+};
+
+void Replayer::replay(const std::vector<Path> &paths) {
+  paths_ = &paths;
+  for (size_t i = 0; i < paths.size(); i++)
+    replayPath(i);
+
+  pool_.waitForPendingQueries();
+  handleResults();
+}
+
+void Replayer::replayPath(size_t pathIndex) {
+  auto &path = (*paths_)[pathIndex];
+  std::unique_ptr<ConstraintSlicer> slicer;
+  if (options_.slicing)
+    slicer = std::make_unique<ConstraintSlicer>(context_);
+  // Without slicing, we pass all preceding constraints to the solver.
+  std::vector<Z3_ast> preceding;
+
+  auto *solver = Z3_mk_solver(context_);
+  Z3_solver_inc_ref(context_, solver);
+
+  auto nextFlip = path.flips.begin();
+  for (size_t position = 0; position < path.constraints.size(); position++) {
+    auto &constraint = constraints_[path.constraints[position]];
+    auto *negation = Z3_mk_not(context_, constraint.condition);
+    Z3_inc_ref(context_, negation);
+    auto *followed = constraint.taken ? constraint.condition : negation;
+    auto *alternative = constraint.taken ? negation : constraint.condition;
+
+    if (nextFlip != path.flips.end() && *nextFlip == position) {
+      Z3_solver_reset(context_, solver);
+      auto relevant = slicer ? slicer->relevantTo(constraint.condition)
+                             : preceding;
+      for (auto *assertion : relevant)
+        Z3_solver_assert(context_, solver, assertion);
+      Z3_solver_assert(context_, solver, alternative);
+      submit(Z3_solver_to_string(context_, solver), pathIndex,
+             constraint.site);
+      ++nextFlip;
+    }
+
+    if (slicer) {
+      slicer->add(followed);
+    } else {
+      Z3_inc_ref(context_, followed);
+      preceding.push_back(followed);
+    }
+    Z3_dec_ref(context_, negation);
+  }
+
+  for (auto *assertion : preceding)
+    Z3_dec_ref(context_, assertion);
+  Z3_solver_dec_ref(context_, solver);
+}
+
+void Replayer::submit(std::string query, size_t pathIndex, uintptr_t site) {
+  queries_++;
+  // The pool hands the constraint ID back with the result; we pass the path
+  // instead, which is all we need to build test cases.
+  while (!pool_.submit(query, {}, 0, site, pathIndex)) {
+    // The backlog is full; let the solvers catch up.
+    pool_.waitForPendingQueries();
+    handleResults();
+  }
+  handleResults();
+}
+
+void Replayer::handleResults() {
+  for (auto &result : pool_.takeResults()) {
+    solverTime_ += result.time;
+    if (result.status == Z3_L_FALSE) {
+      unsat_++;
+    } else if (result.status == Z3_L_TRUE) {
+      sat_++;
+      if (result.assignment)
+        saveTestCase((*paths_)[result.constraint], *result.assignment);
+    } else {
+      unknown_++;
+    }
+  }
+}
+
+void Replayer::saveTestCase(const Path &path,
+                            const QueryCache::Model &assignment) {
+  auto values = path.input;
+  for (auto [offset, value] : assignment) {
+    if (offset >= values.size())
+      values.resize(offset + 1);
+    values[offset] = value;
+  }
+
+  char name[16];
+  snprintf(name, sizeof(name), "/%06u", testCases_++);
+  auto fileName = options_.outputDir + name;
+  FILE *file = fopen(fileName.c_str(), "wb");
+  if (file == nullptr) {
+    fprintf(stderr, "Can't create the test case %s: %s\n", fileName.c_str(),
+            strerror(errno));
+    return;
+  }
+  fwrite(values.data(), 1, values.size(), file);
+  fclose(file);
+}
+
+void Replayer::printSummary(std::chrono::steady_clock::duration elapsed) const {
+  using std::chrono::duration_cast;
+  using std::chrono::milliseconds;
+  fprintf(stderr,
+          "%u queries: %u sat, %u unsat, %u unknown; %u test cases in %s\n"
+          "Solver time %lld ms, wall time %lld ms (jobs: %u)\n",
+          queries_, sat_, unsat_, unknown_, testCases_,
+          options_.outputDir.c_str(),
+          static_cast<long long>(
+              duration_cast<milliseconds>(solverTime_).count()),
+          static_cast<long long>(duration_cast<milliseconds>(elapsed).count()),
+          options_.jobs);
+}
+
+[[noreturn]] void usage(const char *program) {
+  fprintf(stderr,
+          "Usage: %s [--output DIR] [--jobs N] [--timeout MS] [--no-slicing] "
+          "[--all] TRACE\n"
+          "\n"
+          "  --output DIR   where to write new test cases (default: "
+          "$SYMCC_OUTPUT_DIR\n"
+          "                 or /tmp/output)\n"
+          "  --jobs N       the number of solver threads (default: one per "
+          "core)\n"
+          "  --timeout MS   the time limit per query (default: 10000)\n"
+          "  --no-slicing   pass all preceding path constraints to the solver\n"
+          "  --all          try to flip every branch, not only the ones that "
+          "the\n"
+          "                 runtime queried\n",
+          program);
+  exit(2);
+}
+
+unsigned parsePositive(const char *program, const char *value) {
+  char *end;
+  auto number = strtoul(value, &end, 10);
+  if (*value == '\0' || *end != '\0' || number == 0 || number > UINT32_MAX)
+    usage(program);
+  return number;
+}
+
+Options parseOptions(int argc, char *argv[]) {
+  Options options;
+  if (auto *outputDir = getenv("SYMCC_OUTPUT_DIR"))
+    options.outputDir = outputDir;
+
+  for (int i = 1; i < argc; i++) {
+    bool hasValue = i + 1 < argc;
+    if (strcmp(argv[i], "--output") == 0 && hasValue)
+      options.outputDir = argv[++i];
+    else if (strcmp(argv[i], "--jobs") == 0 && hasValue)
+      options.jobs = parsePositive(argv[0], argv[++i]);
+    else if (strcmp(argv[i], "--timeout") == 0 && hasValue)
+      options.timeout = parsePositive(argv[0], argv[++i]);
+    else if (strcmp(argv[i], "--no-slicing") == 0)
+      options.slicing = false;
+    else if (strcmp(argv[i], "--all") == 0)
+      options.allBranches = true;
+    else if (argv[i][0] != '-' && options.tracePath.empty())
+      options.tracePath = argv[i];
+    else
+      usage(argv[0]);
+  }
+
+  if (options.tracePath.empty())
+    usage(argv[0]);
+  return options;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  auto options = parseOptions(argc, argv);
+  auto start = std::chrono::steady_clock::now();
+
+  auto *cfg = Z3_mk_config();
+  auto *context = Z3_mk_context_rc(cfg);
+  Z3_del_config(cfg);
+  // We check for errors ourselves.
+  Z3_set_error_handler(context, nullptr);
+
+  try {
+    TraceLoader loader(context, options.allBranches);
+    auto paths = loader.load(options.tracePath);
+
+    Replayer replayer(context, options, loader.constraints());
+    replayer.replay(paths);
+    replayer.printSummary(std::chrono::steady_clock::now() - start);
+  } catch (std::runtime_error &e) {
+    fprintf(stderr, "%s: %s\n", argv[0], e.what());
+    return 1;
+  }
+
+  return 0;
+}
@@ -18,20 +18,36 @@
 #include <algorithm>
 #include <atomic>
 #include <cassert>
+#include <cerrno>
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
 #include <iostream>
-#include <set>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_set>
 #include <vector>
 
-#ifndef NDEBUG
 #include <chrono>
-#endif
 
 #include "Config.h"
+#include "ConstraintSlicer.h"
+#include "ConstraintTrace.h"
+#include "CoverageMap.h"
+#include "ExpressionTable.h"
+#include "Forkserver.h"
 #include "GarbageCollection.h"
 #include "LibcWrappers.h"
+#include "QueryCache.h"
 #include "Shadow.h"
+#include "SimplificationCache.h"
+#include "SiteStatistics.h"
+#include "Snapshot.h"
+#include "SolverPool.h"
+#include "Statistics.h"
+#include "TestCaseRing.h"
+#include "Threads.h"
 
 #ifndef NDEBUG
 // Helper to print pointers properly.
@@ -66,12 +82,68 @@ Z3_ast g_null_pointer, g_true, g_false;
 
 FILE *g_log = stderr;
 
+/// The path constraints, if we slice queries; otherwise, they're asserted in
+/// g_solver directly.
+std::unique_ptr<ConstraintSlicer> g_path_constraints;
+
+/// The persistent solver cache, if enabled.
+std::unique_ptr<QueryCache> g_query_cache;
+
+/// The background solvers, if enabled.
+std::unique_ptr<SolverPool> g_solver_pool;
+
+/// The maximum number of entries in the simplification cache.
+constexpr size_t kSimplificationCacheSize = 1 << 16;
+
+/// The results of Z3_simplify on path constraints and their negations.
+std::unique_ptr<SimplificationCache> g_simplification_cache;
+
+/// The user-provided test case handler, if any.
+///
+/// If the user doesn't register a handler, we write test cases to files in
+/// the output directory.
+TestCaseHandler g_test_case_handler = nullptr;
+
+/// The number of test cases we have generated.
+unsigned g_test_cases = 0;
+
+/// Set when we fail to create a test case file; we stop writing files then
+/// instead of failing (and complaining) again for every input we find.
+bool g_output_failed = false;
+
+/// The branch edges that we've already covered or tried to solve; only used
+/// with SYMCC_AFL_COVERAGE_MAP.
+CoverageMap g_coverage_map;
+
+/// Solver statistics and back-off per branch site.
+SiteStatistics g_site_statistics;
+
+/// The binary trace of path constraints and queries, if enabled.
+ConstraintTrace g_trace;
+
+/// The total time spent solving so far.
+std::chrono::steady_clock::duration g_solver_time{};
+
+/// Have we used up the solver budget?
+bool g_solver_budget_exhausted = false;
+
+/// The symbolic input bytes, indexed by offset.
+std::vector<SymExpr> g_input_bytes;
+
+/// The concrete values of the input bytes.
+std::vector<uint8_t> g_input_values;
+
+/// The path constraints at the time of the last snapshot, with a reference
+/// each, and the number of input bytes we had seen.
+std::vector<Z3_ast> g_saved_path_constraints;
+size_t g_saved_input_size = 0;
+
 #ifndef NDEBUG
 [[maybe_unused]] void dump_known_regions() {
   std::cerr << "Known regions:" << std::endl;
-  for (const auto &[page, shadow] : g_shadow_pages) {
+  g_shadow_pages.forEach([](uintptr_t page, ShadowPage *shadow) {
     std::cerr << "  " << P(page) << " shadowed by " << P(shadow) << std::endl;
-  }
+  });
 }
 
 void handle_z3_error(Z3_context c [[maybe_unused]], Z3_error_code e) {
@@ -92,19 +164,596 @@ SymExpr build_variable(const char *name, uint8_t bits) {
 }
 
 /// The set of all expressions we have ever passed to client code.
-std::set<SymExpr> allocatedExpressions;
+ExpressionTable<SymExpr> allocatedExpressions;
+
+/// The expressions registered since the last garbage collection.
+std::vector<SymExpr> youngExpressions;
+
+/// Count an expression for the run-time statistics, by its Z3 operator.
+void countExpressionKind(SymExpr expr, bool isNew) {
+  Z3_func_decl decl = nullptr;
+  uint32_t kind = Z3_OP_UNINTERPRETED;
+  if (Z3_is_app(g_context, expr)) {
+    decl = Z3_get_app_decl(g_context, Z3_to_app(g_context, expr));
+    kind = Z3_get_decl_kind(g_context, decl);
+  }
+
+  countExpression(kind, isNew, [&]() -> std::string {
+    // The Z3 names of these would be "bv" and that of the first variable.
+    if (kind == Z3_OP_UNINTERPRETED)
+      return "variable";
+    if (kind == Z3_OP_BNUM)
+      return "numeral";
+    return Z3_get_symbol_string(g_context, Z3_get_decl_name(g_context, decl));
+  });
+}
 
 SymExpr registerExpression(SymExpr expr) {
-  if (allocatedExpressions.count(expr) == 0) {
-    // We don't know this expression yet. Record it and increase the reference
+  bool isNew = allocatedExpressions.insert(expr);
+  if (isNew) {
+    // We didn't know this expression yet. Record it and increase the reference
     // counter.
-    allocatedExpressions.insert(expr);
+    youngExpressions.push_back(expr);
     Z3_inc_ref(g_context, expr);
   }
 
+  if (statisticsEnabled())
+    countExpressionKind(expr, isNew);
+
   return expr;
 }
 
+//
+// Local rewrites
+//
+// Z3 simplifies path constraints before we solve them, but on large
+// expressions that takes a while, and the expressions occupy memory until
+// then. The expression builders therefore apply a few cheap rewrites right
+// away: operations on constants are folded, identities like x + 0 = x return
+// the operand, and extracts look through concatenations. The latter is
+// important because memory accesses split values into bytes and put them back
+// together.
+//
+
+/// Return the value of a bit-vector numeral, if it fits into 64 bits.
+std::optional<uint64_t> numeralValue(Z3_ast expr) {
+  uint64_t value;
+  if (!Z3_is_numeral_ast(g_context, expr) ||
+      !Z3_get_numeral_uint64(g_context, expr, &value))
+    return std::nullopt;
+
+  return value;
+}
+
+bool isAllOnes(Z3_ast expr, uint64_t value) {
+  auto bits = _sym_bits_helper(expr);
+  if (bits > 64)
+    return false;
+  return value == (bits == 64 ? ~uint64_t(0) : (uint64_t(1) << bits) - 1);
+}
+
+/// Return the result of the operation if an identity determines it to be one
+/// of the operands, or null otherwise.
+Z3_ast applyIdentity(Z3_decl_kind op, Z3_ast a, Z3_ast b) {
+  auto valueA = numeralValue(a);
+  auto valueB = numeralValue(b);
+
+  switch (op) {
+  case Z3_OP_BADD:
+  case Z3_OP_BOR:
+  case Z3_OP_BXOR:
+    if (valueA == 0)
+      return b;
+    if (valueB == 0)
+      return a;
+    if (op == Z3_OP_BOR) {
+      if (Z3_is_eq_ast(g_context, a, b) || (valueA && isAllOnes(a, *valueA)))
+        return a;
+      if (valueB && isAllOnes(b, *valueB))
+        return b;
+    }
+    break;
+  case Z3_OP_BSUB:
+  case Z3_OP_BSHL:
+  case Z3_OP_BLSHR:
+  case Z3_OP_BASHR:
+    if (valueB == 0)
+      return a;
+    break;
+  case Z3_OP_BMUL:
+    if (valueA == 0 || valueB == 1)
+      return a;
+    if (valueB == 0 || valueA == 1)
+      return b;
+    break;
+  case Z3_OP_BUDIV:
+  case Z3_OP_BSDIV:
+    if (valueB == 1)
+      return a;
+    break;
+  case Z3_OP_BAND:
+    if (valueA == 0 || Z3_is_eq_ast(g_context, a, b) ||
+        (valueB && isAllOnes(b, *valueB)))
+      return a;
+    if (valueB == 0 || (valueA && isAllOnes(a, *valueA)))
+      return b;
+    break;
+  default:
+    break;
+  }
+
+  return nullptr;
+}
+
+/// Build a binary operation, folding constants and applying identities.
+SymExpr buildBinary(Z3_decl_kind op,
+                    Z3_ast (*build)(Z3_context, Z3_ast, Z3_ast), SymExpr a,
+                    SymExpr b) {
+  if (Z3_is_numeral_ast(g_context, a) && Z3_is_numeral_ast(g_context, b))
+    return registerExpression(Z3_simplify(g_context, build(g_context, a, b)));
+
+  if (auto *result = applyIdentity(op, a, b))
+    return registerExpression(result);
+
+  return registerExpression(build(g_context, a, b));
+}
+
+/// A range of bits of an expression.
+struct BitRange {
+  Z3_ast expr;
+  unsigned high, low;
+};
+
+/// Return the arguments of an application of the given kind, or an empty
+/// vector if the expression is something else.
+std::vector<Z3_ast> argumentsIf(Z3_ast expr, Z3_decl_kind kind) {
+  std::vector<Z3_ast> arguments;
+  if (Z3_get_ast_kind(g_context, expr) != Z3_APP_AST)
+    return arguments;
+
+  auto *app = Z3_to_app(g_context, expr);
+  if (Z3_get_decl_kind(g_context, Z3_get_app_decl(g_context, app)) == kind) {
+    for (unsigned i = 0; i < Z3_get_app_num_args(g_context, app); i++)
+      arguments.push_back(Z3_get_app_arg(g_context, app, i));
+  }
+
+  return arguments;
+}
+
+/// Find the smallest expression that the range of bits can be taken from
+/// directly, looking through concatenations, extracts and zero extensions.
+BitRange narrowBitRange(BitRange range) {
+  while (Z3_get_ast_kind(g_context, range.expr) == Z3_APP_AST) {
+    auto *app = Z3_to_app(g_context, range.expr);
+    auto *decl = Z3_get_app_decl(g_context, app);
+    auto kind = Z3_get_decl_kind(g_context, decl);
+
+    if (kind == Z3_OP_EXTRACT) {
+      auto innerLow = Z3_get_decl_int_parameter(g_context, decl, 1);
+      range = {Z3_get_app_arg(g_context, app, 0), range.high + innerLow,
+               range.low + innerLow};
+    } else if (kind == Z3_OP_ZERO_EXT) {
+      auto *inner = Z3_get_app_arg(g_context, app, 0);
+      if (range.high >= _sym_bits_helper(inner))
+        break;
+      range.expr = inner;
+    } else if (kind == Z3_OP_CONCAT) {
+      // The last argument holds the least significant bits.
+      auto arguments = argumentsIf(range.expr, Z3_OP_CONCAT);
+      unsigned offset = 0;
+      Z3_ast containing = nullptr;
+      for (auto it = arguments.rbegin(); it != arguments.rend(); ++it) {
+        auto bits = _sym_bits_helper(*it);
+        if (range.low >= offset && range.high < offset + bits) {
+          containing = *it;
+          break;
+        }
+        if (offset + bits > range.high)
+          break;
+        offset += bits;
+      }
+
+      if (containing == nullptr)
+        break;
+      range = {containing, range.high - offset, range.low - offset};
+    } else {
+      break;
+    }
+  }
+
+  return range;
+}
+
+SymExpr buildExtract(SymExpr expr, unsigned high, unsigned low) {
+  auto range = narrowBitRange({expr, high, low});
+  if (range.low == 0 && range.high + 1 == _sym_bits_helper(range.expr))
+    return registerExpression(range.expr);
+
+  return registerExpression(
+      Z3_mk_extract(g_context, range.high, range.low, range.expr));
+}
+
+/// If the expression is an extract, return the range of bits that it takes.
+std::optional<BitRange> asExtract(Z3_ast expr) {
+  auto arguments = argumentsIf(expr, Z3_OP_EXTRACT);
+  if (arguments.empty())
+    return std::nullopt;
+
+  auto *decl = Z3_get_app_decl(g_context, Z3_to_app(g_context, expr));
+  return BitRange{arguments[0],
+                  unsigned(Z3_get_decl_int_parameter(g_context, decl, 0)),
+                  unsigned(Z3_get_decl_int_parameter(g_context, decl, 1))};
+}
+
+SymExpr buildConcat(SymExpr a, SymExpr b) {
+  // Concatenating adjacent ranges of the same expression yields a larger
+  // range, e.g., when we read back a value that was stored byte by byte.
+  auto upper = asExtract(a);
+  auto lower = asExtract(b);
+  if (upper && lower && Z3_is_eq_ast(g_context, upper->expr, lower->expr) &&
+      upper->low == lower->high + 1)
+    return buildExtract(upper->expr, upper->high, lower->low);
+
+  if (Z3_is_numeral_ast(g_context, a) && Z3_is_numeral_ast(g_context, b))
+    return registerExpression(
+        Z3_simplify(g_context, Z3_mk_concat(g_context, a, b)));
+
+  return registerExpression(Z3_mk_concat(g_context, a, b));
+}
+
+/// Compute a fingerprint of the concrete values of the input bytes that the
+/// assertions of a query mention.
+///
+/// We find the input bytes by walking the expressions, visiting each node only
+/// once; that's cheap compared to producing the query text.
+uint64_t inputFingerprint(Z3_ast_vector assertions) {
+  std::vector<Z3_ast> worklist;
+  for (unsigned i = 0, n = Z3_ast_vector_size(g_context, assertions); i < n;
+       i++)
+    worklist.push_back(Z3_ast_vector_get(g_context, assertions, i));
+
+  std::unordered_set<unsigned> visited;
+  std::vector<uint32_t> offsets;
+  while (!worklist.empty()) {
+    auto *current = worklist.back();
+    worklist.pop_back();
+    if (!visited.insert(Z3_get_ast_id(g_context, current)).second ||
+        Z3_get_ast_kind(g_context, current) != Z3_APP_AST)
+      continue;
+
+    auto *app = Z3_to_app(g_context, current);
+    auto numArgs = Z3_get_app_num_args(g_context, app);
+    for (unsigned i = 0; i < numArgs; i++)
+      worklist.push_back(Z3_get_app_arg(g_context, app, i));
+
+    auto *decl = Z3_get_app_decl(g_context, app);
+    unsigned offset;
+    if (numArgs == 0 &&
+        Z3_get_decl_kind(g_context, decl) == Z3_OP_UNINTERPRETED &&
+        sscanf(Z3_get_symbol_string(g_context,
+                                    Z3_get_decl_name(g_context, decl)),
+               "stdin%u", &offset) == 1)
+      offsets.push_back(offset);
+  }
+
+  std::sort(offsets.begin(), offsets.end());
+  uint64_t hash = 0xcbf29ce484222325llu;
+  for (auto offset : offsets) {
+    uint64_t value = (offset < g_input_values.size()) ? g_input_values[offset]
+                                                     : 0x100;
+    hash = (hash ^ ((uint64_t(offset) << 9) | value)) * 0x100000001b3llu;
+  }
+
+  return hash;
+}
+
+/// Return the bytes of an input assignment whose values differ from the
+/// current input.
+QueryCache::Model changedInputBytes(const QueryCache::Model &assignment) {
+  QueryCache::Model changes;
+  for (auto [offset, value] : assignment) {
+    if (offset >= g_input_values.size() || value != g_input_values[offset])
+      changes.emplace_back(offset, value);
+  }
+
+  return changes;
+}
+
+/// Generate a test case from the current input, with the given bytes changed.
+void saveTestCase(const QueryCache::Model &changes) {
+  auto values = g_input_values;
+  for (auto [offset, value] : changes) {
+    if (offset >= values.size())
+      values.resize(offset + 1);
+    values[offset] = value;
+  }
+
+  if (auto handler = g_test_case_handler) {
+    // The test-case handler may be instrumented, so let's call it with
+    // argument expressions to meet instrumented code's expectations.
+    _sym_set_parameter_expression(0, nullptr);
+    _sym_set_parameter_expression(1, nullptr);
+    handler(values.data(), values.size());
+    return;
+  }
+
+  if (pushTestCaseToRing(values.data(), values.size()))
+    return;
+
+  if (g_output_failed)
+    return;
+
+  char name[16];
+  snprintf(name, sizeof(name), "/%06u", g_test_cases);
+  auto path = g_config.outputDir + name;
+  FILE *file = fopen(path.c_str(), "wb");
+  if (file == nullptr) {
+    fprintf(g_log,
+            "Can't create the test case %s: %s; not writing any more test "
+            "cases (check SYMCC_OUTPUT_DIR)\n",
+            path.c_str(), strerror(errno));
+    g_output_failed = true;
+    return;
+  }
+  fwrite(values.data(), 1, values.size(), file);
+  fclose(file);
+  g_test_cases++;
+}
+
+/// Decide whether to solve a query at the given site, taking into account the
+/// solver budget and the site's history.
+bool shouldSolve(uintptr_t site) {
+  if (g_config.solverBudget != 0 &&
+      g_solver_time >= std::chrono::milliseconds(g_config.solverBudget)) {
+    if (!g_solver_budget_exhausted) {
+      fprintf(g_log, "Solver budget exhausted, skipping all further queries\n");
+      g_solver_budget_exhausted = true;
+    }
+    return false;
+  }
+
+  if (!g_site_statistics.shouldSolve(site)) {
+    // Back-off mostly happens in hot loops, so we only mention it once per
+    // site; SYMCC_SOLVER_STATS has the numbers.
+    if (g_site_statistics.skipped(site) == 1)
+      fprintf(g_log, "Skipping queries at site %#lx after repeated failures\n",
+              static_cast<unsigned long>(site));
+    return false;
+  }
+
+  return true;
+}
+
+/// Log the values of input bytes in the same format as Z3's models.
+void logInputModel(const QueryCache::Model &model) {
+  for (auto [offset, value] : model)
+    fprintf(g_log, "stdin%u -> #x%02x\n", offset, value);
+}
+
+/// Process the result of a query that we had to send to the solver.
+void handleSolverResult(const QueryCache::Key &key, uint64_t fingerprint,
+                        uintptr_t site, uint64_t constraint, Z3_lbool status,
+                        std::chrono::steady_clock::duration time,
+                        const std::optional<QueryCache::Model> &assignment) {
+  g_solver_time += time;
+  auto outcome = QueryOutcome::Timeout;
+  auto traceResult = trace::QueryResult::Unknown;
+  if (status == Z3_L_TRUE) {
+    outcome = QueryOutcome::Sat;
+    traceResult = trace::QueryResult::Sat;
+  } else if (status == Z3_L_FALSE) {
+    outcome = QueryOutcome::Unsat;
+    traceResult = trace::QueryResult::Unsat;
+  }
+  g_site_statistics.record(site, outcome, time);
+  recordQuery(site, outcome, time);
+  if (g_trace.enabled())
+    g_trace.addQuery(constraint, site, traceResult, time);
+
+  if (status == Z3_L_FALSE) {
+    if (g_query_cache)
+      g_query_cache->insert(key, fingerprint, QueryCache::Result::Unsat);
+    return;
+  }
+
+  // We can only generate test cases from models that assign input bytes.
+  if (status != Z3_L_TRUE || !assignment)
+    return;
+
+  auto changes = changedInputBytes(*assignment);
+  if (g_query_cache)
+    g_query_cache->insert(key, fingerprint, QueryCache::Result::Sat, changes);
+  saveTestCase(changes);
+}
+
+/// Handle the results that the background solvers have produced so far.
+void processBackgroundResults() {
+  for (auto &result : g_solver_pool->takeResults()) {
+    if (result.status == Z3_L_TRUE) {
+      fprintf(g_log, "Found diverging input (background):\n");
+      if (result.assignment)
+        logInputModel(*result.assignment);
+    } else {
+      fprintf(g_log, "Can't find a diverging input (background)\n");
+    }
+
+    handleSolverResult(result.key, result.fingerprint, result.site,
+                       result.constraint, result.status, result.time,
+                       result.assignment);
+  }
+  fflush(g_log);
+}
+
+/// Wait for the background solvers at exit, so that we don't lose any results.
+void finishBackgroundSolving() {
+  g_solver_pool->waitForPendingQueries();
+  processBackgroundResults();
+  g_solver_pool.reset();
+}
+
+void saveCoverageMap() {
+  try {
+    g_coverage_map.save(g_config.aflCoverageMap);
+  } catch (std::runtime_error &e) {
+    fprintf(g_log, "%s\n", e.what());
+  }
+}
+
+void dumpSiteStatistics() {
+  FILE *out = fopen(g_config.solverStatsFile.c_str(), "w");
+  if (out == nullptr) {
+    fprintf(g_log, "Can't write solver statistics to %s: %s\n",
+            g_config.solverStatsFile.c_str(), strerror(errno));
+    return;
+  }
+
+  g_site_statistics.dump(out);
+  fclose(out);
+}
+
+/// Make g_solver contain (at least) the path constraints that the given
+/// expression depends on.
+void prepareSolver(Z3_ast expr) {
+  if (!g_path_constraints)
+    return;
+
+  Z3_solver_reset(g_context, g_solver);
+  for (auto *constraint : g_path_constraints->relevantTo(expr))
+    Z3_solver_assert(g_context, g_solver, constraint);
+}
+
+void addPathConstraint(Z3_ast constraint) {
+  if (g_path_constraints)
+    g_path_constraints->add(constraint);
+  else
+    Z3_solver_assert(g_context, g_solver, constraint);
+}
+
+/// Sweep the expressions that aren't reachable anymore; a minor collection only
+/// considers the young ones (see collectReachableExpressions).
+void collectGarbage(bool fullCollection) {
+  auto start = std::chrono::steady_clock::now();
+
+  auto startSize = allocatedExpressions.size();
+  auto reachableExpressions = collectReachableExpressions(fullCollection);
+  auto isReachable = [&](SymExpr expr) {
+    return std::binary_search(reachableExpressions.begin(),
+                              reachableExpressions.end(), expr);
+  };
+
+  // The table holds a reference to each of its expressions.
+  if (fullCollection) {
+    allocatedExpressions.retainOnly(reachableExpressions, [](SymExpr expr) {
+      Z3_dec_ref(g_context, expr);
+    });
+  } else {
+    // Young expressions that survive are promoted to the old generation.
+    for (auto expr : youngExpressions) {
+      if (!isReachable(expr) && allocatedExpressions.erase(expr))
+        Z3_dec_ref(g_context, expr);
+    }
+  }
+
+  youngExpressions.clear();
+  g_simplification_cache->clear();
+  garbageCollectionFinished(startSize, allocatedExpressions.size());
+
+  auto end = std::chrono::steady_clock::now();
+  auto endSize = allocatedExpressions.size();
+  recordCollection(fullCollection, end - start, startSize, endSize);
+
+#ifndef NDEBUG
+
+  std::cerr << "After " << (fullCollection ? "full" : "minor")
+            << " garbage collection: " << endSize
+            << " expressions remain (before: " << startSize << ")" << std::endl
+            << "\t(collection took "
+            << std::chrono::duration_cast<std::chrono::milliseconds>(end -
+                                                                     start)
+                   .count()
+            << " milliseconds)" << std::endl;
+#endif
+}
+
+/// Try to find an input that takes the alternative branch at the given site,
+/// where the constraint is the branch condition; the ID identifies it in the
+/// constraint trace.
+void solveAlternative(Z3_ast constraint, Z3_ast alternative, uintptr_t site,
+                      uint64_t constraintId) {
+  prepareSolver(constraint);
+  Z3_solver_push(g_context, g_solver);
+  Z3_solver_assert(g_context, g_solver, alternative);
+
+  // Printing the solver is expensive (it's proportional to the length of the
+  // path), so we only do it if we need the text.
+  std::string query;
+  if (g_solver_pool || g_config.logQueries)
+    query = Z3_solver_to_string(g_context, g_solver);
+  if (g_config.logQueries)
+    fprintf(g_log, "Trying to solve:\n%s\n", query.c_str());
+  else
+    fprintf(g_log, "Trying to solve at site %#lx\n",
+            static_cast<unsigned long>(site));
+
+  auto cached = QueryCache::Result::Unknown;
+  QueryCache::Key key{};
+  uint64_t fingerprint = 0;
+  QueryCache::Model cachedModel;
+  if (g_query_cache) {
+    auto *assertions = Z3_solver_get_assertions(g_context, g_solver);
+    Z3_ast_vector_inc_ref(g_context, assertions);
+    key = QueryCache::keyOf(g_context, assertions);
+    fingerprint = inputFingerprint(assertions);
+    Z3_ast_vector_dec_ref(g_context, assertions);
+    cached = g_query_cache->lookup(key, fingerprint, cachedModel);
+  }
+
+  if (cached != QueryCache::Result::Unknown)
+    g_site_statistics.recordCacheHit(site);
+
+  if (cached == QueryCache::Result::Sat) {
+    fprintf(g_log, "Found diverging input (cached):\n");
+    logInputModel(cachedModel);
+    if (g_trace.enabled())
+      g_trace.addQuery(constraintId, site, trace::QueryResult::CachedSat);
+    saveTestCase(cachedModel);
+  } else if (cached == QueryCache::Result::Unsat) {
+    fprintf(g_log, "Can't find a diverging input at this point (cached)\n");
+    if (g_trace.enabled())
+      g_trace.addQuery(constraintId, site, trace::QueryResult::CachedUnsat);
+  } else if (g_solver_pool) {
+    if (!g_solver_pool->submit(std::move(query), key, fingerprint, site,
+                               constraintId)) {
+      fprintf(g_log, "Too many pending queries, dropping this one\n");
+      if (g_trace.enabled())
+        g_trace.addQuery(constraintId, site, trace::QueryResult::Dropped);
+    }
+  } else {
+    auto start = std::chrono::steady_clock::now();
+    Z3_lbool feasible = Z3_solver_check(g_context, g_solver);
+    auto time = std::chrono::steady_clock::now() - start;
+    std::optional<QueryCache::Model> assignment;
+    if (feasible == Z3_L_TRUE) {
+      Z3_model model = Z3_solver_get_model(g_context, g_solver);
+      Z3_model_inc_ref(g_context, model);
+      assignment = readInputModel(g_context, model);
+      fprintf(g_log, "Found diverging input:\n");
+      if (g_config.logQueries)
+        fprintf(g_log, "%s\n", Z3_model_to_string(g_context, model));
+      else if (assignment)
+        logInputModel(*assignment);
+      Z3_model_dec_ref(g_context, model);
+    } else {
+      fprintf(g_log, "Can't find a diverging input at this point\n");
+    }
+    handleSolverResult(key, fingerprint, site, constraintId, feasible, time,
+                       assignment);
+  }
+  fflush(g_log);
+
+  Z3_solver_pop(g_context, g_solver, 1);
+}
+
 } // namespace
 
 void _sym_initialize(void) {
@@ -126,7 +775,8 @@ void _sym_initialize(void) {
 
   cfg = Z3_mk_config();
   Z3_set_param_value(cfg, "model", "true");
-  Z3_set_param_value(cfg, "timeout", "10000"); // milliseconds
+  Z3_set_param_value(cfg, "timeout",
+                     std::to_string(g_config.solverTimeout).c_str());
   g_context = Z3_mk_context_rc(cfg);
   Z3_del_config(cfg);
 
@@ -139,6 +789,10 @@ void _sym_initialize(void) {
 
   g_solver = Z3_mk_solver(g_context);
   Z3_solver_inc_ref(g_context, g_solver);
+  g_simplification_cache = std::make_unique<SimplificationCache>(
+      g_context, kSimplificationCacheSize);
+  if (g_config.constraintSlicing)
+    g_path_constraints = std::make_unique<ConstraintSlicer>(g_context);
 
   auto *pointerSort = Z3_mk_bv_sort(g_context, 8 * sizeof(void *));
   Z3_inc_ref(g_context, (Z3_ast)pointerSort);
@@ -155,9 +809,39 @@ void _sym_initialize(void) {
   } else {
     g_log = fopen(g_config.logFile.c_str(), "w");
   }
+
+  if (!g_config.traceFile.empty())
+    g_trace.open(g_config.traceFile);
+
+  // Everything after this point happens once per execution of the program.
+  runForkserver();
+
+  if (g_trace.enabled())
+    g_trace.beginExecution();
+
+  if (!g_config.queryCacheFile.empty())
+    g_query_cache = std::make_unique<QueryCache>(g_config.queryCacheFile);
+
+  if (!g_config.aflCoverageMap.empty()) {
+    g_coverage_map.load(g_config.aflCoverageMap);
+    atexit(saveCoverageMap);
+  }
+
+  // Register these before the solver pool's exit handler, so that they run
+  // after all background queries have finished.
+  if (!g_config.solverStatsFile.empty())
+    atexit(dumpSiteStatistics);
+  initStatistics();
+
+  if (g_config.solverThreads > 0) {
+    g_solver_pool = std::make_unique<SolverPool>(g_config.solverThreads,
+                                                 g_config.solverTimeout);
+    atexit(finishBackgroundSolving);
+  }
 }
 
 Z3_ast _sym_build_integer(uint64_t value, uint8_t bits) {
+  RuntimeLock lock;
   auto *sort = Z3_mk_bv_sort(g_context, bits);
   Z3_inc_ref(g_context, (Z3_ast)sort);
   auto *result =
@@ -167,11 +851,13 @@ Z3_ast _sym_build_integer(uint64_t value, uint8_t bits) {
 }
 
 Z3_ast _sym_build_integer128(uint64_t high, uint64_t low) {
+  RuntimeLock lock;
   return registerExpression(Z3_mk_concat(
       g_context, _sym_build_integer(high, 64), _sym_build_integer(low, 64)));
 }
 
 Z3_ast _sym_build_float(double value, int is_double) {
+  RuntimeLock lock;
   auto *sort = FSORT(is_double);
   Z3_inc_ref(g_context, (Z3_ast)sort);
   auto *result =
@@ -180,19 +866,42 @@ Z3_ast _sym_build_float(double value, int is_double) {
   return result;
 }
 
-Z3_ast _sym_get_input_byte(size_t offset, uint8_t) {
-  static std::vector<SymExpr> stdinBytes;
-
-  if (offset < stdinBytes.size())
-    return stdinBytes[offset];
+Z3_ast _sym_get_input_byte(size_t offset, uint8_t value) {
+  RuntimeLock lock;
+  Z3_ast result;
+  _sym_get_input_bytes(offset, &value, 1, &result);
+  return result;
+}
 
-  auto varName = "stdin" + std::to_string(stdinBytes.size());
-  auto *var = build_variable(varName.c_str(), 8);
+void _sym_get_input_bytes(size_t offset, const uint8_t *values, size_t length,
+                          Z3_ast *result) {
+  RuntimeLock lock;
+  _sym_symbolic_data_seen = true;
+  if (offset + length > g_input_bytes.size()) {
+    assert(values != nullptr && "Requesting input bytes of unknown value");
+    g_input_bytes.resize(offset + length);
+    g_input_values.resize(offset + length);
+  }
 
-  stdinBytes.resize(offset);
-  stdinBytes.push_back(var);
+  if (values != nullptr) {
+    std::copy(values, values + length, g_input_values.begin() + offset);
+    if (g_trace.enabled() && g_config.traceExpressions) {
+      for (size_t i = 0; i < length; i++)
+        g_trace.addInput(offset + i, values[i]);
+    }
+  }
+  if (result == nullptr)
+    return;
 
-  return var;
+  for (size_t i = 0; i < length; i++) {
+    auto &variable = g_input_bytes[offset + i];
+    if (variable == nullptr) {
+      char varName[32];
+      snprintf(varName, sizeof(varName), "stdin%zu", offset + i);
+      variable = build_variable(varName, 8);
+    }
+    result[i] = variable;
+  }
 }
 
 Z3_ast _sym_build_null_pointer(void) { return g_null_pointer; }
@@ -201,39 +910,47 @@ Z3_ast _sym_build_false(void) { return g_false; }
 Z3_ast _sym_build_bool(bool value) { return value ? g_true : g_false; }
 
 Z3_ast _sym_build_neg(Z3_ast expr) {
+  RuntimeLock lock;
   return registerExpression(Z3_mk_bvneg(g_context, expr));
 }
 
 #define DEF_BINARY_EXPR_BUILDER(name, z3_name)                                 \
   SymExpr _sym_build_##name(SymExpr a, SymExpr b) {                            \
+    RuntimeLock lock;                                                          \
     return registerExpression(Z3_mk_##z3_name(g_context, a, b));               \
   }
 
-DEF_BINARY_EXPR_BUILDER(add, bvadd)
-DEF_BINARY_EXPR_BUILDER(sub, bvsub)
-DEF_BINARY_EXPR_BUILDER(mul, bvmul)
-DEF_BINARY_EXPR_BUILDER(unsigned_div, bvudiv)
-DEF_BINARY_EXPR_BUILDER(signed_div, bvsdiv)
-DEF_BINARY_EXPR_BUILDER(unsigned_rem, bvurem)
-DEF_BINARY_EXPR_BUILDER(signed_rem, bvsrem)
-DEF_BINARY_EXPR_BUILDER(shift_left, bvshl)
-DEF_BINARY_EXPR_BUILDER(logical_shift_right, bvlshr)
-DEF_BINARY_EXPR_BUILDER(arithmetic_shift_right, bvashr)
-
-DEF_BINARY_EXPR_BUILDER(signed_less_than, bvslt)
-DEF_BINARY_EXPR_BUILDER(signed_less_equal, bvsle)
-DEF_BINARY_EXPR_BUILDER(signed_greater_than, bvsgt)
-DEF_BINARY_EXPR_BUILDER(signed_greater_equal, bvsge)
-DEF_BINARY_EXPR_BUILDER(unsigned_less_than, bvult)
-DEF_BINARY_EXPR_BUILDER(unsigned_less_equal, bvule)
-DEF_BINARY_EXPR_BUILDER(unsigned_greater_than, bvugt)
-DEF_BINARY_EXPR_BUILDER(unsigned_greater_equal, bvuge)
-DEF_BINARY_EXPR_BUILDER(equal, eq)
-
-DEF_BINARY_EXPR_BUILDER(and, bvand)
-DEF_BINARY_EXPR_BUILDER(or, bvor)
+#define DEF_REWRITING_EXPR_BUILDER(name, z3_name, op)                          \
+  SymExpr _sym_build_##name(SymExpr a, SymExpr b) {                            \
+    RuntimeLock lock;                                                          \
+    return buildBinary(op, Z3_mk_##z3_name, a, b);                             \
+  }
+
+DEF_REWRITING_EXPR_BUILDER(add, bvadd, Z3_OP_BADD)
+DEF_REWRITING_EXPR_BUILDER(sub, bvsub, Z3_OP_BSUB)
+DEF_REWRITING_EXPR_BUILDER(mul, bvmul, Z3_OP_BMUL)
+DEF_REWRITING_EXPR_BUILDER(unsigned_div, bvudiv, Z3_OP_BUDIV)
+DEF_REWRITING_EXPR_BUILDER(signed_div, bvsdiv, Z3_OP_BSDIV)
+DEF_REWRITING_EXPR_BUILDER(unsigned_rem, bvurem, Z3_OP_BUREM)
+DEF_REWRITING_EXPR_BUILDER(signed_rem, bvsrem, Z3_OP_BSREM)
+DEF_REWRITING_EXPR_BUILDER(shift_left, bvshl, Z3_OP_BSHL)
+DEF_REWRITING_EXPR_BUILDER(logical_shift_right, bvlshr, Z3_OP_BLSHR)
+DEF_REWRITING_EXPR_BUILDER(arithmetic_shift_right, bvashr, Z3_OP_BASHR)
+
+DEF_REWRITING_EXPR_BUILDER(signed_less_than, bvslt, Z3_OP_SLT)
+DEF_REWRITING_EXPR_BUILDER(signed_less_equal, bvsle, Z3_OP_SLEQ)
+DEF_REWRITING_EXPR_BUILDER(signed_greater_than, bvsgt, Z3_OP_SGT)
+DEF_REWRITING_EXPR_BUILDER(signed_greater_equal, bvsge, Z3_OP_SGEQ)
+DEF_REWRITING_EXPR_BUILDER(unsigned_less_than, bvult, Z3_OP_ULT)
+DEF_REWRITING_EXPR_BUILDER(unsigned_less_equal, bvule, Z3_OP_ULEQ)
+DEF_REWRITING_EXPR_BUILDER(unsigned_greater_than, bvugt, Z3_OP_UGT)
+DEF_REWRITING_EXPR_BUILDER(unsigned_greater_equal, bvuge, Z3_OP_UGEQ)
+DEF_REWRITING_EXPR_BUILDER(equal, eq, Z3_OP_EQ)
+
+DEF_REWRITING_EXPR_BUILDER(and, bvand, Z3_OP_BAND)
+DEF_REWRITING_EXPR_BUILDER(or, bvor, Z3_OP_BOR)
 DEF_BINARY_EXPR_BUILDER(bool_xor, xor)
-DEF_BINARY_EXPR_BUILDER(xor, bvxor)
+DEF_REWRITING_EXPR_BUILDER(xor, bvxor, Z3_OP_BXOR)
 
 DEF_BINARY_EXPR_BUILDER(float_ordered_greater_than, fpa_gt)
 DEF_BINARY_EXPR_BUILDER(float_ordered_greater_equal, fpa_geq)
@@ -242,68 +959,84 @@ DEF_BINARY_EXPR_BUILDER(float_ordered_less_equal, fpa_leq)
 DEF_BINARY_EXPR_BUILDER(float_ordered_equal, fpa_eq)
 
 #undef DEF_BINARY_EXPR_BUILDER
+#undef DEF_REWRITING_EXPR_BUILDER
 
 Z3_ast _sym_build_ite(Z3_ast cond, Z3_ast a, Z3_ast b) {
+  RuntimeLock lock;
   return registerExpression(Z3_mk_ite(g_context, cond, a, b));
 }
 
 Z3_ast _sym_build_fp_add(Z3_ast a, Z3_ast b) {
+  RuntimeLock lock;
   return registerExpression(Z3_mk_fpa_add(g_context, g_rounding_mode, a, b));
 }
 
 Z3_ast _sym_build_fp_sub(Z3_ast a, Z3_ast b) {
+  RuntimeLock lock;
   return registerExpression(Z3_mk_fpa_sub(g_context, g_rounding_mode, a, b));
 }
 
 Z3_ast _sym_build_fp_mul(Z3_ast a, Z3_ast b) {
+  RuntimeLock lock;
   return registerExpression(Z3_mk_fpa_mul(g_context, g_rounding_mode, a, b));
 }
 
 Z3_ast _sym_build_fp_div(Z3_ast a, Z3_ast b) {
+  RuntimeLock lock;
   return registerExpression(Z3_mk_fpa_div(g_context, g_rounding_mode, a, b));
 }
 
 Z3_ast _sym_build_fp_rem(Z3_ast a, Z3_ast b) {
+  RuntimeLock lock;
   return registerExpression(Z3_mk_fpa_rem(g_context, a, b));
 }
 
 Z3_ast _sym_build_fp_abs(Z3_ast a) {
+  RuntimeLock lock;
   return registerExpression(Z3_mk_fpa_abs(g_context, a));
 }
 
 Z3_ast _sym_build_fp_neg(Z3_ast a) {
+  RuntimeLock lock;
   return registerExpression(Z3_mk_fpa_neg(g_context, a));
 }
 
 Z3_ast _sym_build_not(Z3_ast expr) {
+  RuntimeLock lock;
   return registerExpression(Z3_mk_bvnot(g_context, expr));
 }
 
 Z3_ast _sym_build_not_equal(Z3_ast a, Z3_ast b) {
+  RuntimeLock lock;
   return registerExpression(Z3_mk_not(g_context, Z3_mk_eq(g_context, a, b)));
 }
 
 Z3_ast _sym_build_bool_and(Z3_ast a, Z3_ast b) {
+  RuntimeLock lock;
   Z3_ast operands[] = {a, b};
   return registerExpression(Z3_mk_and(g_context, 2, operands));
 }
 
 Z3_ast _sym_build_bool_or(Z3_ast a, Z3_ast b) {
+  RuntimeLock lock;
   Z3_ast operands[] = {a, b};
   return registerExpression(Z3_mk_or(g_context, 2, operands));
 }
 
 Z3_ast _sym_build_float_ordered_not_equal(Z3_ast a, Z3_ast b) {
+  RuntimeLock lock;
   return registerExpression(
       Z3_mk_not(g_context, _sym_build_float_ordered_equal(a, b)));
 }
 
 Z3_ast _sym_build_float_ordered(Z3_ast a, Z3_ast b) {
+  RuntimeLock lock;
   return registerExpression(
       Z3_mk_not(g_context, _sym_build_float_unordered(a, b)));
 }
 
 Z3_ast _sym_build_float_unordered(Z3_ast a, Z3_ast b) {
+  RuntimeLock lock;
   Z3_ast checks[2];
   checks[0] = Z3_mk_fpa_is_nan(g_context, a);
   checks[1] = Z3_mk_fpa_is_nan(g_context, b);
@@ -311,6 +1044,7 @@ Z3_ast _sym_build_float_unordered(Z3_ast a, Z3_ast b) {
 }
 
 Z3_ast _sym_build_float_unordered_greater_than(Z3_ast a, Z3_ast b) {
+  RuntimeLock lock;
   Z3_ast checks[3];
   checks[0] = Z3_mk_fpa_is_nan(g_context, a);
   checks[1] = Z3_mk_fpa_is_nan(g_context, b);
@@ -319,6 +1053,7 @@ Z3_ast _sym_build_float_unordered_greater_than(Z3_ast a, Z3_ast b) {
 }
 
 Z3_ast _sym_build_float_unordered_greater_equal(Z3_ast a, Z3_ast b) {
+  RuntimeLock lock;
   Z3_ast checks[3];
   checks[0] = Z3_mk_fpa_is_nan(g_context, a);
   checks[1] = Z3_mk_fpa_is_nan(g_context, b);
@@ -327,6 +1062,7 @@ Z3_ast _sym_build_float_unordered_greater_equal(Z3_ast a, Z3_ast b) {
 }
 
 Z3_ast _sym_build_float_unordered_less_than(Z3_ast a, Z3_ast b) {
+  RuntimeLock lock;
   Z3_ast checks[3];
   checks[0] = Z3_mk_fpa_is_nan(g_context, a);
   checks[1] = Z3_mk_fpa_is_nan(g_context, b);
@@ -335,6 +1071,7 @@ Z3_ast _sym_build_float_unordered_less_than(Z3_ast a, Z3_ast b) {
 }
 
 Z3_ast _sym_build_float_unordered_less_equal(Z3_ast a, Z3_ast b) {
+  RuntimeLock lock;
   Z3_ast checks[3];
   checks[0] = Z3_mk_fpa_is_nan(g_context, a);
   checks[1] = Z3_mk_fpa_is_nan(g_context, b);
@@ -343,6 +1080,7 @@ Z3_ast _sym_build_float_unordered_less_equal(Z3_ast a, Z3_ast b) {
 }
 
 Z3_ast _sym_build_float_unordered_equal(Z3_ast a, Z3_ast b) {
+  RuntimeLock lock;
   Z3_ast checks[3];
   checks[0] = Z3_mk_fpa_is_nan(g_context, a);
   checks[1] = Z3_mk_fpa_is_nan(g_context, b);
@@ -351,6 +1089,7 @@ Z3_ast _sym_build_float_unordered_equal(Z3_ast a, Z3_ast b) {
 }
 
 Z3_ast _sym_build_float_unordered_not_equal(Z3_ast a, Z3_ast b) {
+  RuntimeLock lock;
   Z3_ast checks[3];
   checks[0] = Z3_mk_fpa_is_nan(g_context, a);
   checks[1] = Z3_mk_fpa_is_nan(g_context, b);
@@ -359,25 +1098,29 @@ Z3_ast _sym_build_float_unordered_not_equal(Z3_ast a, Z3_ast b) {
 }
 
 Z3_ast _sym_build_sext(Z3_ast expr, uint8_t bits) {
+  RuntimeLock lock;
   if (expr == nullptr)
     return nullptr;
   return registerExpression(Z3_mk_sign_ext(g_context, bits, expr));
 }
 
 Z3_ast _sym_build_zext(Z3_ast expr, uint8_t bits) {
+  RuntimeLock lock;
   if (expr == nullptr)
     return nullptr;
   return registerExpression(Z3_mk_zero_ext(g_context, bits, expr));
 }
 
 Z3_ast _sym_build_trunc(Z3_ast expr, uint8_t bits) {
+  RuntimeLock lock;
   if (expr == nullptr)
     return nullptr;
 
-  return registerExpression(Z3_mk_extract(g_context, bits - 1, 0, expr));
+  return buildExtract(expr, bits - 1, 0);
 }
 
 Z3_ast _sym_build_int_to_float(Z3_ast value, int is_double, int is_signed) {
+  RuntimeLock lock;
   auto *sort = FSORT(is_double);
   Z3_inc_ref(g_context, (Z3_ast)sort);
   auto *result = registerExpression(
@@ -389,6 +1132,7 @@ Z3_ast _sym_build_int_to_float(Z3_ast value, int is_double, int is_signed) {
 }
 
 Z3_ast _sym_build_float_to_float(Z3_ast expr, int to_double) {
+  RuntimeLock lock;
   auto *sort = FSORT(to_double);
   Z3_inc_ref(g_context, (Z3_ast)sort);
   auto *result = registerExpression(
@@ -398,6 +1142,7 @@ Z3_ast _sym_build_float_to_float(Z3_ast expr, int to_double) {
 }
 
 Z3_ast _sym_build_bits_to_float(Z3_ast expr, int to_double) {
+  RuntimeLock lock;
   if (expr == nullptr)
     return nullptr;
 
@@ -409,22 +1154,26 @@ Z3_ast _sym_build_bits_to_float(Z3_ast expr, int to_double) {
 }
 
 Z3_ast _sym_build_float_to_bits(Z3_ast expr) {
+  RuntimeLock lock;
   if (expr == nullptr)
     return nullptr;
   return registerExpression(Z3_mk_fpa_to_ieee_bv(g_context, expr));
 }
 
 Z3_ast _sym_build_float_to_signed_integer(Z3_ast expr, uint8_t bits) {
+  RuntimeLock lock;
   return registerExpression(Z3_mk_fpa_to_sbv(
       g_context, Z3_mk_fpa_round_toward_zero(g_context), expr, bits));
 }
 
 Z3_ast _sym_build_float_to_unsigned_integer(Z3_ast expr, uint8_t bits) {
+  RuntimeLock lock;
   return registerExpression(Z3_mk_fpa_to_ubv(
       g_context, Z3_mk_fpa_round_toward_zero(g_context), expr, bits));
 }
 
 Z3_ast _sym_build_bool_to_bit(Z3_ast expr) {
+  RuntimeLock lock;
   if (expr == nullptr)
     return nullptr;
   return _sym_build_ite(expr, _sym_build_integer(1, 1),
@@ -432,11 +1181,12 @@ Z3_ast _sym_build_bool_to_bit(Z3_ast expr) {
 }
 
 void _sym_push_path_constraint(Z3_ast constraint, int taken,
-                               uintptr_t site_id [[maybe_unused]]) {
+                               uintptr_t site_id) {
+  RuntimeLock lock;
   if (constraint == nullptr)
     return;
 
-  constraint = Z3_simplify(g_context, constraint);
+  constraint = g_simplification_cache->simplify(constraint);
   Z3_inc_ref(g_context, constraint);
 
   /* Check the easy cases first: if simplification reduced the constraint to
@@ -457,48 +1207,63 @@ void _sym_push_path_constraint(Z3_ast constraint, int taken,
 
   /* Generate a solution for the alternative */
   Z3_ast not_constraint =
-      Z3_simplify(g_context, Z3_mk_not(g_context, constraint));
+      g_simplification_cache->simplify(Z3_mk_not(g_context, constraint));
   Z3_inc_ref(g_context, not_constraint);
 
-  Z3_solver_push(g_context, g_solver);
-  Z3_solver_assert(g_context, g_solver, taken ? not_constraint : constraint);
-  fprintf(g_log, "Trying to solve:\n%s\n",
-          Z3_solver_to_string(g_context, g_solver));
-
-  Z3_lbool feasible = Z3_solver_check(g_context, g_solver);
-  if (feasible == Z3_L_TRUE) {
-    Z3_model model = Z3_solver_get_model(g_context, g_solver);
-    Z3_model_inc_ref(g_context, model);
-    fprintf(g_log, "Found diverging input:\n%s\n",
-            Z3_model_to_string(g_context, model));
-    Z3_model_dec_ref(g_context, model);
-  } else {
-    fprintf(g_log, "Can't find a diverging input at this point\n");
+  if (g_solver_pool)
+    processBackgroundResults();
+
+  uint64_t constraintId = 0;
+  if (g_trace.enabled()) {
+    constraintId = g_trace.addConstraint(site_id, _sym_call_context, taken);
+    if (g_config.traceExpressions)
+      g_trace.addExpression(
+          constraintId, Z3_benchmark_to_smtlib_string(g_context, "", "",
+                                                      "unknown", "", 0, nullptr,
+                                                      constraint));
   }
-  fflush(g_log);
 
-  Z3_solver_pop(g_context, g_solver, 1);
+  // With a coverage map, only solve for branch directions that we haven't
+  // covered yet in this context; the map remembers attempts, too, so that we
+  // don't solve the same query over and over in loops. Without one, we try
+  // every branch.
+  bool uncovered = true;
+  if (!g_config.aflCoverageMap.empty()) {
+    g_coverage_map.cover(site_id, taken, _sym_call_context);
+    uncovered = g_coverage_map.cover(site_id, !taken, _sym_call_context);
+  }
+  if (uncovered) {
+    if (shouldSolve(site_id))
+      solveAlternative(constraint, taken ? not_constraint : constraint, site_id,
+                       constraintId);
+    else if (g_trace.enabled())
+      g_trace.addQuery(constraintId, site_id, trace::QueryResult::Skipped);
+  }
 
   /* Assert the actual path constraint */
   Z3_ast newConstraint = (taken ? constraint : not_constraint);
-  Z3_inc_ref(g_context, newConstraint);
-  Z3_solver_assert(g_context, g_solver, newConstraint);
+  addPathConstraint(newConstraint);
+#ifndef NDEBUG
+  prepareSolver(newConstraint);
   assert((Z3_solver_check(g_context, g_solver) == Z3_L_TRUE) &&
          "Asserting infeasible path constraint");
+#endif
   Z3_dec_ref(g_context, constraint);
   Z3_dec_ref(g_context, not_constraint);
 }
 
 SymExpr _sym_concat_helper(SymExpr a, SymExpr b) {
-  return registerExpression(Z3_mk_concat(g_context, a, b));
+  RuntimeLock lock;
+  return buildConcat(a, b);
 }
 
 SymExpr _sym_extract_helper(SymExpr expr, size_t first_bit, size_t last_bit) {
-  return registerExpression(
-      Z3_mk_extract(g_context, first_bit, last_bit, expr));
+  RuntimeLock lock;
+  return buildExtract(expr, first_bit, last_bit);
 }
 
 size_t _sym_bits_helper(SymExpr expr) {
+  RuntimeLock lock;
   auto *sort = Z3_get_sort(g_context, expr);
   Z3_inc_ref(g_context, (Z3_ast)sort);
   auto result = Z3_get_bv_sort_size(g_context, sort);
@@ -506,20 +1271,24 @@ size_t _sym_bits_helper(SymExpr expr) {
   return result;
 }
 
-/* No call-stack tracing */
+/* No call-stack tracing beyond _sym_call_context, which instrumented code
+ * maintains by itself */
 void _sym_notify_call(uintptr_t) {}
 void _sym_notify_ret(uintptr_t) {}
 void _sym_notify_basic_block(uintptr_t) {}
 
 /* Debugging */
 const char *_sym_expr_to_string(SymExpr expr) {
+  RuntimeLock lock;
   return Z3_ast_to_string(g_context, expr);
 }
 
 bool _sym_feasible(SymExpr expr) {
-  expr = Z3_simplify(g_context, expr);
+  RuntimeLock lock;
+  expr = g_simplification_cache->simplify(expr);
   Z3_inc_ref(g_context, expr);
 
+  prepareSolver(expr);
   Z3_solver_push(g_context, g_solver);
   Z3_solver_assert(g_context, g_solver, expr);
   Z3_lbool feasible = Z3_solver_check(g_context, g_solver);
@@ -531,44 +1300,65 @@ bool _sym_feasible(SymExpr expr) {
 
 /* Garbage collection */
 void _sym_collect_garbage() {
-  if (allocatedExpressions.size() < g_config.garbageCollectionThreshold)
-    return;
+  RuntimeLock lock;
+  auto kind = garbageCollectionDue(allocatedExpressions.size(),
+                                   youngExpressions.size());
+  if (kind != CollectionKind::None)
+    collectGarbage(kind == CollectionKind::Full);
+}
 
-#ifndef NDEBUG
-  auto start = std::chrono::high_resolution_clock::now();
-  auto startSize = allocatedExpressions.size();
-#endif
+/* Snapshots */
+void snapshotBackend() {
+  std::vector<Z3_ast> constraints;
+  if (g_path_constraints) {
+    constraints = g_path_constraints->constraints();
+  } else {
+    auto *assertions = Z3_solver_get_assertions(g_context, g_solver);
+    Z3_ast_vector_inc_ref(g_context, assertions);
+    for (unsigned i = 0; i < Z3_ast_vector_size(g_context, assertions); i++)
+      constraints.push_back(Z3_ast_vector_get(g_context, assertions, i));
+    Z3_ast_vector_dec_ref(g_context, assertions);
+  }
 
-  auto reachableExpressions = collectReachableExpressions();
-  for (auto expr_it = allocatedExpressions.begin();
-       expr_it != allocatedExpressions.end();) {
-    if (reachableExpressions.count(*expr_it) == 0) {
-      expr_it = allocatedExpressions.erase(expr_it);
-    } else {
-      ++expr_it;
-    }
+  for (auto *constraint : constraints)
+    Z3_inc_ref(g_context, constraint);
+  for (auto *constraint : g_saved_path_constraints)
+    Z3_dec_ref(g_context, constraint);
+  g_saved_path_constraints = std::move(constraints);
+  g_saved_input_size = g_input_bytes.size();
+
+  if (g_trace.enabled())
+    g_trace.addSnapshot();
+}
+
+void restoreBackend() {
+  // Background results refer to the current input, so we need to handle them
+  // before it changes.
+  if (g_solver_pool) {
+    g_solver_pool->waitForPendingQueries();
+    processBackgroundResults();
   }
 
-#ifndef NDEBUG
-  auto end = std::chrono::high_resolution_clock::now();
-  auto endSize = allocatedExpressions.size();
+  Z3_solver_reset(g_context, g_solver);
+  if (g_path_constraints)
+    g_path_constraints = std::make_unique<ConstraintSlicer>(g_context);
+  for (auto *constraint : g_saved_path_constraints)
+    addPathConstraint(constraint);
 
-  std::cerr << "After garbage collection: " << endSize
-            << " expressions remain (before: " << startSize << ")" << std::endl
-            << "\t(collection took "
-            << std::chrono::duration_cast<std::chrono::milliseconds>(end -
-                                                                     start)
-                   .count()
-            << " milliseconds)" << std::endl;
-#endif
+  for (size_t i = g_saved_input_size; i < g_input_bytes.size(); i++) {
+    if (g_input_bytes[i] != nullptr)
+      Z3_dec_ref(g_context, g_input_bytes[i]);
+  }
+  g_input_bytes.resize(g_saved_input_size);
+  g_input_values.resize(g_saved_input_size);
+
+  if (g_trace.enabled())
+    g_trace.addRestore();
+
+  collectGarbage(true);
 }
 
 /* Test-case handling */
-void symcc_set_test_case_handler(TestCaseHandler) {
-  // The simple backend doesn't support test-case handlers. However, let's not
-  // make this a fatal error; otherwise, users would have to change their
-  // programs to make them work with the simple backend.
-  fprintf(
-      g_log,
-      "Warning: test-case handlers aren't supported in the simple backend\n");
+void symcc_set_test_case_handler(TestCaseHandler handler) {
+  g_test_case_handler = handler;
 }
@@ -0,0 +1,41 @@
+// This file is part of the SymCC runtime.
+//
+// The SymCC runtime is free software: you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// The SymCC runtime is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+// for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with the SymCC runtime. If not, see <https://www.gnu.org/licenses/>.
+
+#include "SimplificationCache.h"
+
+Z3_ast SimplificationCache::simplify(Z3_ast expr) {
+  auto id = Z3_get_ast_id(context_, expr);
+  if (auto it = entries_.find(id); it != entries_.end())
+    return it->second.second;
+
+  if (entries_.size() >= capacity_)
+    clear();
+
+  // Take the reference to the original first, so that Z3 doesn't free it
+  // (and reuse its ID) while simplifying.
+  Z3_inc_ref(context_, expr);
+  auto *simplified = Z3_simplify(context_, expr);
+  Z3_inc_ref(context_, simplified);
+  entries_.emplace(id, std::make_pair(expr, simplified));
+  return simplified;
+}
+
+void SimplificationCache::clear() {
+  for (auto &[id, entry] : entries_) {
+    Z3_dec_ref(context_, entry.first);
+    Z3_dec_ref(context_, entry.second);
+  }
+  entries_.clear();
+}
@@ -0,0 +1,60 @@
+// This file is part of the SymCC runtime.
+//
+// The SymCC runtime is free software: you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// The SymCC runtime is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+// for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with the SymCC runtime. If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef SIMPLIFICATIONCACHE_H
+#define SIMPLIFICATIONCACHE_H
+
+#include <cstddef>
+#include <unordered_map>
+#include <utility>
+
+#include <z3.h>
+
+/// A memo table for Z3_simplify.
+///
+/// Programs often branch on the same condition many times (e.g., in loops), and
+/// Z3 hash-conses its expressions, so the same AST comes back to us for
+/// simplification again and again. We remember the result by AST ID. The cache
+/// keeps a reference to each expression that it knows, which keeps the IDs
+/// unique; to let the garbage collector free the expressions eventually, the
+/// runtime clears the cache on every collection. The number of entries is
+/// bounded as well, and we start over when the cache is full.
+class SimplificationCache {
+public:
+  SimplificationCache(Z3_context context, size_t capacity)
+      : context_(context), capacity_(capacity) {}
+  ~SimplificationCache() { clear(); }
+
+  SimplificationCache(const SimplificationCache &) = delete;
+  SimplificationCache &operator=(const SimplificationCache &) = delete;
+
+  /// Return the simplified version of the expression.
+  ///
+  /// The cache holds a reference to the result until it's cleared; callers
+  /// that need the result for longer have to take their own reference.
+  Z3_ast simplify(Z3_ast expr);
+
+  /// Forget all entries, releasing their references.
+  void clear();
+
+private:
+  Z3_context context_;
+  size_t capacity_;
+
+  /// The original and simplified expression, by ID of the original.
+  std::unordered_map<unsigned, std::pair<Z3_ast, Z3_ast>> entries_;
+};
+
+#endif
@@ -0,0 +1,84 @@
+// This file is part of the SymCC runtime.
+//
+// The SymCC runtime is free software: you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// The SymCC runtime is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+// for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with the SymCC runtime. If not, see <https://www.gnu.org/licenses/>.
+
+#include "SiteStatistics.h"
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+bool SiteStatistics::shouldSolve(uintptr_t site) {
+  auto &stats = sites_[site];
+  if (stats.skip == 0)
+    return true;
+
+  stats.skip--;
+  stats.skipped++;
+  return false;
+}
+
+unsigned SiteStatistics::skipped(uintptr_t site) const {
+  auto it = sites_.find(site);
+  return (it == sites_.end()) ? 0 : it->second.skipped;
+}
+
+void SiteStatistics::recordCacheHit(uintptr_t site) {
+  sites_[site].cacheHits++;
+}
+
+void SiteStatistics::record(uintptr_t site, Outcome outcome,
+                            std::chrono::steady_clock::duration time) {
+  auto &stats = sites_[site];
+  stats.queries++;
+  stats.time += time;
+
+  if (outcome == Outcome::Sat) {
+    stats.sat++;
+    stats.failures = 0;
+    stats.skip = 0;
+    return;
+  }
+
+  if (outcome == Outcome::Unsat)
+    stats.unsat++;
+  else
+    stats.timeouts++;
+
+  stats.failures++;
+  if (stats.failures >= 2) {
+    auto exponent = std::min(stats.failures - 1, kMaxBackoffExponent);
+    stats.skip = (1u << exponent) - 1;
+  }
+}
+
+void SiteStatistics::dump(FILE *out) const {
+  std::vector<std::pair<uintptr_t, const Site *>> sorted;
+  for (auto &[site, stats] : sites_)
+    sorted.emplace_back(site, &stats);
+  std::sort(sorted.begin(), sorted.end(), [](auto &a, auto &b) {
+    return a.second->time > b.second->time;
+  });
+
+  fprintf(out, "site\tqueries\tsat\tunsat\ttimeout\tskipped\tcached\ttime_ms\n");
+  for (auto &[site, stats] : sorted) {
+    auto milliseconds =
+        std::chrono::duration_cast<std::chrono::milliseconds>(stats->time)
+            .count();
+    fprintf(out, "%#lx\t%u\t%u\t%u\t%u\t%u\t%u\t%lld\n",
+            static_cast<unsigned long>(site), stats->queries, stats->sat,
+            stats->unsat, stats->timeouts, stats->skipped, stats->cacheHits,
+            static_cast<long long>(milliseconds));
+  }
+}
@@ -0,0 +1,74 @@
+// This file is part of the SymCC runtime.
+//
+// The SymCC runtime is free software: you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// The SymCC runtime is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+// for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with the SymCC runtime. If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef SITESTATISTICS_H
+#define SITESTATISTICS_H
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <unordered_map>
+
+#include "Statistics.h"
+
+/// Solver statistics per branch site, and back-off for unproductive sites.
+///
+/// Some branches are visited over and over (e.g., loop conditions), and their
+/// queries keep timing out or turning out unsatisfiable. After two consecutive
+/// failures at a site, we skip an exponentially growing number of its queries;
+/// a success resets the site.
+class SiteStatistics {
+public:
+  using Outcome = QueryOutcome;
+
+  /// Decide whether to solve the next query at the site; if not, count the
+  /// query as skipped.
+  bool shouldSolve(uintptr_t site);
+
+  /// The number of queries skipped at the site so far.
+  unsigned skipped(uintptr_t site) const;
+
+  /// Record a query that was answered from the query cache.
+  void recordCacheHit(uintptr_t site);
+
+  /// Record the outcome of a query that we sent to the solver.
+  void record(uintptr_t site, Outcome outcome,
+              std::chrono::steady_clock::duration time);
+
+  /// Write the statistics as a table, sorted by solver time.
+  void dump(FILE *out) const;
+
+private:
+  static constexpr unsigned kMaxBackoffExponent = 10;
+
+  struct Site {
+    unsigned queries = 0;
+    unsigned sat = 0;
+    unsigned unsat = 0;
+    unsigned timeouts = 0;
+    unsigned skipped = 0;
+    unsigned cacheHits = 0;
+    std::chrono::steady_clock::duration time{};
+
+    /// The number of consecutive failed queries.
+    unsigned failures = 0;
+    /// The number of queries still to be skipped.
+    unsigned skip = 0;
+  };
+
+  std::unordered_map<uintptr_t, Site> sites_;
+};
+
+#endif
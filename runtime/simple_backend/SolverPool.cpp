@@ -0,0 +1,147 @@
+// This file is part of the SymCC runtime.
+//
+// The SymCC runtime is free software: you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// The SymCC runtime is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+// for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with the SymCC runtime. If not, see <https://www.gnu.org/licenses/>.
+
+#include "SolverPool.h"
+
+#include <cstdio>
+#include <utility>
+
+#include "Threads.h"
+
+std::optional<QueryCache::Model> readInputModel(Z3_context context,
+                                                Z3_model model) {
+  QueryCache::Model assignment;
+
+  auto numConsts = Z3_model_get_num_consts(context, model);
+  for (unsigned i = 0; i < numConsts; i++) {
+    auto *decl = Z3_model_get_const_decl(context, model, i);
+    auto *name = Z3_get_symbol_string(context, Z3_get_decl_name(context, decl));
+    unsigned offset;
+    if (sscanf(name, "stdin%u", &offset) != 1)
+      return {};
+
+    auto *interpretation = Z3_model_get_const_interp(context, model, decl);
+    Z3_inc_ref(context, interpretation);
+    unsigned value;
+    bool isNumeral = Z3_get_numeral_uint(context, interpretation, &value);
+    Z3_dec_ref(context, interpretation);
+    if (!isNumeral)
+      return {};
+
+    assignment.emplace_back(offset, value);
+  }
+
+  return assignment;
+}
+
+SolverPool::SolverPool(unsigned threads, unsigned timeout) : timeout_(timeout) {
+  InternalThreadCreation internal;
+  for (unsigned i = 0; i < threads; i++)
+    workers_.emplace_back(&SolverPool::work, this);
+}
+
+SolverPool::~SolverPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  queryAvailable_.notify_all();
+
+  for (auto &worker : workers_)
+    worker.join();
+}
+
+bool SolverPool::submit(std::string query, const QueryCache::Key &key,
+                        uint64_t fingerprint, uintptr_t site,
+                        uint64_t constraint) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (queries_.size() >= kMaxPendingQueries)
+      return false;
+
+    queries_.push_back({std::move(query), key, fingerprint, site, constraint});
+    pending_++;
+  }
+
+  queryAvailable_.notify_one();
+  return true;
+}
+
+std::vector<SolverPool::Result> SolverPool::takeResults() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::vector<Result> results;
+  results.swap(results_);
+  return results;
+}
+
+void SolverPool::waitForPendingQueries() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  queryFinished_.wait(lock, [this] { return pending_ == 0; });
+}
+
+void SolverPool::work() {
+  auto *cfg = Z3_mk_config();
+  Z3_set_param_value(cfg, "model", "true");
+  Z3_set_param_value(cfg, "timeout", std::to_string(timeout_).c_str());
+  auto *context = Z3_mk_context_rc(cfg);
+  Z3_del_config(cfg);
+
+  while (true) {
+    Query query;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      // Drain the queue before stopping.
+      queryAvailable_.wait(lock,
+                           [this] { return stopping_ || !queries_.empty(); });
+      if (queries_.empty())
+        break;
+
+      query = std::move(queries_.front());
+      queries_.pop_front();
+    }
+
+    // A fresh solver per query keeps the workers independent of each other's
+    // history.
+    auto *solver = Z3_mk_solver(context);
+    Z3_solver_inc_ref(context, solver);
+    Z3_solver_from_string(context, solver, query.text.c_str());
+
+    auto start = std::chrono::steady_clock::now();
+    auto status = Z3_solver_check(context, solver);
+    Result result{query.key,
+                  query.fingerprint,
+                  query.site,
+                  query.constraint,
+                  status,
+                  std::chrono::steady_clock::now() - start,
+                  std::nullopt};
+    if (result.status == Z3_L_TRUE) {
+      auto *model = Z3_solver_get_model(context, solver);
+      Z3_model_inc_ref(context, model);
+      result.assignment = readInputModel(context, model);
+      Z3_model_dec_ref(context, model);
+    }
+    Z3_solver_dec_ref(context, solver);
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      results_.push_back(std::move(result));
+      pending_--;
+    }
+    queryFinished_.notify_all();
+  }
+
+  Z3_del_context(context);
+}
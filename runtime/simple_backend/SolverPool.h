@@ -0,0 +1,112 @@
+// This file is part of the SymCC runtime.
+//
+// The SymCC runtime is free software: you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// The SymCC runtime is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+// for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with the SymCC runtime. If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef SOLVERPOOL_H
+#define SOLVERPOOL_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <z3.h>
+
+#include "QueryCache.h"
+
+/// Read the values of the input bytes from a model.
+///
+/// Returns an empty optional if the model assigns something other than input
+/// bytes.
+std::optional<QueryCache::Model> readInputModel(Z3_context context,
+                                                Z3_model model);
+
+/// A pool of threads that solve queries in the background.
+///
+/// Z3 contexts can't be shared between threads, so queries are handed over in
+/// their textual (SMT-LIB) form, and each worker parses them into its own
+/// context. Results are collected until the main thread picks them up; this
+/// way, all test-case handling happens on the main thread.
+class SolverPool {
+public:
+  struct Result {
+    /// The cache key and the fingerprint of the relevant input bytes, as
+    /// passed to submit.
+    QueryCache::Key key;
+    uint64_t fingerprint;
+    /// The branch site that the query belongs to.
+    uintptr_t site;
+    /// The ID of the path constraint in the constraint trace.
+    uint64_t constraint;
+    Z3_lbool status;
+    std::chrono::steady_clock::duration time;
+    /// For satisfiable queries, the assignment of input bytes (if the model
+    /// could be translated).
+    std::optional<QueryCache::Model> assignment;
+  };
+
+  /// Start the given number of workers; the timeout is per query, in
+  /// milliseconds.
+  SolverPool(unsigned threads, unsigned timeout);
+
+  /// Wait for pending queries to finish, then stop the workers.
+  ~SolverPool();
+
+  SolverPool(const SolverPool &) = delete;
+  SolverPool &operator=(const SolverPool &) = delete;
+
+  /// Enqueue a query for solving; the key and the fingerprint are just passed
+  /// on to the result. Returns false (and drops the query) if too many queries
+  /// are pending already.
+  bool submit(std::string query, const QueryCache::Key &key,
+              uint64_t fingerprint, uintptr_t site, uint64_t constraint);
+
+  /// Return the results that have become available since the last call.
+  std::vector<Result> takeResults();
+
+  /// Block until all submitted queries have been solved.
+  void waitForPendingQueries();
+
+private:
+  static constexpr size_t kMaxPendingQueries = 1024;
+
+  struct Query {
+    std::string text;
+    QueryCache::Key key;
+    uint64_t fingerprint;
+    uintptr_t site;
+    uint64_t constraint;
+  };
+
+  void work();
+
+  unsigned timeout_;
+  std::vector<std::thread> workers_;
+
+  std::mutex mutex_;
+  std::condition_variable queryAvailable_;
+  std::condition_variable queryFinished_;
+  std::deque<Query> queries_;
+  std::vector<Result> results_;
+  /// The number of queries that are queued or being solved.
+  size_t pending_ = 0;
+  bool stopping_ = false;
+};
+
+#endif
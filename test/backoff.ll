@@ -0,0 +1,64 @@
+; This file is part of SymCC.
+;
+; SymCC is free software: you can redistribute it and/or modify it under the
+; terms of the GNU General Public License as published by the Free Software
+; Foundation, either version 3 of the License, or (at your option) any later
+; version.
+;
+; SymCC is distributed in the hope that it will be useful, but WITHOUT ANY
+; WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+; A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+;
+; You should have received a copy of the GNU General Public License along with
+; SymCC. If not, see <https://www.gnu.org/licenses/>.
+
+; Verify that the simple backend backs off from a site whose queries keep
+; failing, and that it says so only once. The loop branches on a condition that
+; can't be negated (no square is 2 modulo 256), with a different input byte in
+; every iteration so that the query cache doesn't answer the queries.
+;
+; Since the bitcode is written by hand, we first run llc on it because it
+; performs a validity check, whereas Clang doesn't.
+
+; RUN: llc %s -o /dev/null
+; RUN: %symcc %s -o %t
+; RUN: head -c 64 /dev/zero | %t 2>&1 | %filecheck %s
+
+target triple = "x86_64-pc-linux-gnu"
+
+@done = private constant [5 x i8] c"done\00"
+
+declare i64 @read(i32, i8*, i64)
+declare i32 @puts(i8*)
+
+define i32 @main() {
+entry:
+  %input = alloca [64 x i8]
+  %start = getelementptr [64 x i8], [64 x i8]* %input, i64 0, i64 0
+  %bytes_read = call i64 @read(i32 0, i8* %start, i64 64)
+  %complete = icmp eq i64 %bytes_read, 64
+  br i1 %complete, label %loop, label %error
+
+loop:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %next ]
+  %byte_ptr = getelementptr [64 x i8], [64 x i8]* %input, i64 0, i64 %i
+  %byte = load i8, i8* %byte_ptr
+  %square = mul i8 %byte, %byte
+  %not_two = icmp ne i8 %square, 2
+  br i1 %not_two, label %next, label %error
+
+next:
+  %i.next = add i64 %i, 1
+  %finished = icmp eq i64 %i.next, 64
+  br i1 %finished, label %exit, label %loop
+
+exit:
+  ; SIMPLE-COUNT-1: Skipping queries at site
+  ; SIMPLE-NOT: Skipping queries
+  ; ANY: done
+  call i32 @puts(i8* getelementptr ([5 x i8], [5 x i8]* @done, i64 0, i64 0))
+  ret i32 0
+
+error:
+  ret i32 1
+}
@@ -0,0 +1,68 @@
+; This file is part of SymCC.
+;
+; SymCC is free software: you can redistribute it and/or modify it under the
+; terms of the GNU General Public License as published by the Free Software
+; Foundation, either version 3 of the License, or (at your option) any later
+; version.
+;
+; SymCC is distributed in the hope that it will be useful, but WITHOUT ANY
+; WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+; A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+;
+; You should have received a copy of the GNU General Public License along with
+; SymCC. If not, see <https://www.gnu.org/licenses/>.
+
+; Verify that local variables are handled correctly by the concreteness
+; analysis. The loop counter lives in a local variable that only ever receives
+; concrete values, so the pass doesn't instrument its computations; the
+; symbolic input byte is copied to another local variable, which must remain
+; symbolic. If the analysis wrongly considered the second variable concrete,
+; the solver wouldn't be asked to reach the "yes" branch.
+;
+; Since the bitcode is written by hand, we first run llc on it because it
+; performs a validity check, whereas Clang doesn't.
+;
+; RUN: llc %s -o /dev/null
+; RUN: %symcc %s -o %t
+; RUN: echo -ne "\x00" | %t 2>&1 | %filecheck %s
+
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-pc-linux-gnu"
+
+declare i64 @read(i32, i8*, i64)
+
+define i32 @main(i32 %argc, i8** %argv) {
+entry:
+  %input = alloca i8
+  %counter = alloca i32
+  %copy = alloca i32
+  %count = call i64 @read(i32 0, i8* %input, i64 1)
+  %input_byte = load i8, i8* %input
+  %input_value = zext i8 %input_byte to i32
+  store i32 %input_value, i32* %copy
+  store i32 0, i32* %counter
+  br label %loop
+
+loop:
+  %i = load i32, i32* %counter
+  %next = add i32 %i, 1
+  store i32 %next, i32* %counter
+  %done = icmp eq i32 %next, 10
+  br i1 %done, label %exit, label %loop
+
+exit:
+  %value = load i32, i32* %copy
+  %final = load i32, i32* %counter
+  %sum = add i32 %value, %final
+  %hit = icmp eq i32 %sum, 52
+  ; SIMPLE: Trying to solve
+  ; SIMPLE: Found diverging input
+  ; SIMPLE: stdin0 -> #x2a
+  br i1 %hit, label %yes, label %no
+
+yes:
+  ret i32 1
+
+no:
+  ret i32 0
+}
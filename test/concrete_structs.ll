@@ -38,9 +38,8 @@ target triple = "x86_64-pc-linux-gnu"
 ; variables (reproducing eurecom-s3/symcc#138).
 %struct_type = type { i8, i32, i8, float, i1 }
 
-; Global variable to record whether we've found a solution. Since the simple
-; backend doesn't support test-case handlers, we start with "true".
-@solved = global i1 1
+; Global variable to record whether we've found a solution.
+@solved = global i1 0
 
 ; Our test-case handler verifies that the new test case is a 32-bit integer
 ; with the value 42.
@@ -66,7 +65,6 @@ failed:
 define i32 @main(i32 %argc, i8** %argv) {
   ; Register our test-case handler.
   call void @symcc_set_test_case_handler(void (i8*, i64)* @test_case_handler)
-  ; SIMPLE: Warning: test-case handlers
 
   ; Create a symbolic value that we can use to trigger the creation of struct
   ; expressions.
@@ -92,6 +90,7 @@ define i32 @main(i32 %argc, i8** %argv) {
   %value_loaded = load i32, i32* %value_address
   %is_forty_two = icmp eq i32 %value_loaded, %symbolic_value
   br i1 %is_forty_two, label %never_executed, label %done
+  ; SIMPLE: Found diverging input
   ; QSYM: SMT
 
 never_executed:
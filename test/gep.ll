@@ -0,0 +1,64 @@
+; This file is part of SymCC.
+;
+; SymCC is free software: you can redistribute it and/or modify it under the
+; terms of the GNU General Public License as published by the Free Software
+; Foundation, either version 3 of the License, or (at your option) any later
+; version.
+;
+; SymCC is distributed in the hope that it will be useful, but WITHOUT ANY
+; WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+; A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+;
+; You should have received a copy of the GNU General Public License along with
+; SymCC. If not, see <https://www.gnu.org/licenses/>.
+
+; Verify the symbolic computation of pointers with getelementptr. We compute a
+; pointer from a symbolic index, combined with struct member offsets, an array
+; index and negative offsets (one of them with a narrow index type). The pass
+; folds the constant parts into a single offset; if the result differs from the
+; concrete computation, the solver won't find the input that makes the pointer
+; hit the expected element.
+;
+; Since the bitcode is written by hand, we first run llc on it because it
+; performs a validity check, whereas Clang doesn't.
+;
+; RUN: llc %s -o /dev/null
+; RUN: %symcc %s -o %t
+; RUN: echo -ne "\x00" | %t 2>&1 | %filecheck %s
+
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-pc-linux-gnu"
+
+%pair = type { i32, [4 x i16] }
+
+@table = global [2 x %pair] zeroinitializer
+
+declare i64 @read(i32, i8*, i64)
+
+define i32 @main(i32 %argc, i8** %argv) {
+  %input = alloca i8
+  %count = call i64 @read(i32 0, i8* %input, i64 1)
+  %index_byte = load i8, i8* %input
+  %index = zext i8 %index_byte to i64
+
+  ; Each pair occupies 12 bytes, so this is table + 12 * index + 10.
+  %element = getelementptr [2 x %pair], [2 x %pair]* @table, i64 0, i64 %index, i32 1, i64 3
+  ; Step back by 2 elements (4 bytes) and then 1 byte.
+  %previous = getelementptr i16, i16* %element, i64 -2
+  %previous_bytes = bitcast i16* %previous to i8*
+  %target = getelementptr i8, i8* %previous_bytes, i32 -1
+
+  ; The target is table + 17 for an index of 1.
+  %expected = getelementptr i8, i8* bitcast ([2 x %pair]* @table to i8*), i64 17
+  %hit = icmp eq i8* %target, %expected
+  ; SIMPLE: Trying to solve
+  ; SIMPLE: Found diverging input
+  ; SIMPLE: stdin0 -> #x01
+  br i1 %hit, label %yes, label %no
+
+yes:
+  ret i32 1
+
+no:
+  ret i32 0
+}
@@ -13,11 +13,12 @@
 // SymCC. If not, see <https://www.gnu.org/licenses/>.
 
 // RUN: %symcc -O2 %s -o %t
-// RUN: echo -ne "\x00\x00\x00\x05" | %t 2>&1 | %filecheck %s
+// RUN: echo -ne "\x00\x00\x00\x05" | env SYMCC_LOG_QUERIES=1 %t 2>&1 | %filecheck %s
 //
 // Test that global variables are handled correctly. The special challenge is
 // that we need to initialize the symbolic expression corresponding to any
-// global variable that has an initial value.
+// global variable that has an initial value. The checks below look at the
+// queries, which the simple backend only logs with SYMCC_LOG_QUERIES=1.
 
 #include <stdint.h>
 #include <stdio.h>
@@ -0,0 +1,52 @@
+; This file is part of SymCC.
+;
+; SymCC is free software: you can redistribute it and/or modify it under the
+; terms of the GNU General Public License as published by the Free Software
+; Foundation, either version 3 of the License, or (at your option) any later
+; version.
+;
+; SymCC is distributed in the hope that it will be useful, but WITHOUT ANY
+; WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+; A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+;
+; You should have received a copy of the GNU General Public License along with
+; SymCC. If not, see <https://www.gnu.org/licenses/>.
+
+; Verify that the runtime doesn't create expressions for lazy input that the
+; program never reads. The program makes a 64 KiB buffer symbolic, which leaves
+; its pages lazy, and then clears the buffer with memset; checking whether the
+; buffer is concrete and overwriting it must not create any shadow pages. Only
+; a byte that the program reads afterwards from a second buffer gets a shadow.
+;
+; Since the bitcode is written by hand, we first run llc on it because it
+; performs a validity check, whereas Clang doesn't.
+
+; RUN: llc %s -o /dev/null
+; RUN: %symcc %s -o %t
+; RUN: env SYMCC_MEMORY_INPUT=1 SYMCC_STATS=%t.json %t
+; RUN: %filecheck %s < %t.json
+
+target triple = "x86_64-pc-linux-gnu"
+
+@buffer = internal global [65536 x i8] zeroinitializer, align 4096
+@other = internal global [65536 x i8] zeroinitializer, align 4096
+
+declare void @symcc_make_symbolic(i8*, i64)
+declare void @llvm.memset.p0i8.i64(i8*, i8, i64, i1)
+
+define i32 @main() {
+entry:
+  %start = getelementptr [65536 x i8], [65536 x i8]* @buffer, i64 0, i64 0
+  call void @symcc_make_symbolic(i8* %start, i64 65536)
+  call void @llvm.memset.p0i8.i64(i8* %start, i8 0, i64 65536, i1 false)
+
+  %other = getelementptr [65536 x i8], [65536 x i8]* @other, i64 0, i64 0
+  call void @symcc_make_symbolic(i8* %other, i64 65536)
+  %byte_ptr = getelementptr [65536 x i8], [65536 x i8]* @other, i64 0, i64 5000
+  %byte = load volatile i8, i8* %byte_ptr
+  %wide = zext i8 %byte to i32
+
+  ; ANY: "shadow": {
+  ; ANY-NEXT: "pages_allocated": 1,
+  ret i32 %wide
+}
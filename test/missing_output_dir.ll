@@ -0,0 +1,62 @@
+; This file is part of SymCC.
+;
+; SymCC is free software: you can redistribute it and/or modify it under the
+; terms of the GNU General Public License as published by the Free Software
+; Foundation, either version 3 of the License, or (at your option) any later
+; version.
+;
+; SymCC is distributed in the hope that it will be useful, but WITHOUT ANY
+; WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+; A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+;
+; You should have received a copy of the GNU General Public License along with
+; SymCC. If not, see <https://www.gnu.org/licenses/>.
+
+; Verify that the simple backend complains only once if it can't write test
+; cases to the output directory. The program compares each of its input bytes
+; with a constant, so every iteration yields a new input.
+;
+; Since the bitcode is written by hand, we first run llc on it because it
+; performs a validity check, whereas Clang doesn't.
+
+; RUN: llc %s -o /dev/null
+; RUN: %symcc %s -o %t
+; RUN: head -c 8 /dev/zero | env SYMCC_OUTPUT_DIR=%t.missing %t 2>&1 | %filecheck %s
+
+target triple = "x86_64-pc-linux-gnu"
+
+@done = private constant [5 x i8] c"done\00"
+
+declare i64 @read(i32, i8*, i64)
+declare i32 @puts(i8*)
+
+define i32 @main() {
+entry:
+  %input = alloca [8 x i8]
+  %start = getelementptr [8 x i8], [8 x i8]* %input, i64 0, i64 0
+  %bytes_read = call i64 @read(i32 0, i8* %start, i64 8)
+  %complete = icmp eq i64 %bytes_read, 8
+  br i1 %complete, label %loop, label %error
+
+loop:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %next ]
+  %byte_ptr = getelementptr [8 x i8], [8 x i8]* %input, i64 0, i64 %i
+  %byte = load i8, i8* %byte_ptr
+  %match = icmp eq i8 %byte, 42
+  br i1 %match, label %error, label %next
+
+next:
+  %i.next = add i64 %i, 1
+  %finished = icmp eq i64 %i.next, 8
+  br i1 %finished, label %exit, label %loop
+
+exit:
+  ; SIMPLE-COUNT-1: Can't create the test case
+  ; SIMPLE-NOT: Can't create
+  ; ANY: done
+  call i32 @puts(i8* getelementptr ([5 x i8], [5 x i8]* @done, i64 0, i64 0))
+  ret i32 0
+
+error:
+  ret i32 1
+}
@@ -0,0 +1,70 @@
+; This file is part of SymCC.
+;
+; SymCC is free software: you can redistribute it and/or modify it under the
+; terms of the GNU General Public License as published by the Free Software
+; Foundation, either version 3 of the License, or (at your option) any later
+; version.
+;
+; SymCC is distributed in the hope that it will be useful, but WITHOUT ANY
+; WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+; A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+;
+; You should have received a copy of the GNU General Public License along with
+; SymCC. If not, see <https://www.gnu.org/licenses/>.
+
+; Verify that the garbage collector's helper threads don't make the program
+; multithreaded. The program stores enough distinct expressions in memory that
+; a full collection has to keep more than 2^16 of them alive, which is when the
+; collector sweeps the expression registry on several threads (if the machine
+; has more than one core); the tiny memory limit makes the runtime run full
+; collections all the time. Afterwards, the runtime must still consider the
+; program single-threaded; otherwise, it would take its lock on every call
+; from then on.
+;
+; Since the bitcode is written by hand, we first run llc on it because it
+; performs a validity check, whereas Clang doesn't.
+
+; RUN: llc %s -o /dev/null
+; RUN: %symcc %s -o %t
+; RUN: echo -ne "\x05" | env SYMCC_MEMORY_LIMIT=1M SYMCC_STATS=%t.json %t
+; RUN: %filecheck %s < %t.json
+
+target triple = "x86_64-pc-linux-gnu"
+
+@values = internal global [30000 x i32] zeroinitializer
+
+declare i64 @read(i32, i8*, i64)
+declare void @_sym_collect_garbage()
+
+define i32 @main() {
+entry:
+  %input = alloca i8
+  %bytes_read = call i64 @read(i32 0, i8* %input, i64 1)
+  %complete = icmp eq i64 %bytes_read, 1
+  br i1 %complete, label %start, label %error
+
+start:
+  %byte = load i8, i8* %input
+  %wide = zext i8 %byte to i32
+  br label %loop
+
+loop:
+  %i = phi i32 [ 0, %start ], [ %i.next, %loop ]
+  %value = add i32 %wide, %i
+  %index = zext i32 %i to i64
+  %slot = getelementptr [30000 x i32], [30000 x i32]* @values, i64 0, i64 %index
+  store i32 %value, i32* %slot
+  call void @_sym_collect_garbage()
+  %i.next = add i32 %i, 1
+  %finished = icmp eq i32 %i.next, 30000
+  br i1 %finished, label %exit, label %loop
+
+exit:
+  ; ANY: "gc": {
+  ; ANY: "full": {{[1-9]}}
+  ; ANY: "multithreaded": false
+  ret i32 0
+
+error:
+  ret i32 1
+}
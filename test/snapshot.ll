@@ -0,0 +1,74 @@
+; This file is part of SymCC.
+;
+; SymCC is free software: you can redistribute it and/or modify it under the
+; terms of the GNU General Public License as published by the Free Software
+; Foundation, either version 3 of the License, or (at your option) any later
+; version.
+;
+; SymCC is distributed in the hope that it will be useful, but WITHOUT ANY
+; WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+; A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+;
+; You should have received a copy of the GNU General Public License along with
+; SymCC. If not, see <https://www.gnu.org/licenses/>.
+
+; Verify that symcc_restore returns to a clean symbolic state. Like a persistent
+; fuzzing harness, the program takes a snapshot and then processes several
+; inputs in a loop, restoring the snapshot after each one. Every iteration
+; compares its (single-byte) input with the same constant. If the path
+; constraints of previous iterations survived the restore, the query would
+; contradict them and be unsatisfiable; if the input position survived, the
+; byte would be called stdin1, stdin2 and so on. Instead, each iteration must
+; find the same solution for stdin0.
+;
+; Since the bitcode is written by hand, we first run llc on it because it
+; performs a validity check, whereas Clang doesn't.
+
+; RUN: llc %s -o /dev/null
+; RUN: %symcc %s -o %t
+; RUN: env SYMCC_MEMORY_INPUT=1 %t 2>&1 | %filecheck --implicit-check-not="Can't find" --implicit-check-not=stdin1 %s
+
+target triple = "x86_64-pc-linux-gnu"
+
+@done = private constant [5 x i8] c"done\00"
+
+declare void @symcc_make_symbolic(i8*, i64)
+declare void @symcc_snapshot()
+declare void @symcc_restore()
+declare i32 @puts(i8*)
+
+define i1 @is_magic(i8* %input) noinline {
+  %byte = load i8, i8* %input
+  %magic = icmp eq i8 %byte, 42
+  ret i1 %magic
+}
+
+define i32 @main() {
+entry:
+  %input = alloca i8
+  call void @symcc_snapshot()
+  br label %loop
+
+loop:
+  %i = phi i8 [ 0, %entry ], [ %i.next, %next ]
+  %value = add i8 %i, 1
+  store i8 %value, i8* %input
+  call void @symcc_make_symbolic(i8* %input, i64 1)
+  %magic = call i1 @is_magic(i8* %input)
+  br i1 %magic, label %found, label %next
+
+found:
+  br label %next
+
+next:
+  call void @symcc_restore()
+  %i.next = add i8 %i, 1
+  %finished = icmp eq i8 %i.next, 3
+  br i1 %finished, label %exit, label %loop
+
+exit:
+  ; SIMPLE-COUNT-3: stdin0 -> #x2a
+  ; ANY: done
+  call i32 @puts(i8* getelementptr ([5 x i8], [5 x i8]* @done, i64 0, i64 0))
+  ret i32 0
+}
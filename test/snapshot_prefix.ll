@@ -0,0 +1,114 @@
+; This file is part of SymCC.
+;
+; SymCC is free software: you can redistribute it and/or modify it under the
+; terms of the GNU General Public License as published by the Free Software
+; Foundation, either version 3 of the License, or (at your option) any later
+; version.
+;
+; SymCC is distributed in the hope that it will be useful, but WITHOUT ANY
+; WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+; A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+;
+; You should have received a copy of the GNU General Public License along with
+; SymCC. If not, see <https://www.gnu.org/licenses/>.
+
+; Verify that symcc_restore keeps the symbolic state from before the snapshot.
+; The program makes a prefix byte symbolic and branches on it, so that the path
+; constraint pins the byte to 7, before taking the snapshot. Then it processes
+; several inputs in a loop, restoring the snapshot after each one, and compares
+; each input with the prefix plus 35. If the restore lost the prefix's path
+; constraint, the solver would be free to change the prefix; if it lost the
+; prefix's input byte, the test case would start with 0. Instead, every
+; iteration must produce the test case 07 2a. A test-case handler prints the
+; test cases, so the check works the same with both backends.
+;
+; Since the bitcode is written by hand, we first run llc on it because it
+; performs a validity check, whereas Clang doesn't.
+
+; RUN: llc %s -o /dev/null
+; RUN: %symcc %s -o %t
+; RUN: env SYMCC_MEMORY_INPUT=1 %t 2>/dev/null | %filecheck %s
+
+target triple = "x86_64-pc-linux-gnu"
+
+@header = private constant [12 x i8] c"test case:\00\00"
+@byte_format = private constant [6 x i8] c" %02x\00"
+@newline = private constant [2 x i8] c"\0A\00"
+
+declare void @symcc_make_symbolic(i8*, i64)
+declare void @symcc_snapshot()
+declare void @symcc_restore()
+declare void @symcc_set_test_case_handler(void (i8*, i64)*)
+declare i32 @printf(i8*, ...)
+
+define void @print_test_case(i8* %data, i64 %length) {
+entry:
+  call i32 (i8*, ...) @printf(i8* getelementptr ([12 x i8], [12 x i8]* @header, i64 0, i64 0))
+  %empty = icmp eq i64 %length, 0
+  br i1 %empty, label %exit, label %loop
+
+loop:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %loop ]
+  %byte_ptr = getelementptr i8, i8* %data, i64 %i
+  %byte = load i8, i8* %byte_ptr
+  %wide = zext i8 %byte to i32
+  call i32 (i8*, ...) @printf(i8* getelementptr ([6 x i8], [6 x i8]* @byte_format, i64 0, i64 0), i32 %wide)
+  %i.next = add i64 %i, 1
+  %finished = icmp eq i64 %i.next, %length
+  br i1 %finished, label %exit, label %loop
+
+exit:
+  call i32 (i8*, ...) @printf(i8* getelementptr ([2 x i8], [2 x i8]* @newline, i64 0, i64 0))
+  ret void
+}
+
+define i1 @matches(i8* %input, i8* %prefix) noinline {
+  %byte = load i8, i8* %input
+  %prefix_byte = load i8, i8* %prefix
+  %expected = add i8 %prefix_byte, 35
+  %match = icmp eq i8 %byte, %expected
+  ret i1 %match
+}
+
+define i32 @main() {
+entry:
+  call void @symcc_set_test_case_handler(void (i8*, i64)* @print_test_case)
+  %prefix = alloca i8
+  %input = alloca i8
+  store i8 7, i8* %prefix
+  call void @symcc_make_symbolic(i8* %prefix, i64 1)
+  %prefix_byte = load i8, i8* %prefix
+  %seven = icmp eq i8 %prefix_byte, 7
+  br i1 %seven, label %start, label %error
+
+start:
+  ; The solver negates the prefix check first.
+  ; ANY: test case: {{[0-9a-f][0-9a-f]$}}
+  call void @symcc_snapshot()
+  br label %loop
+
+loop:
+  %i = phi i8 [ 0, %start ], [ %i.next, %next ]
+  %value = add i8 %i, 1
+  store i8 %value, i8* %input
+  call void @symcc_make_symbolic(i8* %input, i64 1)
+  %match = call i1 @matches(i8* %input, i8* %prefix)
+  br i1 %match, label %found, label %next
+
+found:
+  br label %next
+
+next:
+  call void @symcc_restore()
+  %i.next = add i8 %i, 1
+  %finished = icmp eq i8 %i.next, 3
+  br i1 %finished, label %exit, label %loop
+
+exit:
+  ; ANY-COUNT-3: test case: 07 2a{{$}}
+  ; ANY-NOT: test case
+  ret i32 0
+
+error:
+  ret i32 1
+}
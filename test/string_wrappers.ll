@@ -0,0 +1,89 @@
+; This file is part of SymCC.
+;
+; SymCC is free software: you can redistribute it and/or modify it under the
+; terms of the GNU General Public License as published by the Free Software
+; Foundation, either version 3 of the License, or (at your option) any later
+; version.
+;
+; SymCC is distributed in the hope that it will be useful, but WITHOUT ANY
+; WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+; A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+;
+; You should have received a copy of the GNU General Public License along with
+; SymCC. If not, see <https://www.gnu.org/licenses/>.
+
+; Test the symbolic versions of strcmp, memchr, strlen and strstr on a symbolic
+; buffer. Each call should result in a single solver query, no matter how many
+; bytes the function examines. We print a marker before each call to tell the
+; queries apart. (The test is written in bitcode so that the compiler doesn't
+; replace the calls with builtins.)
+;
+; Since the bitcode is written by hand, we first run llc on it because it
+; performs a validity check, whereas Clang doesn't.
+;
+; RUN: llc %s -o /dev/null
+; RUN: %symcc %s -o %t
+; RUN: echo -n test | %t 2>&1 | %filecheck %s
+
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-pc-linux-gnu"
+
+@buffer = global [5 x i8] zeroinitializer
+@tesu = constant [5 x i8] c"tesu\00"
+@es = constant [3 x i8] c"es\00"
+@strcmp_marker = constant [8 x i8] c"strcmp\0A\00"
+@memchr_marker = constant [8 x i8] c"memchr\0A\00"
+@strlen_marker = constant [8 x i8] c"strlen\0A\00"
+@strstr_marker = constant [8 x i8] c"strstr\0A\00"
+@done_marker = constant [6 x i8] c"done\0A\00"
+
+declare i64 @read(i32, i8*, i64)
+declare i64 @write(i32, i8*, i64)
+declare i32 @strcmp(i8*, i8*)
+declare i8* @memchr(i8*, i32, i64)
+declare i64 @strlen(i8*)
+declare i8* @strstr(i8*, i8*)
+
+define i32 @main(i32 %argc, i8** %argv) {
+entry:
+  %input = getelementptr [5 x i8], [5 x i8]* @buffer, i64 0, i64 0
+  %count = call i64 @read(i32 0, i8* %input, i64 4)
+
+  ; The comparison result is an expression over the input, so the branch asks
+  ; the solver for the only input that makes the strings equal.
+  call i64 @write(i32 2, i8* getelementptr ([8 x i8], [8 x i8]* @strcmp_marker, i64 0, i64 0), i64 7)
+  %cmp = call i32 @strcmp(i8* %input, i8* getelementptr ([5 x i8], [5 x i8]* @tesu, i64 0, i64 0))
+  %equal = icmp eq i32 %cmp, 0
+  ; SIMPLE: strcmp
+  ; SIMPLE: Trying to solve
+  ; SIMPLE: Found diverging input
+  ; SIMPLE: stdin3 -> #x75
+  br i1 %equal, label %exit, label %search
+
+search:
+  call i64 @write(i32 2, i8* getelementptr ([8 x i8], [8 x i8]* @memchr_marker, i64 0, i64 0), i64 7)
+  %x = call i8* @memchr(i8* %input, i32 120, i64 4)
+  ; SIMPLE: memchr
+  ; SIMPLE: Trying to solve
+  ; SIMPLE: Found diverging input
+  ; SIMPLE-NOT: Trying to solve
+  ; SIMPLE: strlen
+  call i64 @write(i32 2, i8* getelementptr ([8 x i8], [8 x i8]* @strlen_marker, i64 0, i64 0), i64 7)
+  %length = call i64 @strlen(i8* %input)
+  ; SIMPLE: Trying to solve
+  ; SIMPLE: Found diverging input
+  ; SIMPLE: -> #x00
+  ; SIMPLE-NOT: Trying to solve
+  ; SIMPLE: strstr
+  call i64 @write(i32 2, i8* getelementptr ([8 x i8], [8 x i8]* @strstr_marker, i64 0, i64 0), i64 7)
+  %es = call i8* @strstr(i8* %input, i8* getelementptr ([3 x i8], [3 x i8]* @es, i64 0, i64 0))
+  ; SIMPLE: Trying to solve
+  ; SIMPLE: Found diverging input
+  ; SIMPLE-NOT: Trying to solve
+  ; SIMPLE: done
+  call i64 @write(i32 2, i8* getelementptr ([6 x i8], [6 x i8]* @done_marker, i64 0, i64 0), i64 5)
+  br label %exit
+
+exit:
+  ret i32 0
+}
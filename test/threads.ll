@@ -0,0 +1,107 @@
+; This file is part of SymCC.
+;
+; SymCC is free software: you can redistribute it and/or modify it under the
+; terms of the GNU General Public License as published by the Free Software
+; Foundation, either version 3 of the License, or (at your option) any later
+; version.
+;
+; SymCC is distributed in the hope that it will be useful, but WITHOUT ANY
+; WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+; A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+;
+; You should have received a copy of the GNU General Public License along with
+; SymCC. If not, see <https://www.gnu.org/licenses/>.
+
+; Verify that threads don't interfere with each other's symbolic state. Two
+; threads each take one input byte and pass it through an instrumented identity
+; function many times, so that they keep writing to the parameter and return
+; slots concurrently, before comparing the result with a constant. If the slots
+; were shared between threads, one thread would sooner or later pick up the
+; expression of the other thread's byte (or none at all), and the solver would
+; change the wrong byte. Instead, each thread must find its own value.
+;
+; Since the bitcode is written by hand, we first run llc on it because it
+; performs a validity check, whereas Clang doesn't.
+
+; RUN: llc %s -o /dev/null
+; RUN: %symcc %s -o %t -lpthread
+; RUN: echo -ne "\x00\x00" | %t 2>&1 | %filecheck --implicit-check-not="stdin0 -> #x22" --implicit-check-not="stdin1 -> #x11" %s
+
+target triple = "x86_64-pc-linux-gnu"
+
+@done = private constant [5 x i8] c"done\00"
+
+declare i64 @read(i32, i8*, i64)
+declare i32 @puts(i8*)
+declare i32 @pthread_create(i64*, i8*, i8* (i8*)*, i8*)
+declare i32 @pthread_join(i64, i8**)
+
+define i8 @identity(i8 %x) noinline {
+  ret i8 %x
+}
+
+; Pass the byte at %p through @identity, then branch on whether it's equal to
+; %target.
+define void @run(i8* %p, i8 %target) noinline {
+entry:
+  %byte = load i8, i8* %p
+  br label %loop
+
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %loop ]
+  %value = phi i8 [ %byte, %entry ], [ %value.next, %loop ]
+  %value.next = call i8 @identity(i8 %value)
+  %i.next = add i32 %i, 1
+  %finished = icmp eq i32 %i.next, 10000
+  br i1 %finished, label %check, label %loop
+
+check:
+  %equal = icmp eq i8 %value.next, %target
+  br i1 %equal, label %found, label %exit
+
+found:
+  br label %exit
+
+exit:
+  ret void
+}
+
+define i8* @first_thread(i8* %p) {
+  call void @run(i8* %p, i8 17)
+  ret i8* null
+}
+
+define i8* @second_thread(i8* %p) {
+  call void @run(i8* %p, i8 34)
+  ret i8* null
+}
+
+define i32 @main() {
+  %input = alloca [2 x i8]
+  %first_byte = getelementptr [2 x i8], [2 x i8]* %input, i64 0, i64 0
+  %second_byte = getelementptr [2 x i8], [2 x i8]* %input, i64 0, i64 1
+  %bytes_read = call i64 @read(i32 0, i8* %first_byte, i64 2)
+  %complete = icmp eq i64 %bytes_read, 2
+  br i1 %complete, label %start, label %error
+
+start:
+  %first = alloca i64
+  %second = alloca i64
+  call i32 @pthread_create(i64* %first, i8* null, i8* (i8*)* @first_thread,
+                           i8* %first_byte)
+  call i32 @pthread_create(i64* %second, i8* null, i8* (i8*)* @second_thread,
+                           i8* %second_byte)
+  %first_id = load i64, i64* %first
+  %second_id = load i64, i64* %second
+  call i32 @pthread_join(i64 %first_id, i8** null)
+  call i32 @pthread_join(i64 %second_id, i8** null)
+
+  ; SIMPLE-DAG: stdin0 -> #x11
+  ; SIMPLE-DAG: stdin1 -> #x22
+  ; ANY: done
+  call i32 @puts(i8* getelementptr ([5 x i8], [5 x i8]* @done, i64 0, i64 0))
+  ret i32 0
+
+error:
+  ret i32 1
+}
@@ -0,0 +1,126 @@
+; This file is part of SymCC.
+;
+; SymCC is free software: you can redistribute it and/or modify it under the
+; terms of the GNU General Public License as published by the Free Software
+; Foundation, either version 3 of the License, or (at your option) any later
+; version.
+;
+; SymCC is distributed in the hope that it will be useful, but WITHOUT ANY
+; WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+; A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+;
+; You should have received a copy of the GNU General Public License along with
+; SymCC. If not, see <https://www.gnu.org/licenses/>.
+
+; Test the symbolic handling of vector instructions, as emitted by the
+; vectorizers. We read the input as a single vector and print a marker before
+; each check to tell the queries apart. (The test is written in bitcode because
+; C offers no portable way to generate these instructions.)
+;
+; RUN: llc %s -o /dev/null
+; RUN: %symcc %s -o %t
+; RUN: echo -n test | %t 2>&1 | %filecheck %s
+; RUN: %symcc -O3 %s -o %t_opt
+; RUN: echo -n test | %t_opt 2>&1 | %filecheck %s
+
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-pc-linux-gnu"
+
+@buffer = global [4 x i8] zeroinitializer, align 4
+@shuffle_marker = constant [9 x i8] c"shuffle\0A\00"
+@insert_marker = constant [8 x i8] c"insert\0A\00"
+@compare_marker = constant [9 x i8] c"compare\0A\00"
+@reduce_marker = constant [8 x i8] c"reduce\0A\00"
+@select_marker = constant [8 x i8] c"select\0A\00"
+@float_marker = constant [7 x i8] c"float\0A\00"
+@done_marker = constant [6 x i8] c"done\0A\00"
+
+declare i64 @read(i32, i8*, i64)
+declare i64 @write(i32, i8*, i64)
+declare i8 @llvm.vector.reduce.add.v4i8(<4 x i8>)
+
+define i32 @main(i32 %argc, i8** %argv) {
+entry:
+  %input = getelementptr [4 x i8], [4 x i8]* @buffer, i64 0, i64 0
+  %count = call i64 @read(i32 0, i8* %input, i64 4)
+  %vector_pointer = bitcast i8* %input to <4 x i8>*
+  %v = load <4 x i8>, <4 x i8>* %vector_pointer
+
+  ; Element 0 of the reversed vector is the last input byte plus 4.
+  call i64 @write(i32 2, i8* getelementptr ([9 x i8], [9 x i8]* @shuffle_marker, i64 0, i64 0), i64 8)
+  %w = add <4 x i8> %v, <i8 1, i8 2, i8 3, i8 4>
+  %reversed = shufflevector <4 x i8> %w, <4 x i8> undef, <4 x i32> <i32 3, i32 2, i32 1, i32 0>
+  %first = extractelement <4 x i8> %reversed, i32 0
+  %is_z = icmp eq i8 %first, 122
+  ; ANY: shuffle
+  ; SIMPLE: Trying to solve
+  ; SIMPLE: Found diverging input
+  ; SIMPLE: stdin3 -> #x76
+  br i1 %is_z, label %exit, label %insert
+
+  ; Copy the first byte into the third and compare all bytes with "tete".
+insert:
+  call i64 @write(i32 2, i8* getelementptr ([8 x i8], [8 x i8]* @insert_marker, i64 0, i64 0), i64 7)
+  %b0 = extractelement <4 x i8> %v, i32 0
+  %inserted = insertelement <4 x i8> %v, i8 %b0, i32 2
+  %as_int = bitcast <4 x i8> %inserted to i32
+  %is_tete = icmp eq i32 %as_int, 1702126964
+  ; ANY: insert
+  ; SIMPLE: Trying to solve
+  ; SIMPLE: Found diverging input
+  ; SIMPLE-DAG: stdin1 -> #x65
+  ; SIMPLE-DAG: stdin3 -> #x65
+  br i1 %is_tete, label %exit, label %compare
+
+  ; The comparison yields one bit per element; "test" sets bits 0 and 3.
+compare:
+  call i64 @write(i32 2, i8* getelementptr ([9 x i8], [9 x i8]* @compare_marker, i64 0, i64 0), i64 8)
+  %above = icmp ugt <4 x i8> %v, <i8 115, i8 115, i8 115, i8 115>
+  %lanes = bitcast <4 x i1> %above to i4
+  %pattern = icmp eq i4 %lanes, 9
+  ; ANY: compare
+  ; SIMPLE: Trying to solve
+  ; SIMPLE: Found diverging input
+  br i1 %pattern, label %reduce, label %exit
+
+reduce:
+  call i64 @write(i32 2, i8* getelementptr ([8 x i8], [8 x i8]* @reduce_marker, i64 0, i64 0), i64 7)
+  %sum = call i8 @llvm.vector.reduce.add.v4i8(<4 x i8> %v)
+  %is_zero = icmp eq i8 %sum, 0
+  ; ANY: reduce
+  ; SIMPLE: Trying to solve
+  ; SIMPLE: Found diverging input
+  br i1 %is_zero, label %exit, label %select
+
+  ; Keep the elements above "s" and pick one with a concrete index.
+select:
+  call i64 @write(i32 2, i8* getelementptr ([8 x i8], [8 x i8]* @select_marker, i64 0, i64 0), i64 7)
+  %kept = select <4 x i1> %above, <4 x i8> %v, <4 x i8> zeroinitializer
+  %index = and i64 %count, 3
+  %picked = extractelement <4 x i8> %kept, i64 %index
+  %is_x = icmp eq i8 %picked, 120
+  ; ANY: select
+  ; SIMPLE: Trying to solve
+  ; SIMPLE: Found diverging input
+  ; SIMPLE: stdin0 -> #x78
+  br i1 %is_x, label %exit, label %float
+
+float:
+  call i64 @write(i32 2, i8* getelementptr ([7 x i8], [7 x i8]* @float_marker, i64 0, i64 0), i64 6)
+  %f = uitofp <4 x i8> %v to <4 x float>
+  %g = fmul <4 x float> %f, <float 2.0, float 2.0, float 2.0, float 2.0>
+  %h = extractelement <4 x float> %g, i32 1
+  %big = fcmp ogt float %h, 220.0
+  ; ANY: float
+  ; SIMPLE: Trying to solve
+  ; SIMPLE: Found diverging input
+  br i1 %big, label %exit, label %done
+
+done:
+  ; ANY: done
+  call i64 @write(i32 2, i8* getelementptr ([6 x i8], [6 x i8]* @done_marker, i64 0, i64 0), i64 5)
+  br label %exit
+
+exit:
+  ret i32 0
+}
@@ -0,0 +1,225 @@
+#!/usr/bin/env python3
+
+# This file is part of SymCC.
+#
+# SymCC is free software: you can redistribute it and/or modify it under the
+# terms of the GNU General Public License as published by the Free Software
+# Foundation, either version 3 of the License, or (at your option) any later
+# version.
+#
+# SymCC is distributed in the hope that it will be useful, but WITHOUT ANY
+# WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+# A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License along with
+# SymCC. If not, see <https://www.gnu.org/licenses/>.
+
+"""End-to-end throughput benchmark for SymCC.
+
+Compile the targets in the "targets" directory with symcc, then explore each of
+them from a fixed seed with the same generational loop as
+util/pure_concolic_execution.sh, within a fixed time budget. For every target,
+report the wall time, the time spent in the solver, the peak RSS of the target
+processes, and how quickly new coverage was found.
+
+The runtime provides the numbers (see SYMCC_STATS and SYMCC_AFL_COVERAGE_MAP in
+docs/Configuration.txt), so the benchmark works with either backend; run it
+once per build directory to compare them. Results can be appended to a
+tab-separated file to track them across commits.
+"""
+
+import argparse
+import hashlib
+import json
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+import zlib
+from pathlib import Path
+
+
+TARGETS_DIR = Path(__file__).resolve().parent / "targets"
+
+
+def png_chunk(kind, data):
+    body = kind + data
+    return (len(data).to_bytes(4, "big") + body +
+            zlib.crc32(body).to_bytes(4, "big"))
+
+
+def png_seed():
+    header = ((4).to_bytes(4, "big") + (4).to_bytes(4, "big") +
+              bytes([8, 2, 0, 0, 0]))
+    return (b"\x89PNG\r\n\x1a\n" + png_chunk(b"IHDR", header) +
+            png_chunk(b"tEXt", b"Title\x00seed") +
+            png_chunk(b"IDAT", zlib.compress(bytes(4 * (1 + 4 * 3)))) +
+            png_chunk(b"IEND", b""))
+
+
+# The targets with their seeds. The seeds are valid inputs, so that the first
+# execution reaches the interesting parts of each program.
+SEEDS = {
+    "json": b'{"name": "SymCC", "tags": ["fast", true, null], "version": 1.5}',
+    "png": png_seed(),
+    "http": (b"POST /submit HTTP/1.1\r\nHost: example.com\r\n"
+             b"Content-Length: 5\r\nConnection: close\r\n\r\nhello"),
+}
+
+
+def compile_target(symcc, name, out_dir):
+    binary = out_dir / name
+    subprocess.run([str(symcc), "-O2", "-o", str(binary),
+                    str(TARGETS_DIR / (name + ".c"))], check=True)
+    return binary
+
+
+def coverage(map_file):
+    """Count the set bits in the runtime's coverage map."""
+    try:
+        data = map_file.read_bytes()
+    except FileNotFoundError:
+        return 0
+    return sum(bin(byte).count("1") for byte in data)
+
+
+class Run:
+    """The state of the exploration of one target."""
+
+    def __init__(self, binary, work_dir, timeout):
+        self.binary = binary
+        self.work_dir = work_dir
+        self.timeout = timeout
+        self.map_file = work_dir / "coverage_map"
+        self.stats_file = work_dir / "stats.json"
+        self.seen = set()
+        self.executions = 0
+        self.solver_time = 0.0
+        self.peak_rss_kb = 0
+        self.backend = "simple"
+
+    def is_new(self, data):
+        digest = hashlib.sha256(data).digest()
+        if digest in self.seen:
+            return False
+        self.seen.add(digest)
+        return True
+
+    def execute(self, data):
+        """Run the target on the input and return the generated test cases."""
+        output_dir = self.work_dir / "output"
+        shutil.rmtree(output_dir, ignore_errors=True)
+        output_dir.mkdir()
+
+        env = dict(os.environ,
+                   SYMCC_OUTPUT_DIR=str(output_dir),
+                   SYMCC_AFL_COVERAGE_MAP=str(self.map_file),
+                   SYMCC_STATS=str(self.stats_file))
+        try:
+            result = subprocess.run([str(self.binary)], input=data, env=env,
+                                    stdout=subprocess.DEVNULL,
+                                    stderr=subprocess.PIPE,
+                                    timeout=self.timeout)
+            if b"[STAT] SMT:" in result.stderr:
+                self.backend = "qsym"
+        except subprocess.TimeoutExpired:
+            pass
+
+        self.executions += 1
+        try:
+            stats = json.loads(self.stats_file.read_text())
+            self.solver_time += stats["solver"]["time_us"] / 1e6
+            self.peak_rss_kb = max(self.peak_rss_kb,
+                                   stats["process"]["peak_rss_kb"])
+        except (FileNotFoundError, ValueError, KeyError):
+            # The target was killed before it could write its statistics.
+            pass
+        finally:
+            if self.stats_file.exists():
+                self.stats_file.unlink()
+
+        return [path.read_bytes() for path in sorted(output_dir.iterdir())]
+
+
+def explore(binary, seed, budget, work_dir, timeout):
+    """Explore the target generation by generation until the budget is spent.
+
+    Return the run and the coverage after the seed and at the end."""
+    run = Run(binary, work_dir, timeout)
+    start = time.monotonic()
+    run.is_new(seed)
+    generation = run.execute(seed)
+    seed_coverage = coverage(run.map_file)
+
+    while generation and time.monotonic() - start < budget:
+        next_generation = []
+        for data in generation:
+            if time.monotonic() - start >= budget:
+                break
+            if run.is_new(data):
+                next_generation.extend(run.execute(data))
+        generation = next_generation
+
+    run.wall_time = time.monotonic() - start
+    return run, seed_coverage, coverage(run.map_file)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("build_dir", type=Path,
+                        help="the SymCC build directory containing symcc")
+    parser.add_argument("--budget", type=float, default=60,
+                        help="seconds to spend on each target (default: 60)")
+    parser.add_argument("--timeout", type=float, default=90,
+                        help="seconds after which to kill a single execution "
+                        "(default: 90)")
+    parser.add_argument("--targets", nargs="+", choices=sorted(SEEDS),
+                        default=sorted(SEEDS), help="the targets to run")
+    parser.add_argument("--results", type=Path,
+                        help="append the results to this tab-separated file")
+    args = parser.parse_args()
+
+    symcc = args.build_dir / "symcc"
+    if not symcc.exists():
+        sys.exit(f"{symcc} doesn't exist; is {args.build_dir} a SymCC build?")
+
+    columns = ["target", "backend", "wall_s", "solver_s", "peak_rss_kb",
+               "executions", "tests", "coverage", "new_coverage_per_s"]
+    rows = []
+    with tempfile.TemporaryDirectory(prefix="symcc-benchmark-") as tmp:
+        tmp = Path(tmp)
+        for name in args.targets:
+            binary = compile_target(symcc, name, tmp)
+            work_dir = tmp / (name + "-run")
+            work_dir.mkdir()
+            run, seed_coverage, final_coverage = explore(
+                binary, SEEDS[name], args.budget, work_dir, args.timeout)
+            new_coverage = final_coverage - seed_coverage
+            rows.append([
+                name, run.backend, f"{run.wall_time:.2f}",
+                f"{run.solver_time:.2f}", str(run.peak_rss_kb),
+                str(run.executions), str(len(run.seen) - 1),
+                str(final_coverage),
+                f"{new_coverage / max(run.wall_time, 1e-3):.2f}"
+            ])
+
+    widths = [max(len(row[i]) for row in [columns] + rows)
+              for i in range(len(columns))]
+    for row in [columns] + rows:
+        print("  ".join(cell.ljust(width)
+                        for cell, width in zip(row, widths)).rstrip())
+
+    if args.results is not None:
+        write_header = not args.results.exists()
+        with args.results.open("a") as out:
+            if write_header:
+                print("\t".join(["date"] + columns), file=out)
+            date = time.strftime("%Y-%m-%dT%H:%M:%S")
+            for row in rows:
+                print("\t".join([date] + row), file=out)
+
+
+if __name__ == "__main__":
+    main()
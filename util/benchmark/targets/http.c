@@ -0,0 +1,174 @@
+// This file is part of SymCC.
+//
+// SymCC is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// SymCC is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+// A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// SymCC. If not, see <https://www.gnu.org/licenses/>.
+
+// A parser for HTTP/1.x requests, as an example of a line-based text protocol:
+// it reads a request from standard input, checks the request line and the
+// headers, and prints how it would dispatch the request.
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+#define MAX_INPUT 4096
+#define MAX_HEADERS 16
+
+static char input[MAX_INPUT + 1];
+static size_t length;
+
+static const char *methods[] = {"GET",    "HEAD",    "POST",  "PUT",
+                                "DELETE", "OPTIONS", "TRACE", "PATCH"};
+
+struct request {
+  int method;
+  char *target;
+  int minor_version;
+  const char *host;
+  long content_length;
+  int chunked;
+  int keep_alive;
+};
+
+/// Return the next line, without its CRLF, or null if there is none.
+static char *next_line(size_t *pos) {
+  char *start = input + *pos;
+  char *end = strstr(start, "\r\n");
+  if (end == NULL)
+    return NULL;
+  *end = '\0';
+  *pos = end + 2 - input;
+  return start;
+}
+
+static int parse_request_line(struct request *r, char *line) {
+  char *space = strchr(line, ' ');
+  if (space == NULL)
+    return 0;
+  *space = '\0';
+
+  r->method = -1;
+  for (size_t i = 0; i < sizeof(methods) / sizeof(methods[0]); i++) {
+    if (strcmp(line, methods[i]) == 0)
+      r->method = (int)i;
+  }
+  if (r->method < 0)
+    return 0;
+
+  r->target = space + 1;
+  space = strchr(r->target, ' ');
+  if (space == NULL || space == r->target)
+    return 0;
+  *space = '\0';
+  if (r->target[0] != '/' && strcmp(r->target, "*") != 0)
+    return 0;
+
+  const char *version = space + 1;
+  if (strncmp(version, "HTTP/1.", 7) != 0 || !isdigit(version[7]) ||
+      version[8] != '\0')
+    return 0;
+  r->minor_version = version[7] - '0';
+  r->keep_alive = r->minor_version >= 1;
+  return 1;
+}
+
+static int parse_header(struct request *r, char *line) {
+  char *colon = strchr(line, ':');
+  if (colon == NULL || colon == line)
+    return 0;
+  *colon = '\0';
+
+  for (char *c = line; *c; c++) {
+    if (!isalnum((unsigned char)*c) && *c != '-')
+      return 0;
+  }
+
+  char *value = colon + 1;
+  while (*value == ' ' || *value == '\t')
+    value++;
+
+  if (strcasecmp(line, "Host") == 0) {
+    if (r->host != NULL || *value == '\0')
+      return 0;
+    r->host = value;
+  } else if (strcasecmp(line, "Content-Length") == 0) {
+    char *end;
+    r->content_length = strtol(value, &end, 10);
+    if (end == value || *end != '\0' || r->content_length < 0)
+      return 0;
+  } else if (strcasecmp(line, "Transfer-Encoding") == 0) {
+    if (strcasecmp(value, "chunked") != 0)
+      return 0;
+    r->chunked = 1;
+  } else if (strcasecmp(line, "Connection") == 0) {
+    if (strcasecmp(value, "close") == 0)
+      r->keep_alive = 0;
+    else if (strcasecmp(value, "keep-alive") == 0)
+      r->keep_alive = 1;
+    else
+      return 0;
+  }
+
+  return 1;
+}
+
+int main(void) {
+  ssize_t n = read(STDIN_FILENO, input, MAX_INPUT);
+  if (n < 0)
+    return 1;
+  length = (size_t)n;
+  input[length] = '\0';
+
+  size_t pos = 0;
+  struct request r = {0};
+  char *line = next_line(&pos);
+  if (line == NULL || !parse_request_line(&r, line)) {
+    printf("400 bad request line\n");
+    return 1;
+  }
+
+  unsigned headers = 0;
+  while ((line = next_line(&pos)) != NULL && *line != '\0') {
+    if (++headers > MAX_HEADERS || !parse_header(&r, line)) {
+      printf("400 bad header\n");
+      return 1;
+    }
+  }
+  if (line == NULL) {
+    printf("400 incomplete headers\n");
+    return 1;
+  }
+
+  if (r.minor_version >= 1 && r.host == NULL) {
+    printf("400 missing host\n");
+    return 1;
+  }
+  if (r.chunked && r.content_length > 0) {
+    printf("400 conflicting lengths\n");
+    return 1;
+  }
+  if ((size_t)r.content_length > length - pos) {
+    printf("400 truncated body\n");
+    return 1;
+  }
+  if (r.content_length > 0 && (r.method == 0 || r.method == 1)) {
+    printf("400 unexpected body\n");
+    return 1;
+  }
+
+  printf("200 %s %s (%ld bytes, %s)\n", methods[r.method], r.target,
+         r.content_length, r.keep_alive ? "keep-alive" : "close");
+  return 0;
+}
@@ -0,0 +1,206 @@
+// This file is part of SymCC.
+//
+// SymCC is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// SymCC is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+// A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// SymCC. If not, see <https://www.gnu.org/licenses/>.
+
+// A recursive-descent JSON parser that reads a document from standard input
+// and prints a summary of its structure.
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define MAX_INPUT 4096
+#define MAX_DEPTH 32
+
+static char input[MAX_INPUT];
+static size_t length, pos;
+
+static unsigned objects, arrays, strings, numbers, literals;
+
+static int parse_value(int depth);
+
+static void skip_whitespace(void) {
+  while (pos < length && isspace((unsigned char)input[pos]))
+    pos++;
+}
+
+static int expect(char c) {
+  skip_whitespace();
+  if (pos < length && input[pos] == c) {
+    pos++;
+    return 1;
+  }
+  return 0;
+}
+
+static int parse_literal(const char *word) {
+  size_t n = strlen(word);
+  if (length - pos < n || memcmp(input + pos, word, n) != 0)
+    return 0;
+  pos += n;
+  literals++;
+  return 1;
+}
+
+static int parse_string(void) {
+  if (!expect('"'))
+    return 0;
+
+  while (pos < length) {
+    char c = input[pos++];
+    if (c == '"') {
+      strings++;
+      return 1;
+    }
+    if ((unsigned char)c < 0x20)
+      return 0;
+    if (c != '\\')
+      continue;
+
+    if (pos == length)
+      return 0;
+    switch (input[pos++]) {
+    case '"':
+    case '\\':
+    case '/':
+    case 'b':
+    case 'f':
+    case 'n':
+    case 'r':
+    case 't':
+      break;
+    case 'u':
+      for (int i = 0; i < 4; i++) {
+        if (pos == length || !isxdigit((unsigned char)input[pos++]))
+          return 0;
+      }
+      break;
+    default:
+      return 0;
+    }
+  }
+
+  return 0;
+}
+
+static int parse_digits(void) {
+  size_t start = pos;
+  while (pos < length && isdigit((unsigned char)input[pos]))
+    pos++;
+  return pos > start;
+}
+
+static int parse_number(void) {
+  if (pos < length && input[pos] == '-')
+    pos++;
+  if (pos < length && input[pos] == '0')
+    pos++;
+  else if (!parse_digits())
+    return 0;
+
+  if (pos < length && input[pos] == '.') {
+    pos++;
+    if (!parse_digits())
+      return 0;
+  }
+
+  if (pos < length && (input[pos] == 'e' || input[pos] == 'E')) {
+    pos++;
+    if (pos < length && (input[pos] == '+' || input[pos] == '-'))
+      pos++;
+    if (!parse_digits())
+      return 0;
+  }
+
+  numbers++;
+  return 1;
+}
+
+static int parse_object(int depth) {
+  objects++;
+  if (expect('}'))
+    return 1;
+
+  do {
+    skip_whitespace();
+    if (!parse_string() || !expect(':') || !parse_value(depth + 1))
+      return 0;
+  } while (expect(','));
+
+  return expect('}');
+}
+
+static int parse_array(int depth) {
+  arrays++;
+  if (expect(']'))
+    return 1;
+
+  do {
+    if (!parse_value(depth + 1))
+      return 0;
+  } while (expect(','));
+
+  return expect(']');
+}
+
+static int parse_value(int depth) {
+  if (depth > MAX_DEPTH)
+    return 0;
+
+  skip_whitespace();
+  if (pos == length)
+    return 0;
+
+  switch (input[pos]) {
+  case '{':
+    pos++;
+    return parse_object(depth);
+  case '[':
+    pos++;
+    return parse_array(depth);
+  case '"':
+    return parse_string();
+  case 't':
+    return parse_literal("true");
+  case 'f':
+    return parse_literal("false");
+  case 'n':
+    return parse_literal("null");
+  default:
+    return parse_number();
+  }
+}
+
+int main(void) {
+  ssize_t n = read(STDIN_FILENO, input, sizeof(input));
+  if (n < 0)
+    return 1;
+  length = (size_t)n;
+
+  if (!parse_value(0)) {
+    printf("syntax error at offset %zu\n", pos);
+    return 1;
+  }
+
+  skip_whitespace();
+  if (pos != length) {
+    printf("trailing data at offset %zu\n", pos);
+    return 1;
+  }
+
+  printf("%u objects, %u arrays, %u strings, %u numbers, %u literals\n",
+         objects, arrays, strings, numbers, literals);
+  return 0;
+}
@@ -0,0 +1,185 @@
+// This file is part of SymCC.
+//
+// SymCC is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// SymCC is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+// A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// SymCC. If not, see <https://www.gnu.org/licenses/>.
+
+// A decoder for the chunk structure of PNG images, in the style of libpng: it
+// reads an image from standard input, verifies the signature and the checksum
+// of every chunk, and validates the header, the palette and text chunks. The
+// image data itself isn't decompressed.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define MAX_INPUT 4096
+
+static uint8_t input[MAX_INPUT];
+static size_t length;
+
+static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a,
+                                     '\n'};
+
+static uint32_t crc_table[256];
+
+static void make_crc_table(void) {
+  for (uint32_t n = 0; n < 256; n++) {
+    uint32_t c = n;
+    for (int k = 0; k < 8; k++)
+      c = (c & 1) ? (0xedb88320u ^ (c >> 1)) : (c >> 1);
+    crc_table[n] = c;
+  }
+}
+
+static uint32_t crc(const uint8_t *data, size_t n) {
+  uint32_t c = 0xffffffffu;
+  for (size_t i = 0; i < n; i++)
+    c = crc_table[(c ^ data[i]) & 0xff] ^ (c >> 8);
+  return c ^ 0xffffffffu;
+}
+
+static uint32_t read_u32(const uint8_t *p) {
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+         ((uint32_t)p[2] << 8) | p[3];
+}
+
+struct header {
+  uint32_t width, height;
+  uint8_t bit_depth, color_type;
+  int seen;
+};
+
+static int check_header(struct header *h, const uint8_t *data, uint32_t n) {
+  if (h->seen || n != 13)
+    return 0;
+
+  h->width = read_u32(data);
+  h->height = read_u32(data + 4);
+  h->bit_depth = data[8];
+  h->color_type = data[9];
+  h->seen = 1;
+  if (h->width == 0 || h->height == 0 || h->width > (1u << 24) ||
+      h->height > (1u << 24))
+    return 0;
+
+  // Compression, filter and interlace method.
+  if (data[10] != 0 || data[11] != 0 || data[12] > 1)
+    return 0;
+
+  switch (h->color_type) {
+  case 0: // grayscale
+    return h->bit_depth == 1 || h->bit_depth == 2 || h->bit_depth == 4 ||
+           h->bit_depth == 8 || h->bit_depth == 16;
+  case 3: // palette
+    return h->bit_depth == 1 || h->bit_depth == 2 || h->bit_depth == 4 ||
+           h->bit_depth == 8;
+  case 2: // RGB
+  case 4: // grayscale with alpha
+  case 6: // RGBA
+    return h->bit_depth == 8 || h->bit_depth == 16;
+  default:
+    return 0;
+  }
+}
+
+static int check_text(const uint8_t *data, uint32_t n) {
+  // A keyword of 1-79 Latin-1 characters, a null separator, and the text.
+  uint32_t i = 0;
+  while (i < n && data[i] != 0) {
+    if (data[i] < 32 || (data[i] > 126 && data[i] < 161))
+      return 0;
+    i++;
+  }
+  return i > 0 && i < 80 && i < n;
+}
+
+int main(void) {
+  ssize_t n = read(STDIN_FILENO, input, sizeof(input));
+  if (n < 0)
+    return 1;
+  length = (size_t)n;
+
+  if (length < sizeof(signature) ||
+      memcmp(input, signature, sizeof(signature)) != 0) {
+    printf("not a PNG image\n");
+    return 1;
+  }
+
+  make_crc_table();
+  struct header h = {0};
+  unsigned chunks = 0, data_chunks = 0, palette_entries = 0;
+  size_t pos = sizeof(signature);
+  while (length - pos >= 12) {
+    uint32_t chunk_length = read_u32(input + pos);
+    const uint8_t *type = input + pos + 4;
+    const uint8_t *data = type + 4;
+    if (chunk_length > length - pos - 12) {
+      printf("chunk %u is truncated\n", chunks);
+      return 1;
+    }
+
+    if (crc(type, chunk_length + 4) != read_u32(data + chunk_length)) {
+      printf("bad checksum in chunk %u\n", chunks);
+      return 1;
+    }
+
+    // The header must come first.
+    if (chunks == 0 && memcmp(type, "IHDR", 4) != 0) {
+      printf("missing header\n");
+      return 1;
+    }
+
+    if (memcmp(type, "IHDR", 4) == 0) {
+      if (!check_header(&h, data, chunk_length)) {
+        printf("invalid header\n");
+        return 1;
+      }
+    } else if (memcmp(type, "PLTE", 4) == 0) {
+      if (chunk_length % 3 != 0 || chunk_length / 3 > 256 ||
+          h.color_type == 0 || h.color_type == 4) {
+        printf("invalid palette\n");
+        return 1;
+      }
+      palette_entries = chunk_length / 3;
+    } else if (memcmp(type, "IDAT", 4) == 0) {
+      if (h.color_type == 3 && palette_entries == 0) {
+        printf("image data before the palette\n");
+        return 1;
+      }
+      data_chunks++;
+    } else if (memcmp(type, "tEXt", 4) == 0) {
+      if (!check_text(data, chunk_length)) {
+        printf("invalid text\n");
+        return 1;
+      }
+    } else if (memcmp(type, "IEND", 4) == 0) {
+      if (data_chunks == 0) {
+        printf("no image data\n");
+        return 1;
+      }
+      printf("%ux%u image, depth %u, color type %u, %u chunks\n", h.width,
+             h.height, h.bit_depth, h.color_type, chunks + 1);
+      return 0;
+    } else if (!(type[0] & 0x20)) {
+      // Unknown critical chunk.
+      printf("unsupported chunk %.4s\n", (const char *)type);
+      return 1;
+    }
+
+    chunks++;
+    pos += 12 + chunk_length;
+  }
+
+  printf("missing end of image\n");
+  return 1;
+}
@@ -0,0 +1,161 @@
+#!/usr/bin/env python3
+
+# This file is part of SymCC.
+#
+# SymCC is free software: you can redistribute it and/or modify it under the
+# terms of the GNU General Public License as published by the Free Software
+# Foundation, either version 3 of the License, or (at your option) any later
+# version.
+#
+# SymCC is distributed in the hope that it will be useful, but WITHOUT ANY
+# WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+# A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License along with
+# SymCC. If not, see <https://www.gnu.org/licenses/>.
+
+"""Decode the binary constraint trace of the simple backend.
+
+The runtime writes the trace when SYMCC_TRACE_FILE is set (see
+docs/Configuration.txt); runtime/simple_backend/ConstraintTrace.h describes the
+format. By default, print one line per record; with --summary, print a table of
+queries and their results per branch site instead.
+"""
+
+import argparse
+import collections
+import struct
+import sys
+
+MAGIC = b"SYMCCTR1"
+
+HEADER = struct.Struct("=HHI")
+EXECUTION = struct.Struct("=IIQ")
+CONSTRAINT = struct.Struct("=QQQ")
+QUERY = struct.Struct("=QQQ")
+INPUT = struct.Struct("=II")
+EXPRESSION_ID = struct.Struct("=Q")
+
+KIND_EXECUTION = 1
+KIND_CONSTRAINT = 2
+KIND_QUERY = 3
+KIND_INPUT = 4
+KIND_EXPRESSION = 5
+KIND_SNAPSHOT = 6
+KIND_RESTORE = 7
+
+TAKEN = 1
+
+QUERY_RESULTS = ["sat", "unsat", "unknown", "cached-sat", "cached-unsat",
+                 "skipped", "dropped"]
+
+
+def read_records(data):
+    """Yield (kind, flags, payload) for each record of a trace."""
+    if data[:len(MAGIC)] != MAGIC:
+        raise ValueError("Not a SymCC constraint trace")
+
+    position = len(MAGIC)
+    while position < len(data):
+        if position + HEADER.size > len(data):
+            raise ValueError("Truncated record header at offset %d" % position)
+        kind, flags, size = HEADER.unpack_from(data, position)
+        position += HEADER.size
+        if position + size > len(data):
+            raise ValueError("Truncated record at offset %d" % position)
+        yield kind, flags, data[position:position + size]
+        position += size
+
+
+def result_name(flags):
+    if flags < len(QUERY_RESULTS):
+        return QUERY_RESULTS[flags]
+    return "result%d" % flags
+
+
+def print_records(records, out):
+    for kind, flags, payload in records:
+        if kind == KIND_EXECUTION:
+            pid, _, start = EXECUTION.unpack_from(payload)
+            print("execution pid=%d start=%d.%06d" %
+                  (pid, start // 10**6, start % 10**6), file=out)
+        elif kind == KIND_CONSTRAINT:
+            ident, site, context = CONSTRAINT.unpack_from(payload)
+            print("constraint %d site=%#x context=%#x %s" %
+                  (ident, site, context,
+                   "taken" if flags & TAKEN else "not-taken"), file=out)
+        elif kind == KIND_QUERY:
+            constraint, site, time = QUERY.unpack_from(payload)
+            print("query %d site=%#x %s time=%dus" %
+                  (constraint, site, result_name(flags), time), file=out)
+        elif kind == KIND_INPUT:
+            offset, value = INPUT.unpack_from(payload)
+            print("input stdin%d = %#04x" % (offset, value), file=out)
+        elif kind == KIND_EXPRESSION:
+            (constraint,) = EXPRESSION_ID.unpack_from(payload)
+            text = payload[EXPRESSION_ID.size:].decode(errors="replace")
+            print("expression %d" % constraint, file=out)
+            for line in text.splitlines():
+                if line.strip() and not line.startswith(";"):
+                    print("  " + line, file=out)
+        elif kind == KIND_SNAPSHOT:
+            print("snapshot", file=out)
+        elif kind == KIND_RESTORE:
+            print("restore", file=out)
+        else:
+            print("unknown record kind %d (%d bytes)" % (kind, len(payload)),
+                  file=out)
+
+
+def print_summary(records, out):
+    constraints = collections.Counter()
+    queries = collections.defaultdict(collections.Counter)
+    times = collections.Counter()
+    executions = 0
+    for kind, flags, payload in records:
+        if kind == KIND_EXECUTION:
+            executions += 1
+        elif kind == KIND_CONSTRAINT:
+            _, site, _ = CONSTRAINT.unpack_from(payload)
+            constraints[site] += 1
+        elif kind == KIND_QUERY:
+            _, site, time = QUERY.unpack_from(payload)
+            queries[site][result_name(flags)] += 1
+            times[site] += time
+
+    print("# %d executions, %d constraints, %d queries" %
+          (executions, sum(constraints.values()),
+           sum(sum(q.values()) for q in queries.values())), file=out)
+    print("\t".join(["site", "constraints"] + QUERY_RESULTS + ["time_us"]),
+          file=out)
+    sites = sorted(set(constraints) | set(queries),
+                   key=lambda site: (-times[site], site))
+    for site in sites:
+        row = ["%#x" % site, str(constraints[site])]
+        row += [str(queries[site][result]) for result in QUERY_RESULTS]
+        row.append(str(times[site]))
+        print("\t".join(row), file=out)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("trace", help="the trace file (SYMCC_TRACE_FILE)")
+    parser.add_argument("--summary", action="store_true",
+                        help="print per-site totals instead of all records")
+    args = parser.parse_args()
+
+    with open(args.trace, "rb") as trace_file:
+        data = trace_file.read()
+
+    try:
+        records = read_records(data)
+        if args.summary:
+            print_summary(records, sys.stdout)
+        else:
+            print_records(records, sys.stdout)
+    except ValueError as e:
+        sys.exit("%s: %s" % (args.trace, e))
+
+
+if __name__ == "__main__":
+    main()
@@ -16,11 +16,13 @@ mod symcc;
 
 use anyhow::{Context, Result};
 use clap::{self, StructOpt};
-use std::collections::HashSet;
+use std::collections::{HashSet, VecDeque};
 use std::fs;
 use std::fs::File;
 use std::io::Write;
 use std::path::{Path, PathBuf};
+use std::sync::mpsc::{self, RecvTimeoutError};
+use std::sync::{Arc, Mutex};
 use std::thread;
 use std::time::{Duration, Instant};
 use symcc::{AflConfig, AflMap, AflShowmapResult, SymCC, TestcaseDir};
@@ -28,6 +30,13 @@ use tempfile::tempdir;
 
 const STATS_INTERVAL_SEC: u64 = 60;
 
+/// How often we check the fuzzer's progress.
+const PROGRESS_CHECK_INTERVAL: Duration = Duration::from_secs(30);
+
+/// The period over which we measure the fuzzer's progress; it needs to cover
+/// several updates of AFL's statistics.
+const PROGRESS_WINDOW: Duration = Duration::from_secs(300);
+
 // TODO extend timeout when idle? Possibly reprocess previously timed-out
 // inputs.
 
@@ -50,6 +59,19 @@ struct CLI {
     #[clap(short = 'v')]
     verbose: bool,
 
+    /// Start a fresh process for every input instead of using fork servers
+    #[clap(long = "no-forkserver")]
+    no_forkserver: bool,
+
+    /// Number of SymCC instances to run in parallel
+    #[clap(short = 'j', default_value_t = 1)]
+    jobs: usize,
+
+    /// Pause SymCC while the fuzzer finds more than this many new paths per
+    /// minute on its own
+    #[clap(long = "max-fuzzer-rate")]
+    max_fuzzer_rate: Option<f64>,
+
     /// Program under test
     command: Vec<String>,
 }
@@ -71,6 +93,10 @@ struct Stats {
 
     /// Time spent in failed SymCC executions.
     failed_time: Duration,
+
+    /// Time during which SymCC was paused because the fuzzer made good
+    /// progress.
+    paused_time: Duration,
 }
 
 impl Stats {
@@ -145,6 +171,12 @@ impl Stats {
             )?;
         }
 
+        writeln!(
+            out,
+            "Time paused in favor of the fuzzer: {}s",
+            self.paused_time.as_secs()
+        )?;
+
         writeln!(
             out,
             "--------------------------------------------------------------------------------"
@@ -156,12 +188,15 @@ impl Stats {
 
 /// Mutable run-time state.
 ///
-/// This is a collection of the state we update during execution.
+/// This is a collection of the state we update during execution. All workers
+/// share it, so that they split the AFL queue among them and judge new test
+/// cases against the same coverage map.
 struct State {
     /// The cumulative coverage of all test cases generated so far.
     current_bitmap: AflMap,
 
-    /// The AFL test cases that have been analyzed so far.
+    /// The AFL test cases that have been analyzed so far (or are being
+    /// analyzed by some worker).
     processed_files: HashSet<PathBuf>,
 
     /// The place to put new and useful test cases.
@@ -181,6 +216,9 @@ struct State {
 
     /// Write statistics to this file.
     stats_file: File,
+
+    /// Should SymCC currently leave the CPU to the fuzzer?
+    paused: bool,
 }
 
 impl State {
@@ -209,57 +247,139 @@ impl State {
             stats: Default::default(), // Is this bad style?
             last_stats_output: Instant::now(),
             stats_file,
+            paused: false,
         })
     }
 
-    /// Run a single input through SymCC and process the new test cases it
-    /// generates.
-    fn test_input(
-        &mut self,
-        input: impl AsRef<Path>,
-        symcc: &SymCC,
-        afl_config: &AflConfig,
-    ) -> Result<()> {
-        log::info!("Running on input {}", input.as_ref().display());
-
-        let tmp_dir = tempdir()
-            .context("Failed to create a temporary directory for this execution of SymCC")?;
-
-        let mut num_interesting = 0u64;
-        let mut num_total = 0u64;
-
-        let symcc_result = symcc
-            .run(&input, tmp_dir.path().join("output"))
-            .context("Failed to run SymCC")?;
-        for new_test in symcc_result.test_cases.iter() {
-            let res = process_new_testcase(&new_test, &input, &tmp_dir, &afl_config, self)?;
-
-            num_total += 1;
-            if res == TestcaseResult::New {
-                log::debug!("Test case is interesting");
-                num_interesting += 1;
+    /// Pick the most promising AFL test case that no worker has analyzed yet,
+    /// and mark it as taken.
+    ///
+    /// Returns `None` if there is no such test case or if SymCC is paused.
+    fn claim_best_testcase(&mut self, afl_config: &AflConfig) -> Result<Option<PathBuf>> {
+        if self.paused {
+            return Ok(None);
+        }
+
+        let best = afl_config
+            .best_new_testcase(&self.processed_files)
+            .context("Failed to check for new test cases")?;
+        if let Some(input) = &best {
+            self.processed_files.insert(input.clone());
+        }
+
+        Ok(best)
+    }
+
+    /// Write the statistics to the stats file if it's time to do so.
+    fn log_stats_if_due(&mut self) {
+        if self.last_stats_output.elapsed().as_secs() > STATS_INTERVAL_SEC {
+            if let Err(e) = self.stats.log(&mut self.stats_file) {
+                log::error!("Failed to log run-time statistics: {}", e);
             }
+            self.last_stats_output = Instant::now();
         }
+    }
+}
+
+/// Run a single input through SymCC and process the new test cases it
+/// generates.
+///
+/// We only lock the state to record results, so that other workers can run
+/// SymCC in the meantime.
+fn test_input(
+    state: &Mutex<State>,
+    input: impl AsRef<Path>,
+    symcc: &SymCC,
+    afl_config: &AflConfig,
+) -> Result<()> {
+    log::info!("Running on input {}", input.as_ref().display());
+
+    let tmp_dir =
+        tempdir().context("Failed to create a temporary directory for this execution of SymCC")?;
+
+    let mut num_interesting = 0u64;
+    let mut num_total = 0u64;
+
+    let symcc_result = symcc
+        .run(&input, tmp_dir.path().join("output"))
+        .context("Failed to run SymCC")?;
+    for new_test in symcc_result.test_cases.iter() {
+        let res = process_new_testcase(new_test, &input, &tmp_dir, &afl_config, state)?;
+
+        num_total += 1;
+        if res == TestcaseResult::New {
+            log::debug!("Test case is interesting");
+            num_interesting += 1;
+        }
+    }
+
+    log::info!(
+        "Generated {} test cases ({} new)",
+        num_total,
+        num_interesting
+    );
 
+    let mut state = state.lock().unwrap();
+    if symcc_result.killed {
         log::info!(
-            "Generated {} test cases ({} new)",
-            num_total,
-            num_interesting
+            "The target process was killed (probably timeout or out of memory); \
+             archiving to {}",
+            state.hangs.path.display()
         );
+        symcc::copy_testcase(&input, &mut state.hangs, &input)
+            .context("Failed to archive the test case")?;
+    }
+
+    state.stats.add_execution(&symcc_result);
+    Ok(())
+}
+
+/// The fuzzer's recent progress, measured in paths that it found on its own.
+struct FuzzerProgress {
+    /// Path counts over the last PROGRESS_WINDOW, oldest first.
+    samples: VecDeque<(Instant, u64)>,
+}
 
-        if symcc_result.killed {
-            log::info!(
-                "The target process was killed (probably timeout or out of memory); \
-                 archiving to {}",
-                self.hangs.path.display()
-            );
-            symcc::copy_testcase(&input, &mut self.hangs, &input)
-                .context("Failed to archive the test case")?;
+impl FuzzerProgress {
+    fn new() -> Self {
+        FuzzerProgress {
+            samples: VecDeque::new(),
         }
+    }
 
-        self.processed_files.insert(input.as_ref().to_path_buf());
-        self.stats.add_execution(&symcc_result);
-        Ok(())
+    /// Record the fuzzer's current number of paths and return the rate of new
+    /// paths per minute, or `None` if we don't have enough data yet.
+    fn update(&mut self, paths: u64) -> Option<f64> {
+        let now = Instant::now();
+        while self.samples.len() > 1 && now - self.samples[1].0 >= PROGRESS_WINDOW {
+            self.samples.pop_front();
+        }
+        self.samples.push_back((now, paths));
+
+        let (oldest_time, oldest_paths) = *self.samples.front().unwrap();
+        let elapsed = now - oldest_time;
+        if elapsed < PROGRESS_WINDOW / 2 {
+            return None;
+        }
+
+        Some(paths.saturating_sub(oldest_paths) as f64 / elapsed.as_secs_f64() * 60.0)
+    }
+}
+
+/// Analyze AFL test cases with the given SymCC instance until something goes
+/// wrong.
+fn work(state: &Mutex<State>, symcc: SymCC, afl_config: AflConfig) -> Result<()> {
+    loop {
+        let input = state.lock().unwrap().claim_best_testcase(&afl_config)?;
+        match input {
+            None => {
+                log::debug!("Waiting for new test cases...");
+                thread::sleep(Duration::from_secs(5));
+            }
+            Some(input) => test_input(state, &input, &symcc, &afl_config)?,
+        }
+
+        state.lock().unwrap().log_stats_if_due();
     }
 }
 
@@ -296,29 +416,78 @@ fn main() -> Result<()> {
         return Ok(());
     }
 
-    let symcc = SymCC::new(symcc_dir.clone(), &options.command);
-    log::debug!("SymCC configuration: {:?}", &symcc);
-    let afl_config = AflConfig::load(options.output_dir.join(&options.fuzzer_name))?;
-    log::debug!("AFL configuration: {:?}", &afl_config);
-    let mut state = State::initialize(symcc_dir)?;
+    let state = Arc::new(Mutex::new(State::initialize(&symcc_dir)?));
+    let (result_sender, result_receiver) = mpsc::channel();
+    for worker in 0..options.jobs.max(1) {
+        // The first worker uses SymCC's directory directly, the others get
+        // private subdirectories for their inputs and fork servers but share
+        // the bitmap for branch pruning.
+        let worker_dir = if worker == 0 {
+            symcc_dir.clone()
+        } else {
+            let dir = symcc_dir.join(format!(".worker{}", worker));
+            fs::create_dir(&dir)
+                .with_context(|| format!("Failed to create the directory {}", dir.display()))?;
+            dir
+        };
+
+        let mut symcc = SymCC::new(worker_dir, &options.command, !options.no_forkserver);
+        symcc.set_bitmap(symcc_dir.join("bitmap"));
+        log::debug!("SymCC configuration: {:?}", &symcc);
+        let afl_config = AflConfig::load(
+            options.output_dir.join(&options.fuzzer_name),
+            !options.no_forkserver,
+        )?;
+        log::debug!("AFL configuration: {:?}", &afl_config);
+
+        let state = Arc::clone(&state);
+        let result_sender = result_sender.clone();
+        thread::spawn(move || {
+            // The receiver only goes away when we exit anyway.
+            let _ = result_sender.send(work(&state, symcc, afl_config));
+        });
+    }
 
+    // Workers only return on errors; report the first one. In the meantime,
+    // decide whether SymCC should make room for the fuzzer.
+    let progress_config = AflConfig::load(options.output_dir.join(&options.fuzzer_name), false)?;
+    let mut progress = FuzzerProgress::new();
+    let mut last_check = Instant::now();
     loop {
-        match afl_config
-            .best_new_testcase(&state.processed_files)
-            .context("Failed to check for new test cases")?
-        {
-            None => {
-                log::debug!("Waiting for new test cases...");
-                thread::sleep(Duration::from_secs(5));
-            }
-            Some(input) => state.test_input(&input, &symcc, &afl_config)?,
+        match result_receiver.recv_timeout(PROGRESS_CHECK_INTERVAL) {
+            Ok(result) => return result,
+            Err(RecvTimeoutError::Timeout) => (),
+            Err(RecvTimeoutError::Disconnected) => panic!("All workers terminated unexpectedly"),
         }
 
-        if state.last_stats_output.elapsed().as_secs() > STATS_INTERVAL_SEC {
-            if let Err(e) = state.stats.log(&mut state.stats_file) {
-                log::error!("Failed to log run-time statistics: {}", e);
+        let mut state = state.lock().unwrap();
+        if state.paused {
+            state.stats.paused_time += last_check.elapsed();
+        }
+        last_check = Instant::now();
+
+        let max_rate = match options.max_fuzzer_rate {
+            Some(rate) => rate,
+            None => continue,
+        };
+        let rate = match progress_config.own_paths() {
+            Ok(paths) => progress.update(paths),
+            Err(e) => {
+                log::warn!("Failed to check the fuzzer's progress: {:#}", e);
+                None
+            }
+        };
+
+        if let Some(rate) = rate {
+            let paused = rate > max_rate;
+            if paused != state.paused {
+                log::info!(
+                    "The fuzzer finds {:.1} new paths per minute; {} SymCC",
+                    rate,
+                    if paused { "pausing" } else { "resuming" }
+                );
+                state.paused = paused;
             }
-            state.last_stats_output = Instant::now();
         }
     }
 }
@@ -335,32 +504,26 @@ enum TestcaseResult {
 /// Check if the given test case provides new coverage, crashes, or times out;
 /// copy it to the corresponding location.
 fn process_new_testcase(
-    testcase: impl AsRef<Path>,
+    testcase: &[u8],
     parent: impl AsRef<Path>,
     tmp_dir: impl AsRef<Path>,
     afl_config: &AflConfig,
-    state: &mut State,
+    state: &Mutex<State>,
 ) -> Result<TestcaseResult> {
-    log::debug!("Processing test case {}", testcase.as_ref().display());
+    log::debug!("Processing a test case of {} bytes", testcase.len());
 
     let testcase_bitmap_path = tmp_dir.as_ref().join("testcase_bitmap");
+    let testcase_path = tmp_dir.as_ref().join("testcase");
     match afl_config
-        .run_showmap(&testcase_bitmap_path, &testcase)
-        .with_context(|| {
-            format!(
-                "Failed to check whether test case {} is interesting",
-                &testcase.as_ref().display()
-            )
-        })? {
+        .run_target(testcase, &testcase_bitmap_path, &testcase_path)
+        .context("Failed to check whether the new test case is interesting")?
+    {
         AflShowmapResult::Success(testcase_bitmap) => {
+            let mut state = state.lock().unwrap();
             let interesting = state.current_bitmap.merge(&testcase_bitmap);
             if interesting {
-                symcc::copy_testcase(&testcase, &mut state.queue, parent).with_context(|| {
-                    format!(
-                        "Failed to enqueue the new test case {}",
-                        testcase.as_ref().display()
-                    )
-                })?;
+                symcc::save_testcase(testcase, &mut state.queue, parent)
+                    .context("Failed to enqueue the new test case")?;
 
                 Ok(TestcaseResult::New)
             } else {
@@ -368,24 +531,15 @@ fn process_new_testcase(
             }
         }
         AflShowmapResult::Hang => {
-            log::info!(
-                "Ignoring new test case {} because afl-showmap timed out on it",
-                testcase.as_ref().display()
-            );
+            log::info!("Ignoring a new test case because afl-showmap timed out on it");
             Ok(TestcaseResult::Hang)
         }
         AflShowmapResult::Crash => {
-            log::info!(
-                "Test case {} crashes afl-showmap; it is probably interesting",
-                testcase.as_ref().display()
-            );
-            symcc::copy_testcase(&testcase, &mut state.crashes, &parent)?;
-            symcc::copy_testcase(&testcase, &mut state.queue, &parent).with_context(|| {
-                format!(
-                    "Failed to enqueue the new test case {}",
-                    testcase.as_ref().display()
-                )
-            })?;
+            log::info!("A new test case crashes afl-showmap; it is probably interesting");
+            let mut state = state.lock().unwrap();
+            symcc::save_testcase(testcase, &mut state.crashes, &parent)?;
+            symcc::save_testcase(testcase, &mut state.queue, &parent)
+                .context("Failed to enqueue the new test case")?;
             Ok(TestcaseResult::Crash)
         }
     }
@@ -14,16 +14,23 @@
 
 use anyhow::{bail, ensure, Context, Result};
 use regex::Regex;
+use std::cell::RefCell;
 use std::cmp;
 use std::collections::HashSet;
 use std::ffi::{OsStr, OsString};
-use std::fs::{self, File};
-use std::io::{self, Read};
-use std::os::unix::process::ExitStatusExt;
+use std::fs::{self, File, OpenOptions};
+use std::io::{self, Read, Seek, SeekFrom, Write};
+use std::os::unix::ffi::OsStrExt;
+use std::os::unix::fs::FileExt;
+use std::os::unix::io::{AsRawFd, FromRawFd};
+use std::os::unix::net::{UnixListener, UnixStream};
+use std::os::unix::process::{CommandExt, ExitStatusExt};
 use std::path::{Path, PathBuf};
-use std::process::{Command, Stdio};
+use std::process::{Child, Command, ExitStatus, Stdio};
 use std::str;
+use std::thread;
 use std::time::{Duration, Instant};
+use tempfile::TempDir;
 
 const TIMEOUT: u32 = 90;
 
@@ -40,15 +47,41 @@ fn insert_input_file<S: AsRef<OsStr>, P: AsRef<Path>>(
     fixed_command
 }
 
+/// The size of AFL's coverage map.
+const AFL_MAP_SIZE: usize = 65536;
+
 /// A coverage map as used by AFL.
 pub struct AflMap {
-    data: [u8; 65536],
+    data: [u8; AFL_MAP_SIZE],
 }
 
 impl AflMap {
     /// Create an empty map.
     pub fn new() -> AflMap {
-        AflMap { data: [0; 65536] }
+        AflMap {
+            data: [0; AFL_MAP_SIZE],
+        }
+    }
+
+    /// Create a map from the raw hit counts of an execution, bucketing them
+    /// like afl-showmap does.
+    fn from_trace(trace: &[u8]) -> AflMap {
+        let mut result = AflMap::new();
+        for (bucket, count) in result.data.iter_mut().zip(trace.iter()) {
+            *bucket = match *count {
+                0 => 0,
+                1 => 1,
+                2 => 2,
+                3 => 4,
+                4..=7 => 8,
+                8..=15 => 16,
+                16..=31 => 32,
+                32..=127 => 64,
+                128..=255 => 128,
+            };
+        }
+
+        result
     }
 
     /// Load a map from disk.
@@ -61,7 +94,7 @@ impl AflMap {
             )
         })?;
         ensure!(
-            data.len() == 65536,
+            data.len() == AFL_MAP_SIZE,
             "The file to load the coverage map from has the wrong size ({})",
             data.len()
         );
@@ -181,6 +214,18 @@ pub fn copy_testcase(
     testcase: impl AsRef<Path>,
     target_dir: &mut TestcaseDir,
     parent: impl AsRef<Path>,
+) -> Result<()> {
+    let data = fs::read(&testcase)
+        .with_context(|| format!("Failed to read the test case {}", testcase.as_ref().display()))?;
+    save_testcase(&data, target_dir, parent)
+}
+
+/// Store a test case in a directory, using the parent test case's name to
+/// derive the new name.
+pub fn save_testcase(
+    testcase: &[u8],
+    target_dir: &mut TestcaseDir,
+    parent: impl AsRef<Path>,
 ) -> Result<()> {
     let orig_name = parent
         .as_ref()
@@ -197,10 +242,10 @@ pub fn copy_testcase(
         let new_name = format!("id:{:06},src:{}", target_dir.current_id, &orig_id);
         let target = target_dir.path.join(new_name);
         log::debug!("Creating test case {}", target.display());
-        fs::copy(testcase.as_ref(), target).with_context(|| {
+        fs::write(&target, testcase).with_context(|| {
             format!(
-                "Failed to copy the test case {} to {}",
-                testcase.as_ref().display(),
+                "Failed to write the test case {} to {}",
+                target.display(),
                 target_dir.path.display()
             )
         })?;
@@ -235,6 +280,12 @@ pub struct AflConfig {
 
     /// The fuzzer instance's queue of test cases.
     queue: PathBuf,
+
+    /// The fuzzer instance's statistics.
+    stats_file: PathBuf,
+
+    /// The AFL-instrumented target in fork-server mode, if we use it.
+    forkserver: RefCell<AflForkserverState>,
 }
 
 /// Possible results of afl-showmap.
@@ -249,7 +300,10 @@ pub enum AflShowmapResult {
 
 impl AflConfig {
     /// Read the AFL configuration from a fuzzer instance's output directory.
-    pub fn load(fuzzer_output: impl AsRef<Path>) -> Result<Self> {
+    ///
+    /// Unless `use_forkserver` is false, we evaluate test cases by running the
+    /// AFL-instrumented target in fork-server mode.
+    pub fn load(fuzzer_output: impl AsRef<Path>, use_forkserver: bool) -> Result<Self> {
         let afl_stats_file_path = fuzzer_output.as_ref().join("fuzzer_stats");
         let mut afl_stats_file = File::open(&afl_stats_file_path).with_context(|| {
             format!(
@@ -289,15 +343,51 @@ impl AflConfig {
         .parent()
         .unwrap();
 
+        let use_qemu_mode = afl_command.contains(&"-Q".into());
         Ok(AflConfig {
             show_map: afl_binary_dir.join("afl-showmap"),
             use_standard_input: !afl_target_command.contains(&"@@".into()),
-            use_qemu_mode: afl_command.contains(&"-Q".into()),
+            use_qemu_mode,
             target_command: afl_target_command,
             queue: fuzzer_output.as_ref().join("queue"),
+            stats_file: afl_stats_file_path,
+            forkserver: RefCell::new(if use_forkserver && !use_qemu_mode {
+                AflForkserverState::NotStarted
+            } else {
+                AflForkserverState::Unavailable
+            }),
         })
     }
 
+    /// Count the paths that the fuzzer has found on its own, i.e., without
+    /// those imported from other instances (such as SymCC).
+    ///
+    /// Note that AFL only updates its statistics about once a minute.
+    pub fn own_paths(&self) -> Result<u64> {
+        let afl_stats = fs::read_to_string(&self.stats_file).with_context(|| {
+            format!(
+                "Failed to read the fuzzer's stats at {}",
+                self.stats_file.display()
+            )
+        })?;
+        // AFL++ renamed the fields that AFL calls paths_*.
+        let field = |names: &[&str]| {
+            afl_stats.lines().find_map(|line| {
+                let (name, value) = line.split_once(':')?;
+                if names.contains(&name.trim()) {
+                    value.trim().parse::<u64>().ok()
+                } else {
+                    None
+                }
+            })
+        };
+
+        let total = field(&["corpus_count", "paths_total"])
+            .context("The fuzzer stats don't contain the number of paths")?;
+        let imported = field(&["corpus_imported", "paths_imported"]).unwrap_or(0);
+        Ok(total.saturating_sub(imported))
+    }
+
     /// Return the most promising unseen test case of this fuzzer.
     pub fn best_new_testcase(&self, seen: &HashSet<PathBuf>) -> Result<Option<PathBuf>> {
         let best = fs::read_dir(&self.queue)
@@ -322,11 +412,68 @@ impl AflConfig {
         Ok(best)
     }
 
+    /// Run the AFL-instrumented target on a test case and collect its coverage.
+    ///
+    /// We use a long-running fork server if possible, which saves starting
+    /// afl-showmap and the target for every test case; otherwise, we fall back
+    /// to run_showmap with the given files.
+    pub fn run_target(
+        &self,
+        testcase: &[u8],
+        testcase_bitmap: impl AsRef<Path>,
+        scratch_file: impl AsRef<Path>,
+    ) -> Result<AflShowmapResult> {
+        let mut forkserver = self.forkserver.borrow_mut();
+        if let AflForkserverState::NotStarted = *forkserver {
+            *forkserver = match AflForkserver::start(&self.target_command, self.use_standard_input)
+            {
+                Ok(server) => AflForkserverState::Running(server),
+                Err(e) => {
+                    log::warn!(
+                        "Failed to start the AFL-instrumented target as a fork server, \
+                         using afl-showmap instead: {:#}",
+                        e
+                    );
+                    AflForkserverState::Unavailable
+                }
+            };
+        }
+
+        if let AflForkserverState::Running(server) = &mut *forkserver {
+            match server.run(testcase) {
+                Ok(result) => return Ok(result),
+                Err(e) => {
+                    log::warn!(
+                        "The AFL fork server failed, using afl-showmap from now on: {:#}",
+                        e
+                    );
+                    *forkserver = AflForkserverState::Unavailable;
+                }
+            }
+        }
+
+        self.run_showmap(testcase_bitmap, testcase, scratch_file)
+    }
+
+    /// Run the target on a test case with afl-showmap.
+    ///
+    /// Unless the target reads standard input, the test case is written to the
+    /// given scratch file first.
     pub fn run_showmap(
         &self,
         testcase_bitmap: impl AsRef<Path>,
-        testcase: impl AsRef<Path>,
+        testcase: &[u8],
+        scratch_file: impl AsRef<Path>,
     ) -> Result<AflShowmapResult> {
+        if !self.use_standard_input {
+            fs::write(&scratch_file, testcase).with_context(|| {
+                format!(
+                    "Failed to write the test case to {}",
+                    scratch_file.as_ref().display()
+                )
+            })?;
+        }
+
         let mut afl_show_map = Command::new(&self.show_map);
 
         if self.use_qemu_mode {
@@ -336,7 +483,7 @@ impl AflConfig {
         afl_show_map
             .args(&["-t", "5000", "-m", "none", "-b", "-o"])
             .arg(testcase_bitmap.as_ref())
-            .args(insert_input_file(&self.target_command, &testcase))
+            .args(insert_input_file(&self.target_command, &scratch_file))
             .stdout(Stdio::null())
             .stderr(Stdio::null())
             .stdin(if self.use_standard_input {
@@ -349,14 +496,12 @@ impl AflConfig {
         let mut afl_show_map_child = afl_show_map.spawn().context("Failed to run afl-showmap")?;
 
         if self.use_standard_input {
-            io::copy(
-                &mut File::open(&testcase)?,
-                afl_show_map_child
-                    .stdin
-                    .as_mut()
-                    .expect("Failed to open the stardard input of afl-showmap"),
-            )
-            .context("Failed to pipe the test input to afl-showmap")?;
+            afl_show_map_child
+                .stdin
+                .take()
+                .expect("Failed to open the stardard input of afl-showmap")
+                .write_all(testcase)
+                .context("Failed to pipe the test input to afl-showmap")?;
         }
 
         let afl_show_map_status = afl_show_map_child
@@ -384,6 +529,566 @@ impl AflConfig {
     }
 }
 
+/// The file descriptor on which AFL-instrumented targets read fork-server
+/// commands; they reply on the next one.
+const AFL_FORKSRV_FD: i32 = 198;
+
+/// How long we let the AFL-instrumented target run on a test case (the timeout
+/// that we pass to afl-showmap).
+const AFL_TIMEOUT: Duration = Duration::from_secs(5);
+
+/// Fork-server options that AFL++ announces in its hello message.
+const AFL_FS_OPT_ENABLED: u32 = 0x8000_0001;
+const AFL_FS_OPT_MAPSIZE: u32 = 0x4000_0000;
+const AFL_FS_OPT_SHDMEM_FUZZ: u32 = 0x0100_0000;
+const AFL_FS_OPT_AUTODICT: u32 = 0x1000_0000;
+
+/// The hello message and options of the newer AFL++ fork-server handshake.
+const AFL_FS_NEW_VERSION: u32 = 0x4146_4c01;
+const AFL_FS_NEW_OPT_MAPSIZE: u32 = 0x1;
+const AFL_FS_NEW_OPT_SHDMEM_FUZZ: u32 = 0x2;
+const AFL_FS_NEW_OPT_AUTODICT: u32 = 0x800;
+
+/// A System V shared-memory segment for AFL's coverage map.
+#[derive(Debug)]
+struct AflSharedMap {
+    id: i32,
+    data: *mut u8,
+}
+
+// The segment is owned by its AflSharedMap, so moving it to another thread is
+// fine.
+unsafe impl Send for AflSharedMap {}
+
+impl AflSharedMap {
+    fn create() -> Result<AflSharedMap> {
+        let id = unsafe { shmget(IPC_PRIVATE, AFL_MAP_SIZE, IPC_CREAT | IPC_EXCL | 0o600) };
+        if id == -1 {
+            return Err(io::Error::last_os_error()).context("Failed to create the coverage map");
+        }
+
+        let data = unsafe { shmat(id, std::ptr::null(), 0) };
+        if data as isize == -1 {
+            let error = io::Error::last_os_error();
+            unsafe {
+                shmctl(id, IPC_RMID, std::ptr::null_mut());
+            }
+            return Err(error).context("Failed to attach the coverage map");
+        }
+
+        Ok(AflSharedMap {
+            id,
+            data: data as *mut u8,
+        })
+    }
+
+    fn trace(&mut self) -> &mut [u8] {
+        unsafe { std::slice::from_raw_parts_mut(self.data, AFL_MAP_SIZE) }
+    }
+}
+
+impl Drop for AflSharedMap {
+    fn drop(&mut self) {
+        unsafe {
+            shmdt(self.data as *const u8);
+            shmctl(self.id, IPC_RMID, std::ptr::null_mut());
+        }
+    }
+}
+
+/// Create a pipe, returning the reading and the writing end.
+fn pipe() -> io::Result<(File, File)> {
+    let mut fds = [0i32; 2];
+    if unsafe { pipe2(fds.as_mut_ptr(), O_CLOEXEC) } == -1 {
+        return Err(io::Error::last_os_error());
+    }
+
+    unsafe { Ok((File::from_raw_fd(fds[0]), File::from_raw_fd(fds[1]))) }
+}
+
+/// Read a number from a pipe, waiting at most for the given time (or
+/// indefinitely).
+///
+/// Returns `None` on timeout.
+fn read_u32_timeout(pipe: &mut File, timeout: Option<Duration>) -> Result<Option<u32>> {
+    if let Some(timeout) = timeout {
+        let mut poll_fd = PollFd {
+            fd: pipe.as_raw_fd(),
+            events: POLLIN,
+            revents: 0,
+        };
+        loop {
+            match unsafe { poll(&mut poll_fd, 1, timeout.as_millis() as i32) } {
+                -1 if io::Error::last_os_error().kind() == io::ErrorKind::Interrupted => continue,
+                -1 => return Err(io::Error::last_os_error().into()),
+                0 => return Ok(None),
+                _ => break,
+            }
+        }
+    }
+
+    let mut bytes = [0u8; 4];
+    pipe.read_exact(&mut bytes)?;
+    Ok(Some(u32::from_le_bytes(bytes)))
+}
+
+/// The AFL-instrumented target running as an AFL fork server.
+///
+/// We speak the fork-server protocol of AFL and AFL++: the target reads a
+/// command on file descriptor AFL_FORKSRV_FD and replies with the PID and
+/// later the exit status of a child on the next descriptor, while the child
+/// records its coverage in the shared memory named by __AFL_SHM_ID. The input
+/// is always in the same file; for targets reading from standard input, the
+/// file is also their standard input, and we rewind it before each execution.
+#[derive(Debug)]
+struct AflForkserver {
+    process: Child,
+    control: File,
+    status: File,
+    coverage: AflSharedMap,
+    input: File,
+    /// Did we kill the previous child?
+    killed: bool,
+    /// Holds the input file.
+    _input_dir: TempDir,
+}
+
+impl AflForkserver {
+    /// Start the fork server and perform the handshake.
+    fn start(target_command: &[OsString], use_standard_input: bool) -> Result<AflForkserver> {
+        let coverage = AflSharedMap::create()?;
+        let input_dir = tempfile::Builder::new()
+            .prefix("symcc_afl")
+            .tempdir()
+            .context("Failed to create a directory for the input")?;
+        let input_path = input_dir.path().join("input");
+        let input = OpenOptions::new()
+            .read(true)
+            .write(true)
+            .create(true)
+            .open(&input_path)
+            .context("Failed to create the input file")?;
+
+        let (control_read, control) = pipe()?;
+        let (status, status_write) = pipe()?;
+        let (control_fd, status_fd) = (control_read.as_raw_fd(), status_write.as_raw_fd());
+
+        // Skip the double dash that separates the command from afl-fuzz options.
+        let command_line = insert_input_file(target_command.get(1..).unwrap_or(&[]), &input_path);
+        ensure!(!command_line.is_empty(), "The AFL target command is empty");
+        let mut command = Command::new(&command_line[0]);
+        command
+            .args(&command_line[1..])
+            .env("__AFL_SHM_ID", coverage.id.to_string())
+            .stdin(if use_standard_input {
+                Stdio::from(input.try_clone()?)
+            } else {
+                Stdio::null()
+            })
+            .stdout(Stdio::null())
+            .stderr(Stdio::null());
+        unsafe {
+            command.pre_exec(move || {
+                if dup2(control_fd, AFL_FORKSRV_FD) == -1
+                    || dup2(status_fd, AFL_FORKSRV_FD + 1) == -1
+                {
+                    return Err(io::Error::last_os_error());
+                }
+                Ok(())
+            });
+        }
+
+        log::debug!("Starting the AFL fork server as follows: {:?}", &command);
+        let process = command
+            .spawn()
+            .context("Failed to start the AFL-instrumented target")?;
+        drop(control_read);
+        drop(status_write);
+
+        let mut server = AflForkserver {
+            process,
+            control,
+            status,
+            coverage,
+            input,
+            killed: false,
+            _input_dir: input_dir,
+        };
+
+        let hello = read_u32_timeout(&mut server.status, Some(FORKSERVER_STARTUP_TIMEOUT))
+            .context("The target didn't start a fork server")?
+            .context("The target didn't start a fork server in time")?;
+        server.handshake(hello)?;
+        Ok(server)
+    }
+
+    /// Negotiate fork-server options, declining everything that we don't
+    /// support.
+    fn handshake(&mut self, hello: u32) -> Result<()> {
+        if hello == AFL_FS_NEW_VERSION {
+            self.control.write_all(&(hello ^ 0xffff_ffff).to_le_bytes())?;
+            let options = self.read_u32()?;
+            ensure!(
+                options & AFL_FS_NEW_OPT_SHDMEM_FUZZ == 0,
+                "The target requires shared-memory test cases"
+            );
+            if options & AFL_FS_NEW_OPT_MAPSIZE != 0 {
+                let map_size = self.read_u32()?;
+                ensure!(
+                    map_size as usize <= AFL_MAP_SIZE,
+                    "The target's coverage map is too large ({} bytes)",
+                    map_size
+                );
+            }
+            if options & AFL_FS_NEW_OPT_AUTODICT != 0 {
+                let length = self.read_u32()?;
+                io::copy(
+                    &mut (&mut self.status).take(length.into()),
+                    &mut io::sink(),
+                )?;
+            }
+            ensure!(
+                self.read_u32()? == AFL_FS_NEW_VERSION,
+                "The fork-server handshake failed"
+            );
+        } else if hello & AFL_FS_OPT_ENABLED == AFL_FS_OPT_ENABLED {
+            if hello & AFL_FS_OPT_MAPSIZE != 0 {
+                let map_size = ((hello & 0x00ff_fffe) >> 1) + 1;
+                ensure!(
+                    map_size as usize <= AFL_MAP_SIZE,
+                    "The target's coverage map is too large ({} bytes)",
+                    map_size
+                );
+            }
+            if hello & (AFL_FS_OPT_SHDMEM_FUZZ | AFL_FS_OPT_AUTODICT) != 0 {
+                // The target waits for the options that we want; we want none.
+                self.control.write_all(&0u32.to_le_bytes())?;
+            }
+        }
+
+        Ok(())
+    }
+
+    /// Run the target on a test case.
+    fn run(&mut self, testcase: &[u8]) -> Result<AflShowmapResult> {
+        self.input.set_len(0)?;
+        self.input.write_all_at(testcase, 0)?;
+        self.input.seek(SeekFrom::Start(0))?;
+        for count in self.coverage.trace().iter_mut() {
+            *count = 0;
+        }
+
+        self.control
+            .write_all(&u32::from(self.killed).to_le_bytes())
+            .context("Failed to send a request to the AFL fork server")?;
+        let pid = self
+            .read_u32()
+            .context("Failed to read the PID of the target from the AFL fork server")?;
+        ensure!(pid as i32 > 0, "The AFL fork server failed to fork");
+
+        self.killed = false;
+        let status = match read_u32_timeout(&mut self.status, Some(AFL_TIMEOUT))? {
+            Some(status) => status,
+            None => {
+                log::debug!("Killing the target process {} after a timeout", pid);
+                unsafe {
+                    kill(pid as i32, SIGKILL);
+                }
+                self.killed = true;
+                self.read_u32()?
+            }
+        };
+
+        if self.killed {
+            Ok(AflShowmapResult::Hang)
+        } else if ExitStatus::from_raw(status as i32).signal().is_some() {
+            Ok(AflShowmapResult::Crash)
+        } else {
+            Ok(AflShowmapResult::Success(Box::new(AflMap::from_trace(
+                self.coverage.trace(),
+            ))))
+        }
+    }
+
+    fn read_u32(&mut self) -> Result<u32> {
+        Ok(read_u32_timeout(&mut self.status, None)?.expect("Reading without timeout"))
+    }
+}
+
+impl Drop for AflForkserver {
+    fn drop(&mut self) {
+        // Ignore errors: the process may have exited already.
+        let _ = self.process.kill();
+        let _ = self.process.wait();
+    }
+}
+
+/// The state of the AFL fork server, which we start on the first evaluation.
+#[derive(Debug)]
+enum AflForkserverState {
+    NotStarted,
+    Running(AflForkserver),
+    Unavailable,
+}
+
+/// The magic number at the start of a test-case ring ("SYMCRING").
+const TESTCASE_RING_MAGIC: u64 = 0x474e_4952_434d_5953;
+
+/// The offset of the data area in a test-case ring.
+const TESTCASE_RING_DATA_OFFSET: u64 = 4096;
+
+/// The size of the data area of our test-case ring.
+const TESTCASE_RING_CAPACITY: u64 = 16 << 20;
+
+/// A ring buffer through which the target delivers its test cases, so that we
+/// don't need a file per test case; see runtime/TestCaseRing.h for the layout.
+///
+/// The target maps the file into memory. We only read the ring between
+/// executions, when no target writes to it, so plain file I/O suffices here.
+/// Targets built without support for the ring simply ignore it and create
+/// files as before.
+#[derive(Debug)]
+struct TestcaseRing {
+    path: PathBuf,
+    file: File,
+}
+
+impl TestcaseRing {
+    /// Create an empty ring at the given location.
+    fn create(path: impl AsRef<Path>) -> Result<TestcaseRing> {
+        let path = path.as_ref();
+        let file = OpenOptions::new()
+            .read(true)
+            .write(true)
+            .create(true)
+            .truncate(true)
+            .open(path)
+            .with_context(|| format!("Failed to create the test-case ring {}", path.display()))?;
+        file.set_len(TESTCASE_RING_DATA_OFFSET + TESTCASE_RING_CAPACITY)?;
+
+        let mut header = [0u8; 16];
+        header[..8].copy_from_slice(&TESTCASE_RING_MAGIC.to_le_bytes());
+        header[8..].copy_from_slice(&TESTCASE_RING_CAPACITY.to_le_bytes());
+        file.write_all_at(&header, 0)?;
+
+        Ok(TestcaseRing {
+            path: path.into(),
+            file,
+        })
+    }
+
+    /// Remove all test cases from the ring and return them.
+    fn drain(&self) -> Result<Vec<Vec<u8>>> {
+        let head = self.read_u64(64)?;
+        let mut tail = self.read_u64(128)?;
+        ensure!(
+            tail <= head && head - tail <= TESTCASE_RING_CAPACITY,
+            "The test-case ring is corrupted (head {}, tail {})",
+            head,
+            tail
+        );
+
+        let mut testcases = Vec::new();
+        while tail < head {
+            let mut length = [0u8; 4];
+            self.read_wrapped(tail, &mut length)?;
+            let length = u64::from(u32::from_le_bytes(length));
+            ensure!(
+                tail + 4 + length <= head,
+                "The test-case ring contains a truncated record"
+            );
+
+            let mut testcase = vec![0u8; length as usize];
+            self.read_wrapped(tail + 4, &mut testcase)?;
+            testcases.push(testcase);
+            tail += (4 + length + 7) & !7;
+        }
+
+        self.file.write_all_at(&tail.to_le_bytes(), 128)?;
+        Ok(testcases)
+    }
+
+    fn read_u64(&self, offset: u64) -> Result<u64> {
+        let mut bytes = [0u8; 8];
+        self.file.read_exact_at(&mut bytes, offset)?;
+        Ok(u64::from_le_bytes(bytes))
+    }
+
+    /// Read from the data area, starting at the given (unwrapped) position.
+    fn read_wrapped(&self, position: u64, buffer: &mut [u8]) -> Result<()> {
+        let offset = position % TESTCASE_RING_CAPACITY;
+        let first = cmp::min(buffer.len() as u64, TESTCASE_RING_CAPACITY - offset) as usize;
+        self.file
+            .read_exact_at(&mut buffer[..first], TESTCASE_RING_DATA_OFFSET + offset)?;
+        self.file
+            .read_exact_at(&mut buffer[first..], TESTCASE_RING_DATA_OFFSET)?;
+        Ok(())
+    }
+}
+
+/// The state of the test-case ring, which we create on the first execution.
+#[derive(Debug)]
+enum TestcaseRingState {
+    NotCreated,
+    Ready(TestcaseRing),
+    Unavailable,
+}
+
+/// The signal number of SIGKILL.
+const SIGKILL: i32 = 9;
+
+/// How long we wait for a target to connect in fork-server mode.
+const FORKSERVER_STARTUP_TIMEOUT: Duration = Duration::from_secs(10);
+
+const IPC_PRIVATE: i32 = 0;
+const IPC_CREAT: i32 = 0o1000;
+const IPC_EXCL: i32 = 0o2000;
+const IPC_RMID: i32 = 0;
+const O_CLOEXEC: i32 = 0o2000000;
+const POLLIN: i16 = 1;
+
+#[repr(C)]
+struct PollFd {
+    fd: i32,
+    events: i16,
+    revents: i16,
+}
+
+extern "C" {
+    fn kill(pid: i32, sig: i32) -> i32;
+    fn pipe2(fds: *mut i32, flags: i32) -> i32;
+    fn dup2(old_fd: i32, new_fd: i32) -> i32;
+    fn poll(fds: *mut PollFd, nfds: std::os::raw::c_ulong, timeout: i32) -> i32;
+    fn shmget(key: i32, size: usize, flags: i32) -> i32;
+    fn shmat(id: i32, address: *const u8, flags: i32) -> *mut u8;
+    fn shmdt(address: *const u8) -> i32;
+    fn shmctl(id: i32, command: i32, buffer: *mut u8) -> i32;
+}
+
+/// A target process in fork-server mode.
+///
+/// The target initializes the SymCC runtime once and then forks a child for
+/// each input we request; see runtime/Forkserver.h for the protocol.
+#[derive(Debug)]
+struct Forkserver {
+    process: Child,
+    connection: UnixStream,
+}
+
+impl Forkserver {
+    /// Start the fork server, listening on the given socket.
+    ///
+    /// Returns `None` if the target doesn't connect, e.g., because it was built
+    /// with an older version of SymCC.
+    fn start(mut command: Command, socket: impl AsRef<Path>) -> Result<Option<Forkserver>> {
+        let socket = socket.as_ref();
+        if socket.exists() {
+            fs::remove_file(socket).with_context(|| {
+                format!("Failed to remove the stale socket {}", socket.display())
+            })?;
+        }
+
+        let listener = UnixListener::bind(socket)
+            .with_context(|| format!("Failed to listen on {}", socket.display()))?;
+        listener.set_nonblocking(true)?;
+
+        command
+            .env("SYMCC_FORKSERVER", socket)
+            .stdin(Stdio::null())
+            .stdout(Stdio::null())
+            .stderr(Stdio::null());
+        log::debug!("Starting the fork server as follows: {:?}", &command);
+        let mut process = command.spawn().context("Failed to start the fork server")?;
+
+        let start = Instant::now();
+        loop {
+            match listener.accept() {
+                Ok((connection, _)) => {
+                    connection.set_nonblocking(false)?;
+                    return Ok(Some(Forkserver {
+                        process,
+                        connection,
+                    }));
+                }
+                Err(e) if e.kind() == io::ErrorKind::WouldBlock => {
+                    if process.try_wait()?.is_some() || start.elapsed() > FORKSERVER_STARTUP_TIMEOUT
+                    {
+                        // Ignore errors: the process may have exited already.
+                        let _ = process.kill();
+                        let _ = process.wait();
+                        return Ok(None);
+                    }
+                    thread::sleep(Duration::from_millis(10));
+                }
+                Err(e) => return Err(e).context("Failed to accept the fork server's connection"),
+            }
+        }
+    }
+
+    /// Run the target once, optionally redirecting its standard input, and
+    /// return its exit status.
+    ///
+    /// The target is killed if it doesn't terminate within the usual timeout.
+    fn run(&mut self, stdin: Option<&Path>, stderr: impl AsRef<Path>) -> Result<ExitStatus> {
+        let stdin = stdin.map_or(&[][..], |path| path.as_os_str().as_bytes());
+        let stderr = stderr.as_ref().as_os_str().as_bytes();
+        let mut request = Vec::new();
+        for field in &[stdin, stderr] {
+            request.extend_from_slice(&(field.len() as u32).to_le_bytes());
+            request.extend_from_slice(field);
+        }
+
+        self.connection.set_read_timeout(None)?;
+        self.connection
+            .write_all(&request)
+            .context("Failed to send a request to the fork server")?;
+        let pid = self
+            .read_u32()
+            .context("Failed to read the PID of the target from the fork server")?;
+
+        self.connection
+            .set_read_timeout(Some(Duration::from_secs(TIMEOUT.into())))?;
+        let status = match self.read_u32() {
+            Ok(status) => status,
+            Err(e)
+                if e.kind() == io::ErrorKind::WouldBlock || e.kind() == io::ErrorKind::TimedOut =>
+            {
+                log::debug!("Killing the target process {} after a timeout", pid);
+                unsafe {
+                    kill(pid as i32, SIGKILL);
+                }
+                self.connection.set_read_timeout(None)?;
+                self.read_u32()?
+            }
+            Err(e) => return Err(e.into()),
+        };
+
+        Ok(ExitStatus::from_raw(status as i32))
+    }
+
+    fn read_u32(&mut self) -> io::Result<u32> {
+        let mut bytes = [0u8; 4];
+        self.connection.read_exact(&mut bytes)?;
+        Ok(u32::from_le_bytes(bytes))
+    }
+}
+
+impl Drop for Forkserver {
+    fn drop(&mut self) {
+        // Ignore errors: the process may have exited already.
+        let _ = self.process.kill();
+        let _ = self.process.wait();
+    }
+}
+
+/// The state of the fork server, which we start on the first execution.
+#[derive(Debug)]
+enum ForkserverState {
+    NotStarted,
+    Running(Forkserver),
+    Unavailable,
+}
+
 /// The run-time configuration of SymCC.
 #[derive(Debug)]
 pub struct SymCC {
@@ -398,12 +1103,21 @@ pub struct SymCC {
 
     /// The command to run.
     command: Vec<OsString>,
+
+    /// The directory for the fork server's socket, log and outputs.
+    forkserver_dir: PathBuf,
+
+    /// The fork server, if we use one.
+    forkserver: RefCell<ForkserverState>,
+
+    /// The ring buffer for the target's test cases.
+    testcase_ring: RefCell<TestcaseRingState>,
 }
 
 /// The result of executing SymCC.
 pub struct SymCCResult {
     /// The generated test cases.
-    pub test_cases: Vec<PathBuf>,
+    pub test_cases: Vec<Vec<u8>>,
     /// Whether the process was killed (e.g., out of memory, timeout).
     pub killed: bool,
     /// The total time taken by the execution.
@@ -414,7 +1128,10 @@ pub struct SymCCResult {
 
 impl SymCC {
     /// Create a new SymCC configuration.
-    pub fn new(output_dir: PathBuf, command: &[String]) -> Self {
+    ///
+    /// Unless disabled, we try to run the target in fork-server mode, falling
+    /// back to executing it afresh for every input if that doesn't work.
+    pub fn new(output_dir: PathBuf, command: &[String], use_forkserver: bool) -> Self {
         let input_file = output_dir.join(".cur_input");
 
         SymCC {
@@ -422,6 +1139,43 @@ impl SymCC {
             bitmap: output_dir.join("bitmap"),
             command: insert_input_file(command, &input_file),
             input_file,
+            forkserver_dir: output_dir.join(".forkserver"),
+            forkserver: RefCell::new(if use_forkserver {
+                ForkserverState::NotStarted
+            } else {
+                ForkserverState::Unavailable
+            }),
+            testcase_ring: RefCell::new(TestcaseRingState::NotCreated),
+        }
+    }
+
+    /// Use the given bitmap for branch pruning instead of a private one.
+    ///
+    /// Parallel instances can share a bitmap; the runtime merges it with its
+    /// own on exit.
+    pub fn set_bitmap(&mut self, bitmap: impl AsRef<Path>) {
+        self.bitmap = bitmap.as_ref().into();
+    }
+
+    /// The path of the test-case ring, creating the ring if necessary.
+    ///
+    /// Returns `None` if we can't create the ring; the target then writes its
+    /// test cases to files.
+    fn testcase_ring_path(&self) -> Option<PathBuf> {
+        let mut ring = self.testcase_ring.borrow_mut();
+        if let TestcaseRingState::NotCreated = *ring {
+            *ring = match TestcaseRing::create(self.input_file.with_file_name(".testcase_ring")) {
+                Ok(ring) => TestcaseRingState::Ready(ring),
+                Err(e) => {
+                    log::warn!("Failed to create the test-case ring: {:#}", e);
+                    TestcaseRingState::Unavailable
+                }
+            };
+        }
+
+        match &*ring {
+            TestcaseRingState::Ready(ring) => Some(ring.path.clone()),
+            _ => None,
         }
     }
 
@@ -473,6 +1227,26 @@ impl SymCC {
             )
         })?;
 
+        let testcase_ring = self.testcase_ring_path();
+        let mut forkserver = self.forkserver.borrow_mut();
+        if let ForkserverState::NotStarted = *forkserver {
+            *forkserver = self.start_forkserver(testcase_ring.as_ref());
+        }
+        if let ForkserverState::Running(server) = &mut *forkserver {
+            match self.run_forked(server, &output_dir) {
+                Ok(result) => return Ok(result),
+                Err(e) => {
+                    log::warn!(
+                        "The fork server failed ({:#}); \
+                         falling back to a fresh process per input",
+                        e
+                    );
+                    *forkserver = ForkserverState::Unavailable;
+                }
+            }
+        }
+        drop(forkserver);
+
         let mut analysis_command = Command::new("timeout");
         analysis_command
             .args(&["-k", "5", &TIMEOUT.to_string()])
@@ -483,6 +1257,10 @@ impl SymCC {
             .stdout(Stdio::null())
             .stderr(Stdio::piped()); // capture SMT logs
 
+        if let Some(ring) = &testcase_ring {
+            analysis_command.env("SYMCC_TESTCASE_RING", ring);
+        }
+
         if self.use_standard_input {
             analysis_command.stdin(Stdio::piped());
         } else {
@@ -514,13 +1292,113 @@ impl SymCC {
             .wait_with_output()
             .context("Failed to wait for SymCC")?;
         let total_time = start.elapsed();
-        let killed = match result.status.code() {
+        self.make_result(result.status, result.stderr, total_time, output_dir)
+    }
+
+    /// Start the target in fork-server mode, falling back to regular
+    /// execution on failure.
+    fn start_forkserver(&self, testcase_ring: Option<&PathBuf>) -> ForkserverState {
+        let output_dir = self.forkserver_dir.join("output");
+        if let Err(e) = fs::create_dir_all(&output_dir) {
+            log::warn!("Failed to create {}: {}", output_dir.display(), e);
+            return ForkserverState::Unavailable;
+        }
+
+        let mut command = Command::new(&self.command[0]);
+        command
+            .args(&self.command[1..])
+            .env("SYMCC_ENABLE_LINEARIZATION", "1")
+            .env("SYMCC_AFL_COVERAGE_MAP", &self.bitmap)
+            .env("SYMCC_OUTPUT_DIR", &output_dir);
+        if !self.use_standard_input {
+            command.env("SYMCC_INPUT_FILE", &self.input_file);
+        }
+        if let Some(ring) = testcase_ring {
+            command.env("SYMCC_TESTCASE_RING", ring);
+        }
+
+        match Forkserver::start(command, self.forkserver_dir.join("socket")) {
+            Ok(Some(server)) => {
+                log::info!("Running the target in fork-server mode");
+                ForkserverState::Running(server)
+            }
+            Ok(None) => {
+                log::info!(
+                    "The target doesn't support fork-server mode; \
+                     starting a fresh process per input"
+                );
+                ForkserverState::Unavailable
+            }
+            Err(e) => {
+                log::warn!("Failed to start the fork server: {:#}", e);
+                ForkserverState::Unavailable
+            }
+        }
+    }
+
+    /// Run the target via the fork server.
+    ///
+    /// The fork server writes its test cases to a fixed directory, so we move
+    /// them to the requested output directory afterwards.
+    fn run_forked(
+        &self,
+        server: &mut Forkserver,
+        output_dir: impl AsRef<Path>,
+    ) -> Result<SymCCResult> {
+        let server_output_dir = self.forkserver_dir.join("output");
+        let log_file = self.forkserver_dir.join("log");
+        for entry in fs::read_dir(&server_output_dir)? {
+            fs::remove_file(entry?.path())?;
+        }
+
+        let start = Instant::now();
+        let status = server.run(
+            if self.use_standard_input {
+                Some(&self.input_file)
+            } else {
+                None
+            },
+            &log_file,
+        )?;
+        let total_time = start.elapsed();
+
+        for entry in fs::read_dir(&server_output_dir)? {
+            let path = entry?.path();
+            let new_path = output_dir.as_ref().join(path.file_name().unwrap());
+            // The output directory may be on another file system, so we can't
+            // just rename.
+            fs::copy(&path, &new_path).with_context(|| {
+                format!(
+                    "Failed to move the test case {} to {}",
+                    path.display(),
+                    new_path.display()
+                )
+            })?;
+            fs::remove_file(&path)?;
+        }
+
+        let stderr = fs::read(&log_file).unwrap_or_default();
+        self.make_result(status, stderr, total_time, output_dir)
+    }
+
+    /// Collect the results of an execution.
+    ///
+    /// Test cases come from the ring, or from files in the output directory if
+    /// the ring is unavailable or full.
+    fn make_result(
+        &self,
+        status: ExitStatus,
+        stderr: Vec<u8>,
+        total_time: Duration,
+        output_dir: impl AsRef<Path>,
+    ) -> Result<SymCCResult> {
+        let killed = match status.code() {
             Some(code) => {
                 log::debug!("SymCC returned code {}", code);
                 (code == 124) || (code == -9) // as per the man-page of timeout
             }
             None => {
-                let maybe_sig = result.status.signal();
+                let maybe_sig = status.signal();
                 if let Some(signal) = maybe_sig {
                     log::warn!("SymCC received signal {}", signal);
                 }
@@ -528,7 +1406,14 @@ impl SymCC {
             }
         };
 
-        let new_tests = fs::read_dir(&output_dir)
+        let mut new_tests = match &*self.testcase_ring.borrow() {
+            TestcaseRingState::Ready(ring) => ring
+                .drain()
+                .context("Failed to read the test cases from the ring")?,
+            _ => Vec::new(),
+        };
+
+        for entry in fs::read_dir(&output_dir)
             .with_context(|| {
                 format!(
                     "Failed to read the generated test cases at {}",
@@ -542,11 +1427,15 @@ impl SymCC {
                     output_dir.as_ref().display()
                 )
             })?
-            .iter()
-            .map(|entry| entry.path())
-            .collect();
+        {
+            let path = entry.path();
+            new_tests.push(
+                fs::read(&path)
+                    .with_context(|| format!("Failed to read the test case {}", path.display()))?,
+            );
+        }
 
-        let solver_time = SymCC::parse_solver_time(result.stderr);
+        let solver_time = SymCC::parse_solver_time(stderr);
         if solver_time.is_some() && solver_time.unwrap() > total_time {
             log::warn!("Backend reported inaccurate solver time!");
         }